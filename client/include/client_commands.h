@@ -10,9 +10,10 @@ void handle_info(const char *filename);
 void handle_addaccess(const char *filename, const char *target, const char *mode);
 void handle_remaccess(const char *filename, const char *target);
 void handle_read(const char *filename);
-void handle_write(const char *filename, int sentence_index);
-void handle_stream(const char *filename);
-void handle_undo(const char *filename);
+void handle_write(const char *filename, int sentence_index, int wait_secs);
+void handle_stream(const char *filename, int rate);
+void handle_undo(const char *filename, int steps, int version);
+void handle_versions(const char *filename);
 void handle_delete(const char *filename);
 void handle_exec(const char *filename);
 void print_help(void);
@@ -3,6 +3,7 @@
 
 #include <arpa/inet.h>
 #include <ctype.h>
+#include <errno.h>
 #include <netinet/in.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,8 +12,13 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "proto_json.h"
+#include "proto_shard.h"
+
 #define NM_PORT 9000
 #define BUFFER_SIZE 8192
+#define CHUNK_BUFFER_SIZE 65536
+#define STREAM_DEFAULT_RATE 10
 #define MAX_USERNAME 64
 #define MAX_FILENAME 256
 
@@ -4,8 +4,23 @@
 #include "client_common.h"
 
 int connect_to_nm(void);
+int connect_to_nm_shard(int shard);
 int connect_to_ss(const char *ip, int port);
 void send_message(int fd, const char *message);
 char *receive_message(int fd);
+int receive_chunked(int fd, FILE *out, char *reason, size_t reason_size);
+
+extern int nm_oneshot_mode;
+
+int nm_load_shard_map(void);
+int nm_shard_count(void);
+
+int nm_session_open(int shard);
+void nm_session_close(int shard);
+void nm_session_close_all(void);
+long nm_session_send(int shard, const char *request);
+char *nm_session_wait(int shard, long req_id);
+char *nm_request_shard(int shard, const char *request);
+char *nm_request(const char *request);
 
 #endif /* CLIENT_NETWORK_H */
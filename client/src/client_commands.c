@@ -1,129 +1,110 @@
 //AI code starts
 #include "client_commands.h"
 #include "client_network.h"
-#include "client_utils.h"
 
+static void print_view_header(const char *flags);
 static void print_view_response(const char *response, const char *flags);
+static void print_view_footer(const char *flags);
 
+/* Each shard lists the files it owns; the listings are printed one after another */
 void handle_view(const char *flags) {
-    int nm_fd = connect_to_nm();
-    if (nm_fd < 0) {
-        return;
-    }
-
     char request[256];
     snprintf(request, sizeof(request),
              "{\"cmd\":\"VIEW\",\"username\":\"%s\",\"flags\":\"%s\"}",
              current_username, flags);
 
-    send_message(nm_fd, request);
-    char *response = receive_message(nm_fd);
+    print_view_header(flags);
+    for (int shard = 0; shard < nm_shard_count(); shard++) {
+        char *response = nm_request_shard(shard, request);
 
-    if (response) {
-        print_view_response(response, flags);
-        free(response);
-    } else {
-        printf("Error: No response from server\n");
+        if (response) {
+            print_view_response(response, flags);
+            free(response);
+        } else {
+            printf("Error: No response from server\n");
+        }
     }
-
-    close(nm_fd);
+    print_view_footer(flags);
 }
 
+/* Clients register with every shard, so the same user can come back from each */
 void handle_list(void) {
-    int nm_fd = connect_to_nm();
-    if (nm_fd < 0) {
-        return;
-    }
-
     char request[256];
     snprintf(request, sizeof(request),
              "{\"cmd\":\"LIST\",\"username\":\"%s\"}",
              current_username);
 
-    send_message(nm_fd, request);
-    char *response = receive_message(nm_fd);
+    char (*seen)[MAX_USERNAME] = NULL;
+    size_t seen_count = 0;
+    for (int shard = 0; shard < nm_shard_count(); shard++) {
+        char *response = nm_request_shard(shard, request);
+        if (!response) {
+            continue;
+        }
 
-    if (response) {
         if (strstr(response, "\"status\":\"ERR\"")) {
             char reason[128] = {0};
-            parse_json_string(response, "reason", reason, sizeof(reason));
+            json_get_string(response, "reason", reason, sizeof(reason));
             printf("Error: %s\n", reason);
-        } else {
-            const char *pos = strstr(response, "\"users\":[");
-            if (pos) {
-                pos += 9;
-                while (*pos && *pos != ']') {
-                    if (*pos == '"') {
-                        pos++;
-                        const char *end = strchr(pos, '"');
-                        if (end) {
-                            char username[MAX_USERNAME];
-                            int len = (int)(end - pos);
-                            if (len >= MAX_USERNAME) {
-                                len = MAX_USERNAME - 1;
-                            }
-                            strncpy(username, pos, (size_t)len);
-                            username[len] = '\0';
-                            printf("--> %s\n", username);
-                            pos = end + 1;
-                        }
-                    }
-                    pos++;
-                }
+            free(response);
+            break;
+        }
+
+        const char *cursor = json_find_array(response, "users");
+        char username[MAX_USERNAME];
+        while ((cursor = json_array_next_string(cursor, username, sizeof(username))) != NULL) {
+            size_t i = 0;
+            while (i < seen_count && strcmp(seen[i], username) != 0) {
+                i++;
+            }
+            if (i < seen_count) {
+                continue;
+            }
+
+            void *tmp = realloc(seen, (seen_count + 1) * sizeof(*seen));
+            if (tmp) {
+                seen = tmp;
+                memcpy(seen[seen_count++], username, sizeof(username));
             }
+            printf("--> %s\n", username);
         }
         free(response);
     }
-
-    close(nm_fd);
+    free(seen);
 }
 
 void handle_create(const char *filename) {
-    int nm_fd = connect_to_nm();
-    if (nm_fd < 0) {
-        return;
-    }
-
     char request[512];
     snprintf(request, sizeof(request),
              "{\"cmd\":\"CREATE\",\"username\":\"%s\",\"filename\":\"%s\"}",
              current_username, filename);
 
-    send_message(nm_fd, request);
-    char *response = receive_message(nm_fd);
+    char *response = nm_request(request);
 
     if (response) {
         if (strstr(response, "\"status\":\"ERR\"")) {
             char reason[128] = {0};
-            parse_json_string(response, "reason", reason, sizeof(reason));
+            json_get_string(response, "reason", reason, sizeof(reason));
             printf("Error: %s\n", reason);
         } else {
             printf("File Created Successfully!\n");
         }
         free(response);
     }
-
-    close(nm_fd);
 }
 
 void handle_info(const char *filename) {
-    int nm_fd = connect_to_nm();
-    if (nm_fd < 0) {
-        return;
-    }
-
     char request[512];
     snprintf(request, sizeof(request),
              "{\"cmd\":\"INFO\",\"username\":\"%s\",\"filename\":\"%s\"}",
              current_username, filename);
 
-    send_message(nm_fd, request);
-    char *response = receive_message(nm_fd);
+    char *response = nm_request(request);
 
     if (response) {
         if (strstr(response, "\"status\":\"ERR\"")) {
             char reason[128] = {0};
-            parse_json_string(response, "reason", reason, sizeof(reason));
+            json_get_string(response, "reason", reason, sizeof(reason));
             printf("Error: %s\n", reason);
         } else {
             char fname[MAX_FILENAME] = {0};
@@ -133,20 +114,25 @@ void handle_info(const char *filename) {
             char accessed[64] = {0};
             char accessed_by[MAX_USERNAME] = {0};
 
-            parse_json_string(response, "filename", fname, sizeof(fname));
-            parse_json_string(response, "owner", owner, sizeof(owner));
-            parse_json_string(response, "created_at", created, sizeof(created));
-            parse_json_string(response, "last_modified", modified, sizeof(modified));
-            parse_json_string(response, "last_accessed", accessed, sizeof(accessed));
-            parse_json_string(response, "last_accessed_by", accessed_by, sizeof(accessed_by));
+            JsonMessage info;
+            json_parse(&info, response, (size_t)-1);
+            json_field_string(&info, "filename", fname, sizeof(fname));
+            json_field_string(&info, "owner", owner, sizeof(owner));
+            json_field_string(&info, "created_at", created, sizeof(created));
+            json_field_string(&info, "last_modified", modified, sizeof(modified));
+            json_field_string(&info, "last_accessed", accessed, sizeof(accessed));
+            json_field_string(&info, "last_accessed_by", accessed_by, sizeof(accessed_by));
 
             printf("--> File: %s\n", fname);
             printf("--> Owner: %s\n", owner);
             printf("--> Created: %s\n", strlen(created) > 0 ? created : "N/A");
             printf("--> Last Modified: %s\n", strlen(modified) > 0 ? modified : "N/A");
-            int stat_words = parse_json_int(response, "words");
-            int stat_chars = parse_json_int(response, "chars");
-            int stat_bytes = parse_json_int(response, "bytes");
+            int stat_words = 0;
+            int stat_chars = 0;
+            int stat_bytes = 0;
+            json_field_int(&info, "words", &stat_words);
+            json_field_int(&info, "chars", &stat_chars);
+            json_field_int(&info, "bytes", &stat_bytes);
 
             printf("--> Words: %d\n", stat_words);
             printf("--> Characters: %d\n", stat_chars);
@@ -154,59 +140,44 @@ void handle_info(const char *filename) {
             printf("--> Access:\n");
             printf("    %s (RW)\n", owner);
 
-            const char *access_section = strstr(response, "\"access\"");
-            if (access_section) {
-                const char *cursor = strchr(access_section, '[');
-                if (cursor) {
+            const char *cursor = json_field_array(&info, "access");
+            while (cursor && *cursor) {
+                while (*cursor && (isspace((unsigned char)*cursor) || *cursor == ',')) {
                     cursor++;
-                    while (*cursor) {
-                        while (*cursor && (isspace((unsigned char)*cursor) || *cursor == ',')) {
-                            cursor++;
-                        }
-                        if (*cursor == ']' || *cursor == '\0') {
-                            break;
-                        }
-                        if (*cursor != '{') {
-                            cursor++;
-                            continue;
-                        }
+                }
+                if (*cursor == ']' || *cursor == '\0') {
+                    break;
+                }
+                if (*cursor != '{') {
+                    cursor++;
+                    continue;
+                }
 
-                        cursor++;
-                        int depth = 1;
-                        const char *obj_start = cursor;
-                        const char *obj_end = obj_start;
-                        while (*obj_end && depth > 0) {
-                            if (*obj_end == '{') {
-                                depth++;
-                            } else if (*obj_end == '}') {
-                                depth--;
-                            }
-                            obj_end++;
-                        }
-                        if (depth != 0) {
-                            break;
-                        }
+                const char *obj_start = cursor++;
+                int depth = 1;
+                while (*cursor && depth > 0) {
+                    if (*cursor == '{') {
+                        depth++;
+                    } else if (*cursor == '}') {
+                        depth--;
+                    }
+                    cursor++;
+                }
+                if (depth != 0) {
+                    break;
+                }
 
-                        size_t obj_len = (size_t)((obj_end - 1) - obj_start);
-                        if (obj_len >= 256) {
-                            obj_len = 255;
-                        }
-                        char access_obj[256];
-                        memcpy(access_obj, obj_start, obj_len);
-                        access_obj[obj_len] = '\0';
-
-                        char shared_user[MAX_USERNAME] = {0};
-                        char shared_mode[8] = {0};
-                        parse_json_string(access_obj, "user", shared_user, sizeof(shared_user));
-                        parse_json_string(access_obj, "mode", shared_mode, sizeof(shared_mode));
-
-                        if (shared_user[0] != '\0' && strcmp(shared_user, owner) != 0) {
-                            const char *mode_to_print = (shared_mode[0] != '\0') ? shared_mode : "R";
-                            printf("    %s (%s)\n", shared_user, mode_to_print);
-                        }
+                JsonMessage access_obj;
+                json_parse(&access_obj, obj_start, (size_t)(cursor - obj_start));
 
-                        cursor = obj_end;
-                    }
+                char shared_user[MAX_USERNAME] = {0};
+                char shared_mode[8] = {0};
+                json_field_string(&access_obj, "user", shared_user, sizeof(shared_user));
+                json_field_string(&access_obj, "mode", shared_mode, sizeof(shared_mode));
+
+                if (shared_user[0] != '\0' && strcmp(shared_user, owner) != 0) {
+                    const char *mode_to_print = (shared_mode[0] != '\0') ? shared_mode : "R";
+                    printf("    %s (%s)\n", shared_user, mode_to_print);
                 }
             }
 
@@ -216,101 +187,76 @@ void handle_info(const char *filename) {
         }
         free(response);
     }
-
-    close(nm_fd);
 }
 
 void handle_addaccess(const char *filename, const char *target, const char *mode) {
-    int nm_fd = connect_to_nm();
-    if (nm_fd < 0) {
-        return;
-    }
-
     char request[512];
     snprintf(request, sizeof(request),
              "{\"cmd\":\"ADDACCESS\",\"username\":\"%s\",\"filename\":\"%s\",\"target\":\"%s\",\"mode\":\"%s\"}",
              current_username, filename, target, mode);
 
-    send_message(nm_fd, request);
-    char *response = receive_message(nm_fd);
+    char *response = nm_request(request);
 
     if (response) {
         if (strstr(response, "\"status\":\"ERR\"")) {
             char reason[128] = {0};
-            parse_json_string(response, "reason", reason, sizeof(reason));
+            json_get_string(response, "reason", reason, sizeof(reason));
             printf("Error: %s\n", reason);
         } else {
             printf("Access granted successfully!\n");
         }
         free(response);
     }
-
-    close(nm_fd);
 }
 
 void handle_remaccess(const char *filename, const char *target) {
-    int nm_fd = connect_to_nm();
-    if (nm_fd < 0) {
-        return;
-    }
-
     char request[512];
     snprintf(request, sizeof(request),
              "{\"cmd\":\"REMACCESS\",\"username\":\"%s\",\"filename\":\"%s\",\"target\":\"%s\"}",
              current_username, filename, target);
 
-    send_message(nm_fd, request);
-    char *response = receive_message(nm_fd);
+    char *response = nm_request(request);
 
     if (response) {
         if (strstr(response, "\"status\":\"ERR\"")) {
             char reason[128] = {0};
-            parse_json_string(response, "reason", reason, sizeof(reason));
+            json_get_string(response, "reason", reason, sizeof(reason));
             printf("Error: %s\n", reason);
         } else {
             printf("Access removed successfully!\n");
         }
         free(response);
     }
-
-    close(nm_fd);
 }
 
 void handle_read(const char *filename) {
-    int nm_fd = connect_to_nm();
-    if (nm_fd < 0) {
-        return;
-    }
-
     char request[512];
     snprintf(request, sizeof(request),
              "{\"cmd\":\"READ\",\"username\":\"%s\",\"filename\":\"%s\"}",
              current_username, filename);
 
-    send_message(nm_fd, request);
-    char *response = receive_message(nm_fd);
+    char *response = nm_request(request);
 
     if (!response) {
-        close(nm_fd);
         return;
     }
 
     if (strstr(response, "\"status\":\"ERR\"")) {
         char reason[128] = {0};
-        parse_json_string(response, "reason", reason, sizeof(reason));
+        json_get_string(response, "reason", reason, sizeof(reason));
         printf("Error: %s\n", reason);
         free(response);
-        close(nm_fd);
         return;
     }
 
     char ss_ip[INET_ADDRSTRLEN] = {0};
     int ss_port = 0;
-    parse_json_string(response, "ss_ip", ss_ip, sizeof(ss_ip));
-    ss_port = parse_json_int(response, "ss_port");
+    JsonMessage route;
+    json_parse(&route, response, (size_t)-1);
+    json_field_string(&route, "ss_ip", ss_ip, sizeof(ss_ip));
+    json_field_int(&route, "ss_port", &ss_port);
 
     free(response);
-    close(nm_fd);
 
     int ss_fd = connect_to_ss(ss_ip, ss_port);
     if (ss_fd < 0) {
@@ -320,63 +266,53 @@ void handle_read(const char *filename) {
 
     char ss_request[512];
     snprintf(ss_request, sizeof(ss_request),
-             "{\"cmd\":\"READ\",\"username\":\"%s\",\"filename\":\"%s\"}",
+             "{\"cmd\":\"READ\",\"username\":\"%s\",\"filename\":\"%s\",\"mode\":\"chunked\"}",
              current_username, filename);
 
     send_message(ss_fd, ss_request);
-    char *ss_response = receive_message(ss_fd);
 
-    if (ss_response) {
-        if (strstr(ss_response, "\"status\":\"ERR\"")) {
-            char reason[128] = {0};
-            parse_json_string(ss_response, "reason", reason, sizeof(reason));
-            printf("Error: %s\n", reason);
-        } else {
-            char content[BUFFER_SIZE] = {0};
-            parse_json_string(ss_response, "content", content, sizeof(content));
-            printf("%s\n", content);
-        }
-        free(ss_response);
+    char reason[128] = {0};
+    int rc = receive_chunked(ss_fd, stdout, reason, sizeof(reason));
+    if (rc == 0) {
+        printf("\n");
+    } else if (rc > 0) {
+        printf("Error: %s\n", reason);
+    } else {
+        printf("\nError: Read from Storage Server interrupted\n");
     }
+    fflush(stdout);
 
     close(ss_fd);
 }
 
-void handle_write(const char *filename, int sentence_index) {
-    int nm_fd = connect_to_nm();
-    if (nm_fd < 0) {
-        return;
-    }
-
+void handle_write(const char *filename, int sentence_index, int wait_secs) {
     char request[512];
     snprintf(request, sizeof(request),
              "{\"cmd\":\"WRITE\",\"username\":\"%s\",\"filename\":\"%s\"}",
              current_username, filename);
 
-    send_message(nm_fd, request);
-    char *response = receive_message(nm_fd);
+    char *response = nm_request(request);
 
     if (!response) {
-        close(nm_fd);
         return;
     }
 
     if (strstr(response, "\"status\":\"ERR\"")) {
         char reason[128] = {0};
-        parse_json_string(response, "reason", reason, sizeof(reason));
+        json_get_string(response, "reason", reason, sizeof(reason));
         printf("Error: %s\n", reason);
         free(response);
-        close(nm_fd);
         return;
     }
 
     char ss_ip[INET_ADDRSTRLEN] = {0};
     int ss_port = 0;
-    parse_json_string(response, "ss_ip", ss_ip, sizeof(ss_ip));
-    ss_port = parse_json_int(response, "ss_port");
+    JsonMessage route;
+    json_parse(&route, response, (size_t)-1);
+    json_field_string(&route, "ss_ip", ss_ip, sizeof(ss_ip));
+    json_field_int(&route, "ss_port", &ss_port);
 
     free(response);
-    close(nm_fd);
 
     int ss_fd = connect_to_ss(ss_ip, ss_port);
     if (ss_fd < 0) {
@@ -386,16 +322,32 @@ void handle_write(const char *filename, int sentence_index) {
 
     char ss_request[512];
     snprintf(ss_request, sizeof(ss_request),
-             "{\"cmd\":\"WRITE\",\"username\":\"%s\",\"filename\":\"%s\",\"sentence_index\":%d}",
-             current_username, filename, sentence_index);
+             "{\"cmd\":\"WRITE\",\"username\":\"%s\",\"filename\":\"%s\",\"sentence_index\":%d,"
+             "\"wait_ms\":%d}",
+             current_username, filename, sentence_index, wait_secs * 1000);
 
     send_message(ss_fd, ss_request);
     char *ss_response = receive_message(ss_fd);
 
+    /* queued behind another writer: progress lines until the lock or an error */
+    while (ss_response && strstr(ss_response, "\"status\":\"WAIT\"")) {
+        int position = 0;
+        json_get_int(ss_response, "position", &position);
+        printf("Waiting for sentence lock (queue position %d)...\n", position);
+        fflush(stdout);
+        char *rest = strchr(ss_response, '\n');
+        if (rest && rest[1] != '\0') {
+            memmove(ss_response, rest + 1, strlen(rest + 1) + 1);
+            continue;
+        }
+        free(ss_response);
+        ss_response = receive_message(ss_fd);
+    }
+
     if (!ss_response || strstr(ss_response, "\"status\":\"ERR\"")) {
         if (ss_response) {
             char reason[128] = {0};
-            parse_json_string(ss_response, "reason", reason, sizeof(reason));
+            json_get_string(ss_response, "reason", reason, sizeof(reason));
             printf("Error: %s\n", reason);
             free(ss_response);
         }
@@ -489,48 +441,26 @@ void handle_write(const char *filename, int sentence_index) {
 
         word_index = atoi(index_token);
 
-        char escaped_content[1024];
-        size_t j = 0;
-        for (size_t i = 0; i < strlen(content) && j < sizeof(escaped_content) - 2; i++) {
-            char ch = content[i];
-            if (ch == '\\') {
-                escaped_content[j++] = '\\';
-                escaped_content[j++] = '\\';
-            } else if (ch == '"') {
-                escaped_content[j++] = '\\';
-                escaped_content[j++] = '"';
-            } else if (ch == '\n') {
-                escaped_content[j++] = '\\';
-                escaped_content[j++] = 'n';
-            } else if (ch == '\r') {
-                escaped_content[j++] = '\\';
-                escaped_content[j++] = 'r';
-            } else if (ch == '\t') {
-                escaped_content[j++] = '\\';
-                escaped_content[j++] = 't';
-            } else {
-                escaped_content[j++] = ch;
-            }
-        }
-        escaped_content[j] = '\0';
-
-        char update[2048];
+        /* room for every byte of content escaped as \u00XX */
+        char update[sizeof(content) * 6 + 64];
+        JsonWriter w;
+        json_writer_init(&w, update, sizeof(update));
+        json_write_begin_object(&w, NULL);
+        json_write_string(&w, "cmd", "UPDATE");
+        json_write_int(&w, "word_index", word_index);
+        json_write_string(&w, "content", content);
         if (replace_word) {
-            snprintf(update, sizeof(update),
-                     "{\"cmd\":\"UPDATE\",\"word_index\":%d,\"content\":\"%s\",\"mode\":\"replace\"}",
-                     word_index, escaped_content);
-        } else {
-            snprintf(update, sizeof(update),
-                     "{\"cmd\":\"UPDATE\",\"word_index\":%d,\"content\":\"%s\"}",
-                     word_index, escaped_content);
+            json_write_string(&w, "mode", "replace");
         }
+        json_write_end_object(&w);
+        json_writer_finish(&w, NULL);
 
         send_message(ss_fd, update);
         ss_response = receive_message(ss_fd);
         if (ss_response) {
             if (strstr(ss_response, "\"status\":\"ERR\"")) {
                 char reason[128] = {0};
-                parse_json_string(ss_response, "reason", reason, sizeof(reason));
+                json_get_string(ss_response, "reason", reason, sizeof(reason));
                 printf("Update Failed: %s\n", reason);
             } else {
                 printf("Update acknowledged.\n");
@@ -547,41 +477,34 @@ void handle_write(const char *filename, int sentence_index) {
     close(ss_fd);
 }
 
-void handle_stream(const char *filename) {
-    int nm_fd = connect_to_nm();
-    if (nm_fd < 0) {
-        return;
-    }
-
+void handle_stream(const char *filename, int rate) {
     char request[512];
     snprintf(request, sizeof(request),
              "{\"cmd\":\"STREAM\",\"username\":\"%s\",\"filename\":\"%s\"}",
              current_username, filename);
 
-    send_message(nm_fd, request);
-    char *response = receive_message(nm_fd);
+    char *response = nm_request(request);
 
     if (!response) {
-        close(nm_fd);
         return;
     }
 
     if (strstr(response, "\"status\":\"ERR\"")) {
         char reason[128] = {0};
-        parse_json_string(response, "reason", reason, sizeof(reason));
+        json_get_string(response, "reason", reason, sizeof(reason));
         printf("Error: %s\n", reason);
         free(response);
-        close(nm_fd);
         return;
     }
 
     char ss_ip[INET_ADDRSTRLEN] = {0};
     int ss_port = 0;
-    parse_json_string(response, "ss_ip", ss_ip, sizeof(ss_ip));
-    ss_port = parse_json_int(response, "ss_port");
+    JsonMessage route;
+    json_parse(&route, response, (size_t)-1);
+    json_field_string(&route, "ss_ip", ss_ip, sizeof(ss_ip));
+    json_field_int(&route, "ss_port", &ss_port);
 
     free(response);
-    close(nm_fd);
 
     int ss_fd = connect_to_ss(ss_ip, ss_port);
     if (ss_fd < 0) {
@@ -591,12 +514,13 @@ void handle_stream(const char *filename) {
 
     char ss_request[512];
     snprintf(ss_request, sizeof(ss_request),
-             "{\"cmd\":\"STREAM\",\"filename\":\"%s\"}",
-             filename);
+             "{\"cmd\":\"STREAM\",\"filename\":\"%s\",\"rate\":%d}",
+             filename, rate);
 
     send_message(ss_fd, ss_request);
 
-    char buffer[256];
+    /* the server paces the words; print each batch as it arrives */
+    char buffer[BUFFER_SIZE];
     char word[256];
     size_t word_len = 0;
     int stop_received = 0;
@@ -627,7 +551,7 @@ void handle_stream(const char *filename) {
                 if (word[0] == '{') {
                     if (strstr(word, "\"status\":\"ERR\"")) {
                         char reason[128] = {0};
-                        parse_json_string(word, "reason", reason, sizeof(reason));
+                        json_get_string(word, "reason", reason, sizeof(reason));
                         if (strlen(reason) == 0) {
                             strcpy(reason, "STREAM_FAILED");
                         }
@@ -638,8 +562,6 @@ void handle_stream(const char *filename) {
                 }
 
                 printf("%s ", word);
-                fflush(stdout);
-                usleep(100000);
                 printed_words = 1;
             } else if ((unsigned char)ch >= 32 || ch == '\t') {
                 if (word_len < sizeof(word) - 1) {
@@ -648,6 +570,7 @@ void handle_stream(const char *filename) {
             }
         }
 
+        fflush(stdout);
         if (stop_received || server_error) {
             break;
         }
@@ -659,7 +582,7 @@ void handle_stream(const char *filename) {
             stop_received = 1;
         } else if (word[0] == '{' && strstr(word, "\"status\":\"ERR\"")) {
             char reason[128] = {0};
-            parse_json_string(word, "reason", reason, sizeof(reason));
+            json_get_string(word, "reason", reason, sizeof(reason));
             if (strlen(reason) == 0) {
                 strcpy(reason, "STREAM_FAILED");
             }
@@ -668,7 +591,6 @@ void handle_stream(const char *filename) {
         } else if (word[0] != '\0') {
             printf("%s ", word);
             fflush(stdout);
-            usleep(100000);
             printed_words = 1;
         }
     }
@@ -687,41 +609,93 @@ void handle_stream(const char *filename) {
     close(ss_fd);
 }
 
-void handle_undo(const char *filename) {
-    int nm_fd = connect_to_nm();
-    if (nm_fd < 0) {
+void handle_undo(const char *filename, int steps, int version) {
+    char request[512];
+    snprintf(request, sizeof(request),
+             "{\"cmd\":\"UNDO\",\"username\":\"%s\",\"filename\":\"%s\"}",
+             current_username, filename);
+
+    char *response = nm_request(request);
+
+    if (!response) {
+        return;
+    }
+
+    if (strstr(response, "\"status\":\"ERR\"")) {
+        char reason[128] = {0};
+        json_get_string(response, "reason", reason, sizeof(reason));
+        printf("Error: %s\n", reason);
+        free(response);
+        return;
+    }
+
+    char ss_ip[INET_ADDRSTRLEN] = {0};
+    int ss_port = 0;
+    JsonMessage route;
+    json_parse(&route, response, (size_t)-1);
+    json_field_string(&route, "ss_ip", ss_ip, sizeof(ss_ip));
+    json_field_int(&route, "ss_port", &ss_port);
+
+    free(response);
+
+    int ss_fd = connect_to_ss(ss_ip, ss_port);
+    if (ss_fd < 0) {
+        printf("Error: Could not connect to Storage Server\n");
         return;
     }
 
+    char ss_request[512];
+    snprintf(ss_request, sizeof(ss_request),
+             "{\"cmd\":\"UNDO\",\"filename\":\"%s\",\"steps\":%d,\"version\":%d}",
+             filename, steps, version);
+
+    send_message(ss_fd, ss_request);
+    char *ss_response = receive_message(ss_fd);
+
+    if (ss_response) {
+        if (strstr(ss_response, "\"status\":\"ERR\"")) {
+            char reason[128] = {0};
+            json_get_string(ss_response, "reason", reason, sizeof(reason));
+            printf("Error: %s\n", reason);
+        } else {
+            int version_now = 0;
+            json_get_int(ss_response, "version", &version_now);
+            printf("Undo Successful! '%s' is now at version %d.\n", filename, version_now);
+        }
+        free(ss_response);
+    }
+
+    close(ss_fd);
+}
+
+void handle_versions(const char *filename) {
     char request[512];
     snprintf(request, sizeof(request),
-             "{\"cmd\":\"UNDO\",\"username\":\"%s\",\"filename\":\"%s\"}",
+             "{\"cmd\":\"VERSIONS\",\"username\":\"%s\",\"filename\":\"%s\"}",
              current_username, filename);
 
-    send_message(nm_fd, request);
-    char *response = receive_message(nm_fd);
+    char *response = nm_request(request);
 
     if (!response) {
-        close(nm_fd);
         return;
     }
 
     if (strstr(response, "\"status\":\"ERR\"")) {
         char reason[128] = {0};
-        parse_json_string(response, "reason", reason, sizeof(reason));
+        json_get_string(response, "reason", reason, sizeof(reason));
         printf("Error: %s\n", reason);
         free(response);
-        close(nm_fd);
         return;
     }
 
     char ss_ip[INET_ADDRSTRLEN] = {0};
     int ss_port = 0;
-    parse_json_string(response, "ss_ip", ss_ip, sizeof(ss_ip));
-    ss_port = parse_json_int(response, "ss_port");
+    JsonMessage route;
+    json_parse(&route, response, (size_t)-1);
+    json_field_string(&route, "ss_ip", ss_ip, sizeof(ss_ip));
+    json_field_int(&route, "ss_port", &ss_port);
 
     free(response);
-    close(nm_fd);
 
     int ss_fd = connect_to_ss(ss_ip, ss_port);
     if (ss_fd < 0) {
@@ -731,7 +705,7 @@ void handle_undo(const char *filename) {
 
     char ss_request[512];
     snprintf(ss_request, sizeof(ss_request),
-             "{\"cmd\":\"UNDO\",\"filename\":\"%s\"}",
+             "{\"cmd\":\"VERSIONS\",\"filename\":\"%s\"}",
              filename);
 
     send_message(ss_fd, ss_request);
@@ -740,10 +714,33 @@ void handle_undo(const char *filename) {
     if (ss_response) {
         if (strstr(ss_response, "\"status\":\"ERR\"")) {
             char reason[128] = {0};
-            parse_json_string(ss_response, "reason", reason, sizeof(reason));
+            json_get_string(ss_response, "reason", reason, sizeof(reason));
             printf("Error: %s\n", reason);
         } else {
-            printf("Undo Successful!\n");
+            // Each entry is {"version":N,"time":T,"full":B}, newest first
+            const char *entry = json_find_array(ss_response, "versions");
+            int shown = 0;
+            while (entry && (entry = strchr(entry, '{')) != NULL) {
+                const char *end = strchr(entry, '}');
+                if (!end) break;
+                JsonMessage version;
+                json_parse(&version, entry, (size_t)(end + 1 - entry));
+                int number = 0;
+                long when = 0;
+                json_field_int(&version, "version", &number);
+                json_field_long(&version, "time", &when);
+                const JsonField *full = json_find(&version, "full");
+                time_t stamp_time = (time_t)when;
+                char stamp[32];
+                strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&stamp_time));
+                printf("  version %-6d %s%s\n", number, stamp,
+                       full && full->value_len == 4 && memcmp(full->value, "true", 4) == 0 ? "  (full)" : "");
+                shown++;
+                entry = end + 1;
+            }
+            if (shown == 0) {
+                printf("No saved versions of '%s'.\n", filename);
+            }
         }
         free(ss_response);
     }
@@ -752,89 +749,50 @@ void handle_undo(const char *filename) {
 }
 
 void handle_delete(const char *filename) {
-    int nm_fd = connect_to_nm();
-    if (nm_fd < 0) {
-        return;
-    }
-
     char request[512];
     snprintf(request, sizeof(request),
              "{\"cmd\":\"DELETE\",\"username\":\"%s\",\"filename\":\"%s\"}",
              current_username, filename);
 
-    send_message(nm_fd, request);
-    char *response = receive_message(nm_fd);
+    char *response = nm_request(request);
 
     if (response) {
         if (strstr(response, "\"status\":\"ERR\"")) {
             char reason[128] = {0};
-            parse_json_string(response, "reason", reason, sizeof(reason));
+            json_get_string(response, "reason", reason, sizeof(reason));
             printf("Error: %s\n", reason);
         } else {
             printf("File '%s' deleted successfully!\n", filename);
         }
         free(response);
     }
-
-    close(nm_fd);
 }
 
 void handle_exec(const char *filename) {
-    int nm_fd = connect_to_nm();
-    if (nm_fd < 0) {
-        return;
-    }
-
     char request[512];
     snprintf(request, sizeof(request),
              "{\"cmd\":\"EXEC\",\"username\":\"%s\",\"filename\":\"%s\"}",
              current_username, filename);
 
-    send_message(nm_fd, request);
-    char *response = receive_message(nm_fd);
+    char *response = nm_request(request);
 
     if (response) {
         if (strstr(response, "\"status\":\"ERR\"")) {
             char reason[128] = {0};
-            parse_json_string(response, "reason", reason, sizeof(reason));
+            json_get_string(response, "reason", reason, sizeof(reason));
             printf("Error: %s\n", reason);
         } else {
             char output[BUFFER_SIZE] = {0};
-            parse_json_string(response, "output", output, sizeof(output));
-
-            char unescaped[BUFFER_SIZE];
-            int j = 0;
-            for (int i = 0; i < (int)strlen(output) && j < BUFFER_SIZE - 1; i++) {
-                if (output[i] == '\\' && output[i + 1] == 'n') {
-                    unescaped[j++] = '\n';
-                    i++;
-                } else if (output[i] == '\\' && output[i + 1] == 'r') {
-                    unescaped[j++] = '\r';
-                    i++;
-                } else if (output[i] == '\\' && output[i + 1] == 't') {
-                    unescaped[j++] = '\t';
-                    i++;
-                } else if (output[i] == '\\' && output[i + 1] == '\\') {
-                    unescaped[j++] = '\\';
-                    i++;
-                } else if (output[i] == '\\' && output[i + 1] == '"') {
-                    unescaped[j++] = '"';
-                    i++;
-                } else {
-                    unescaped[j++] = output[i];
-                }
-            }
-            unescaped[j] = '\0';
+            json_get_string(response, "output", output, sizeof(output));
 
-            printf("%s", unescaped);
-            if (j > 0 && unescaped[j - 1] != '\n') {
+            printf("%s", output);
+            size_t len = strlen(output);
+            if (len > 0 && output[len - 1] != '\n') {
                 printf("\n");
             }
         }
         free(response);
     }
-
-    close(nm_fd);
 }
 
 void print_help(void) {
@@ -843,11 +801,13 @@ void print_help(void) {
     printf("  VIEW [-a] [-l] [-al]     - List files (use -a for all, -l for details)\n");
     printf("  CREATE <filename>        - Create a new file\n");
     printf("  READ <filename>          - Display file content\n");
-    printf("  WRITE <filename> <sent#> - Edit a sentence in the file\n");
+    printf("  WRITE <filename> <sent#> [wait] - Edit a sentence, waiting up to <wait> seconds if it is locked\n");
     printf("  DELETE <filename>        - Delete a file\n");
     printf("  INFO <filename>          - Show file metadata\n");
-    printf("  STREAM <filename>        - Stream file content word-by-word\n");
-    printf("  UNDO <filename>          - Undo last change to file\n");
+    printf("  STREAM <filename> [wps]  - Stream file content word-by-word (default 10 words/s, 0 = no delay)\n");
+    printf("  UNDO <filename> [n]      - Undo the last n changes to file (default 1)\n");
+    printf("  UNDO <filename> -v <ver> - Restore file to a version listed by VERSIONS\n");
+    printf("  VERSIONS <filename>      - List saved versions of file, newest first\n");
     printf("  EXEC <filename>          - Execute file as shell commands\n\n");
     printf("Access Control:\n");
     printf("  ADDACCESS -R <file> <user>  - Grant read access\n");
@@ -859,10 +819,24 @@ void print_help(void) {
     printf("  exit/quit                - Exit client\n\n");
 }
 
+static void print_view_header(const char *flags) {
+    if (strstr(flags, "l") != NULL) {
+        printf("-------------------------------------------------------------------------------\n");
+        printf("|  Filename  | Words | Chars | Bytes | Last Access Time    | Owner       |\n");
+        printf("|------------|-------|-------|-------|---------------------|-------------|\n");
+    }
+}
+
+static void print_view_footer(const char *flags) {
+    if (strstr(flags, "l") != NULL) {
+        printf("-------------------------------------------------------------------------------\n");
+    }
+}
+
 static void print_view_response(const char *response, const char *flags) {
     if (strstr(response, "\"status\":\"ERR\"")) {
         char reason[128] = {0};
-        parse_json_string(response, "reason", reason, sizeof(reason));
+        json_get_string(response, "reason", reason, sizeof(reason));
         printf("Error: %s\n", reason);
         return;
     }
@@ -870,102 +844,64 @@ static void print_view_response(const char *response, const char *flags) {
     int show_details = (strstr(flags, "l") != NULL);
 
     if (show_details) {
-        printf("-------------------------------------------------------------------------------\n");
-        printf("|  Filename  | Words | Chars | Bytes | Last Access Time    | Owner       |\n");
-        printf("|------------|-------|-------|-------|---------------------|-------------|\n");
-
-        const char *files_start = strstr(response, "\"files\":[");
-        if (files_start) {
-            const char *cursor = strchr(files_start, '[');
-            if (cursor) {
+        const char *cursor = json_find_array(response, "files");
+        while (cursor && *cursor) {
+            while (*cursor && (isspace((unsigned char)*cursor) || *cursor == ',')) {
                 cursor++;
+            }
 
-                while (*cursor) {
-                    while (*cursor && (isspace((unsigned char)*cursor) || *cursor == ',')) {
-                        cursor++;
-                    }
+            if (*cursor == ']' || *cursor == '\0') {
+                break;
+            }
 
-                    if (*cursor == ']' || *cursor == '\0') {
-                        break;
-                    }
+            if (*cursor != '{') {
+                cursor++;
+                continue;
+            }
 
-                    if (*cursor == '{') {
-                        cursor++;
-
-                        int depth = 1;
-                        const char *obj_start = cursor;
-                        const char *obj_end = cursor;
-                        while (*obj_end && depth > 0) {
-                            if (*obj_end == '{') {
-                                depth++;
-                            } else if (*obj_end == '}') {
-                                depth--;
-                            }
-                            obj_end++;
-                        }
+            const char *obj_start = cursor++;
+            int depth = 1;
+            while (*cursor && depth > 0) {
+                if (*cursor == '{') {
+                    depth++;
+                } else if (*cursor == '}') {
+                    depth--;
+                }
+                cursor++;
+            }
 
-                        if (depth != 0) {
-                            break;
-                        }
+            if (depth != 0) {
+                break;
+            }
 
-                        size_t obj_len = (size_t)((obj_end - 1) - obj_start);
-                        if (obj_len >= 512) {
-                            obj_len = 511;
-                        }
-                        char file_obj[512];
-                        memcpy(file_obj, obj_start, obj_len);
-                        file_obj[obj_len] = '\0';
-
-                        char filename[MAX_FILENAME] = {0};
-                        char owner[MAX_USERNAME] = {0};
-                        char last_accessed[64] = {0};
-                        int words = 0;
-                        int chars = 0;
-                        int bytes = 0;
-
-                        parse_json_string(file_obj, "filename", filename, sizeof(filename));
-                        parse_json_string(file_obj, "owner", owner, sizeof(owner));
-                        parse_json_string(file_obj, "last_accessed", last_accessed, sizeof(last_accessed));
-                        words = parse_json_int(file_obj, "words");
-                        chars = parse_json_int(file_obj, "chars");
-                        bytes = parse_json_int(file_obj, "bytes");
-
-                        if (strlen(filename) > 0) {
-                            const char *access_display = strlen(last_accessed) > 0 ? last_accessed : "N/A";
-                            printf("| %-10.10s | %5d | %5d | %5d | %-19.19s | %-11.11s |\n",
-                                   filename, words, chars, bytes, access_display, owner);
-                        }
+            JsonMessage file_obj;
+            json_parse(&file_obj, obj_start, (size_t)(cursor - obj_start));
 
-                        cursor = obj_end;
-                    } else {
-                        cursor++;
-                    }
-                }
+            char filename[MAX_FILENAME] = {0};
+            char owner[MAX_USERNAME] = {0};
+            char last_accessed[64] = {0};
+            int words = 0;
+            int chars = 0;
+            int bytes = 0;
+
+            json_field_string(&file_obj, "filename", filename, sizeof(filename));
+            json_field_string(&file_obj, "owner", owner, sizeof(owner));
+            json_field_string(&file_obj, "last_accessed", last_accessed, sizeof(last_accessed));
+            json_field_int(&file_obj, "words", &words);
+            json_field_int(&file_obj, "chars", &chars);
+            json_field_int(&file_obj, "bytes", &bytes);
+
+            if (strlen(filename) > 0) {
+                const char *access_display = strlen(last_accessed) > 0 ? last_accessed : "N/A";
+                printf("| %-10.10s | %5d | %5d | %5d | %-19.19s | %-11.11s |\n",
+                       filename, words, chars, bytes, access_display, owner);
             }
         }
-        printf("-------------------------------------------------------------------------------\n");
     } else {
-        const char *pos = strstr(response, "\"files\":[");
-        if (pos) {
-            pos += 9;
-            while (*pos && *pos != ']') {
-                if (*pos == '"') {
-                    pos++;
-                    const char *end = strchr(pos, '"');
-                    if (end) {
-                        char filename[MAX_FILENAME];
-                        int len = (int)(end - pos);
-                        if (len >= MAX_FILENAME) {
-                            len = MAX_FILENAME - 1;
-                        }
-                        strncpy(filename, pos, (size_t)len);
-                        filename[len] = '\0';
-                        printf("--> %s\n", filename);
-                        pos = end + 1;
-                    }
-                }
-                pos++;
-            }
+        const char *cursor = json_find_array(response, "files");
+        char filename[MAX_FILENAME];
+        while ((cursor = json_array_next_string(cursor, filename, sizeof(filename))) != NULL) {
+            printf("--> %s\n", filename);
         }
     }
 }
@@ -7,12 +7,21 @@ char NM_IP[INET_ADDRSTRLEN] = "127.0.0.1";
 char current_username[MAX_USERNAME];
 
 int main(int argc, char *argv[]) {
-    if (argc > 1) {
-        strncpy(NM_IP, argv[1], INET_ADDRSTRLEN - 1);
+    const char *nm_ip_arg = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--oneshot") == 0) {
+            nm_oneshot_mode = 1;
+        } else if (!nm_ip_arg) {
+            nm_ip_arg = argv[i];
+        }
+    }
+
+    if (nm_ip_arg) {
+        strncpy(NM_IP, nm_ip_arg, INET_ADDRSTRLEN - 1);
         NM_IP[INET_ADDRSTRLEN - 1] = '\0';
         printf("Connecting to Name Server at %s:%d\n", NM_IP, NM_PORT);
     } else {
-        printf("Usage: %s [name_server_ip]\n", argv[0]);
+        printf("Usage: %s [name_server_ip] [--oneshot]\n", argv[0]);
         printf("Using default Name Server IP: %s\n", NM_IP);
     }
 
@@ -39,26 +48,33 @@ int main(int argc, char *argv[]) {
     if (getsockname(nm_fd, (struct sockaddr *)&local_addr, &addr_len) == 0) {
         inet_ntop(AF_INET, &local_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
     }
+    close(nm_fd);
+
+    if (nm_load_shard_map() != 0) {
+        fprintf(stderr, "Error: Could not connect to Name Server\n");
+        return 1;
+    }
+    if (nm_shard_count() > 1) {
+        printf("Name Server namespace is split across %d shards\n", nm_shard_count());
+    }
 
     char register_msg[512];
     snprintf(register_msg, sizeof(register_msg),
              "{\"cmd\":\"register_client\",\"username\":\"%s\",\"ip\":\"%s\",\"nm_port\":%d,\"ss_port\":%d}",
              current_username, client_ip, NM_PORT, NM_PORT + 100);
 
-    send_message(nm_fd, register_msg);
-    char *response = receive_message(nm_fd);
-
-    if (response && strstr(response, "\"status\":\"OK\"")) {
-        printf("Successfully registered as '%s'\n\n", current_username);
-    } else {
-        fprintf(stderr, "Registration failed\n");
-        if (response) free(response);
-        close(nm_fd);
-        return 1;
+    /* every shard keeps its own user list for LIST */
+    for (int shard = 0; shard < nm_shard_count(); shard++) {
+        char *response = nm_request_shard(shard, register_msg);
+        if (!response || !strstr(response, "\"status\":\"OK\"")) {
+            fprintf(stderr, "Registration failed\n");
+            free(response);
+            nm_session_close_all();
+            return 1;
+        }
+        free(response);
     }
-
-    if (response) free(response);
-    close(nm_fd);
+    printf("Successfully registered as '%s'\n\n", current_username);
 
     printf("Type 'help' for available commands\n\n");
 
@@ -135,24 +151,40 @@ int main(int argc, char *argv[]) {
         } else if (strcmp(cmd, "WRITE") == 0) {
             char filename[MAX_FILENAME];
             int sentence_index = 0;
-            if (sscanf(input, "WRITE %255s %d", filename, &sentence_index) == 2) {
-                handle_write(filename, sentence_index);
+            int wait_secs = 0;
+            if (sscanf(input, "WRITE %255s %d %d", filename, &sentence_index, &wait_secs) >= 2 &&
+                wait_secs >= 0) {
+                handle_write(filename, sentence_index, wait_secs);
             } else {
-                printf("Usage: WRITE <filename> <sentence_number>\n");
+                printf("Usage: WRITE <filename> <sentence_number> [wait_seconds]\n");
             }
         } else if (strcmp(cmd, "STREAM") == 0) {
             char filename[MAX_FILENAME];
-            if (sscanf(input, "STREAM %255s", filename) == 1) {
-                handle_stream(filename);
+            int rate = STREAM_DEFAULT_RATE;
+            int parsed = sscanf(input, "STREAM %255s %d", filename, &rate);
+            if (parsed >= 1 && rate >= 0) {
+                handle_stream(filename, rate);
             } else {
-                printf("Usage: STREAM <filename>\n");
+                printf("Usage: STREAM <filename> [words_per_second]\n");
             }
         } else if (strcmp(cmd, "UNDO") == 0) {
             char filename[MAX_FILENAME];
-            if (sscanf(input, "UNDO %255s", filename) == 1) {
-                handle_undo(filename);
+            int steps = 1;
+            int version = -1;
+            if (sscanf(input, "UNDO %255s -v %d", filename, &version) == 2 && version >= 0) {
+                handle_undo(filename, 1, version);
+            } else if (sscanf(input, "UNDO %255s %d", filename, &steps) >= 1 && steps >= 1 &&
+                       !strstr(input, " -v")) {
+                handle_undo(filename, steps, -1);
+            } else {
+                printf("Usage: UNDO <filename> [steps] | UNDO <filename> -v <version>\n");
+            }
+        } else if (strcmp(cmd, "VERSIONS") == 0) {
+            char filename[MAX_FILENAME];
+            if (sscanf(input, "VERSIONS %255s", filename) == 1) {
+                handle_versions(filename);
             } else {
-                printf("Usage: UNDO <filename>\n");
+                printf("Usage: VERSIONS <filename>\n");
             }
         } else if (strcmp(cmd, "DELETE") == 0) {
             char filename[MAX_FILENAME];
@@ -176,6 +208,7 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    nm_session_close_all();
     return 0;
 }
 //AI code ends
@@ -1,7 +1,7 @@
 //AI code starts
 #include "client_network.h"
 
-int connect_to_nm(void) {
+static int connect_to_host(const char *ip, int port, const char *failure) {
     int sock = socket(AF_INET, SOCK_STREAM, 0);
     if (sock < 0) {
         perror("Socket creation failed");
@@ -10,16 +10,16 @@ int connect_to_nm(void) {
 
     struct sockaddr_in server_addr;
     server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(NM_PORT);
+    server_addr.sin_port = htons(port);
 
-    if (inet_pton(AF_INET, NM_IP, &server_addr.sin_addr) <= 0) {
+    if (inet_pton(AF_INET, ip, &server_addr.sin_addr) <= 0) {
         perror("Invalid address");
         close(sock);
         return -1;
     }
 
     if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Connection to Name Server failed");
+        perror(failure);
         close(sock);
         return -1;
     }
@@ -27,30 +27,12 @@ int connect_to_nm(void) {
     return sock;
 }
 
-int connect_to_ss(const char *ip, int port) {
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) {
-        perror("Socket creation failed");
-        return -1;
-    }
-
-    struct sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
-
-    if (inet_pton(AF_INET, ip, &server_addr.sin_addr) <= 0) {
-        perror("Invalid address");
-        close(sock);
-        return -1;
-    }
-
-    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Connection to Storage Server failed");
-        close(sock);
-        return -1;
-    }
+int connect_to_nm(void) {
+    return connect_to_host(NM_IP, NM_PORT, "Connection to Name Server failed");
+}
 
-    return sock;
+int connect_to_ss(const char *ip, int port) {
+    return connect_to_host(ip, port, "Connection to Storage Server failed");
 }
 
 void send_message(int fd, const char *message) {
@@ -82,4 +64,379 @@ char *receive_message(int fd) {
     buffer[bytes_read] = '\0';
     return buffer;
 }
+
+/*
+ * Reader for a chunked READ reply: a JSON header line, then chunks of a
+ * 4-byte big-endian length and that many raw bytes, ended by a zero length.
+ * One fixed buffer is reused, so memory stays flat however large the file.
+ */
+typedef struct {
+    int fd;
+    char buf[CHUNK_BUFFER_SIZE];
+    size_t pos;
+    size_t len;
+} ChunkReader;
+
+static int chunk_fill(ChunkReader *reader) {
+    if (reader->pos < reader->len) {
+        return 1;
+    }
+    ssize_t n;
+    do {
+        n = recv(reader->fd, reader->buf, sizeof(reader->buf), 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return 0;
+    }
+    reader->pos = 0;
+    reader->len = (size_t)n;
+    return 1;
+}
+
+static int chunk_read_exact(ChunkReader *reader, void *dst, size_t count) {
+    char *out = (char *)dst;
+    while (count > 0) {
+        if (!chunk_fill(reader)) {
+            return 0;
+        }
+        size_t avail = reader->len - reader->pos;
+        size_t take = avail < count ? avail : count;
+        memcpy(out, reader->buf + reader->pos, take);
+        reader->pos += take;
+        out += take;
+        count -= take;
+    }
+    return 1;
+}
+
+/* Returns 0 on success, 1 if the server sent an error (reason filled in),
+ * -1 if the connection failed or ended early. */
+int receive_chunked(int fd, FILE *out, char *reason, size_t reason_size) {
+    ChunkReader *reader = (ChunkReader *)malloc(sizeof(ChunkReader));
+    if (!reader) {
+        return -1;
+    }
+    reader->fd = fd;
+    reader->pos = 0;
+    reader->len = 0;
+
+    char header[512];
+    size_t header_len = 0;
+    int result = -1;
+    while (header_len < sizeof(header) - 1 && chunk_read_exact(reader, &header[header_len], 1)) {
+        if (header[header_len] == '\n') {
+            break;
+        }
+        header_len++;
+    }
+    header[header_len] = '\0';
+
+    if (strstr(header, "\"status\":\"ERR\"")) {
+        json_get_string(header, "reason", reason, reason_size);
+        result = 1;
+    } else if (strstr(header, "\"status\":\"OK\"")) {
+        while (1) {
+            unsigned char prefix[4];
+            if (!chunk_read_exact(reader, prefix, sizeof(prefix))) {
+                break;
+            }
+            size_t chunk = ((size_t)prefix[0] << 24) | ((size_t)prefix[1] << 16) |
+                           ((size_t)prefix[2] << 8) | (size_t)prefix[3];
+            if (chunk == 0) {
+                result = 0;
+                break;
+            }
+
+            /* write straight out of the receive buffer, no per-chunk copy */
+            while (chunk > 0 && chunk_fill(reader)) {
+                size_t avail = reader->len - reader->pos;
+                size_t take = avail < chunk ? avail : chunk;
+                fwrite(reader->buf + reader->pos, 1, take, out);
+                reader->pos += take;
+                chunk -= take;
+            }
+            if (chunk > 0) {
+                break;
+            }
+        }
+    }
+
+    free(reader);
+    return result;
+}
+
+/*
+ * Persistent name server sessions, one per shard (or one in all when the
+ * name server is not sharded). Requests are tagged with "req_id" and framed
+ * by newlines; responses may arrive in any order, so replies for other ids
+ * are parked until their caller asks for them.
+ */
+typedef struct PendingReply {
+    long req_id;
+    char *response;
+    struct PendingReply *next;
+} PendingReply;
+
+typedef struct {
+    int fd;
+    char *buf;
+    size_t len;
+    size_t cap;
+    PendingReply *pending;
+} NmSession;
+
+int nm_oneshot_mode = 0;
+
+static ShardMap shard_map;
+static NmSession sessions[SHARD_MAX] = {[0 ... SHARD_MAX - 1] = {.fd = -1}};
+static long next_req_id = 1;
+
+int connect_to_nm_shard(int shard) {
+    if (shard_map.count == 0) {
+        return connect_to_nm();
+    }
+    return connect_to_host(shard_map.shards[shard].host, shard_map.shards[shard].port,
+                           "Connection to Name Server shard failed");
+}
+
+int nm_shard_count(void) {
+    return shard_map.count > 0 ? shard_map.count : 1;
+}
+
+int nm_session_open(int shard) {
+    NmSession *session = &sessions[shard];
+    if (session->fd >= 0) {
+        return session->fd;
+    }
+    session->fd = connect_to_nm_shard(shard);
+    session->len = 0;
+    return session->fd;
+}
+
+void nm_session_close(int shard) {
+    NmSession *session = &sessions[shard];
+    if (session->fd >= 0) {
+        close(session->fd);
+        session->fd = -1;
+    }
+    free(session->buf);
+    session->buf = NULL;
+    session->len = 0;
+    session->cap = 0;
+    while (session->pending) {
+        PendingReply *next = session->pending->next;
+        free(session->pending->response);
+        free(session->pending);
+        session->pending = next;
+    }
+}
+
+void nm_session_close_all(void) {
+    for (int shard = 0; shard < SHARD_MAX; shard++) {
+        nm_session_close(shard);
+    }
+}
+
+long nm_session_send(int shard, const char *request) {
+    if (!request || request[0] != '{' || nm_session_open(shard) < 0) {
+        return -1;
+    }
+
+    long req_id = next_req_id++;
+    size_t len = strlen(request);
+    char prefix[48];
+    int prefix_len = snprintf(prefix, sizeof(prefix), "{\"req_id\":%ld%s",
+                              req_id, request[1] == '}' ? "" : ",");
+    size_t total = (size_t)prefix_len + len;
+    char *framed = (char *)malloc(total + 1);
+    if (!framed) {
+        return -1;
+    }
+    memcpy(framed, prefix, (size_t)prefix_len);
+    memcpy(framed + prefix_len, request + 1, len - 1);
+    framed[total - 1] = '\n';
+    framed[total] = '\0';
+
+    size_t sent = 0;
+    while (sent < total) {
+        ssize_t n = send(sessions[shard].fd, framed + sent, total - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            free(framed);
+            nm_session_close(shard);
+            return -1;
+        }
+        sent += (size_t)n;
+    }
+    free(framed);
+    return req_id;
+}
+
+static char *session_read_line(NmSession *session) {
+    while (1) {
+        char *nl = session->buf ? memchr(session->buf, '\n', session->len) : NULL;
+        if (nl) {
+            size_t line_len = (size_t)(nl - session->buf);
+            char *line = (char *)malloc(line_len + 1);
+            if (!line) {
+                return NULL;
+            }
+            memcpy(line, session->buf, line_len);
+            line[line_len] = '\0';
+            session->len -= line_len + 1;
+            memmove(session->buf, nl + 1, session->len);
+            return line;
+        }
+
+        if (session->cap - session->len < BUFFER_SIZE) {
+            size_t new_cap = session->cap ? session->cap * 2 : BUFFER_SIZE * 2;
+            char *tmp = (char *)realloc(session->buf, new_cap);
+            if (!tmp) {
+                return NULL;
+            }
+            session->buf = tmp;
+            session->cap = new_cap;
+        }
+
+        ssize_t n = recv(session->fd, session->buf + session->len, session->cap - session->len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0 && session->len > 0) {
+            /* a name server without sessions sends one unterminated reply
+             * and closes; hand it back as the last line */
+            char *line = (char *)malloc(session->len + 1);
+            if (!line) {
+                return NULL;
+            }
+            memcpy(line, session->buf, session->len);
+            line[session->len] = '\0';
+            session->len = 0;
+            return line;
+        }
+        if (n <= 0) {
+            return NULL;
+        }
+        session->len += (size_t)n;
+    }
+}
+
+char *nm_session_wait(int shard, long req_id) {
+    NmSession *session = &sessions[shard];
+    PendingReply **indirect = &session->pending;
+    while (*indirect) {
+        if ((*indirect)->req_id == req_id) {
+            PendingReply *found = *indirect;
+            char *response = found->response;
+            *indirect = found->next;
+            free(found);
+            return response;
+        }
+        indirect = &(*indirect)->next;
+    }
+
+    if (session->fd < 0) {
+        return NULL;
+    }
+
+    while (1) {
+        char *line = session_read_line(session);
+        if (!line) {
+            nm_session_close(shard);
+            return NULL;
+        }
+
+        JsonMessage tagged;
+        json_parse(&tagged, line, (size_t)-1);
+        long id = 0;
+        if (!json_field_long(&tagged, "req_id", &id)) {
+            /* the name server predates sessions; answer this call and go one-shot */
+            nm_oneshot_mode = 1;
+            nm_session_close(shard);
+            return line;
+        }
+        if (id == req_id) {
+            return line;
+        }
+
+        PendingReply *reply = (PendingReply *)malloc(sizeof(PendingReply));
+        if (!reply) {
+            free(line);
+            continue;
+        }
+        reply->req_id = id;
+        reply->response = line;
+        reply->next = session->pending;
+        session->pending = reply;
+    }
+}
+
+char *nm_request_shard(int shard, const char *request) {
+    if (nm_oneshot_mode) {
+        int nm_fd = connect_to_nm_shard(shard);
+        if (nm_fd < 0) {
+            return NULL;
+        }
+        send_message(nm_fd, request);
+        char *response = receive_message(nm_fd);
+        close(nm_fd);
+        return response;
+    }
+
+    long req_id = nm_session_send(shard, request);
+    if (req_id < 0) {
+        /* the name server may have restarted; reconnect once before giving up */
+        req_id = nm_session_send(shard, request);
+        if (req_id < 0) {
+            return NULL;
+        }
+    }
+    return nm_session_wait(shard, req_id);
+}
+
+/*
+ * Asks the name server given on the command line for the shard map. Any
+ * reply that is not a map (an older server answers UNKNOWN_COMMAND) means
+ * one unsharded server. Open sessions are dropped, as their shards may
+ * have moved.
+ */
+int nm_load_shard_map(void) {
+    int nm_fd = connect_to_nm();
+    if (nm_fd < 0) {
+        return -1;
+    }
+    send_message(nm_fd, "{\"cmd\":\"SHARD_MAP\"}");
+    char *response = receive_message(nm_fd);
+    close(nm_fd);
+    if (!response) {
+        return -1;
+    }
+
+    nm_session_close_all();
+    JsonMessage reply;
+    json_parse(&reply, response, (size_t)-1);
+    if (shard_map_from_json(&shard_map, &reply) != 0) {
+        fprintf(stderr, "Warning: ignoring malformed shard map from the Name Server\n");
+    }
+    free(response);
+    return 0;
+}
+
+/* Requests naming a file go to the shard that owns it */
+char *nm_request(const char *request) {
+    char filename[MAX_FILENAME] = {0};
+    json_get_string(request, "filename", filename, sizeof(filename));
+    int shard = shard_map_owner(&shard_map, filename);
+    char *response = nm_request_shard(shard < 0 ? 0 : shard, request);
+
+    if (response && strstr(response, "\"WRONG_SHARD\"")) {
+        /* the shards were reconfigured since the map was fetched */
+        free(response);
+        if (nm_load_shard_map() != 0) {
+            return NULL;
+        }
+        shard = shard_map_owner(&shard_map, filename);
+        response = nm_request_shard(shard < 0 ? 0 : shard, request);
+    }
+    return response;
+}
 //AI code ends
\ No newline at end of file
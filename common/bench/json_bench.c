@@ -0,0 +1,287 @@
+/*
+ * Message parsing: the shared tokenizer against per-key string searches.
+ *
+ * Every component used to pull each field out of a message with its own
+ * strstr for "key", so a handler reading five fields scanned the message
+ * five times and a key quoted inside a string value could be matched in
+ * place of the real one. This replays typical messages (a small client
+ * request, an UPDATE carrying escaped text, REPLICATE with a large
+ * sentence array or file body) through both: the old lookups, and
+ * json_parse once followed by table lookups for the same keys; a delta's
+ * sentences are walked in both, as its handler does. A check pass first makes
+ * sure both read the same values, and shows the old search being fooled
+ * by an UPDATE whose text is a field name.
+ *
+ *   ./common/bench/json_bench [iterations]     (default 200000)
+ */
+#include "proto_json.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define OUT_BYTES (256 * 1024)
+
+typedef struct {
+    const char *label;
+    char *text;
+    const char *keys[8];        /* NULL-terminated lists */
+    const char *int_keys[8];
+    const char *array_key;      /* string array the handler walks, if any */
+} Message;
+
+static double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+/* The lookups every component carried before the shared tokenizer */
+static void legacy_string(const char *json, const char *key, char *value, int max_len) {
+    char search_key[128];
+    snprintf(search_key, sizeof(search_key), "\"%s\"", key);
+
+    const char *pos = strstr(json, search_key);
+    if (!pos) return;
+    pos = strchr(pos, ':');
+    if (!pos) return;
+    pos++;
+    while (*pos == ' ' || *pos == '\t') pos++;
+    if (*pos != '"') return;
+    pos++;
+
+    const char *end = pos;
+    while (*end && *end != '"') {
+        if (*end == '\\' && *(end + 1)) {
+            end += 2;
+            continue;
+        }
+        end++;
+    }
+    if (*end != '"') return;
+
+    int len = (int)(end - pos);
+    if (len >= max_len) len = max_len - 1;
+    int idx = 0;
+    while (pos < end && idx < len) {
+        if (*pos == '\\' && (pos + 1) < end) {
+            pos++;
+            switch (*pos) {
+                case 'n': value[idx++] = '\n'; break;
+                case 'r': value[idx++] = '\r'; break;
+                case 't': value[idx++] = '\t'; break;
+                default: value[idx++] = *pos; break;
+            }
+            pos++;
+        } else {
+            value[idx++] = *pos++;
+        }
+    }
+    value[idx] = '\0';
+}
+
+static int legacy_int(const char *json, const char *key) {
+    char search_key[128];
+    snprintf(search_key, sizeof(search_key), "\"%s\"", key);
+
+    const char *pos = strstr(json, search_key);
+    if (!pos) return 0;
+    pos = strchr(pos, ':');
+    if (!pos) return 0;
+    pos++;
+    while (*pos == ' ' || *pos == '\t') pos++;
+    return atoi(pos);
+}
+
+static unsigned long legacy_pass(const Message *m, char *out) {
+    unsigned long sum = 0;
+    for (int k = 0; m->keys[k]; k++) {
+        out[0] = '\0';
+        legacy_string(m->text, m->keys[k], out, OUT_BYTES);
+        sum += (unsigned char)out[0];
+    }
+    for (int k = 0; m->int_keys[k]; k++) {
+        sum += (unsigned long)legacy_int(m->text, m->int_keys[k]);
+    }
+    if (m->array_key) {
+        char search_key[128];
+        snprintf(search_key, sizeof(search_key), "\"%s\"", m->array_key);
+        const char *cursor = strstr(m->text, search_key);
+        cursor = cursor ? strchr(cursor, '[') : NULL;
+        if (cursor) cursor++;
+        while ((cursor = json_array_next_string(cursor, out, OUT_BYTES)) != NULL) {
+            sum++;
+        }
+    }
+    return sum;
+}
+
+static unsigned long parsed_pass(const Message *m, char *out) {
+    JsonMessage msg;
+    json_parse(&msg, m->text, strlen(m->text));
+    unsigned long sum = 0;
+    for (int k = 0; m->keys[k]; k++) {
+        out[0] = '\0';
+        json_field_string(&msg, m->keys[k], out, OUT_BYTES);
+        sum += (unsigned char)out[0];
+    }
+    for (int k = 0; m->int_keys[k]; k++) {
+        int value = 0;
+        json_field_int(&msg, m->int_keys[k], &value);
+        sum += (unsigned long)value;
+    }
+    const char *cursor = m->array_key ? json_field_array(&msg, m->array_key) : NULL;
+    while ((cursor = json_array_next_string(cursor, out, OUT_BYTES)) != NULL) {
+        sum++;
+    }
+    return sum;
+}
+
+static int check(const Message *m, char *a, char *b) {
+    for (int k = 0; m->keys[k]; k++) {
+        a[0] = '\0';
+        b[0] = '\0';
+        legacy_string(m->text, m->keys[k], a, OUT_BYTES);
+        JsonMessage msg;
+        json_parse(&msg, m->text, strlen(m->text));
+        json_field_string(&msg, m->keys[k], b, OUT_BYTES);
+        if (strcmp(a, b) != 0) {
+            printf("  %-18s \"%s\": search read \"%.24s\", tokenizer \"%.24s\"\n",
+                   m->label, m->keys[k], a, b);
+            return 1;
+        }
+    }
+    for (int k = 0; m->int_keys[k]; k++) {
+        JsonMessage msg;
+        json_parse(&msg, m->text, strlen(m->text));
+        int value = 0;
+        json_field_int(&msg, m->int_keys[k], &value);
+        if (value != legacy_int(m->text, m->int_keys[k])) {
+            printf("  %-18s \"%s\" differs\n", m->label, m->int_keys[k]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static char *build_update(size_t words) {
+    size_t cap = words * 16 + 256;
+    char *text = malloc(cap);
+    if (!text) return NULL;
+    size_t len = (size_t)snprintf(text, cap, "{\"cmd\":\"UPDATE\",\"word_index\":7,\"content\":\"");
+    for (size_t w = 0; w < words; w++) {
+        len += (size_t)snprintf(text + len, cap - len, w % 9 == 8 ? "w%04zu.\\n" : "w%04zu ", w % 10000);
+    }
+    snprintf(text + len, cap - len, "\",\"mode\":\"insert\"}");
+    return text;
+}
+
+/* Shaped like what replication sends: the delta's sentences come last */
+static char *build_replicate(size_t sentences, bool delta) {
+    size_t cap = sentences * 96 + 256;
+    char *text = malloc(cap);
+    if (!text) return NULL;
+    size_t len = (size_t)snprintf(text, cap,
+                                  "{\"cmd\":\"REPLICATE\",\"filename\":\"report.txt\",\"epoch\":3,"
+                                  "\"seq\":412,\"mode\":\"%s\",", delta ? "delta" : "full");
+    len += (size_t)snprintf(text + len, cap - len, delta ?
+                            "\"base_count\":%zu,\"keep_prefix\":0,\"resume\":0,\"sentences\":[" :
+                            "\"content\":\"", sentences);
+    for (size_t s = 0; s < sentences; s++) {
+        len += (size_t)snprintf(text + len, cap - len,
+                                delta ? "%s\"Sentence %zu of the report, with \\\"quoted\\\" words.\"" :
+                                        "%sSentence %zu of the report, with \\\"quoted\\\" words.",
+                                s ? (delta ? "," : " ") : "", s);
+    }
+    snprintf(text + len, cap - len, delta ? "]}" : "\"}");
+    return text;
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = argc > 1 ? atol(argv[1]) : 200000;
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    char *a = malloc(OUT_BYTES);
+    char *b = malloc(OUT_BYTES);
+    Message messages[] = {
+        {"client request",
+         strdup("{\"req_id\":42,\"cmd\":\"READ\",\"username\":\"alice\",\"filename\":\"notes.txt\"}"),
+         {"cmd", "username", "filename", NULL}, {"req_id", NULL}, NULL},
+        {"NM route reply",
+         strdup("{\"req_id\":42,\"status\":\"OK\",\"ss_ip\":\"10.0.0.7\",\"ss_port\":9101,"
+                "\"backup_ss_ip\":\"10.0.0.8\",\"backup_ss_port\":9102}"),
+         {"status", "ss_ip", NULL}, {"ss_port", NULL}, NULL},
+        {"UPDATE 4 KB", build_update(600),
+         {"cmd", "content", "mode", NULL}, {"word_index", NULL}, NULL},
+        {"REPLICATE delta", build_replicate(512, true),
+         {"filename", "mode", NULL}, {"epoch", "seq", "base_count", "keep_prefix", "resume", NULL},
+         "sentences"},
+        {"REPLICATE full", build_replicate(512, false),
+         {"filename", "mode", "content", NULL}, {"epoch", "seq", NULL}, NULL},
+    };
+    int count = (int)(sizeof(messages) / sizeof(messages[0]));
+    if (!a || !b) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!messages[i].text) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        if (check(&messages[i], a, b) != 0) {
+            fprintf(stderr, "lookups disagree on a well-formed message\n");
+            return 1;
+        }
+    }
+
+    Message quoted = {"UPDATE of \"mode\"",
+                      strdup("{\"cmd\":\"UPDATE\",\"word_index\":0,\"content\":\"mode\",\"username\":\"alice\"}"),
+                      {"mode", NULL}, {NULL}, NULL};
+    printf("field named inside a value:\n");
+    if (!quoted.text || check(&quoted, a, b) == 0) {
+        printf("  (not reproduced)\n");
+    }
+    free(quoted.text);
+    printf("\n");
+
+    printf("%-20s %8s %14s %14s %9s\n", "message", "bytes", "search msg/s", "parsed msg/s", "speedup");
+    for (int i = 0; i < count; i++) {
+        const Message *m = &messages[i];
+        size_t len = strlen(m->text);
+        long n = iterations;
+        if (len > 256) {
+            n = iterations * 256 / (long)len;
+            if (n < 100) n = 100;
+        }
+
+        volatile unsigned long sink = 0;
+        double start = now_seconds();
+        for (long r = 0; r < n; r++) {
+            sink += legacy_pass(m, a);
+        }
+        double legacy_time = now_seconds() - start;
+
+        start = now_seconds();
+        for (long r = 0; r < n; r++) {
+            sink += parsed_pass(m, b);
+        }
+        double parsed_time = now_seconds() - start;
+        (void)sink;
+
+        printf("%-20s %8zu %14.0f %14.0f %8.2fx\n", m->label, len, n / legacy_time,
+               n / parsed_time, legacy_time / parsed_time);
+    }
+
+    for (int i = 0; i < count; i++) {
+        free(messages[i].text);
+    }
+    free(a);
+    free(b);
+    return 0;
+}
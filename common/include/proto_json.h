@@ -0,0 +1,112 @@
+#ifndef PROTO_JSON_H
+#define PROTO_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * JSON as spoken between client, name server and storage server: one flat
+ * object per message whose values are strings, numbers, or arrays and
+ * objects that are passed through whole.
+ *
+ * json_parse walks a message once and records where each top-level field
+ * lies; lookups then compare keys against that small table instead of
+ * searching the text again, and a key that only appears inside a string
+ * value can never match. Nothing is allocated and the text is not modified,
+ * so it must outlive the JsonMessage. Values stay escaped until read.
+ */
+
+#define JSON_MAX_FIELDS 32      /* later fields are skipped, not recorded */
+
+typedef enum {
+    JSON_STRING = 0,
+    JSON_NUMBER,
+    JSON_LITERAL,               /* true, false or null */
+    JSON_OBJECT,
+    JSON_ARRAY
+} JsonType;
+
+typedef struct {
+    const char *key;            /* not NUL-terminated */
+    size_t key_len;
+    const char *value;          /* strings: between the quotes; others: the whole token */
+    size_t value_len;
+    JsonType type;
+    bool escaped;               /* a string value holding backslash escapes */
+} JsonField;
+
+typedef struct {
+    const char *text;
+    size_t len;
+    JsonField fields[JSON_MAX_FIELDS];
+    int count;
+} JsonMessage;
+
+/* Returns 0, or -1 if the text is not a well-formed object. The fields
+ * before a syntax error are still recorded, so a damaged message can be
+ * answered with whatever could be read from it. len may be (size_t)-1 for
+ * a NUL-terminated text. */
+int json_parse(JsonMessage *msg, const char *text, size_t len);
+
+const JsonField *json_find(const JsonMessage *msg, const char *key);
+
+/* Copy out a string value, unescaped and cut to out_size - 1 bytes. Returns
+ * 0 and leaves out untouched if the field is missing or not a string. */
+int json_field_string(const JsonMessage *msg, const char *key, char *out, size_t out_size);
+int json_field_int(const JsonMessage *msg, const char *key, int *out);
+int json_field_long(const JsonMessage *msg, const char *key, long *out);
+
+/* Points just past the '[' of an array value, for json_array_next_string */
+const char *json_field_array(const JsonMessage *msg, const char *key);
+
+/* One-off lookups on an unparsed, NUL-terminated message. Each scans the
+ * text only up to the field it finds; use json_parse for several keys. */
+int json_get_string(const char *json, const char *key, char *out, size_t out_size);
+int json_get_int(const char *json, const char *key, int *out);
+const char *json_find_array(const char *json, const char *key);
+
+/* Next string of an array, starting at the '[' position or after the
+ * previous element; NULL at the end of the array */
+const char *json_array_next_string(const char *cursor, char *out, size_t out_size);
+
+/* Next object of an array, parsed into out; same cursor rules. The object's
+ * text stays in the array, so out is valid as long as the message is */
+const char *json_array_next_object(const char *cursor, JsonMessage *out);
+
+/* Decodes the escapes in src[0..len) into out, cut to out_size - 1 bytes
+ * and NUL-terminated; returns the bytes written */
+size_t json_unescape(const char *src, size_t len, char *out, size_t out_size);
+
+/* Escaped copy of src for use inside a JSON string (malloc'd) */
+char *json_escape(const char *src);
+
+/* Escapes one byte into out, which needs room for 6; returns the bytes
+ * written. For callers that escape straight into their own buffers. */
+size_t json_escape_byte(char *out, unsigned char ch);
+
+/*
+ * Builds a message into a caller-provided buffer. Keys are passed as NULL
+ * for array elements. On overflow the writer stops and json_writer_finish
+ * returns NULL, so a reply is never sent cut short.
+ */
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t len;
+    bool need_comma;
+    bool overflow;
+} JsonWriter;
+
+void json_writer_init(JsonWriter *w, char *buf, size_t cap);
+void json_write_begin_object(JsonWriter *w, const char *key);
+void json_write_end_object(JsonWriter *w);
+void json_write_begin_array(JsonWriter *w, const char *key);
+void json_write_end_array(JsonWriter *w);
+void json_write_string(JsonWriter *w, const char *key, const char *value);
+void json_write_string_len(JsonWriter *w, const char *key, const char *value, size_t len);
+void json_write_int(JsonWriter *w, const char *key, long value);
+void json_write_bool(JsonWriter *w, const char *key, bool value);
+void json_write_raw(JsonWriter *w, const char *key, const char *json);    /* already encoded */
+const char *json_writer_finish(JsonWriter *w, size_t *len);
+
+#endif /* PROTO_JSON_H */
@@ -0,0 +1,59 @@
+#ifndef PROTO_SHARD_H
+#define PROTO_SHARD_H
+
+#include <stdint.h>
+
+#include "proto_json.h"
+
+/*
+ * Map of the name server shards, each written "host:port". A filename
+ * belongs to the shard whose point follows the name's hash on a ring of
+ * 32-bit hashes; every shard is placed at SHARD_VNODES points hashed from
+ * its address, so name servers, clients and storage servers given the same
+ * list agree on owners without asking, and adding a shard only takes over
+ * the names that fall just before its new points.
+ *
+ * A map with no shards means one name server holds the whole namespace.
+ */
+
+#define SHARD_MAX 16
+#define SHARD_VNODES 64
+#define SHARD_HOST_MAX 64
+
+typedef struct {
+    char host[SHARD_HOST_MAX];
+    int port;
+} ShardAddr;
+
+typedef struct {
+    uint32_t point;
+    int shard;
+} ShardPoint;
+
+typedef struct {
+    int count;
+    ShardAddr shards[SHARD_MAX];
+    ShardPoint ring[SHARD_MAX * SHARD_VNODES];    /* sorted by point */
+    int ring_size;
+} ShardMap;
+
+void shard_map_init(ShardMap *map);
+
+/* Parses a comma-separated "host:port" list and builds the ring; returns 0,
+ * or -1 (leaving the map empty) if an entry is malformed or there are more
+ * than SHARD_MAX */
+int shard_map_parse(ShardMap *map, const char *list);
+
+/* Reads the "shards" array of a SHARD_MAP reply; an error reply or an
+ * empty array leaves an empty map. Returns -1 if an entry is malformed */
+int shard_map_from_json(ShardMap *map, const JsonMessage *reply);
+
+/* Writes the shards as a "shards" array of "host:port" strings */
+void shard_map_write_json(const ShardMap *map, JsonWriter *w);
+
+/* Index of the shard owning filename, or -1 for an empty map */
+int shard_map_owner(const ShardMap *map, const char *filename);
+
+uint32_t shard_hash(const char *key, size_t len);
+
+#endif /* PROTO_SHARD_H */
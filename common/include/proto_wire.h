@@ -0,0 +1,101 @@
+#ifndef PROTO_WIRE_H
+#define PROTO_WIRE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Compact binary framing for storage server clients, next to the JSON lines
+ * of proto_json.h. A connection opts in by sending WIRE_HANDSHAKE and its
+ * version as its first two bytes; the server answers with the same two
+ * bytes for the version it speaks. Any other first byte means JSON.
+ *
+ * Every frame after that is a 4-byte big-endian length, then that many
+ * bytes: an opcode (requests) or status (replies) and its fields. Integers
+ * are big-endian and fixed width; strings are a u16 (names) or u32 (file
+ * content) length followed by the bytes, unescaped and not NUL-terminated.
+ * See protocol/message_formats.md for the fields of each opcode.
+ */
+
+#define WIRE_HANDSHAKE 0xB1     /* can never start a JSON line */
+#define WIRE_VERSION 1
+#define WIRE_PREFIX_BYTES 4
+
+/* Request opcodes; each body starts with the username as a str16 */
+typedef enum {
+    WIRE_OP_READ = 1,
+    WIRE_OP_CREATE,
+    WIRE_OP_WRITE,
+    WIRE_OP_UPDATE,
+    WIRE_OP_ETIRW,
+    WIRE_OP_UNDO,
+    WIRE_OP_VERSIONS,
+    WIRE_OP_STAT,
+    WIRE_OP_DELETE,
+    WIRE_OP_LOCK_STATS,
+    WIRE_OP_READ_CACHE_STATS,
+    WIRE_OP_COUNT
+} WireOp;
+
+/* Reply statuses */
+typedef enum {
+    WIRE_OK = 0,
+    WIRE_ERR,                   /* str16 reason */
+    WIRE_WAIT,                  /* u32 queue position; the final reply follows */
+    WIRE_JSON                   /* str32 holding the reply as JSON text */
+} WireStatus;
+
+/* The command name an opcode stands for, or NULL */
+const char *wire_op_name(unsigned int op);
+
+/* Length field of a frame from its first WIRE_PREFIX_BYTES bytes */
+uint32_t wire_frame_length(const char *prefix);
+
+/*
+ * Builds one frame into a caller-provided buffer; the length prefix is
+ * filled in by wire_writer_finish. As with JsonWriter, an overflow stops
+ * the writer and finish returns NULL.
+ */
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+} WireWriter;
+
+void wire_writer_init(WireWriter *w, char *buf, size_t cap);
+void wire_put_u8(WireWriter *w, uint8_t value);
+void wire_put_u16(WireWriter *w, uint16_t value);
+void wire_put_u32(WireWriter *w, uint32_t value);
+void wire_put_u64(WireWriter *w, uint64_t value);
+void wire_put_str16(WireWriter *w, const char *value, size_t len);
+void wire_put_str32(WireWriter *w, const char *value, size_t len);
+
+/* trailing counts payload bytes the caller writes straight after the
+ * frame, such as a file sent from its mapping instead of copied in */
+const char *wire_writer_finish(WireWriter *w, size_t trailing, size_t *len);
+
+/*
+ * Reads the fields of one frame body in order. A read past the end sets
+ * error and returns zero or NULL, so a handler can read every field and
+ * check once at the end.
+ */
+typedef struct {
+    const unsigned char *pos;
+    const unsigned char *end;
+    bool error;
+} WireReader;
+
+void wire_reader_init(WireReader *r, const char *data, size_t len);
+uint8_t wire_get_u8(WireReader *r);
+uint16_t wire_get_u16(WireReader *r);
+uint32_t wire_get_u32(WireReader *r);
+uint64_t wire_get_u64(WireReader *r);
+const char *wire_get_str16(WireReader *r, size_t *len);
+const char *wire_get_str32(WireReader *r, size_t *len);
+
+/* Every field read without error and nothing left over */
+bool wire_reader_done(const WireReader *r);
+
+#endif /* PROTO_WIRE_H */
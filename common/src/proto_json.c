@@ -0,0 +1,467 @@
+#include "proto_json.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char *p;
+    const char *end;            /* NULL when the text is NUL-terminated instead */
+} Cursor;
+
+static int more(const Cursor *c) {
+    return c->end ? c->p < c->end : *c->p != '\0';
+}
+
+static bool is_ws(char ch) {
+    return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t';
+}
+
+static void skip_ws(Cursor *c) {
+    while (more(c) && is_ws(*c->p)) {
+        c->p++;
+    }
+}
+
+/* Next ch at or after c->p, or NULL */
+static const char *find_char(const Cursor *c, char ch) {
+    if (c->end) {
+        return c->p < c->end ? memchr(c->p, ch, (size_t)(c->end - c->p)) : NULL;
+    }
+    return strchr(c->p, ch);
+}
+
+#define SHORT_STRING 32         /* scanned bytewise before switching to memchr */
+
+/* At an opening quote; returns the closing one, or NULL if the string is
+ * unterminated, and sets *escaped if it holds a backslash. Short strings
+ * are scanned a byte at a time; longer ones jump between quotes with
+ * memchr, and the run of backslashes before each quote tells an escaped
+ * one from the end of the string. */
+static const char *closing_quote(Cursor *c, bool *escaped) {
+    const char *start = ++c->p;
+    *escaped = false;
+    for (int i = 0; i < SHORT_STRING && more(c); i++) {
+        char ch = *c->p;
+        if (ch == '"') return c->p;
+        if (ch == '\\') {
+            *escaped = true;
+            c->p++;
+            if (!more(c)) return NULL;
+        }
+        c->p++;
+    }
+    while (1) {
+        const char *quote = find_char(c, '"');
+        if (!quote) return NULL;
+        const char *b = quote;
+        while (b > start && b[-1] == '\\') {
+            b--;
+        }
+        if ((quote - b) % 2 == 0) {
+            if (!*escaped) {
+                *escaped = memchr(start, '\\', (size_t)(quote - start)) != NULL;
+            }
+            return quote;
+        }
+        c->p = quote + 1;
+    }
+}
+
+/* At an opening quote; leaves c past the closing one */
+static int scan_string(Cursor *c, const char **start, size_t *len, bool *escaped) {
+    const char *open = c->p;
+    const char *close = closing_quote(c, escaped);
+    if (!close) return 0;
+    *start = open + 1;
+    *len = (size_t)(close - *start);
+    c->p = close + 1;
+    return 1;
+}
+
+/* At '{' or '['; leaves c past the matching bracket */
+static int skip_nested(Cursor *c) {
+    int depth = 0;
+    while (more(c)) {
+        char ch = *c->p;
+        if (ch == '"') {
+            bool escaped;
+            const char *close = closing_quote(c, &escaped);
+            if (!close) return 0;
+            c->p = close + 1;
+            continue;
+        }
+        if (ch == '{' || ch == '[') {
+            depth++;
+        } else if (ch == '}' || ch == ']') {
+            if (--depth == 0) {
+                c->p++;
+                return 1;
+            }
+        }
+        c->p++;
+    }
+    return 0;
+}
+
+/* Records fields into msg; given stop_key, records only that field and
+ * stops there */
+static int tokenize(JsonMessage *msg, const char *text, size_t len, const char *stop_key) {
+    msg->text = text;
+    msg->len = len;
+    msg->count = 0;
+    if (!text) return -1;
+
+    Cursor c = {text, len == (size_t)-1 ? NULL : text + len};
+    size_t stop_len = stop_key ? strlen(stop_key) : 0;
+    skip_ws(&c);
+    if (!more(&c) || *c.p != '{') return -1;
+    c.p++;
+
+    while (1) {
+        skip_ws(&c);
+        if (!more(&c)) return -1;
+        if (*c.p == '}') return 0;
+        if (*c.p != '"') return -1;
+
+        JsonField field;
+        bool key_escaped;
+        if (!scan_string(&c, &field.key, &field.key_len, &key_escaped)) return -1;
+        skip_ws(&c);
+        if (!more(&c) || *c.p != ':') return -1;
+        c.p++;
+        skip_ws(&c);
+        if (!more(&c)) return -1;
+
+        field.escaped = false;
+        char ch = *c.p;
+        if (ch == '"') {
+            field.type = JSON_STRING;
+            if (!scan_string(&c, &field.value, &field.value_len, &field.escaped)) return -1;
+        } else if (ch == '{' || ch == '[') {
+            field.type = ch == '{' ? JSON_OBJECT : JSON_ARRAY;
+            field.value = c.p;
+            if (!skip_nested(&c)) return -1;
+            field.value_len = (size_t)(c.p - field.value);
+        } else {
+            field.type = (ch == '-' || isdigit((unsigned char)ch)) ? JSON_NUMBER : JSON_LITERAL;
+            field.value = c.p;
+            while (more(&c) && *c.p != ',' && *c.p != '}' && !is_ws(*c.p)) {
+                c.p++;
+            }
+            field.value_len = (size_t)(c.p - field.value);
+            if (field.value_len == 0) return -1;
+        }
+
+        if (stop_key) {
+            if (field.key_len == stop_len && memcmp(field.key, stop_key, stop_len) == 0) {
+                msg->fields[msg->count++] = field;
+                return 0;
+            }
+        } else if (msg->count < JSON_MAX_FIELDS) {
+            msg->fields[msg->count++] = field;
+        }
+
+        skip_ws(&c);
+        if (!more(&c)) return -1;
+        if (*c.p == ',') {
+            c.p++;
+        } else if (*c.p == '}') {
+            return 0;
+        } else {
+            return -1;
+        }
+    }
+}
+
+int json_parse(JsonMessage *msg, const char *text, size_t len) {
+    return tokenize(msg, text, len, NULL);
+}
+
+const JsonField *json_find(const JsonMessage *msg, const char *key) {
+    if (!msg || !key) return NULL;
+    size_t key_len = strlen(key);
+    for (int i = 0; i < msg->count; i++) {
+        const JsonField *field = &msg->fields[i];
+        if (field->key_len == key_len && memcmp(field->key, key, key_len) == 0) {
+            return field;
+        }
+    }
+    return NULL;
+}
+
+size_t json_unescape(const char *src, size_t len, char *out, size_t out_size) {
+    if (!out || out_size == 0) return 0;
+    size_t idx = 0;
+    const char *p = src;
+    const char *end = src + len;
+    while (p < end && idx < out_size - 1) {
+        char ch = *p++;
+        if (ch == '\\' && p < end) {
+            char esc = *p++;
+            switch (esc) {
+                case 'n':  ch = '\n'; break;
+                case 'r':  ch = '\r'; break;
+                case 't':  ch = '\t'; break;
+                case 'b':  ch = '\b'; break;
+                case 'f':  ch = '\f'; break;
+                case 'u': {
+                    char hex[5] = {0};
+                    int digits = 0;
+                    while (digits < 4 && p < end && isxdigit((unsigned char)*p)) {
+                        hex[digits++] = *p++;
+                    }
+                    ch = (char)strtol(hex, NULL, 16);
+                    break;
+                }
+                default:   ch = esc; break;
+            }
+        }
+        out[idx++] = ch;
+    }
+    out[idx] = '\0';
+    return idx;
+}
+
+static int field_string(const JsonField *field, char *out, size_t out_size) {
+    if (!field || field->type != JSON_STRING || !out || out_size == 0) return 0;
+    if (field->escaped) {
+        json_unescape(field->value, field->value_len, out, out_size);
+    } else {
+        size_t n = field->value_len < out_size - 1 ? field->value_len : out_size - 1;
+        memcpy(out, field->value, n);
+        out[n] = '\0';
+    }
+    return 1;
+}
+
+static int field_long(const JsonField *field, long *out) {
+    if (!field || field->type != JSON_NUMBER || !out) return 0;
+    char digits[32];
+    size_t n = field->value_len < sizeof(digits) - 1 ? field->value_len : sizeof(digits) - 1;
+    memcpy(digits, field->value, n);
+    digits[n] = '\0';
+    char *endptr = NULL;
+    long value = strtol(digits, &endptr, 10);
+    if (endptr == digits) return 0;
+    *out = value;
+    return 1;
+}
+
+int json_field_string(const JsonMessage *msg, const char *key, char *out, size_t out_size) {
+    return field_string(json_find(msg, key), out, out_size);
+}
+
+int json_field_long(const JsonMessage *msg, const char *key, long *out) {
+    return field_long(json_find(msg, key), out);
+}
+
+int json_field_int(const JsonMessage *msg, const char *key, int *out) {
+    long value;
+    if (!out || !json_field_long(msg, key, &value)) return 0;
+    *out = (int)value;
+    return 1;
+}
+
+const char *json_field_array(const JsonMessage *msg, const char *key) {
+    const JsonField *field = json_find(msg, key);
+    return (field && field->type == JSON_ARRAY) ? field->value + 1 : NULL;
+}
+
+int json_get_string(const char *json, const char *key, char *out, size_t out_size) {
+    JsonMessage msg;
+    tokenize(&msg, json, (size_t)-1, key);
+    return json_field_string(&msg, key, out, out_size);
+}
+
+int json_get_int(const char *json, const char *key, int *out) {
+    JsonMessage msg;
+    tokenize(&msg, json, (size_t)-1, key);
+    return json_field_int(&msg, key, out);
+}
+
+const char *json_find_array(const char *json, const char *key) {
+    JsonMessage msg;
+    tokenize(&msg, json, (size_t)-1, key);
+    return json_field_array(&msg, key);
+}
+
+const char *json_array_next_string(const char *cursor, char *out, size_t out_size) {
+    if (!cursor || !out || out_size == 0) return NULL;
+
+    Cursor c = {cursor, NULL};
+    skip_ws(&c);
+    if (*c.p == ',') {
+        c.p++;
+        skip_ws(&c);
+    }
+    if (*c.p != '"') return NULL;
+
+    const char *start;
+    size_t len;
+    bool escaped;
+    if (!scan_string(&c, &start, &len, &escaped)) return NULL;
+    json_unescape(start, len, out, out_size);
+    return c.p;
+}
+
+const char *json_array_next_object(const char *cursor, JsonMessage *out) {
+    if (!cursor || !out) return NULL;
+
+    Cursor c = {cursor, NULL};
+    skip_ws(&c);
+    if (*c.p == ',') {
+        c.p++;
+        skip_ws(&c);
+    }
+    if (*c.p != '{') return NULL;
+
+    const char *start = c.p;
+    if (!skip_nested(&c)) return NULL;
+    json_parse(out, start, (size_t)(c.p - start));
+    return c.p;
+}
+
+/* Escaped form of one byte into out (room for 6); returns the bytes written */
+size_t json_escape_byte(char *out, unsigned char ch) {
+    switch (ch) {
+        case '\\': out[0] = '\\'; out[1] = '\\'; return 2;
+        case '"':  out[0] = '\\'; out[1] = '"';  return 2;
+        case '\n': out[0] = '\\'; out[1] = 'n';  return 2;
+        case '\r': out[0] = '\\'; out[1] = 'r';  return 2;
+        case '\t': out[0] = '\\'; out[1] = 't';  return 2;
+        default:
+            if (ch < 0x20) {
+                static const char hex[] = "0123456789abcdef";
+                memcpy(out, "\\u00", 4);
+                out[4] = hex[ch >> 4];
+                out[5] = hex[ch & 0xf];
+                return 6;
+            }
+            out[0] = (char)ch;
+            return 1;
+    }
+}
+
+char *json_escape(const char *src) {
+    if (!src) src = "";
+    size_t len = 0;
+    char scratch[6];
+    for (const char *p = src; *p; p++) {
+        len += json_escape_byte(scratch, (unsigned char)*p);
+    }
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    char *w = out;
+    for (const char *p = src; *p; p++) {
+        w += json_escape_byte(w, (unsigned char)*p);
+    }
+    *w = '\0';
+    return out;
+}
+
+void json_writer_init(JsonWriter *w, char *buf, size_t cap) {
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->need_comma = false;
+    w->overflow = cap == 0;
+    if (cap > 0) {
+        buf[0] = '\0';
+    }
+}
+
+/* Keeps one byte back for the terminating NUL */
+static void put(JsonWriter *w, const char *data, size_t len) {
+    if (w->overflow) return;
+    if (w->len + len >= w->cap) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+static void put_escaped(JsonWriter *w, const char *value, size_t len) {
+    put(w, "\"", 1);
+    const char *run = value;
+    for (size_t i = 0; i < len && !w->overflow; i++) {
+        unsigned char ch = (unsigned char)value[i];
+        if (ch >= 0x20 && ch != '"' && ch != '\\') continue;
+        put(w, run, (size_t)(value + i - run));
+        char escaped[6];
+        put(w, escaped, json_escape_byte(escaped, ch));
+        run = value + i + 1;
+    }
+    put(w, run, (size_t)(value + len - run));
+    put(w, "\"", 1);
+}
+
+static void begin_value(JsonWriter *w, const char *key) {
+    if (w->need_comma) {
+        put(w, ",", 1);
+    }
+    if (key) {
+        put_escaped(w, key, strlen(key));
+        put(w, ":", 1);
+    }
+    w->need_comma = true;
+}
+
+void json_write_begin_object(JsonWriter *w, const char *key) {
+    begin_value(w, key);
+    put(w, "{", 1);
+    w->need_comma = false;
+}
+
+void json_write_end_object(JsonWriter *w) {
+    put(w, "}", 1);
+    w->need_comma = true;
+}
+
+void json_write_begin_array(JsonWriter *w, const char *key) {
+    begin_value(w, key);
+    put(w, "[", 1);
+    w->need_comma = false;
+}
+
+void json_write_end_array(JsonWriter *w) {
+    put(w, "]", 1);
+    w->need_comma = true;
+}
+
+void json_write_string_len(JsonWriter *w, const char *key, const char *value, size_t len) {
+    begin_value(w, key);
+    put_escaped(w, value ? value : "", value ? len : 0);
+}
+
+void json_write_string(JsonWriter *w, const char *key, const char *value) {
+    json_write_string_len(w, key, value, value ? strlen(value) : 0);
+}
+
+void json_write_int(JsonWriter *w, const char *key, long value) {
+    char digits[24];
+    int n = snprintf(digits, sizeof(digits), "%ld", value);
+    begin_value(w, key);
+    put(w, digits, (size_t)n);
+}
+
+void json_write_bool(JsonWriter *w, const char *key, bool value) {
+    begin_value(w, key);
+    put(w, value ? "true" : "false", value ? 4 : 5);
+}
+
+void json_write_raw(JsonWriter *w, const char *key, const char *json) {
+    begin_value(w, key);
+    put(w, json, strlen(json));
+}
+
+const char *json_writer_finish(JsonWriter *w, size_t *len) {
+    if (w->overflow) return NULL;
+    w->buf[w->len] = '\0';
+    if (len) {
+        *len = w->len;
+    }
+    return w->buf;
+}
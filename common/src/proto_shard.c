@@ -0,0 +1,137 @@
+#include "proto_shard.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint32_t shard_hash(const char *key, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    /* FNV-1a alone leaves names differing in the last byte on nearby
+     * points; the murmur finalizer spreads them around the ring */
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+void shard_map_init(ShardMap *map) {
+    memset(map, 0, sizeof(*map));
+}
+
+static int add_shard(ShardMap *map, const char *entry, size_t len) {
+    const char *colon = NULL;
+    for (size_t i = 0; i < len; i++) {
+        if (entry[i] == ':') {
+            colon = entry + i;
+        }
+    }
+    if (!colon || colon == entry || (size_t)(colon - entry) >= SHARD_HOST_MAX ||
+        map->count >= SHARD_MAX) {
+        return -1;
+    }
+
+    int port = 0;
+    for (const char *p = colon + 1; p < entry + len; p++) {
+        if (*p < '0' || *p > '9' || port > 65535) {
+            return -1;
+        }
+        port = port * 10 + (*p - '0');
+    }
+    if (port <= 0 || port > 65535) {
+        return -1;
+    }
+
+    ShardAddr *addr = &map->shards[map->count++];
+    memcpy(addr->host, entry, (size_t)(colon - entry));
+    addr->host[colon - entry] = '\0';
+    addr->port = port;
+    return 0;
+}
+
+static int compare_points(const void *a, const void *b) {
+    const ShardPoint *pa = a;
+    const ShardPoint *pb = b;
+    if (pa->point != pb->point) {
+        return pa->point < pb->point ? -1 : 1;
+    }
+    return pa->shard - pb->shard;
+}
+
+static void build_ring(ShardMap *map) {
+    map->ring_size = 0;
+    for (int s = 0; s < map->count; s++) {
+        for (int v = 0; v < SHARD_VNODES; v++) {
+            char key[SHARD_HOST_MAX + 32];
+            int len = snprintf(key, sizeof(key), "%s:%d#%d", map->shards[s].host, map->shards[s].port, v);
+            ShardPoint *point = &map->ring[map->ring_size++];
+            point->point = shard_hash(key, (size_t)len);
+            point->shard = s;
+        }
+    }
+    qsort(map->ring, (size_t)map->ring_size, sizeof(ShardPoint), compare_points);
+}
+
+int shard_map_parse(ShardMap *map, const char *list) {
+    shard_map_init(map);
+    const char *entry = list;
+    while (entry && *entry) {
+        const char *end = strchr(entry, ',');
+        size_t len = end ? (size_t)(end - entry) : strlen(entry);
+        if (add_shard(map, entry, len) != 0) {
+            shard_map_init(map);
+            return -1;
+        }
+        entry = end ? end + 1 : NULL;
+    }
+    build_ring(map);
+    return 0;
+}
+
+int shard_map_from_json(ShardMap *map, const JsonMessage *reply) {
+    shard_map_init(map);
+    const char *cursor = json_field_array(reply, "shards");
+    char entry[SHARD_HOST_MAX + 8];
+    while ((cursor = json_array_next_string(cursor, entry, sizeof(entry))) != NULL) {
+        if (add_shard(map, entry, strlen(entry)) != 0) {
+            shard_map_init(map);
+            return -1;
+        }
+    }
+    build_ring(map);
+    return 0;
+}
+
+void shard_map_write_json(const ShardMap *map, JsonWriter *w) {
+    json_write_begin_array(w, "shards");
+    for (int s = 0; s < map->count; s++) {
+        char entry[SHARD_HOST_MAX + 8];
+        snprintf(entry, sizeof(entry), "%s:%d", map->shards[s].host, map->shards[s].port);
+        json_write_string(w, NULL, entry);
+    }
+    json_write_end_array(w);
+}
+
+int shard_map_owner(const ShardMap *map, const char *filename) {
+    if (map->ring_size == 0) {
+        return -1;
+    }
+
+    uint32_t h = shard_hash(filename, strlen(filename));
+    int lo = 0;
+    int hi = map->ring_size;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (map->ring[mid].point < h) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return map->ring[lo == map->ring_size ? 0 : lo].shard;
+}
@@ -0,0 +1,160 @@
+#include "proto_wire.h"
+
+#include <string.h>
+
+static const char *const g_op_names[WIRE_OP_COUNT] = {
+    [WIRE_OP_READ] = "READ",
+    [WIRE_OP_CREATE] = "CREATE",
+    [WIRE_OP_WRITE] = "WRITE",
+    [WIRE_OP_UPDATE] = "UPDATE",
+    [WIRE_OP_ETIRW] = "ETIRW",
+    [WIRE_OP_UNDO] = "UNDO",
+    [WIRE_OP_VERSIONS] = "VERSIONS",
+    [WIRE_OP_STAT] = "STAT",
+    [WIRE_OP_DELETE] = "DELETE",
+    [WIRE_OP_LOCK_STATS] = "LOCK_STATS",
+    [WIRE_OP_READ_CACHE_STATS] = "READ_CACHE_STATS",
+};
+
+const char *wire_op_name(unsigned int op) {
+    return op < WIRE_OP_COUNT ? g_op_names[op] : NULL;
+}
+
+uint32_t wire_frame_length(const char *prefix) {
+    const unsigned char *p = (const unsigned char *)prefix;
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+void wire_writer_init(WireWriter *w, char *buf, size_t cap) {
+    w->buf = buf;
+    w->cap = cap;
+    w->len = WIRE_PREFIX_BYTES;
+    w->overflow = cap < WIRE_PREFIX_BYTES;
+}
+
+static void put_be(WireWriter *w, uint64_t value, size_t bytes) {
+    if (w->overflow || w->cap - w->len < bytes) {
+        w->overflow = true;
+        return;
+    }
+    for (size_t i = 0; i < bytes; i++) {
+        w->buf[w->len + i] = (char)(value >> (8 * (bytes - 1 - i)));
+    }
+    w->len += bytes;
+}
+
+void wire_put_u8(WireWriter *w, uint8_t value) {
+    put_be(w, value, 1);
+}
+
+void wire_put_u16(WireWriter *w, uint16_t value) {
+    put_be(w, value, 2);
+}
+
+void wire_put_u32(WireWriter *w, uint32_t value) {
+    put_be(w, value, 4);
+}
+
+void wire_put_u64(WireWriter *w, uint64_t value) {
+    put_be(w, value, 8);
+}
+
+static void put_bytes(WireWriter *w, const char *data, size_t len) {
+    if (w->overflow || w->cap - w->len < len) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+void wire_put_str16(WireWriter *w, const char *value, size_t len) {
+    if (len > UINT16_MAX) {
+        w->overflow = true;
+        return;
+    }
+    put_be(w, len, 2);
+    put_bytes(w, value, len);
+}
+
+void wire_put_str32(WireWriter *w, const char *value, size_t len) {
+    if (len > UINT32_MAX) {
+        w->overflow = true;
+        return;
+    }
+    put_be(w, len, 4);
+    put_bytes(w, value, len);
+}
+
+const char *wire_writer_finish(WireWriter *w, size_t trailing, size_t *len) {
+    size_t body = w->len - WIRE_PREFIX_BYTES;
+    if (w->overflow || trailing > UINT32_MAX - body) {
+        return NULL;
+    }
+    uint32_t length = (uint32_t)(body + trailing);
+    w->buf[0] = (char)(length >> 24);
+    w->buf[1] = (char)(length >> 16);
+    w->buf[2] = (char)(length >> 8);
+    w->buf[3] = (char)length;
+    *len = w->len;
+    return w->buf;
+}
+
+void wire_reader_init(WireReader *r, const char *data, size_t len) {
+    r->pos = (const unsigned char *)data;
+    r->end = r->pos + len;
+    r->error = false;
+}
+
+static uint64_t get_be(WireReader *r, size_t bytes) {
+    if (r->error || (size_t)(r->end - r->pos) < bytes) {
+        r->error = true;
+        return 0;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value = (value << 8) | r->pos[i];
+    }
+    r->pos += bytes;
+    return value;
+}
+
+uint8_t wire_get_u8(WireReader *r) {
+    return (uint8_t)get_be(r, 1);
+}
+
+uint16_t wire_get_u16(WireReader *r) {
+    return (uint16_t)get_be(r, 2);
+}
+
+uint32_t wire_get_u32(WireReader *r) {
+    return (uint32_t)get_be(r, 4);
+}
+
+uint64_t wire_get_u64(WireReader *r) {
+    return get_be(r, 8);
+}
+
+static const char *get_bytes(WireReader *r, size_t len) {
+    if (r->error || (size_t)(r->end - r->pos) < len) {
+        r->error = true;
+        return NULL;
+    }
+    const char *data = (const char *)r->pos;
+    r->pos += len;
+    return data;
+}
+
+const char *wire_get_str16(WireReader *r, size_t *len) {
+    *len = wire_get_u16(r);
+    return get_bytes(r, *len);
+}
+
+const char *wire_get_str32(WireReader *r, size_t *len) {
+    *len = wire_get_u32(r);
+    return get_bytes(r, *len);
+}
+
+bool wire_reader_done(const WireReader *r) {
+    return !r->error && r->pos == r->end;
+}
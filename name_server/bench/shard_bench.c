@@ -0,0 +1,434 @@
+/*
+ * Lookup scaling of a sharded name server namespace, on loopback.
+ *
+ * For 1..N shards this starts that many real name server processes (each
+ * with one worker, so a shard is one unit of capacity), preloads every
+ * shard with the files it owns, then runs one load process per shard.
+ * Each load process routes READ lookups for random files through the
+ * shard map, as the client does, pipelining a window per shard on a
+ * tagged session. Reported per shard count: aggregate lookups/s, the name
+ * servers' CPU time, lookups per name server CPU-second and how far the
+ * busiest shard is above an even share.
+ *
+ * Aggregate throughput can only grow with the shards while there are
+ * cores to run them; what stays flat is the cost of a lookup and the load
+ * per shard. A last table shows what share of names change owner when one
+ * shard is added (ideal: 1 / new shard count).
+ *
+ *   ./name_server/bench/shard_bench [max_shards] [lookups]   (default 4 200000)
+ */
+#define _GNU_SOURCE
+#include "proto_shard.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <libgen.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define FILES 20000
+#define BASE_PORT 19400
+#define DEPTH 32
+
+typedef struct {
+    long ok;
+    long failed;
+    long per_shard[SHARD_MAX];
+} LoadResult;
+
+static double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static void file_name(int i, char *out, size_t size) {
+    snprintf(out, size, "project_%03d/notes_%05d.txt", i % 500, i);
+}
+
+static void shard_list(int shards, char *out, size_t size) {
+    size_t len = 0;
+    out[0] = '\0';
+    for (int s = 0; s < shards && len < size; s++) {
+        len += (size_t)snprintf(out + len, size - len, "%s127.0.0.1:%d", s ? "," : "", BASE_PORT + s);
+    }
+}
+
+/* Each shard imports only its own files, as if clients had created them there */
+static int write_imports(const ShardMap *map) {
+    FILE *out[SHARD_MAX];
+    for (int s = 0; s < map->count; s++) {
+        char path[64];
+        snprintf(path, sizeof(path), "shard-%d.json", s);
+        out[s] = fopen(path, "w");
+        if (!out[s]) {
+            return -1;
+        }
+        fprintf(out[s], "{\"users\": [\"bench\"], \"files\": {");
+    }
+
+    int first[SHARD_MAX];
+    for (int s = 0; s < map->count; s++) {
+        first[s] = 1;
+    }
+    for (int i = 0; i < FILES; i++) {
+        char name[64];
+        file_name(i, name, sizeof(name));
+        int s = shard_map_owner(map, name);
+        /* port 1 refuses at once, so the stats refresher never waits on it */
+        fprintf(out[s], "%s\n\"%s\": {\"owner\": \"bench\", \"ss_ip\": \"127.0.0.1\", \"ss_port\": 1}",
+                first[s] ? "" : ",", name);
+        first[s] = 0;
+    }
+
+    int rc = 0;
+    for (int s = 0; s < map->count; s++) {
+        fprintf(out[s], "\n}}\n");
+        if (fclose(out[s]) != 0) {
+            rc = -1;
+        }
+    }
+    return rc;
+}
+
+static int connect_port(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return fd;
+}
+
+static pid_t start_shard(const char *nm_path, const char *list, int index) {
+    pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+
+    int devnull = open("/dev/null", O_RDWR);
+    if (devnull >= 0) {
+        dup2(devnull, STDIN_FILENO);
+        dup2(devnull, STDOUT_FILENO);
+        dup2(devnull, STDERR_FILENO);
+    }
+    char shards_arg[1100];
+    char index_arg[32];
+    char import_arg[64];
+    snprintf(shards_arg, sizeof(shards_arg), "--shards=%s", list);
+    snprintf(index_arg, sizeof(index_arg), "--shard-index=%d", index);
+    snprintf(import_arg, sizeof(import_arg), "--import-json=shard-%d.json", index);
+    execl(nm_path, "nm", shards_arg, index_arg, import_arg, "--workers=1", (char *)NULL);
+    _exit(127);
+}
+
+static int wait_ready(int port) {
+    for (int attempt = 0; attempt < 500; attempt++) {
+        int fd = connect_port(port);
+        if (fd >= 0) {
+            close(fd);
+            return 0;
+        }
+        usleep(10000);
+    }
+    return -1;
+}
+
+/* utime + stime of a process, in seconds */
+static double process_cpu(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return 0.0;
+    }
+    char line[1024];
+    size_t len = fread(line, 1, sizeof(line) - 1, fp);
+    fclose(fp);
+    line[len] = '\0';
+
+    const char *rest = strrchr(line, ')');
+    unsigned long utime = 0;
+    unsigned long stime = 0;
+    if (!rest || sscanf(rest + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                        &utime, &stime) != 2) {
+        return 0.0;
+    }
+    return (double)(utime + stime) / (double)sysconf(_SC_CLK_TCK);
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Reads replies until expected lines have arrived, counting the OK ones */
+static int read_replies(int fd, char *buf, size_t cap, size_t *held, int expected, long *ok) {
+    while (expected > 0) {
+        char *nl;
+        while (expected > 0 && (nl = memchr(buf, '\n', *held)) != NULL) {
+            *nl = '\0';
+            if (strstr(buf, "\"status\":\"OK\"")) {
+                (*ok)++;
+            }
+            size_t line = (size_t)(nl - buf) + 1;
+            memmove(buf, buf + line, *held - line);
+            *held -= line;
+            expected--;
+        }
+        if (expected == 0) {
+            break;
+        }
+        ssize_t n = read(fd, buf + *held, cap - *held);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        *held += (size_t)n;
+    }
+    return 0;
+}
+
+static void run_loader(const ShardMap *map, long lookups, unsigned int seed, int result_fd) {
+    LoadResult result;
+    memset(&result, 0, sizeof(result));
+
+    int fds[SHARD_MAX];
+    for (int s = 0; s < map->count; s++) {
+        fds[s] = connect_port(map->shards[s].port);
+        if (fds[s] < 0) {
+            result.failed = lookups;
+            write_all(result_fd, (const char *)&result, sizeof(result));
+            _exit(1);
+        }
+    }
+
+    size_t cap = 64 * 1024;
+    char *requests[SHARD_MAX];
+    size_t request_len[SHARD_MAX];
+    int sent[SHARD_MAX];
+    char *replies[SHARD_MAX];
+    size_t held[SHARD_MAX];
+    for (int s = 0; s < map->count; s++) {
+        requests[s] = malloc(cap);
+        replies[s] = malloc(cap);
+        held[s] = 0;
+        if (!requests[s] || !replies[s]) {
+            _exit(1);
+        }
+    }
+
+    long req_id = 0;
+    long done = 0;
+    while (done < lookups) {
+        long round = (long)DEPTH * map->count;
+        if (round > lookups - done) {
+            round = lookups - done;
+        }
+        for (int s = 0; s < map->count; s++) {
+            request_len[s] = 0;
+            sent[s] = 0;
+        }
+        for (long r = 0; r < round; r++) {
+            char name[64];
+            file_name((int)(rand_r(&seed) % FILES), name, sizeof(name));
+            int s = shard_map_owner(map, name);
+            request_len[s] += (size_t)snprintf(requests[s] + request_len[s], cap - request_len[s],
+                                               "{\"req_id\":%ld,\"cmd\":\"READ\",\"username\":\"bench\","
+                                               "\"filename\":\"%s\"}\n", ++req_id, name);
+            sent[s]++;
+        }
+        for (int s = 0; s < map->count; s++) {
+            if (sent[s] > 0 && write_all(fds[s], requests[s], request_len[s]) != 0) {
+                _exit(1);
+            }
+        }
+        for (int s = 0; s < map->count; s++) {
+            long ok = 0;
+            if (sent[s] > 0 && read_replies(fds[s], replies[s], cap, &held[s], sent[s], &ok) != 0) {
+                _exit(1);
+            }
+            result.ok += ok;
+            result.failed += sent[s] - ok;
+            result.per_shard[s] += sent[s];
+        }
+        done += round;
+    }
+
+    write_all(result_fd, (const char *)&result, sizeof(result));
+    _exit(0);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+int main(int argc, char *argv[]) {
+    int max_shards = argc > 1 ? atoi(argv[1]) : 4;
+    long lookups = argc > 2 ? atol(argv[2]) : 200000;
+    if (max_shards <= 0 || max_shards >= SHARD_MAX || lookups <= 0) {
+        fprintf(stderr, "Usage: %s [max_shards < %d] [lookups]\n", argv[0], SHARD_MAX);
+        return 1;
+    }
+
+    /* the nm binary sits one directory above this one */
+    char self[PATH_MAX];
+    char nm_path[PATH_MAX + 8];
+    snprintf(self, sizeof(self), "%s", argv[0]);
+    snprintf(nm_path, sizeof(nm_path), "%s/../nm", dirname(self));
+    char *resolved = realpath(nm_path, NULL);
+    if (!resolved || access(resolved, X_OK) != 0) {
+        fprintf(stderr, "name server binary not found at %s; run make first\n", nm_path);
+        return 1;
+    }
+
+    char scratch[] = "/tmp/shard_bench.XXXXXX";
+    if (!mkdtemp(scratch) || chdir(scratch) != 0) {
+        perror("scratch directory");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%d files, %ld READ lookups per run, %d in flight per shard and loader; %ld cores\n\n",
+           FILES, lookups, DEPTH, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-7s %12s %10s %16s %10s %8s\n", "shards", "lookups/s", "NM cpu s", "lookups/cpu-s",
+           "busiest", "failed");
+
+    int status = 0;
+    for (int shards = 1; shards <= max_shards && status == 0; shards++) {
+        char list[1024];
+        ShardMap map;
+        shard_list(shards, list, sizeof(list));
+        if (shard_map_parse(&map, list) != 0 || write_imports(&map) != 0) {
+            fprintf(stderr, "could not set up %d shards\n", shards);
+            status = 1;
+            break;
+        }
+
+        pid_t nm_pids[SHARD_MAX];
+        double cpu_before[SHARD_MAX];
+        for (int s = 0; s < shards; s++) {
+            nm_pids[s] = start_shard(resolved, list, s);
+        }
+        for (int s = 0; s < shards; s++) {
+            if (wait_ready(map.shards[s].port) != 0) {
+                fprintf(stderr, "shard %d did not start (port %d in use?)\n", s, map.shards[s].port);
+                status = 1;
+            }
+            cpu_before[s] = process_cpu(nm_pids[s]);
+        }
+
+        LoadResult total;
+        memset(&total, 0, sizeof(total));
+        double elapsed = 0.0;
+        if (status == 0) {
+            int pipe_fds[2];
+            if (pipe(pipe_fds) != 0) {
+                perror("pipe");
+                return 1;
+            }
+            pid_t loaders[SHARD_MAX];
+            double start = now_seconds();
+            for (int l = 0; l < shards; l++) {
+                long share = lookups / shards + (l < lookups % shards ? 1 : 0);
+                loaders[l] = fork();
+                if (loaders[l] == 0) {
+                    close(pipe_fds[0]);
+                    run_loader(&map, share, 1234u + (unsigned int)l, pipe_fds[1]);
+                }
+            }
+            close(pipe_fds[1]);
+            LoadResult part;
+            while (read(pipe_fds[0], &part, sizeof(part)) == (ssize_t)sizeof(part)) {
+                total.ok += part.ok;
+                total.failed += part.failed;
+                for (int s = 0; s < shards; s++) {
+                    total.per_shard[s] += part.per_shard[s];
+                }
+            }
+            close(pipe_fds[0]);
+            for (int l = 0; l < shards; l++) {
+                waitpid(loaders[l], NULL, 0);
+            }
+            elapsed = now_seconds() - start;
+        }
+
+        double nm_cpu = 0.0;
+        long busiest = 0;
+        for (int s = 0; s < shards; s++) {
+            nm_cpu += process_cpu(nm_pids[s]) - cpu_before[s];
+            if (total.per_shard[s] > busiest) {
+                busiest = total.per_shard[s];
+            }
+            kill(nm_pids[s], SIGKILL);
+            waitpid(nm_pids[s], NULL, 0);
+        }
+        if (status != 0) {
+            break;
+        }
+
+        long answered = total.ok + total.failed;
+        printf("%-7d %12.0f %10.2f %16.0f %9.0f%% %8ld\n", shards, answered / elapsed, nm_cpu,
+               nm_cpu > 0 ? answered / nm_cpu : 0.0,
+               answered ? 100.0 * (double)busiest * shards / (double)answered - 100.0 : 0.0, total.failed);
+        if (total.failed > 0 || answered != lookups) {
+            fprintf(stderr, "%ld lookups failed or went unanswered\n", lookups - total.ok);
+            status = 1;
+        }
+    }
+
+    printf("\n%-10s %14s %8s\n", "shards", "names moved", "ideal");
+    for (int shards = 1; shards < max_shards && status == 0; shards++) {
+        char before_list[1024];
+        char after_list[1024];
+        ShardMap before;
+        ShardMap after;
+        shard_list(shards, before_list, sizeof(before_list));
+        shard_list(shards + 1, after_list, sizeof(after_list));
+        shard_map_parse(&before, before_list);
+        shard_map_parse(&after, after_list);
+
+        int moved = 0;
+        for (int i = 0; i < FILES; i++) {
+            char name[64];
+            file_name(i, name, sizeof(name));
+            moved += shard_map_owner(&before, name) != shard_map_owner(&after, name);
+        }
+        printf("%d -> %-5d %13.1f%% %7.1f%%\n", shards, shards + 1, 100.0 * moved / FILES,
+               100.0 / (shards + 1));
+    }
+
+    if (chdir("/") == 0) {
+        nftw(scratch, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+    free(resolved);
+    return status;
+}
@@ -0,0 +1,144 @@
+/*
+ * Startup load time of the name server metadata: JSON import versus the
+ * binary mmap snapshot, for growing namespaces.
+ *
+ *   ./name_server/bench/snapshot_bench [files ...]   (default 10000 100000 1000000)
+ */
+#include "nm_cache.h"
+#include "nm_file_table.h"
+#include "nm_metadata.h"
+#include "nm_snapshot.h"
+
+char BASE_DIR[1024] = ".";
+char LOG_DIR[1024];
+char METADATA_FILE[1024];
+char JOURNAL_FILE[1024];
+char SNAPSHOT_FILE[1024];
+
+Client clients[MAX_CLIENTS];
+StorageServer storage_servers[MAX_STORAGE_SERVERS];
+FileTable file_table;
+LRUCache file_cache;
+int client_count = 0;
+int ss_count = 0;
+pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t ss_mutex = PTHREAD_MUTEX_INITIALIZER;
+FILE *log_file = NULL;
+pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void release_file(FileMetadata *file) {
+    while (file->access_list) {
+        AccessEntry *next = file->access_list->next;
+        free(file->access_list);
+        file->access_list = next;
+    }
+    free(file);
+}
+
+static double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+static void populate(long count) {
+    time_t now = time(NULL);
+    for (long i = 0; i < count; i++) {
+        FileMetadata *file = calloc(1, sizeof(FileMetadata));
+        if (!file) {
+            fprintf(stderr, "out of memory at %ld files\n", i);
+            exit(1);
+        }
+        snprintf(file->filename, sizeof(file->filename), "project_%ld/notes_%ld.txt", i % 1000, i);
+        snprintf(file->owner, sizeof(file->owner), "user%ld", i % 50);
+        strcpy(file->ss_ip, "10.0.0.1");
+        file->ss_port = 9100 + (int)(i % 4);
+        strcpy(file->backup_ss_ip, "10.0.0.2");
+        file->backup_ss_port = 9101;
+        file->active = 1;
+        file->created_at = now - i;
+        file->last_modified = now;
+        file->last_accessed = now;
+        strcpy(file->last_accessed_by, file->owner);
+        file->words = (int)(i % 500);
+        file->chars = file->words * 6;
+        file->bytes = file->chars + 1;
+
+        for (int a = 0; a < 2; a++) {
+            AccessEntry *entry = calloc(1, sizeof(AccessEntry));
+            if (!entry) {
+                exit(1);
+            }
+            snprintf(entry->username, sizeof(entry->username), "user%ld", (i + a + 1) % 50);
+            strcpy(entry->mode, a ? "W" : "R");
+            entry->next = file->access_list;
+            file->access_list = entry;
+        }
+        file_table_insert(file);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    long default_sizes[] = {10000, 100000, 1000000};
+    int size_count = argc > 1 ? argc - 1 : 3;
+
+    char dir[] = "/tmp/nm_snapshot_benchXXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(METADATA_FILE, sizeof(METADATA_FILE), "%s/metadata_store.json", dir);
+    snprintf(SNAPSHOT_FILE, sizeof(SNAPSHOT_FILE), "%s/metadata_store.bin", dir);
+
+    file_table_init();
+    init_cache(0);
+    client_count = 10;
+    for (int i = 0; i < client_count; i++) {
+        snprintf(clients[i].username, sizeof(clients[i].username), "user%d", i);
+    }
+
+    printf("%10s %12s %12s %12s %12s %8s\n",
+           "files", "json bytes", "json load s", "snap bytes", "snap load s", "speedup");
+    for (int n = 0; n < size_count; n++) {
+        long count = argc > 1 ? atol(argv[n + 1]) : default_sizes[n];
+        if (count <= 0) {
+            continue;
+        }
+
+        populate(count);
+        if (!export_metadata_json(METADATA_FILE) || !save_metadata()) {
+            fprintf(stderr, "failed to write test stores in %s\n", dir);
+            return 1;
+        }
+        file_table_clear(release_file);
+
+        double start = now_seconds();
+        long json_loaded = import_metadata_json(METADATA_FILE);
+        double json_time = now_seconds() - start;
+        file_table_clear(release_file);
+
+        start = now_seconds();
+        long snap_loaded = snapshot_load(SNAPSHOT_FILE);
+        double snap_time = now_seconds() - start;
+        file_table_clear(release_file);
+
+        if (json_loaded != count || snap_loaded != count) {
+            fprintf(stderr, "load mismatch: json=%ld snapshot=%ld expected=%ld\n",
+                    json_loaded, snap_loaded, count);
+        }
+
+        printf("%10ld %12ld %12.3f %12ld %12.3f %7.1fx\n", count,
+               file_size(METADATA_FILE), json_time, file_size(SNAPSHOT_FILE), snap_time,
+               snap_time > 0 ? json_time / snap_time : 0.0);
+    }
+
+    unlink(METADATA_FILE);
+    unlink(SNAPSHOT_FILE);
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * Lookup throughput of the name server file table under concurrency.
+ *
+ * "global" reproduces the old layout: one chained table of 1000 buckets
+ * behind a single mutex. "sharded" is nm_file_table.c. Each thread performs
+ * a 95/5 mix of lookups and metadata updates over a shared set of files.
+ *
+ *   ./name_server/bench/table_bench [files] [ops_per_thread] [max_threads]
+ */
+#include "nm_file_table.h"
+
+#include <sys/time.h>
+
+#define GLOBAL_BUCKETS 1000
+
+FileTable file_table;
+
+static HashNode *global_buckets[GLOBAL_BUCKETS];
+static pthread_mutex_t global_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static FileMetadata *global_find(const char *filename) {
+    unsigned int index = file_table_hash(filename) % GLOBAL_BUCKETS;
+    for (HashNode *node = global_buckets[index]; node; node = node->next) {
+        if (strcmp(node->key, filename) == 0 && node->file->active) {
+            return node->file;
+        }
+    }
+    return NULL;
+}
+
+static void global_insert(FileMetadata *file) {
+    unsigned int index = file_table_hash(file->filename) % GLOBAL_BUCKETS;
+    HashNode *node = malloc(sizeof(HashNode));
+    if (!node) {
+        return;
+    }
+    strncpy(node->key, file->filename, sizeof(node->key) - 1);
+    node->key[sizeof(node->key) - 1] = '\0';
+    node->file = file;
+    node->next = global_buckets[index];
+    global_buckets[index] = node;
+}
+
+typedef struct {
+    int sharded;
+    int file_count;
+    long ops;
+    unsigned int seed;
+    long found;
+} BenchThread;
+
+static void make_name(char *buf, size_t size, int i) {
+    snprintf(buf, size, "dir%d/file_%d.txt", i % 97, i);
+}
+
+static void *bench_worker(void *arg) {
+    BenchThread *t = arg;
+    char name[MAX_FILENAME];
+
+    for (long i = 0; i < t->ops; i++) {
+        int idx = (int)(rand_r(&t->seed) % (unsigned int)t->file_count);
+        int is_write = (rand_r(&t->seed) % 100) < 5;
+        make_name(name, sizeof(name), idx);
+
+        if (t->sharded) {
+            if (is_write) {
+                file_table_wrlock(name);
+            } else {
+                file_table_rdlock(name);
+            }
+            FileMetadata *file = file_table_find(name);
+            if (file) {
+                t->found++;
+                if (is_write) {
+                    file->last_accessed++;
+                }
+            }
+            file_table_unlock(name);
+        } else {
+            pthread_mutex_lock(&global_mutex);
+            FileMetadata *file = global_find(name);
+            if (file) {
+                t->found++;
+                if (is_write) {
+                    file->last_accessed++;
+                }
+            }
+            pthread_mutex_unlock(&global_mutex);
+        }
+    }
+    return NULL;
+}
+
+static double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static double run(int sharded, int threads, int file_count, long ops) {
+    pthread_t tids[threads];
+    BenchThread args[threads];
+
+    double start = now_seconds();
+    for (int i = 0; i < threads; i++) {
+        args[i].sharded = sharded;
+        args[i].file_count = file_count;
+        args[i].ops = ops;
+        args[i].seed = (unsigned int)(i * 7919 + 1);
+        args[i].found = 0;
+        pthread_create(&tids[i], NULL, bench_worker, &args[i]);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    double elapsed = now_seconds() - start;
+
+    for (int i = 0; i < threads; i++) {
+        if (args[i].found != ops) {
+            fprintf(stderr, "lookup miss in %s table\n", sharded ? "sharded" : "global");
+        }
+    }
+    return (double)threads * (double)ops / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    int file_count = argc > 1 ? atoi(argv[1]) : 100000;
+    long ops = argc > 2 ? atol(argv[2]) : 500000;
+    int max_threads = argc > 3 ? atoi(argv[3]) : 16;
+    if (file_count <= 0 || ops <= 0 || max_threads <= 0) {
+        fprintf(stderr, "Usage: %s [files] [ops_per_thread] [max_threads]\n", argv[0]);
+        return 1;
+    }
+
+    file_table_init();
+    for (int i = 0; i < file_count; i++) {
+        FileMetadata *file = calloc(1, sizeof(FileMetadata));
+        if (!file) {
+            return 1;
+        }
+        make_name(file->filename, sizeof(file->filename), i);
+        file->active = 1;
+        global_insert(file);
+        file_table_insert(file);
+    }
+
+    printf("%d files, %ld ops/thread, 95%% lookups / 5%% updates\n", file_count, ops);
+    printf("%8s %16s %16s %8s\n", "threads", "global ops/s", "sharded ops/s", "speedup");
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double global_rate = run(0, threads, file_count, ops);
+        double sharded_rate = run(1, threads, file_count, ops);
+        printf("%8d %16.0f %16.0f %7.2fx\n", threads, global_rate, sharded_rate,
+               sharded_rate / global_rate);
+    }
+    return 0;
+}
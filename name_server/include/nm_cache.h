@@ -3,9 +3,19 @@
 
 #include "nm_common.h"
 
-void init_cache(void);
+typedef struct {
+    int capacity;
+    int size;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+} CacheStats;
+
+void init_cache(int capacity);
+void cache_set_capacity(int capacity);
 FileMetadata *cache_get(const char *filename);
 void cache_put(const char *filename, FileMetadata *file);
 void cache_remove(const char *filename);
+void cache_get_stats(CacheStats *stats);
 
 #endif /* NM_CACHE_H */
@@ -2,7 +2,7 @@
 #define NM_COMMON_H
 
 #ifndef _XOPEN_SOURCE
-#define _XOPEN_SOURCE
+#define _XOPEN_SOURCE 700
 #endif
 
 #include <arpa/inet.h>
@@ -21,32 +21,63 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "proto_json.h"
+#include "proto_shard.h"
+
 #define NM_PORT 9000
 #define MAX_CLIENTS 100
 #define MAX_STORAGE_SERVERS 10
-#define MAX_FILES 1000
 #define MAX_USERS 100
 #define BUFFER_SIZE 8192
 #define MAX_FILENAME 256
 #define MAX_USERNAME 64
 #define CACHE_SIZE 50
+#define CACHE_SHARDS 8
+#define FILE_TABLE_SHARDS 16
+#define FILE_TABLE_INITIAL_BUCKETS 64
+#define NM_DEFAULT_WORKERS 8
+#define NM_WORK_QUEUE_SIZE 1024
+#define NM_MAX_EVENTS 64
+#define NM_JOURNAL_FLUSH_MS 20
+#define NM_JOURNAL_BATCH_BYTES (64 * 1024)
+#define NM_JOURNAL_COMPACT_BYTES (4 * 1024 * 1024)
+#define NM_MAX_REQUEST (1024 * 1024)
+#define NM_STATS_REFRESH_MS 1000
+#define NM_STATS_STALE_SECS 30
+#define NM_STATS_BATCH_BYTES 3072
+#define NM_STATS_TIMEOUT_SECS 2
+#define NM_SS_HEARTBEAT_TIMEOUT_SECS 3
+#define NM_SS_HEALTH_CHECK_MS 500
 
 /* Forward declarations */
 typedef struct FileMetadata FileMetadata;
 
 typedef struct CacheNode {
     char filename[MAX_FILENAME];
+    unsigned int hash;
     FileMetadata *file;
     struct CacheNode *prev;
     struct CacheNode *next;
+    struct CacheNode *chain;
     time_t last_access;
 } CacheNode;
 
 typedef struct {
     CacheNode *head;
     CacheNode *tail;
+    CacheNode **buckets;
+    size_t bucket_count;
     int size;
+    int capacity;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
     pthread_mutex_t mutex;
+} CacheShard;
+
+typedef struct {
+    CacheShard shards[CACHE_SHARDS];
+    int capacity;
 } LRUCache;
 
 typedef struct {
@@ -66,6 +97,7 @@ typedef struct {
     char **files;
     int file_count;
     time_t connected_at;
+    time_t last_heartbeat;
 } StorageServer;
 
 typedef struct AccessEntry {
@@ -90,30 +122,48 @@ struct FileMetadata {
     int words;
     int chars;
     int bytes;
+    time_t stats_refreshed;
 };
 
 typedef struct HashNode {
     char key[MAX_FILENAME];
+    unsigned int hash;
     FileMetadata *file;
     struct HashNode *next;
 } HashNode;
 
+typedef struct {
+    HashNode **buckets;
+    size_t bucket_count;
+    size_t entry_count;
+    pthread_rwlock_t lock;
+} FileTableShard;
+
+typedef struct {
+    FileTableShard shards[FILE_TABLE_SHARDS];
+} FileTable;
+
 extern char BASE_DIR[1024];
 extern char LOG_DIR[1024];
 extern char METADATA_FILE[1024];
+extern char JOURNAL_FILE[1024];
+extern char SNAPSHOT_FILE[1024];
 
 extern Client clients[MAX_CLIENTS];
 extern StorageServer storage_servers[MAX_STORAGE_SERVERS];
-extern HashNode *file_hash_table[MAX_FILES];
+extern FileTable file_table;
 extern LRUCache file_cache;
 extern int client_count;
 extern int ss_count;
 extern pthread_mutex_t clients_mutex;
 extern pthread_mutex_t ss_mutex;
-extern pthread_mutex_t files_mutex;
 extern FILE *log_file;
 extern pthread_mutex_t log_mutex;
 
-void init_name_server(void);
+/* Empty unless started with --shards; shard_self is this server's index */
+extern ShardMap shard_map;
+extern int shard_self;
+
+void init_name_server(int cache_capacity, const char *import_json);
 
 #endif /* NM_COMMON_H */
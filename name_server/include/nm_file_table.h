@@ -0,0 +1,24 @@
+#ifndef NM_FILE_TABLE_H
+#define NM_FILE_TABLE_H
+
+#include "nm_common.h"
+
+typedef int (*FileTableVisitor)(FileMetadata *file, void *arg);
+
+void file_table_init(void);
+unsigned int file_table_hash(const char *filename);
+
+/* Lock the shard that owns filename. Lookups and inserts require it held. */
+void file_table_rdlock(const char *filename);
+void file_table_wrlock(const char *filename);
+void file_table_unlock(const char *filename);
+
+FileMetadata *file_table_find(const char *filename);
+int file_table_insert(FileMetadata *file);
+size_t file_table_count(void);
+void file_table_clear(void (*release)(FileMetadata *file));
+
+/* Visit every entry shard by shard; the visitor returns 0 to stop early. */
+int file_table_foreach(FileTableVisitor visitor, void *arg, int exclusive);
+
+#endif /* NM_FILE_TABLE_H */
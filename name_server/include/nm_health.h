@@ -0,0 +1,24 @@
+#ifndef NM_HEALTH_H
+#define NM_HEALTH_H
+
+#include "nm_common.h"
+
+/*
+ * Storage-server failure detector. Every message on an SS control session
+ * counts as a heartbeat; a background thread marks servers inactive once
+ * nothing has arrived for NM_SS_HEARTBEAT_TIMEOUT_SECS, and routing reads
+ * StorageServer.active instead of probing with a connect().
+ */
+int health_start(void);
+time_t health_now(void);
+
+/* Index of the registered server matching the sender, or -1. Call with ss_mutex held. */
+int health_find_ss(const char *advertised_ip, const char *observed_ip, int client_port);
+
+/* Record a heartbeat for storage_servers[index]. Call with ss_mutex held. */
+void health_heartbeat(int index);
+
+/* 0 only when the server is registered and known to be down. */
+int health_ss_alive(const char *ip, int client_port);
+
+#endif /* NM_HEALTH_H */
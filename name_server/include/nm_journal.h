@@ -0,0 +1,22 @@
+#ifndef NM_JOURNAL_H
+#define NM_JOURNAL_H
+
+#include "nm_common.h"
+
+/*
+ * Append-only metadata journal. Every mutation is logged as one JSON line;
+ * a background thread writes and fsyncs the pending lines in batches and
+ * folds the journal into a fresh snapshot once it grows past
+ * NM_JOURNAL_COMPACT_BYTES.
+ */
+void journal_replay(void);
+int journal_start(void);
+/* Drop the journal and any unfinished checkpoint's .old; startup only. */
+void journal_discard(void);
+
+/* Call with the file's shard write lock held so records stay in order. */
+void journal_log_file(const FileMetadata *file);
+void journal_log_delete(const char *filename);
+void journal_log_user(const char *username);
+
+#endif /* NM_JOURNAL_H */
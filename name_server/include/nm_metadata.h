@@ -6,11 +6,11 @@
 FileMetadata *lookup_file(const char *filename);
 void insert_file(FileMetadata *file);
 int check_access(FileMetadata *file, const char *username, const char *required_mode);
-void save_metadata(void);
-void load_metadata(void);
-void parse_json_string(const char *json, const char *key, char *value, int max_len);
-int parse_json_int(const char *json, const char *key);
-int request_file_stats(const char *ip, int port, const char *filename,
-                       int *words, int *chars, int *bytes);
+int save_metadata(void);
+int load_metadata(const char *import_json);
+int export_metadata_json(const char *path);
+long import_metadata_json(const char *path);
+void metadata_write_entry(FILE *fp, const FileMetadata *file);
+FileMetadata *metadata_parse_entry(const char *filename, const char *entry, size_t len);
 
 #endif /* NM_METADATA_H */
@@ -3,8 +3,42 @@
 
 #include "nm_common.h"
 
+/*
+ * One accepted socket. A connection stays one-shot (serve one request, then
+ * close) unless the peer tags its requests with "req_id", which turns it into
+ * a persistent session with newline-delimited framing.
+ */
+typedef struct NmConn {
+    int fd;
+    char ip[INET_ADDRSTRLEN];
+    int port;
+    int session;
+    int refs;
+    char *rbuf;
+    size_t rlen;
+    size_t rcap;
+    pthread_mutex_t mutex;
+    pthread_mutex_t write_mutex;
+} NmConn;
+
+typedef struct {
+    NmConn *conn;
+    int tagged;
+    long req_id;
+} NmRequestContext;
+
+NmConn *conn_create(int fd);
+void conn_retain(NmConn *conn);
+void conn_release(NmConn *conn);
+int conn_fill(NmConn *conn);
+char *conn_next_request(NmConn *conn);
+/* Serves one request; returns nonzero if it was tagged with a req_id */
+int conn_handle_request(NmConn *conn, const char *request);
+int request_is_tagged(const char *request);
+
 void *handle_connection(void *arg);
+void serve_connection(int socket_fd);
+void dispatch_request(int socket_fd, const JsonMessage *request, const char *client_ip, int client_port);
 void send_response(int fd, const char *response);
-char *read_request(int fd);
 
 #endif /* NM_NETWORK_H */
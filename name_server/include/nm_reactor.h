@@ -0,0 +1,14 @@
+#ifndef NM_REACTOR_H
+#define NM_REACTOR_H
+
+#include "nm_common.h"
+
+typedef enum {
+    NM_MODE_THREADED = 0,
+    NM_MODE_EPOLL
+} NmServeMode;
+
+int run_threaded_server(int server_fd);
+int run_epoll_server(int server_fd, int worker_count);
+
+#endif /* NM_REACTOR_H */
@@ -0,0 +1,53 @@
+#ifndef NM_SNAPSHOT_H
+#define NM_SNAPSHOT_H
+
+#include "nm_common.h"
+
+#include <stdint.h>
+
+#define SNAPSHOT_MAGIC "NMSNAP\0\0"
+#define SNAPSHOT_VERSION 1
+
+/*
+ * Binary metadata snapshot:
+ *   SnapshotHeader
+ *   users:  [u8 len][name] * user_count
+ *   files:  [SnapshotFileRecord][filename][owner][ss_ip][backup_ss_ip]
+ *           [last_accessed_by] then access_count * [u8 user_len][u8 mode_len][user][mode]
+ * All integers are host byte order; the checksum is FNV-1a over everything
+ * after the header.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t user_count;
+    uint64_t file_count;
+    uint64_t payload_bytes;
+    uint64_t checksum;
+} SnapshotHeader;
+
+typedef struct {
+    int64_t created_at;
+    int64_t last_modified;
+    int64_t last_accessed;
+    int32_t ss_port;
+    int32_t backup_ss_port;
+    int32_t words;
+    int32_t chars;
+    int32_t bytes;
+    uint16_t filename_len;
+    uint16_t owner_len;
+    uint16_t ss_ip_len;
+    uint16_t backup_ss_ip_len;
+    uint16_t accessed_by_len;
+    uint16_t access_count;
+} SnapshotFileRecord;
+
+/* snapshot_load failures: no snapshot yet, or one that cannot be trusted */
+#define SNAPSHOT_MISSING -1
+#define SNAPSHOT_INVALID -2
+
+int snapshot_save(const char *path);
+long snapshot_load(const char *path);
+
+#endif /* NM_SNAPSHOT_H */
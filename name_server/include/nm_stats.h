@@ -0,0 +1,23 @@
+#ifndef NM_STATS_H
+#define NM_STATS_H
+
+#include "nm_common.h"
+
+/*
+ * Word/char/byte counts are served from FileMetadata. Storage servers push
+ * new counts over their control session on every commit, undo and create;
+ * as a fallback, counts older than NM_STATS_STALE_SECS are refreshed in the
+ * background with one STAT_BATCH request per storage server.
+ */
+int stats_start(void);
+
+/* Apply an SS_STATS push from ss_ip:ss_port; stats is its "stats" array. */
+int stats_apply_push(const char *ss_ip, int ss_port, const char *stats);
+
+/* Call with the file's shard lock held. */
+int stats_is_stale(const FileMetadata *file, time_t now);
+
+/* Wake the refresher early; never blocks on the network. */
+void stats_request_refresh(void);
+
+#endif /* NM_STATS_H */
@@ -1,37 +1,165 @@
 #include "nm_cache.h"
+#include "nm_file_table.h"
 #include "nm_logging.h"
 
-static void move_to_front(CacheNode *node) {
-    if (!node || node == file_cache.head) {
-        return;
-    }
+/*
+ * The cache is split into CACHE_SHARDS independent LRUs. Each shard keeps a
+ * hash index over its nodes for O(1) lookup and a doubly linked recency list
+ * for O(1) promotion and eviction, all under one short-lived shard mutex.
+ */
 
+static CacheShard *shard_for_hash(unsigned int hash) {
+    return &file_cache.shards[hash % CACHE_SHARDS];
+}
+
+static CacheNode **bucket_for(CacheShard *shard, unsigned int hash) {
+    return &shard->buckets[(hash / CACHE_SHARDS) & (shard->bucket_count - 1)];
+}
+
+/* Every shard gets an equal slice, so the total rounds up to a multiple of CACHE_SHARDS. */
+static int shard_capacity(int capacity) {
+    return (capacity + CACHE_SHARDS - 1) / CACHE_SHARDS;
+}
+
+static void list_unlink(CacheShard *shard, CacheNode *node) {
     if (node->prev) {
         node->prev->next = node->next;
+    } else {
+        shard->head = node->next;
     }
     if (node->next) {
         node->next->prev = node->prev;
+    } else {
+        shard->tail = node->prev;
     }
-    if (node == file_cache.tail) {
-        file_cache.tail = node->prev;
-    }
+    node->prev = NULL;
+    node->next = NULL;
+}
 
+static void list_push_front(CacheShard *shard, CacheNode *node) {
     node->prev = NULL;
-    node->next = file_cache.head;
-    if (file_cache.head) {
-        file_cache.head->prev = node;
+    node->next = shard->head;
+    if (shard->head) {
+        shard->head->prev = node;
+    }
+    shard->head = node;
+    if (!shard->tail) {
+        shard->tail = node;
+    }
+}
+
+static void move_to_front(CacheShard *shard, CacheNode *node) {
+    if (node == shard->head) {
+        return;
+    }
+    list_unlink(shard, node);
+    list_push_front(shard, node);
+}
+
+static CacheNode *index_find(CacheShard *shard, const char *filename, unsigned int hash) {
+    CacheNode *node = *bucket_for(shard, hash);
+    while (node) {
+        if (node->hash == hash && strcmp(node->filename, filename) == 0) {
+            return node;
+        }
+        node = node->chain;
+    }
+    return NULL;
+}
+
+static void index_remove(CacheShard *shard, CacheNode *node) {
+    CacheNode **indirect = bucket_for(shard, node->hash);
+    while (*indirect) {
+        if (*indirect == node) {
+            *indirect = node->chain;
+            return;
+        }
+        indirect = &(*indirect)->chain;
+    }
+}
+
+static void shard_detach(CacheShard *shard, CacheNode *node) {
+    index_remove(shard, node);
+    list_unlink(shard, node);
+    shard->size--;
+}
+
+/* Rebuild the bucket index for a new capacity; caller holds shard->mutex. */
+static int shard_resize_index(CacheShard *shard, int capacity) {
+    size_t bucket_count = 8;
+    while (bucket_count < (size_t)capacity) {
+        bucket_count *= 2;
+    }
+    if (bucket_count == shard->bucket_count) {
+        return 1;
+    }
+
+    CacheNode **buckets = calloc(bucket_count, sizeof(CacheNode *));
+    if (!buckets) {
+        return 0;
     }
-    file_cache.head = node;
-    if (!file_cache.tail) {
-        file_cache.tail = node;
+
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->bucket_count = bucket_count;
+    for (CacheNode *node = shard->head; node; node = node->next) {
+        CacheNode **bucket = bucket_for(shard, node->hash);
+        node->chain = *bucket;
+        *bucket = node;
     }
+    return 1;
 }
 
-void init_cache(void) {
-    file_cache.head = NULL;
-    file_cache.tail = NULL;
-    file_cache.size = 0;
-    pthread_mutex_init(&file_cache.mutex, NULL);
+/* Drop LRU entries until the shard fits; returns how many were dropped. */
+static int shard_trim(CacheShard *shard, char *last_evicted, size_t last_size) {
+    int evicted = 0;
+    while (shard->size > shard->capacity && shard->tail) {
+        CacheNode *lru = shard->tail;
+        shard_detach(shard, lru);
+        if (last_evicted) {
+            snprintf(last_evicted, last_size, "%s", lru->filename);
+        }
+        free(lru);
+        shard->evictions++;
+        evicted++;
+    }
+    return evicted;
+}
+
+void init_cache(int capacity) {
+    if (capacity < 0) {
+        capacity = 0;
+    }
+    file_cache.capacity = shard_capacity(capacity) * CACHE_SHARDS;
+
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &file_cache.shards[i];
+        memset(shard, 0, sizeof(*shard));
+        shard->capacity = shard_capacity(capacity);
+        pthread_mutex_init(&shard->mutex, NULL);
+        shard_resize_index(shard, shard->capacity);
+    }
+}
+
+void cache_set_capacity(int capacity) {
+    if (capacity < 0) {
+        capacity = 0;
+    }
+
+    int evicted = 0;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &file_cache.shards[i];
+        pthread_mutex_lock(&shard->mutex);
+        shard->capacity = shard_capacity(capacity);
+        evicted += shard_trim(shard, NULL, 0);
+        shard_resize_index(shard, shard->capacity);
+        pthread_mutex_unlock(&shard->mutex);
+    }
+    file_cache.capacity = shard_capacity(capacity) * CACHE_SHARDS;
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "Cache capacity set to %d (%d evicted)", file_cache.capacity, evicted);
+    log_message("INFO", log_msg, "0.0.0.0", 0, "cache");
 }
 
 FileMetadata *cache_get(const char *filename) {
@@ -39,22 +167,23 @@ FileMetadata *cache_get(const char *filename) {
         return NULL;
     }
 
-    pthread_mutex_lock(&file_cache.mutex);
+    unsigned int hash = file_table_hash(filename);
+    CacheShard *shard = shard_for_hash(hash);
+    pthread_mutex_lock(&shard->mutex);
 
-    CacheNode *current = file_cache.head;
-    while (current) {
-        if (strcmp(current->filename, filename) == 0) {
-            current->last_access = time(NULL);
-            move_to_front(current);
-            FileMetadata *result = current->file;
-            pthread_mutex_unlock(&file_cache.mutex);
-            return result;
-        }
-        current = current->next;
+    CacheNode *node = shard->bucket_count ? index_find(shard, filename, hash) : NULL;
+    if (!node) {
+        shard->misses++;
+        pthread_mutex_unlock(&shard->mutex);
+        return NULL;
     }
 
-    pthread_mutex_unlock(&file_cache.mutex);
-    return NULL;
+    shard->hits++;
+    node->last_access = time(NULL);
+    move_to_front(shard, node);
+    FileMetadata *result = node->file;
+    pthread_mutex_unlock(&shard->mutex);
+    return result;
 }
 
 void cache_put(const char *filename, FileMetadata *file) {
@@ -62,60 +191,51 @@ void cache_put(const char *filename, FileMetadata *file) {
         return;
     }
 
-    pthread_mutex_lock(&file_cache.mutex);
+    unsigned int hash = file_table_hash(filename);
+    CacheShard *shard = shard_for_hash(hash);
+    pthread_mutex_lock(&shard->mutex);
 
-    CacheNode *current = file_cache.head;
-    while (current) {
-        if (strcmp(current->filename, filename) == 0) {
-            current->file = file;
-            current->last_access = time(NULL);
-            move_to_front(current);
-            pthread_mutex_unlock(&file_cache.mutex);
-            return;
-        }
-        current = current->next;
+    if (shard->capacity == 0 || shard->bucket_count == 0) {
+        pthread_mutex_unlock(&shard->mutex);
+        return;
     }
 
-    CacheNode *new_node = malloc(sizeof(CacheNode));
-    if (!new_node) {
-        pthread_mutex_unlock(&file_cache.mutex);
+    CacheNode *node = index_find(shard, filename, hash);
+    if (node) {
+        node->file = file;
+        node->last_access = time(NULL);
+        move_to_front(shard, node);
+        pthread_mutex_unlock(&shard->mutex);
         return;
     }
 
-    strncpy(new_node->filename, filename, sizeof(new_node->filename) - 1);
-    new_node->filename[sizeof(new_node->filename) - 1] = '\0';
-    new_node->file = file;
-    new_node->last_access = time(NULL);
-    new_node->prev = NULL;
-    new_node->next = file_cache.head;
-
-    if (file_cache.head) {
-        file_cache.head->prev = new_node;
-    }
-    file_cache.head = new_node;
-    if (!file_cache.tail) {
-        file_cache.tail = new_node;
+    node = malloc(sizeof(CacheNode));
+    if (!node) {
+        pthread_mutex_unlock(&shard->mutex);
+        return;
     }
 
-    file_cache.size++;
+    strncpy(node->filename, filename, sizeof(node->filename) - 1);
+    node->filename[sizeof(node->filename) - 1] = '\0';
+    node->hash = hash;
+    node->file = file;
+    node->last_access = time(NULL);
 
-    if (file_cache.size > CACHE_SIZE) {
-        CacheNode *lru = file_cache.tail;
-        if (lru) {
-            if (lru->prev) {
-                lru->prev->next = NULL;
-            }
-            file_cache.tail = lru->prev;
+    CacheNode **bucket = bucket_for(shard, hash);
+    node->chain = *bucket;
+    *bucket = node;
+    list_push_front(shard, node);
+    shard->size++;
 
-            char log_msg[512];
-            snprintf(log_msg, sizeof(log_msg), "Cache evicted (LRU): %s", lru->filename);
-            log_message("INFO", log_msg, "0.0.0.0", 0, "cache");
-            free(lru);
-            file_cache.size--;
-        }
-    }
+    char evicted_name[MAX_FILENAME];
+    int evicted = shard_trim(shard, evicted_name, sizeof(evicted_name));
+    pthread_mutex_unlock(&shard->mutex);
 
-    pthread_mutex_unlock(&file_cache.mutex);
+    if (evicted) {
+        char log_msg[512];
+        snprintf(log_msg, sizeof(log_msg), "Cache evicted (LRU): %s", evicted_name);
+        log_message("INFO", log_msg, "0.0.0.0", 0, "cache");
+    }
 }
 
 void cache_remove(const char *filename) {
@@ -123,29 +243,33 @@ void cache_remove(const char *filename) {
         return;
     }
 
-    pthread_mutex_lock(&file_cache.mutex);
-
-    CacheNode *current = file_cache.head;
-    while (current) {
-        if (strcmp(current->filename, filename) == 0) {
-            if (current->prev) {
-                current->prev->next = current->next;
-            }
-            if (current->next) {
-                current->next->prev = current->prev;
-            }
-            if (current == file_cache.head) {
-                file_cache.head = current->next;
-            }
-            if (current == file_cache.tail) {
-                file_cache.tail = current->prev;
-            }
-            free(current);
-            file_cache.size--;
-            break;
-        }
-        current = current->next;
+    unsigned int hash = file_table_hash(filename);
+    CacheShard *shard = shard_for_hash(hash);
+    pthread_mutex_lock(&shard->mutex);
+
+    CacheNode *node = shard->bucket_count ? index_find(shard, filename, hash) : NULL;
+    if (node) {
+        shard_detach(shard, node);
+        free(node);
+    }
+
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+void cache_get_stats(CacheStats *stats) {
+    if (!stats) {
+        return;
     }
 
-    pthread_mutex_unlock(&file_cache.mutex);
+    memset(stats, 0, sizeof(*stats));
+    stats->capacity = file_cache.capacity;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &file_cache.shards[i];
+        pthread_mutex_lock(&shard->mutex);
+        stats->size += shard->size;
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->evictions += shard->evictions;
+        pthread_mutex_unlock(&shard->mutex);
+    }
 }
@@ -0,0 +1,189 @@
+#include "nm_file_table.h"
+
+/*
+ * The file table is split into FILE_TABLE_SHARDS independent chained hash
+ * tables, each behind its own rwlock. The low bits of the hash pick the
+ * shard and the remaining bits pick the bucket, so a shard can double its
+ * bucket array without touching the others.
+ */
+
+static FileTableShard *shard_for_hash(unsigned int hash) {
+    return &file_table.shards[hash % FILE_TABLE_SHARDS];
+}
+
+static size_t bucket_for_hash(const FileTableShard *shard, unsigned int hash) {
+    return (hash / FILE_TABLE_SHARDS) & (shard->bucket_count - 1);
+}
+
+unsigned int file_table_hash(const char *filename) {
+    unsigned int hash = 5381;
+    int c;
+    while (filename && (c = *filename++)) {
+        hash = ((hash << 5) + hash) + (unsigned int)c;
+    }
+    return hash;
+}
+
+void file_table_init(void) {
+    for (int i = 0; i < FILE_TABLE_SHARDS; i++) {
+        FileTableShard *shard = &file_table.shards[i];
+        shard->buckets = calloc(FILE_TABLE_INITIAL_BUCKETS, sizeof(HashNode *));
+        shard->bucket_count = shard->buckets ? FILE_TABLE_INITIAL_BUCKETS : 0;
+        shard->entry_count = 0;
+        pthread_rwlock_init(&shard->lock, NULL);
+    }
+}
+
+void file_table_rdlock(const char *filename) {
+    pthread_rwlock_rdlock(&shard_for_hash(file_table_hash(filename))->lock);
+}
+
+void file_table_wrlock(const char *filename) {
+    pthread_rwlock_wrlock(&shard_for_hash(file_table_hash(filename))->lock);
+}
+
+void file_table_unlock(const char *filename) {
+    pthread_rwlock_unlock(&shard_for_hash(file_table_hash(filename))->lock);
+}
+
+FileMetadata *file_table_find(const char *filename) {
+    if (!filename) {
+        return NULL;
+    }
+
+    unsigned int hash = file_table_hash(filename);
+    FileTableShard *shard = shard_for_hash(hash);
+    if (shard->bucket_count == 0) {
+        return NULL;
+    }
+
+    HashNode *node = shard->buckets[bucket_for_hash(shard, hash)];
+    while (node) {
+        if (node->hash == hash && strcmp(node->key, filename) == 0 && node->file->active) {
+            return node->file;
+        }
+        node = node->next;
+    }
+    return NULL;
+}
+
+static void shard_grow(FileTableShard *shard) {
+    size_t new_count = shard->bucket_count * 2;
+    HashNode **new_buckets = calloc(new_count, sizeof(HashNode *));
+    if (!new_buckets) {
+        return;
+    }
+
+    size_t old_count = shard->bucket_count;
+    HashNode **old_buckets = shard->buckets;
+    shard->buckets = new_buckets;
+    shard->bucket_count = new_count;
+
+    for (size_t i = 0; i < old_count; i++) {
+        HashNode *node = old_buckets[i];
+        while (node) {
+            HashNode *next = node->next;
+            size_t index = bucket_for_hash(shard, node->hash);
+            node->next = new_buckets[index];
+            new_buckets[index] = node;
+            node = next;
+        }
+    }
+    free(old_buckets);
+}
+
+int file_table_insert(FileMetadata *file) {
+    if (!file) {
+        return 0;
+    }
+
+    unsigned int hash = file_table_hash(file->filename);
+    FileTableShard *shard = shard_for_hash(hash);
+    if (shard->bucket_count == 0) {
+        return 0;
+    }
+
+    HashNode *new_node = malloc(sizeof(HashNode));
+    if (!new_node) {
+        return 0;
+    }
+
+    strncpy(new_node->key, file->filename, sizeof(new_node->key) - 1);
+    new_node->key[sizeof(new_node->key) - 1] = '\0';
+    new_node->hash = hash;
+    new_node->file = file;
+
+    size_t index = bucket_for_hash(shard, hash);
+    new_node->next = shard->buckets[index];
+    shard->buckets[index] = new_node;
+    shard->entry_count++;
+
+    /* keep chains short: grow once the load factor passes 0.75 */
+    if (shard->entry_count * 4 > shard->bucket_count * 3) {
+        shard_grow(shard);
+    }
+    return 1;
+}
+
+size_t file_table_count(void) {
+    size_t total = 0;
+    for (int i = 0; i < FILE_TABLE_SHARDS; i++) {
+        FileTableShard *shard = &file_table.shards[i];
+        pthread_rwlock_rdlock(&shard->lock);
+        total += shard->entry_count;
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    return total;
+}
+
+int file_table_foreach(FileTableVisitor visitor, void *arg, int exclusive) {
+    if (!visitor) {
+        return 0;
+    }
+
+    for (int i = 0; i < FILE_TABLE_SHARDS; i++) {
+        FileTableShard *shard = &file_table.shards[i];
+        if (exclusive) {
+            pthread_rwlock_wrlock(&shard->lock);
+        } else {
+            pthread_rwlock_rdlock(&shard->lock);
+        }
+
+        for (size_t b = 0; b < shard->bucket_count; b++) {
+            for (HashNode *node = shard->buckets[b]; node; node = node->next) {
+                if (!node->file->active) {
+                    continue;
+                }
+                if (!visitor(node->file, arg)) {
+                    pthread_rwlock_unlock(&shard->lock);
+                    return 0;
+                }
+            }
+        }
+
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    return 1;
+}
+
+/* Drop every entry, handing each file to release; callers must be quiescent. */
+void file_table_clear(void (*release)(FileMetadata *file)) {
+    for (int i = 0; i < FILE_TABLE_SHARDS; i++) {
+        FileTableShard *shard = &file_table.shards[i];
+        pthread_rwlock_wrlock(&shard->lock);
+        for (size_t b = 0; b < shard->bucket_count; b++) {
+            HashNode *node = shard->buckets[b];
+            while (node) {
+                HashNode *next = node->next;
+                if (release) {
+                    release(node->file);
+                }
+                free(node);
+                node = next;
+            }
+            shard->buckets[b] = NULL;
+        }
+        shard->entry_count = 0;
+        pthread_rwlock_unlock(&shard->lock);
+    }
+}
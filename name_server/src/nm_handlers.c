@@ -1,8 +1,12 @@
 #include "nm_handlers.h"
 #include "nm_cache.h"
+#include "nm_file_table.h"
+#include "nm_health.h"
+#include "nm_journal.h"
 #include "nm_logging.h"
 #include "nm_metadata.h"
 #include "nm_network.h"
+#include "nm_stats.h"
 
 static int safe_append(char *dest, size_t dest_size, const char *src) {
     if (!dest || !src || dest_size == 0) {
@@ -19,9 +23,9 @@ static int safe_append(char *dest, size_t dest_size, const char *src) {
     return 1;
 }
 
-void handle_register_client(int client_fd, const char *request, const char *client_ip) {
+void handle_register_client(int client_fd, const JsonMessage *request, const char *client_ip) {
     char username[MAX_USERNAME] = {0};
-    parse_json_string(request, "username", username, sizeof(username));
+    json_field_string(request, "username", username, sizeof(username));
 
     pthread_mutex_lock(&clients_mutex);
 
@@ -53,6 +57,7 @@ void handle_register_client(int client_fd, const char *request, const char *clie
         clients[client_count].active = 1;
         clients[client_count].connected_at = time(NULL);
         client_count++;
+        journal_log_user(username);
 
         char log_msg[512];
         snprintf(log_msg, sizeof(log_msg), "Client registered: %s", username);
@@ -66,11 +71,39 @@ void handle_register_client(int client_fd, const char *request, const char *clie
     pthread_mutex_unlock(&clients_mutex);
 }
 
-void handle_register_ss(int ss_fd, const char *request, const char *ss_ip) {
+typedef struct {
+    const char *ip;
+    int port;
+    int files_updated;
+} RemapContext;
+
+static int remap_file_to_ss(FileMetadata *file, void *arg) {
+    RemapContext *ctx = arg;
+    if (strcmp(file->ss_ip, ctx->ip) != 0 || file->ss_port != ctx->port) {
+        return 1;
+    }
+
+    strncpy(file->ss_ip, ctx->ip, sizeof(file->ss_ip) - 1);
+    file->ss_ip[sizeof(file->ss_ip) - 1] = '\0';
+    file->ss_port = ctx->port;
+    cache_remove(file->filename);
+    journal_log_file(file);
+    ctx->files_updated++;
+
+    char update_msg[256];
+    snprintf(update_msg, sizeof(update_msg), "Updated file mapping: %s -> %s:%d",
+             file->filename, ctx->ip, ctx->port);
+    log_message("INFO", update_msg, ctx->ip, ctx->port, "SS");
+    return 1;
+}
+
+void handle_register_ss(int ss_fd, const JsonMessage *request, const char *ss_ip) {
     char advertised_ip[INET_ADDRSTRLEN] = {0};
-    parse_json_string(request, "ip", advertised_ip, sizeof(advertised_ip));
-    int nm_port = parse_json_int(request, "nm_port");
-    int client_port = parse_json_int(request, "client_port");
+    json_field_string(request, "ip", advertised_ip, sizeof(advertised_ip));
+    int nm_port = 0;
+    int client_port = 0;
+    json_field_int(request, "nm_port", &nm_port);
+    json_field_int(request, "client_port", &client_port);
 
     char resolved_ip[INET_ADDRSTRLEN] = {0};
     int advertised_valid = 0;
@@ -124,6 +157,7 @@ void handle_register_ss(int ss_fd, const char *request, const char *ss_ip) {
         storage_servers[ss_index].socket_fd = ss_fd;
         storage_servers[ss_index].active = 1;
         storage_servers[ss_index].connected_at = time(NULL);
+        storage_servers[ss_index].last_heartbeat = health_now();
         strncpy(storage_servers[ss_index].ip, resolved_ip, sizeof(storage_servers[ss_index].ip) - 1);
         storage_servers[ss_index].ip[sizeof(storage_servers[ss_index].ip) - 1] = '\0';
 
@@ -144,6 +178,7 @@ void handle_register_ss(int ss_fd, const char *request, const char *ss_ip) {
         storage_servers[ss_index].socket_fd = ss_fd;
         storage_servers[ss_index].active = 1;
         storage_servers[ss_index].connected_at = time(NULL);
+        storage_servers[ss_index].last_heartbeat = health_now();
         storage_servers[ss_index].files = NULL;
         storage_servers[ss_index].file_count = 0;
         ss_count++;
@@ -153,43 +188,25 @@ void handle_register_ss(int ss_fd, const char *request, const char *ss_ip) {
         return;
     }
 
-    const char *files_start = strstr(request, "\"files\":[");
-    if (files_start) {
-        files_start += 9;
-        const char *p = files_start;
-        while (*p && *p != ']') {
-            if (*p == '"') {
-                p++;
-                const char *start = p;
-                while (*p && *p != '"') {
-                    if (*p == '\\' && *(p + 1)) {
-                        p++;
-                    }
-                    if (*p) {
-                        p++;
-                    }
-                }
-                size_t len = (size_t)(p - start);
-                if (len > 0 && len < MAX_FILENAME) {
-                    char *filename = malloc(len + 1);
-                    if (filename) {
-                        strncpy(filename, start, len);
-                        filename[len] = '\0';
-
-                        char **tmp = realloc(storage_servers[ss_index].files,
-                                             sizeof(char *) * (storage_servers[ss_index].file_count + 1));
-                        if (tmp) {
-                            storage_servers[ss_index].files = tmp;
-                            storage_servers[ss_index].files[storage_servers[ss_index].file_count++] = filename;
-                        } else {
-                            free(filename);
-                        }
-                    }
-                }
-            }
-            if (*p) {
-                p++;
-            }
+    const char *files = json_field_array(request, "files");
+    char name[MAX_FILENAME + 1];
+    while ((files = json_array_next_string(files, name, sizeof(name))) != NULL) {
+        size_t len = strlen(name);
+        if (len == 0 || len >= MAX_FILENAME) {
+            continue;
+        }
+        char *filename = strdup(name);
+        if (!filename) {
+            continue;
+        }
+
+        char **tmp = realloc(storage_servers[ss_index].files,
+                             sizeof(char *) * (storage_servers[ss_index].file_count + 1));
+        if (tmp) {
+            storage_servers[ss_index].files = tmp;
+            storage_servers[ss_index].files[storage_servers[ss_index].file_count++] = filename;
+        } else {
+            free(filename);
         }
     }
 
@@ -206,28 +223,9 @@ void handle_register_ss(int ss_fd, const char *request, const char *ss_ip) {
         snprintf(log_msg, sizeof(log_msg), "Storage Server re-registered: %s:%d (was offline)", resolved_ip, client_port);
         log_message("INFO", log_msg, resolved_ip, client_port, "SS");
 
-        pthread_mutex_lock(&files_mutex);
-        int files_updated = 0;
-        for (int i = 0; i < MAX_FILES; i++) {
-            HashNode *node = file_hash_table[i];
-            while (node) {
-                FileMetadata *file = node->file;
-                if (file->active && strcmp(file->ss_ip, resolved_ip) == 0 && file->ss_port == client_port) {
-                    strncpy(file->ss_ip, resolved_ip, sizeof(file->ss_ip) - 1);
-                    file->ss_ip[sizeof(file->ss_ip) - 1] = '\0';
-                    file->ss_port = client_port;
-                    cache_remove(file->filename);
-                    files_updated++;
-
-                    char update_msg[256];
-                    snprintf(update_msg, sizeof(update_msg), "Updated file mapping: %s -> %s:%d",
-                             file->filename, resolved_ip, client_port);
-                    log_message("INFO", update_msg, resolved_ip, client_port, "SS");
-                }
-                node = node->next;
-            }
-        }
-        pthread_mutex_unlock(&files_mutex);
+        RemapContext remap = {resolved_ip, client_port, 0};
+        file_table_foreach(remap_file_to_ss, &remap, 1);
+        int files_updated = remap.files_updated;
 
         snprintf(log_msg, sizeof(log_msg), "Re-registration complete: %d files updated", files_updated);
         log_message("INFO", log_msg, resolved_ip, client_port, "SS");
@@ -240,90 +238,185 @@ void handle_register_ss(int ss_fd, const char *request, const char *ss_ip) {
     pthread_mutex_unlock(&ss_mutex);
 }
 
-void handle_view(int client_fd, const char *request, const char *username) {
+/*
+ * Resolve the sender of a control-session message to its registered address
+ * and count the message as a heartbeat. Returns 0 (after replying) when the
+ * server is not registered, which tells it to register again.
+ */
+static int control_sender(int ss_fd, const JsonMessage *request, const char *ss_ip,
+                          char *resolved_ip, size_t resolved_size, int *client_port) {
+    char advertised_ip[INET_ADDRSTRLEN] = {0};
+    json_field_string(request, "ip", advertised_ip, sizeof(advertised_ip));
+    *client_port = 0;
+    json_field_int(request, "client_port", client_port);
+
+    pthread_mutex_lock(&ss_mutex);
+    int index = health_find_ss(advertised_ip, ss_ip, *client_port);
+    if (index >= 0) {
+        strncpy(resolved_ip, storage_servers[index].ip, resolved_size - 1);
+        resolved_ip[resolved_size - 1] = '\0';
+        health_heartbeat(index);
+    }
+    pthread_mutex_unlock(&ss_mutex);
+
+    if (index < 0) {
+        send_response(ss_fd, "{\"status\":\"ERR\",\"reason\":\"UNKNOWN_SS\"}");
+        return 0;
+    }
+    return 1;
+}
+
+void handle_ss_heartbeat(int ss_fd, const JsonMessage *request, const char *ss_ip) {
+    char resolved_ip[INET_ADDRSTRLEN];
+    int client_port = 0;
+    if (control_sender(ss_fd, request, ss_ip, resolved_ip, sizeof(resolved_ip), &client_port)) {
+        send_response(ss_fd, "{\"status\":\"OK\"}");
+    }
+}
+
+/*
+ * Counts pushed by a storage server over its control session; only files
+ * whose primary is that server are updated.
+ */
+void handle_ss_stats(int ss_fd, const JsonMessage *request, const char *ss_ip) {
+    char resolved_ip[INET_ADDRSTRLEN];
+    int client_port = 0;
+    if (!control_sender(ss_fd, request, ss_ip, resolved_ip, sizeof(resolved_ip), &client_port)) {
+        return;
+    }
+
+    int applied = stats_apply_push(resolved_ip, client_port, json_field_array(request, "stats"));
+
+    char response[64];
+    snprintf(response, sizeof(response), "{\"status\":\"OK\",\"applied\":%d}", applied);
+    send_response(ss_fd, response);
+}
+
+/*
+ * Clients and storage servers fetch the map once and then go straight to
+ * the shard owning each file; an unsharded server answers with no shards.
+ */
+void handle_shard_map(int fd) {
+    char response[SHARD_MAX * (SHARD_HOST_MAX + 16) + 64];
+    JsonWriter w;
+    json_writer_init(&w, response, sizeof(response));
+    json_write_begin_object(&w, NULL);
+    json_write_string(&w, "status", "OK");
+    json_write_int(&w, "self", shard_self < 0 ? 0 : shard_self);
+    shard_map_write_json(&shard_map, &w);
+    json_write_end_object(&w);
+    const char *reply = json_writer_finish(&w, NULL);
+    send_response(fd, reply ? reply : "{\"status\":\"ERR\",\"reason\":\"RESPONSE_TOO_LARGE\"}");
+}
+
+typedef struct {
+    char filename[MAX_FILENAME];
+    char owner[MAX_USERNAME];
+    char ss_ip[INET_ADDRSTRLEN];
+    int ss_port;
+    int words;
+    int chars;
+    int bytes;
+    time_t last_accessed;
+} ViewEntry;
+
+typedef struct {
+    const char *username;
+    int show_all;
+    time_t now;
+    size_t stale;
+    ViewEntry *entries;
+    size_t count;
+    size_t capacity;
+} ViewSnapshot;
+
+static int snapshot_view_entry(FileMetadata *file, void *arg) {
+    ViewSnapshot *snap = arg;
+    if (!snap->show_all && !check_access(file, snap->username, "R")) {
+        return 1;
+    }
+
+    if (snap->count == snap->capacity) {
+        size_t new_capacity = snap->capacity ? snap->capacity * 2 : 64;
+        ViewEntry *tmp = realloc(snap->entries, sizeof(ViewEntry) * new_capacity);
+        if (!tmp) {
+            return 0;
+        }
+        snap->entries = tmp;
+        snap->capacity = new_capacity;
+    }
+
+    ViewEntry *entry = &snap->entries[snap->count++];
+    strncpy(entry->filename, file->filename, sizeof(entry->filename) - 1);
+    entry->filename[sizeof(entry->filename) - 1] = '\0';
+    strncpy(entry->owner, file->owner, sizeof(entry->owner) - 1);
+    entry->owner[sizeof(entry->owner) - 1] = '\0';
+    strncpy(entry->ss_ip, file->ss_ip, sizeof(entry->ss_ip) - 1);
+    entry->ss_ip[sizeof(entry->ss_ip) - 1] = '\0';
+    entry->ss_port = file->ss_port;
+    entry->words = file->words;
+    entry->chars = file->chars;
+    entry->bytes = file->bytes;
+    entry->last_accessed = file->last_accessed;
+    if (stats_is_stale(file, snap->now)) {
+        snap->stale++;
+    }
+    return 1;
+}
+
+/*
+ * VIEW copies what it needs out of the table under shared shard locks and
+ * answers from the cached counts; stale entries only wake the background
+ * refresher, so no request ever waits on a storage server here.
+ */
+void handle_view(int client_fd, const JsonMessage *request, const char *username) {
     char flags[16] = {0};
-    parse_json_string(request, "flags", flags, sizeof(flags));
+    json_field_string(request, "flags", flags, sizeof(flags));
 
     int show_all = (strstr(flags, "a") != NULL);
     int show_details = (strstr(flags, "l") != NULL);
 
-    char response[BUFFER_SIZE] = {0};
-    if (!safe_append(response, sizeof(response), "{\"status\":\"OK\",\"files\":[")) {
-        send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"RESPONSE_BUILD_FAILED\"}");
+    ViewSnapshot snap = {username, show_all, time(NULL), 0, NULL, 0, 0};
+    if (!file_table_foreach(snapshot_view_entry, &snap, 0)) {
+        free(snap.entries);
+        send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"UNKNOWN\"}");
         return;
     }
+    if (show_details && snap.stale > 0) {
+        stats_request_refresh();
+    }
 
-    pthread_mutex_lock(&files_mutex);
+    char response[BUFFER_SIZE] = {0};
+    int ok = safe_append(response, sizeof(response), "{\"status\":\"OK\",\"files\":[");
 
-    int first = 1;
-    for (int i = 0; i < MAX_FILES; i++) {
-        HashNode *node = file_hash_table[i];
-        while (node) {
-            FileMetadata *file = node->file;
-            if (file->active) {
-                int has_access = show_all || check_access(file, username, "R");
-                if (has_access) {
-                    if (!first) {
-                        if (!safe_append(response, sizeof(response), ",")) {
-                            pthread_mutex_unlock(&files_mutex);
-                            send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"RESPONSE_TOO_LARGE\"}");
-                            return;
-                        }
-                    }
-                    first = 0;
-
-                    int words = file->words;
-                    int chars = file->chars;
-                    int bytes = file->bytes;
-
-                    int temp_words = 0;
-                    int temp_chars = 0;
-                    int temp_bytes = 0;
-                    if (request_file_stats(file->ss_ip, file->ss_port, file->filename,
-                                           &temp_words, &temp_chars, &temp_bytes)) {
-                        words = temp_words;
-                        chars = temp_chars;
-                        bytes = temp_bytes;
-                        file->words = words;
-                        file->chars = chars;
-                        file->bytes = bytes;
-                    }
+    for (size_t i = 0; ok && i < snap.count; i++) {
+        ViewEntry *entry = &snap.entries[i];
+        if (i > 0) {
+            ok = safe_append(response, sizeof(response), ",");
+        }
 
-                    if (show_details) {
-                        char entry[512];
-                        struct tm *tm_info = localtime(&file->last_accessed);
-                        char timestamp[32];
-                        strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M", tm_info);
-
-                        snprintf(entry, sizeof(entry),
-                                 "{\"filename\":\"%s\",\"owner\":\"%s\",\"words\":%d,\"chars\":%d,\"bytes\":%d,\"last_accessed\":\"%s\"}",
-                                 file->filename, file->owner, words, chars, bytes, timestamp);
-                        if (!safe_append(response, sizeof(response), entry)) {
-                            pthread_mutex_unlock(&files_mutex);
-                            send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"RESPONSE_TOO_LARGE\"}");
-                            return;
-                        }
-                    } else {
-                        char entry[300];
-                        snprintf(entry, sizeof(entry), "\"%s\"", file->filename);
-                        if (!safe_append(response, sizeof(response), entry)) {
-                            pthread_mutex_unlock(&files_mutex);
-                            send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"RESPONSE_TOO_LARGE\"}");
-                            return;
-                        }
-                    }
-                }
-            }
-            node = node->next;
+        char item[512];
+        if (show_details) {
+            struct tm tm_info;
+            char timestamp[32];
+            localtime_r(&entry->last_accessed, &tm_info);
+            strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M", &tm_info);
+
+            snprintf(item, sizeof(item),
+                     "{\"filename\":\"%s\",\"owner\":\"%s\",\"words\":%d,\"chars\":%d,\"bytes\":%d,\"last_accessed\":\"%s\"}",
+                     entry->filename, entry->owner, entry->words, entry->chars, entry->bytes, timestamp);
+        } else {
+            snprintf(item, sizeof(item), "\"%s\"", entry->filename);
         }
+        ok = ok && safe_append(response, sizeof(response), item);
     }
+    ok = ok && safe_append(response, sizeof(response), "]}");
+    free(snap.entries);
 
-    if (!safe_append(response, sizeof(response), "]}")) {
-        pthread_mutex_unlock(&files_mutex);
+    if (!ok) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"RESPONSE_TOO_LARGE\"}");
         return;
     }
-    pthread_mutex_unlock(&files_mutex);
 
     log_message("INFO", "VIEW command executed", "0.0.0.0", 0, username);
     send_response(client_fd, response);
@@ -369,21 +462,89 @@ void handle_list(int client_fd, const char *username) {
     send_response(client_fd, response);
 }
 
-void handle_create(int client_fd, const char *request, const char *username) {
+void handle_cache_stats(int client_fd, const JsonMessage *request, const char *username) {
+    int capacity = 0;
+    if (json_field_int(request, "capacity", &capacity)) {
+        if (capacity < 0) {
+            send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"BAD_REQUEST\"}");
+            return;
+        }
+        cache_set_capacity(capacity);
+    }
+
+    CacheStats stats;
+    cache_get_stats(&stats);
+
+    unsigned long lookups = stats.hits + stats.misses;
+    double hit_ratio = lookups ? (double)stats.hits / (double)lookups : 0.0;
+
+    char response[256];
+    snprintf(response, sizeof(response),
+             "{\"status\":\"OK\",\"capacity\":%d,\"size\":%d,\"hits\":%lu,\"misses\":%lu,\"evictions\":%lu,\"hit_ratio\":%.4f}",
+             stats.capacity, stats.size, stats.hits, stats.misses, stats.evictions, hit_ratio);
+
+    log_message("INFO", "CACHE_STATS command executed", "0.0.0.0", 0, username);
+    send_response(client_fd, response);
+}
+
+/* Tell the primary where its backup lives so it can stream commits to it. */
+static void assign_replica(const FileMetadata *file) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return;
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec = NM_STATS_TIMEOUT_SECS;
+    timeout.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(file->ss_port);
+    inet_pton(AF_INET, file->ss_ip, &addr.sin_addr);
+
+    int assigned = 0;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        char request[MAX_FILENAME + 128];
+        int len = snprintf(request, sizeof(request),
+                           "{\"cmd\":\"SET_REPLICA\",\"filename\":\"%s\",\"backup_ip\":\"%s\",\"backup_port\":%d}\n",
+                           file->filename, file->backup_ss_ip, file->backup_ss_port);
+        char reply[256];
+        if (send(fd, request, len, 0) == len) {
+            int bytes = recv(fd, reply, sizeof(reply) - 1, 0);
+            if (bytes > 0) {
+                reply[bytes] = '\0';
+                assigned = strstr(reply, "\"status\":\"OK\"") != NULL;
+            }
+        }
+    }
+    close(fd);
+
+    if (!assigned) {
+        char log_msg[512];
+        snprintf(log_msg, sizeof(log_msg), "Replica assignment for %s failed; backup will not follow writes",
+                 file->filename);
+        log_message("WARN", log_msg, file->ss_ip, file->ss_port, "system");
+    }
+}
+
+void handle_create(int client_fd, const JsonMessage *request, const char *username) {
     char filename[MAX_FILENAME] = {0};
-    parse_json_string(request, "filename", filename, sizeof(filename));
+    json_field_string(request, "filename", filename, sizeof(filename));
     if (strlen(filename) == 0) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"BAD_REQUEST\"}");
         return;
     }
 
-    pthread_mutex_lock(&files_mutex);
+    file_table_rdlock(filename);
     if (lookup_file(filename)) {
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"ALREADY_EXISTS\"}");
         return;
     }
-    pthread_mutex_unlock(&files_mutex);
+    file_table_unlock(filename);
 
     pthread_mutex_lock(&ss_mutex);
     if (ss_count == 0) {
@@ -465,7 +626,7 @@ void handle_create(int client_fd, const char *request, const char *username) {
     if (!success) {
         if (strlen(ss_response) > 0 && strstr(ss_response, "\"status\":\"ERR\"")) {
             char reason[128] = {0};
-            parse_json_string(ss_response, "reason", reason, sizeof(reason));
+            json_get_string(ss_response, "reason", reason, sizeof(reason));
             if (strlen(reason) == 0) {
                 strcpy(reason, "ALL_SS_FAILED");
             }
@@ -622,15 +783,20 @@ void handle_create(int client_fd, const char *request, const char *username) {
     }
     pthread_mutex_unlock(&ss_mutex);
 
-    pthread_mutex_lock(&files_mutex);
+    if (file->backup_ss_ip[0] != '\0') {
+        assign_replica(file);
+    }
+
+    file_table_wrlock(filename);
     if (lookup_file(filename)) {
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         free(file);
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"ALREADY_EXISTS\"}");
         return;
     }
     insert_file(file);
-    pthread_mutex_unlock(&files_mutex);
+    journal_log_file(file);
+    file_table_unlock(filename);
 
     char response[256];
     snprintf(response, sizeof(response),
@@ -641,20 +807,19 @@ void handle_create(int client_fd, const char *request, const char *username) {
     snprintf(log_msg, sizeof(log_msg), "File created: %s by %s on SS %s:%d", filename, username, ss_ip, ss_port);
     log_message("INFO", log_msg, "0.0.0.0", 0, username);
 
-    save_metadata();
     send_response(client_fd, response);
 }
 
-void handle_info(int client_fd, const char *request, const char *username) {
+void handle_info(int client_fd, const JsonMessage *request, const char *username) {
     char filename[MAX_FILENAME] = {0};
-    parse_json_string(request, "filename", filename, sizeof(filename));
+    json_field_string(request, "filename", filename, sizeof(filename));
 
-    pthread_mutex_lock(&files_mutex);
+    file_table_rdlock(filename);
 
     FileMetadata *file = lookup_file(filename);
     if (!file) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"FILE_NOT_FOUND\"}");
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         return;
     }
 
@@ -662,7 +827,7 @@ void handle_info(int client_fd, const char *request, const char *username) {
     access_json[0] = '\0';
     if (!safe_append(access_json, sizeof(access_json), "[")) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"RESPONSE_BUILD_FAILED\"}");
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         return;
     }
 
@@ -670,7 +835,7 @@ void handle_info(int client_fd, const char *request, const char *username) {
     snprintf(temp, sizeof(temp), "{\"user\":\"%s\",\"mode\":\"RW\"}", file->owner);
     if (!safe_append(access_json, sizeof(access_json), temp)) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"ACCESS_LIST_TOO_LARGE\"}");
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         return;
     }
 
@@ -679,7 +844,7 @@ void handle_info(int client_fd, const char *request, const char *username) {
         snprintf(temp, sizeof(temp), ",{\"user\":\"%s\",\"mode\":\"%s\"}", entry->username, entry->mode);
         if (!safe_append(access_json, sizeof(access_json), temp)) {
             send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"ACCESS_LIST_TOO_LARGE\"}");
-            pthread_mutex_unlock(&files_mutex);
+            file_table_unlock(filename);
             return;
         }
         entry = entry->next;
@@ -687,23 +852,23 @@ void handle_info(int client_fd, const char *request, const char *username) {
 
     if (!safe_append(access_json, sizeof(access_json), "]")) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"ACCESS_LIST_TOO_LARGE\"}");
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         return;
     }
 
     char created_str[64];
     char modified_str[64];
     char accessed_str[64];
-    struct tm *tm_info;
+    struct tm tm_info;
 
-    tm_info = localtime(&file->created_at);
-    strftime(created_str, sizeof(created_str), "%Y-%m-%d %H:%M:%S", tm_info);
+    localtime_r(&file->created_at, &tm_info);
+    strftime(created_str, sizeof(created_str), "%Y-%m-%d %H:%M:%S", &tm_info);
 
-    tm_info = localtime(&file->last_modified);
-    strftime(modified_str, sizeof(modified_str), "%Y-%m-%d %H:%M:%S", tm_info);
+    localtime_r(&file->last_modified, &tm_info);
+    strftime(modified_str, sizeof(modified_str), "%Y-%m-%d %H:%M:%S", &tm_info);
 
-    tm_info = localtime(&file->last_accessed);
-    strftime(accessed_str, sizeof(accessed_str), "%Y-%m-%d %H:%M:%S", tm_info);
+    localtime_r(&file->last_accessed, &tm_info);
+    strftime(accessed_str, sizeof(accessed_str), "%Y-%m-%d %H:%M:%S", &tm_info);
 
     char file_owner[MAX_USERNAME];
     char file_ss_ip[INET_ADDRSTRLEN];
@@ -720,26 +885,12 @@ void handle_info(int client_fd, const char *request, const char *username) {
     int words = file->words;
     int chars = file->chars;
     int bytes = file->bytes;
+    int stale = stats_is_stale(file, time(NULL));
 
-    pthread_mutex_unlock(&files_mutex);
-
-    int temp_words = 0;
-    int temp_chars = 0;
-    int temp_bytes = 0;
-    if (request_file_stats(file_ss_ip, file_ss_port, filename, &temp_words, &temp_chars, &temp_bytes)) {
-        words = temp_words;
-        chars = temp_chars;
-        bytes = temp_bytes;
-
-        pthread_mutex_lock(&files_mutex);
-        FileMetadata *file_after = lookup_file(filename);
-        if (file_after) {
-            file_after->words = words;
-            file_after->chars = chars;
-            file_after->bytes = bytes;
-        }
-        pthread_mutex_unlock(&files_mutex);
-        save_metadata();
+    file_table_unlock(filename);
+
+    if (stale) {
+        stats_request_refresh();
     }
 
     char response[BUFFER_SIZE];
@@ -756,27 +907,27 @@ void handle_info(int client_fd, const char *request, const char *username) {
     send_response(client_fd, response);
 }
 
-void handle_addaccess(int client_fd, const char *request, const char *username) {
+void handle_addaccess(int client_fd, const JsonMessage *request, const char *username) {
     char filename[MAX_FILENAME] = {0};
     char target[MAX_USERNAME] = {0};
     char mode[3] = {0};
 
-    parse_json_string(request, "filename", filename, sizeof(filename));
-    parse_json_string(request, "target", target, sizeof(target));
-    parse_json_string(request, "mode", mode, sizeof(mode));
+    json_field_string(request, "filename", filename, sizeof(filename));
+    json_field_string(request, "target", target, sizeof(target));
+    json_field_string(request, "mode", mode, sizeof(mode));
 
-    pthread_mutex_lock(&files_mutex);
+    file_table_wrlock(filename);
 
     FileMetadata *file = lookup_file(filename);
     if (!file) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"FILE_NOT_FOUND\"}");
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         return;
     }
 
     if (strcmp(file->owner, username) != 0) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"UNAUTHORIZED\"}");
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         return;
     }
 
@@ -785,9 +936,9 @@ void handle_addaccess(int client_fd, const char *request, const char *username)
         if (strcmp(entry->username, target) == 0) {
             strncpy(entry->mode, mode, sizeof(entry->mode) - 1);
             entry->mode[sizeof(entry->mode) - 1] = '\0';
+            journal_log_file(file);
             send_response(client_fd, "{\"status\":\"OK\",\"msg\":\"Access updated\"}");
-            pthread_mutex_unlock(&files_mutex);
-            save_metadata();
+            file_table_unlock(filename);
             return;
         }
         entry = entry->next;
@@ -795,7 +946,7 @@ void handle_addaccess(int client_fd, const char *request, const char *username)
 
     AccessEntry *new_entry = malloc(sizeof(AccessEntry));
     if (!new_entry) {
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"UNKNOWN\"}");
         return;
     }
@@ -806,36 +957,36 @@ void handle_addaccess(int client_fd, const char *request, const char *username)
     new_entry->mode[sizeof(new_entry->mode) - 1] = '\0';
     new_entry->next = file->access_list;
     file->access_list = new_entry;
+    journal_log_file(file);
 
-    pthread_mutex_unlock(&files_mutex);
+    file_table_unlock(filename);
 
     char log_msg[512];
     snprintf(log_msg, sizeof(log_msg), "Access added: %s to %s for %s", mode, target, filename);
     log_message("INFO", log_msg, "0.0.0.0", 0, username);
 
-    save_metadata();
     send_response(client_fd, "{\"status\":\"OK\",\"msg\":\"Access granted\"}");
 }
 
-void handle_remaccess(int client_fd, const char *request, const char *username) {
+void handle_remaccess(int client_fd, const JsonMessage *request, const char *username) {
     char filename[MAX_FILENAME] = {0};
     char target[MAX_USERNAME] = {0};
 
-    parse_json_string(request, "filename", filename, sizeof(filename));
-    parse_json_string(request, "target", target, sizeof(target));
+    json_field_string(request, "filename", filename, sizeof(filename));
+    json_field_string(request, "target", target, sizeof(target));
 
-    pthread_mutex_lock(&files_mutex);
+    file_table_wrlock(filename);
 
     FileMetadata *file = lookup_file(filename);
     if (!file) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"FILE_NOT_FOUND\"}");
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         return;
     }
 
     if (strcmp(file->owner, username) != 0) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"UNAUTHORIZED\"}");
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         return;
     }
 
@@ -845,76 +996,104 @@ void handle_remaccess(int client_fd, const char *request, const char *username)
             AccessEntry *to_free = *indirect;
             *indirect = (*indirect)->next;
             free(to_free);
+            journal_log_file(file);
             send_response(client_fd, "{\"status\":\"OK\",\"msg\":\"Access removed\"}");
-            pthread_mutex_unlock(&files_mutex);
-            save_metadata();
+            file_table_unlock(filename);
             return;
         }
         indirect = &(*indirect)->next;
     }
 
     send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"ACCESS_NOT_FOUND\"}");
-    pthread_mutex_unlock(&files_mutex);
+    file_table_unlock(filename);
+}
+
+/*
+ * Readers share the shard lock, so the access stamp of a READ, STREAM or
+ * VERSIONS is taken afterwards under the write lock, at most once a second
+ * per file; readers within the same second are folded into that stamp.
+ * A WRITE or UNDO is stamped here too, once its primary is known to be up.
+ */
+static void record_access(const char *filename, const char *username, time_t now,
+                          int modified) {
+    file_table_wrlock(filename);
+    FileMetadata *file = lookup_file(filename);
+    if (file && (modified || file->last_accessed < now)) {
+        file->last_accessed = now;
+        strncpy(file->last_accessed_by, username, sizeof(file->last_accessed_by) - 1);
+        file->last_accessed_by[sizeof(file->last_accessed_by) - 1] = '\0';
+        if (modified) {
+            file->last_modified = now;
+        }
+        journal_log_file(file);
+    }
+    file_table_unlock(filename);
 }
 
-void handle_file_operation(int client_fd, const char *request, const char *username) {
+void handle_file_operation(int client_fd, const JsonMessage *request, const char *username) {
     char cmd[64] = {0};
     char filename[MAX_FILENAME] = {0};
 
-    parse_json_string(request, "cmd", cmd, sizeof(cmd));
-    parse_json_string(request, "filename", filename, sizeof(filename));
+    json_field_string(request, "cmd", cmd, sizeof(cmd));
+    json_field_string(request, "filename", filename, sizeof(filename));
 
-    pthread_mutex_lock(&files_mutex);
+    int read_only = (strcmp(cmd, "READ") == 0 || strcmp(cmd, "STREAM") == 0 ||
+                     strcmp(cmd, "VERSIONS") == 0);
+    if (read_only) {
+        file_table_rdlock(filename);
+    } else {
+        file_table_wrlock(filename);
+    }
 
     FileMetadata *file = lookup_file(filename);
     if (!file) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"FILE_NOT_FOUND\"}");
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         return;
     }
 
-    const char *required_mode = (strcmp(cmd, "READ") == 0 || strcmp(cmd, "STREAM") == 0) ? "R" : "W";
-    if (!check_access(file, username, required_mode)) {
+    if (!check_access(file, username, read_only ? "R" : "W")) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"UNAUTHORIZED\"}");
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         return;
     }
 
-    file->last_accessed = time(NULL);
-    strncpy(file->last_accessed_by, username, sizeof(file->last_accessed_by) - 1);
-    file->last_accessed_by[sizeof(file->last_accessed_by) - 1] = '\0';
+    time_t now = time(NULL);
+    int stamp_access = !read_only || file->last_accessed < now;
+
+    char primary_ip[INET_ADDRSTRLEN];
+    char backup_ip[INET_ADDRSTRLEN];
+    int primary_port = file->ss_port;
+    int backup_port = file->backup_ss_port;
+    strncpy(primary_ip, file->ss_ip, sizeof(primary_ip) - 1);
+    primary_ip[sizeof(primary_ip) - 1] = '\0';
+    strncpy(backup_ip, file->backup_ss_ip, sizeof(backup_ip) - 1);
+    backup_ip[sizeof(backup_ip) - 1] = '\0';
+
+    file_table_unlock(filename);
+
+    /*
+     * The backup is brought back in line with a full copy from the primary
+     * once it returns, so a write or undo taken by the backup meanwhile
+     * would be lost; only reads fail over.
+     */
+    int primary_alive = health_ss_alive(primary_ip, primary_port);
+    if (!primary_alive && !read_only) {
+        send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"PRIMARY_SS_DOWN\"}");
+        return;
+    }
 
-    if (strcmp(cmd, "WRITE") == 0 || strcmp(cmd, "UNDO") == 0) {
-        file->last_modified = time(NULL);
+    if (stamp_access) {
+        record_access(filename, username, now, !read_only);
     }
 
-    char *ss_ip_to_use = file->ss_ip;
-    int ss_port_to_use = file->ss_port;
+    char *ss_ip_to_use = primary_ip;
+    int ss_port_to_use = primary_port;
     int using_backup = 0;
 
-    int primary_alive = 0;
-    int test_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (test_fd >= 0) {
-        struct sockaddr_in test_addr;
-        test_addr.sin_family = AF_INET;
-        test_addr.sin_port = htons(file->ss_port);
-        inet_pton(AF_INET, file->ss_ip, &test_addr.sin_addr);
-
-        struct timeval timeout;
-        timeout.tv_sec = 1;
-        timeout.tv_usec = 0;
-        setsockopt(test_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-        setsockopt(test_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
-
-        if (connect(test_fd, (struct sockaddr *)&test_addr, sizeof(test_addr)) == 0) {
-            primary_alive = 1;
-        }
-        close(test_fd);
-    }
-
-    if (!primary_alive && file->backup_ss_ip[0] != '\0' && file->backup_ss_port != 0) {
-        ss_ip_to_use = file->backup_ss_ip;
-        ss_port_to_use = file->backup_ss_port;
+    if (!primary_alive && backup_ip[0] != '\0' && backup_port != 0) {
+        ss_ip_to_use = backup_ip;
+        ss_port_to_use = backup_port;
         using_backup = 1;
 
         char log_msg[512];
@@ -934,33 +1113,31 @@ void handle_file_operation(int client_fd, const char *request, const char *usern
              using_backup ? " [BACKUP]" : "");
     log_message("INFO", log_msg, "0.0.0.0", 0, username);
 
-    pthread_mutex_unlock(&files_mutex);
-
-    save_metadata();
     send_response(client_fd, response);
 }
 
-void handle_delete(int client_fd, const char *request, const char *username) {
+void handle_delete(int client_fd, const JsonMessage *request, const char *username) {
     char filename[MAX_FILENAME] = {0};
-    parse_json_string(request, "filename", filename, sizeof(filename));
+    json_field_string(request, "filename", filename, sizeof(filename));
 
-    pthread_mutex_lock(&files_mutex);
+    file_table_wrlock(filename);
 
     FileMetadata *file = lookup_file(filename);
     if (!file) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"FILE_NOT_FOUND\"}");
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         return;
     }
 
     if (strcmp(file->owner, username) != 0) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"UNAUTHORIZED\"}");
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         return;
     }
 
     file->active = 0;
     cache_remove(filename);
+    journal_log_delete(filename);
 
     char ss_ip[INET_ADDRSTRLEN];
     char backup_ss_ip[INET_ADDRSTRLEN];
@@ -971,7 +1148,7 @@ void handle_delete(int client_fd, const char *request, const char *username) {
     strncpy(backup_ss_ip, file->backup_ss_ip, sizeof(backup_ss_ip) - 1);
     backup_ss_ip[sizeof(backup_ss_ip) - 1] = '\0';
 
-    pthread_mutex_unlock(&files_mutex);
+    file_table_unlock(filename);
 
     int ss_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (ss_fd >= 0) {
@@ -1019,26 +1196,25 @@ void handle_delete(int client_fd, const char *request, const char *username) {
     snprintf(log_msg, sizeof(log_msg), "File deleted: %s by %s", filename, username);
     log_message("INFO", log_msg, "0.0.0.0", 0, username);
 
-    save_metadata();
     send_response(client_fd, "{\"status\":\"OK\",\"msg\":\"File deleted\"}");
 }
 
-void handle_exec(int client_fd, const char *request, const char *username) {
+void handle_exec(int client_fd, const JsonMessage *request, const char *username) {
     char filename[MAX_FILENAME] = {0};
-    parse_json_string(request, "filename", filename, sizeof(filename));
+    json_field_string(request, "filename", filename, sizeof(filename));
 
-    pthread_mutex_lock(&files_mutex);
+    file_table_wrlock(filename);
 
     FileMetadata *file = lookup_file(filename);
     if (!file) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"FILE_NOT_FOUND\"}");
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         return;
     }
 
     if (!check_access(file, username, "R")) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"UNAUTHORIZED\"}");
-        pthread_mutex_unlock(&files_mutex);
+        file_table_unlock(filename);
         return;
     }
 
@@ -1051,7 +1227,8 @@ void handle_exec(int client_fd, const char *request, const char *username) {
     strncpy(ss_ip, file->ss_ip, sizeof(ss_ip) - 1);
     ss_ip[sizeof(ss_ip) - 1] = '\0';
 
-    pthread_mutex_unlock(&files_mutex);
+    journal_log_file(file);
+    file_table_unlock(filename);
 
     int ss_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (ss_fd < 0) {
@@ -1095,7 +1272,7 @@ void handle_exec(int client_fd, const char *request, const char *username) {
 
     if (strstr(ss_response, "\"status\":\"ERR\"")) {
         char reason[128] = {0};
-        parse_json_string(ss_response, "reason", reason, sizeof(reason));
+        json_get_string(ss_response, "reason", reason, sizeof(reason));
         free(ss_response);
         if (reason[0] == '\0') {
             send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"SS_READ_FAILED\"}");
@@ -1108,7 +1285,7 @@ void handle_exec(int client_fd, const char *request, const char *username) {
     }
 
     char content[BUFFER_SIZE] = {0};
-    parse_json_string(ss_response, "content", content, sizeof(content));
+    json_get_string(ss_response, "content", content, sizeof(content));
 
     free(ss_response);
 
@@ -1117,32 +1294,8 @@ void handle_exec(int client_fd, const char *request, const char *username) {
         return;
     }
 
-    char unescaped_content[BUFFER_SIZE];
-    int j = 0;
-    for (int i = 0; i < (int)strlen(content) && j < BUFFER_SIZE - 1; i++) {
-        if (content[i] == '\\' && content[i + 1] == 'n') {
-            unescaped_content[j++] = '\n';
-            i++;
-        } else if (content[i] == '\\' && content[i + 1] == 'r') {
-            unescaped_content[j++] = '\r';
-            i++;
-        } else if (content[i] == '\\' && content[i + 1] == 't') {
-            unescaped_content[j++] = '\t';
-            i++;
-        } else if (content[i] == '\\' && content[i + 1] == '\\') {
-            unescaped_content[j++] = '\\';
-            i++;
-        } else if (content[i] == '\\' && content[i + 1] == '"') {
-            unescaped_content[j++] = '"';
-            i++;
-        } else {
-            unescaped_content[j++] = content[i];
-        }
-    }
-    unescaped_content[j] = '\0';
-
     char exec_output[BUFFER_SIZE * 2] = {0};
-    FILE *pipe = popen(unescaped_content, "r");
+    FILE *pipe = popen(content, "r");
     if (!pipe) {
         send_response(client_fd, "{\"status\":\"ERR\",\"reason\":\"EXEC_FAILED\"}");
         return;
@@ -1157,41 +1310,20 @@ void handle_exec(int client_fd, const char *request, const char *username) {
 
     int exit_code = pclose(pipe);
 
-    char escaped_output[BUFFER_SIZE * 2];
-    int k = 0;
-    for (int i = 0; i < (int)strlen(exec_output) && k < (int)sizeof(escaped_output) - 2; i++) {
-        if (exec_output[i] == '"') {
-            escaped_output[k++] = '\\';
-            escaped_output[k++] = '"';
-        } else if (exec_output[i] == '\n') {
-            escaped_output[k++] = '\\';
-            escaped_output[k++] = 'n';
-        } else if (exec_output[i] == '\r') {
-            escaped_output[k++] = '\\';
-            escaped_output[k++] = 'r';
-        } else if (exec_output[i] == '\t') {
-            escaped_output[k++] = '\\';
-            escaped_output[k++] = 't';
-        } else if (exec_output[i] == '\\') {
-            escaped_output[k++] = '\\';
-            escaped_output[k++] = '\\';
-        } else {
-            escaped_output[k++] = exec_output[i];
-        }
-    }
-    escaped_output[k] = '\0';
-
     char response[BUFFER_SIZE * 3];
     int final_exit = WIFEXITED(exit_code) ? WEXITSTATUS(exit_code) : 1;
-    snprintf(response, sizeof(response),
-             "{\"status\":\"OK\",\"output\":\"%s\",\"exit_code\":%d}",
-             escaped_output, final_exit);
-    send_response(client_fd, response);
+    JsonWriter w;
+    json_writer_init(&w, response, sizeof(response));
+    json_write_begin_object(&w, NULL);
+    json_write_string(&w, "status", "OK");
+    json_write_string(&w, "output", exec_output);
+    json_write_int(&w, "exit_code", final_exit);
+    json_write_end_object(&w);
+    const char *reply = json_writer_finish(&w, NULL);
+    send_response(client_fd, reply ? reply : "{\"status\":\"ERR\",\"reason\":\"EXEC_FAILED\"}");
 
     char log_msg[512];
     snprintf(log_msg, sizeof(log_msg), "EXEC: %s by %s (exit_code=%d)",
              filename, username, final_exit);
     log_message("INFO", log_msg, "0.0.0.0", 0, username);
-
-    save_metadata();
 }
@@ -0,0 +1,90 @@
+#include "nm_health.h"
+#include "nm_logging.h"
+
+static int health_running = 0;
+
+/* Monotonic, so a wall-clock step cannot expire every server at once. */
+time_t health_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+int health_find_ss(const char *advertised_ip, const char *observed_ip, int client_port) {
+    for (int i = 0; i < ss_count; i++) {
+        if (storage_servers[i].client_port != client_port) {
+            continue;
+        }
+        if ((advertised_ip && advertised_ip[0] && strcmp(storage_servers[i].ip, advertised_ip) == 0) ||
+            (observed_ip && strcmp(storage_servers[i].ip, observed_ip) == 0)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void health_heartbeat(int index) {
+    StorageServer *ss = &storage_servers[index];
+    ss->last_heartbeat = health_now();
+    if (!ss->active) {
+        ss->active = 1;
+        char log_msg[128];
+        snprintf(log_msg, sizeof(log_msg), "Storage Server %s:%d is back online", ss->ip, ss->client_port);
+        log_message("INFO", log_msg, ss->ip, ss->client_port, "SS");
+    }
+}
+
+int health_ss_alive(const char *ip, int client_port) {
+    int alive = 1;
+    pthread_mutex_lock(&ss_mutex);
+    for (int i = 0; i < ss_count; i++) {
+        if (storage_servers[i].client_port == client_port && strcmp(storage_servers[i].ip, ip) == 0) {
+            alive = storage_servers[i].active;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ss_mutex);
+    return alive;
+}
+
+static void expire_silent_servers(void) {
+    time_t now = health_now();
+    pthread_mutex_lock(&ss_mutex);
+    for (int i = 0; i < ss_count; i++) {
+        StorageServer *ss = &storage_servers[i];
+        if (ss->active && now - ss->last_heartbeat > NM_SS_HEARTBEAT_TIMEOUT_SECS) {
+            ss->active = 0;
+            char log_msg[128];
+            snprintf(log_msg, sizeof(log_msg), "Storage Server %s:%d missed heartbeats; marked offline",
+                     ss->ip, ss->client_port);
+            log_message("WARN", log_msg, ss->ip, ss->client_port, "SS");
+        }
+    }
+    pthread_mutex_unlock(&ss_mutex);
+}
+
+static void *health_thread(void *arg) {
+    (void)arg;
+    struct timespec interval;
+    interval.tv_sec = NM_SS_HEALTH_CHECK_MS / 1000;
+    interval.tv_nsec = (long)(NM_SS_HEALTH_CHECK_MS % 1000) * 1000000L;
+    while (1) {
+        nanosleep(&interval, NULL);
+        expire_silent_servers();
+    }
+    return NULL;
+}
+
+int health_start(void) {
+    if (health_running) {
+        return 0;
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, health_thread, NULL) != 0) {
+        return -1;
+    }
+    pthread_detach(tid);
+    health_running = 1;
+    return 0;
+}
@@ -0,0 +1,362 @@
+#include "nm_journal.h"
+#include "nm_cache.h"
+#include "nm_file_table.h"
+#include "nm_logging.h"
+#include "nm_metadata.h"
+
+/*
+ * Records are appended to an in-memory batch under journal_mutex; only the
+ * flusher thread touches the journal fd. Compaction rotates the journal to
+ * JOURNAL_FILE.old before writing the snapshot, so startup replays
+ * snapshot + .old + current and every step is safe to repeat after a crash.
+ */
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} JournalBuffer;
+
+static pthread_mutex_t journal_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t journal_cond = PTHREAD_COND_INITIALIZER;
+static JournalBuffer pending;
+static int journal_fd = -1;
+static size_t journal_bytes = 0;
+static int journal_running = 0;
+
+static void old_journal_path(char *path, size_t size) {
+    snprintf(path, size, "%s.old", JOURNAL_FILE);
+}
+
+static void journal_append(const char *record, size_t len) {
+    pthread_mutex_lock(&journal_mutex);
+    if (pending.len + len > pending.cap) {
+        size_t new_cap = pending.cap ? pending.cap : 4096;
+        while (new_cap < pending.len + len) {
+            new_cap *= 2;
+        }
+        char *tmp = realloc(pending.data, new_cap);
+        if (!tmp) {
+            pthread_mutex_unlock(&journal_mutex);
+            log_message("ERROR", "Journal buffer allocation failed", "0.0.0.0", 0, "journal");
+            return;
+        }
+        pending.data = tmp;
+        pending.cap = new_cap;
+    }
+    memcpy(pending.data + pending.len, record, len);
+    pending.len += len;
+    if (pending.len >= NM_JOURNAL_BATCH_BYTES) {
+        pthread_cond_signal(&journal_cond);
+    }
+    pthread_mutex_unlock(&journal_mutex);
+}
+
+void journal_log_file(const FileMetadata *file) {
+    if (!file) {
+        return;
+    }
+
+    char *record = NULL;
+    size_t len = 0;
+    FILE *mem = open_memstream(&record, &len);
+    if (!mem) {
+        return;
+    }
+    fprintf(mem, "{\"op\":\"PUT\",\"filename\":\"%s\",\"entry\":", file->filename);
+    metadata_write_entry(mem, file);
+    fprintf(mem, "}\n");
+    fclose(mem);
+
+    journal_append(record, len);
+    free(record);
+}
+
+void journal_log_delete(const char *filename) {
+    char record[MAX_FILENAME + 64];
+    int len = snprintf(record, sizeof(record), "{\"op\":\"DEL\",\"filename\":\"%s\"}\n", filename);
+    if (len > 0 && len < (int)sizeof(record)) {
+        journal_append(record, (size_t)len);
+    }
+}
+
+void journal_log_user(const char *username) {
+    char record[MAX_USERNAME + 64];
+    int len = snprintf(record, sizeof(record), "{\"op\":\"USER\",\"username\":\"%s\"}\n", username);
+    if (len > 0 && len < (int)sizeof(record)) {
+        journal_append(record, (size_t)len);
+    }
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Write out whatever is pending; runs on the flusher thread only. */
+static int journal_flush(void) {
+    pthread_mutex_lock(&journal_mutex);
+    JournalBuffer batch = pending;
+    memset(&pending, 0, sizeof(pending));
+    pthread_mutex_unlock(&journal_mutex);
+
+    if (batch.len == 0) {
+        free(batch.data);
+        return 0;
+    }
+
+    int rc = write_all(journal_fd, batch.data, batch.len);
+    if (rc == 0) {
+        rc = fdatasync(journal_fd);
+    }
+    if (rc == 0) {
+        journal_bytes += batch.len;
+    } else {
+        log_message("ERROR", "Journal write failed", "0.0.0.0", 0, "journal");
+    }
+    free(batch.data);
+    return rc;
+}
+
+static int journal_open(void) {
+    journal_fd = open(JOURNAL_FILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (journal_fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    journal_bytes = (fstat(journal_fd, &st) == 0) ? (size_t)st.st_size : 0;
+    return 0;
+}
+
+static void sync_base_dir(void) {
+    int dir_fd = open(BASE_DIR, O_RDONLY);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+}
+
+static int journal_checkpoint(void) {
+    char old_path[1100];
+    old_journal_path(old_path, sizeof(old_path));
+
+    if (journal_flush() != 0) {
+        return -1;
+    }
+
+    /* A leftover .old means an earlier checkpoint never finished; keep it and
+     * just fold the current journal into the snapshot as well. */
+    struct stat st;
+    if (stat(old_path, &st) != 0) {
+        close(journal_fd);
+        journal_fd = -1;
+        if (rename(JOURNAL_FILE, old_path) != 0 && errno != ENOENT) {
+            journal_open();
+            return -1;
+        }
+        if (journal_open() != 0) {
+            return -1;
+        }
+        sync_base_dir();
+    }
+
+    if (!save_metadata()) {
+        log_message("ERROR", "Metadata snapshot failed; keeping journal", "0.0.0.0", 0, "journal");
+        return -1;
+    }
+    sync_base_dir();
+    unlink(old_path);
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "Metadata checkpoint written (journal now %zu bytes)", journal_bytes);
+    log_message("INFO", log_msg, "0.0.0.0", 0, "journal");
+    return 0;
+}
+
+static void *journal_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&journal_mutex);
+        if (pending.len < NM_JOURNAL_BATCH_BYTES) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += (long)NM_JOURNAL_FLUSH_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&journal_cond, &journal_mutex, &deadline);
+        }
+        pthread_mutex_unlock(&journal_mutex);
+
+        journal_flush();
+        if (journal_bytes >= NM_JOURNAL_COMPACT_BYTES) {
+            journal_checkpoint();
+        }
+    }
+    return NULL;
+}
+
+/* Startup only: state is still single-threaded, so no table locks are taken. */
+static void replay_put(const char *filename, const JsonField *entry) {
+    FileMetadata *parsed = metadata_parse_entry(filename, entry->value, entry->value_len);
+    if (!parsed) {
+        return;
+    }
+
+    FileMetadata *existing = file_table_find(filename);
+    if (!existing) {
+        insert_file(parsed);
+        return;
+    }
+
+    AccessEntry *old_access = existing->access_list;
+    *existing = *parsed;
+    free(parsed);
+    while (old_access) {
+        AccessEntry *next = old_access->next;
+        free(old_access);
+        old_access = next;
+    }
+}
+
+static void replay_delete(const char *filename) {
+    FileMetadata *existing = file_table_find(filename);
+    if (existing) {
+        existing->active = 0;
+        cache_remove(filename);
+    }
+}
+
+static void replay_user(const char *username) {
+    for (int i = 0; i < client_count; i++) {
+        if (strcmp(clients[i].username, username) == 0) {
+            return;
+        }
+    }
+    if (client_count < MAX_CLIENTS) {
+        strncpy(clients[client_count].username, username, sizeof(clients[client_count].username) - 1);
+        clients[client_count].username[sizeof(clients[client_count].username) - 1] = '\0';
+        clients[client_count].active = 0;
+        client_count++;
+    }
+}
+
+static int replay_file(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return 0;
+    }
+
+    int applied = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t n;
+    while ((n = getline(&line, &line_cap, fp)) > 0) {
+        /* a torn final record from a crash has no newline; drop it */
+        if (line[n - 1] != '\n') {
+            break;
+        }
+        line[n - 1] = '\0';
+
+        JsonMessage record;
+        json_parse(&record, line, (size_t)(n - 1));
+
+        char op[16] = {0};
+        char name[MAX_FILENAME] = {0};
+        json_field_string(&record, "op", op, sizeof(op));
+
+        if (strcmp(op, "PUT") == 0) {
+            json_field_string(&record, "filename", name, sizeof(name));
+            const JsonField *entry = json_find(&record, "entry");
+            if (name[0] && entry && entry->type == JSON_OBJECT) {
+                replay_put(name, entry);
+                applied++;
+            }
+        } else if (strcmp(op, "DEL") == 0) {
+            json_field_string(&record, "filename", name, sizeof(name));
+            if (name[0]) {
+                replay_delete(name);
+                applied++;
+            }
+        } else if (strcmp(op, "USER") == 0) {
+            char username[MAX_USERNAME] = {0};
+            json_field_string(&record, "username", username, sizeof(username));
+            if (username[0]) {
+                replay_user(username);
+                applied++;
+            }
+        }
+    }
+
+    free(line);
+    fclose(fp);
+    return applied;
+}
+
+void journal_replay(void) {
+    char old_path[1100];
+    old_journal_path(old_path, sizeof(old_path));
+
+    int applied = replay_file(old_path);
+    applied += replay_file(JOURNAL_FILE);
+
+    if (applied > 0) {
+        char log_msg[128];
+        snprintf(log_msg, sizeof(log_msg), "Replayed %d journal records", applied);
+        log_message("INFO", log_msg, "0.0.0.0", 0, "journal");
+    }
+}
+
+void journal_discard(void) {
+    char old_path[1100];
+    old_journal_path(old_path, sizeof(old_path));
+
+    unlink(old_path);
+    unlink(JOURNAL_FILE);
+    sync_base_dir();
+    log_message("INFO", "Discarded metadata journal", "0.0.0.0", 0, "journal");
+}
+
+int journal_start(void) {
+    if (journal_running) {
+        return 0;
+    }
+    if (journal_open() != 0) {
+        return -1;
+    }
+
+    /* Nothing else is running yet, so everything replayed can be folded into
+     * a fresh snapshot and both journals dropped. */
+    char old_path[1100];
+    old_journal_path(old_path, sizeof(old_path));
+    struct stat st;
+    if (journal_bytes > 0 || stat(old_path, &st) == 0) {
+        if (save_metadata()) {
+            sync_base_dir();
+            unlink(old_path);
+            if (ftruncate(journal_fd, 0) == 0) {
+                fsync(journal_fd);
+                journal_bytes = 0;
+            }
+        }
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, journal_thread, NULL) != 0) {
+        return -1;
+    }
+    pthread_detach(tid);
+    journal_running = 1;
+    return 0;
+}
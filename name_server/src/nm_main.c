@@ -1,28 +1,43 @@
 #include "nm_common.h"
 #include "nm_cache.h"
+#include "nm_file_table.h"
+#include "nm_health.h"
+#include "nm_journal.h"
 #include "nm_logging.h"
 #include "nm_metadata.h"
 #include "nm_network.h"
+#include "nm_reactor.h"
+#include "nm_stats.h"
 
 char BASE_DIR[1024] = "./name_server";
 char LOG_DIR[1024];
 char METADATA_FILE[1024];
+char JOURNAL_FILE[1024];
+char SNAPSHOT_FILE[1024];
 
 Client clients[MAX_CLIENTS];
 StorageServer storage_servers[MAX_STORAGE_SERVERS];
-HashNode *file_hash_table[MAX_FILES];
+FileTable file_table;
 LRUCache file_cache;
 int client_count = 0;
 int ss_count = 0;
 pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t ss_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t files_mutex = PTHREAD_MUTEX_INITIALIZER;
 FILE *log_file = NULL;
 pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+ShardMap shard_map;
+int shard_self = -1;
 
-void init_name_server(void) {
+void init_name_server(int cache_capacity, const char *import_json) {
     snprintf(LOG_DIR, sizeof(LOG_DIR), "%s/logs", BASE_DIR);
     snprintf(METADATA_FILE, sizeof(METADATA_FILE), "%s/metadata_store.json", BASE_DIR);
+    if (snprintf(JOURNAL_FILE, sizeof(JOURNAL_FILE), "%s/metadata_journal.log", BASE_DIR) >=
+            (int)sizeof(JOURNAL_FILE) ||
+        snprintf(SNAPSHOT_FILE, sizeof(SNAPSHOT_FILE), "%s/metadata_store.bin", BASE_DIR) >=
+            (int)sizeof(SNAPSHOT_FILE)) {
+        fprintf(stderr, "Metadata directory path too long: %s\n", BASE_DIR);
+        exit(EXIT_FAILURE);
+    }
 
     mkdir(BASE_DIR, 0755);
     mkdir(LOG_DIR, 0755);
@@ -40,21 +55,136 @@ void init_name_server(void) {
         exit(EXIT_FAILURE);
     }
 
-    memset(file_hash_table, 0, sizeof(file_hash_table));
-    init_cache();
+    file_table_init();
+    init_cache(cache_capacity);
     memset(clients, 0, sizeof(clients));
     memset(storage_servers, 0, sizeof(storage_servers));
-    load_metadata();
+    if (load_metadata(import_json) != 0) {
+        if (import_json) {
+            fprintf(stderr, "Failed to import metadata from %s\n", import_json);
+        } else {
+            fprintf(stderr, "Metadata snapshot %s is unreadable or corrupt; refusing to start over it.\n"
+                    "Restore it, or move it aside to fall back to %s\n", SNAPSHOT_FILE, METADATA_FILE);
+        }
+        exit(EXIT_FAILURE);
+    }
+    if (!import_json) {
+        journal_replay();
+    }
+    if (journal_start() != 0) {
+        fprintf(stderr, "Failed to open metadata journal %s\n", JOURNAL_FILE);
+        exit(EXIT_FAILURE);
+    }
+    if (health_start() != 0) {
+        fprintf(stderr, "Failed to start the storage server failure detector\n");
+        exit(EXIT_FAILURE);
+    }
+    if (stats_start() != 0) {
+        fprintf(stderr, "Failed to start the file stats refresher\n");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Name Server initialized with LRU cache (size: %d)\n", file_cache.capacity);
+}
 
-    printf("Name Server initialized with LRU cache (size: %d)\n", CACHE_SIZE);
+static void print_usage(const char *prog) {
+    printf("Usage: %s [--mode=epoll|threaded] [--workers=N] [--cache-size=N] [--port=N]\n"
+           "          [--shards=HOST:PORT,... --shard-index=I]\n"
+           "          [--import-json=PATH] [--export-json=PATH]\n", prog);
+    printf("  --mode=epoll     Event loop with a fixed worker pool (default)\n");
+    printf("  --mode=threaded  One thread per accepted connection\n");
+    printf("  --workers=N      Worker threads in epoll mode (default %d)\n", NM_DEFAULT_WORKERS);
+    printf("  --cache-size=N   Metadata LRU cache entries, 0 disables it (default %d)\n", CACHE_SIZE);
+    printf("  --port=N         Listen port (default %d, or this shard's port with --shards)\n", NM_PORT);
+    printf("  --shards=LIST    Every name server shard, in the same order on each one\n");
+    printf("  --shard-index=I  Which entry of --shards this server is\n");
+    printf("  --import-json=P  Load metadata from JSON file P instead of the binary snapshot\n");
+    printf("  --export-json=P  Write the current metadata to JSON file P and exit\n");
 }
 
-int main(void) {
-    init_name_server();
+int main(int argc, char *argv[]) {
+    NmServeMode mode = NM_MODE_EPOLL;
+    int worker_count = NM_DEFAULT_WORKERS;
+    int cache_capacity = CACHE_SIZE;
+    const char *import_json = NULL;
+    const char *export_json = NULL;
+    const char *shard_list = NULL;
+    int port = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mode=epoll") == 0) {
+            mode = NM_MODE_EPOLL;
+        } else if (strcmp(argv[i], "--mode=threaded") == 0) {
+            mode = NM_MODE_THREADED;
+        } else if (strncmp(argv[i], "--workers=", 10) == 0) {
+            worker_count = atoi(argv[i] + 10);
+            if (worker_count <= 0) {
+                fprintf(stderr, "Invalid worker count. Using %d\n", NM_DEFAULT_WORKERS);
+                worker_count = NM_DEFAULT_WORKERS;
+            }
+        } else if (strncmp(argv[i], "--cache-size=", 13) == 0) {
+            cache_capacity = atoi(argv[i] + 13);
+            if (cache_capacity < 0) {
+                fprintf(stderr, "Invalid cache size. Using %d\n", CACHE_SIZE);
+                cache_capacity = CACHE_SIZE;
+            }
+        } else if (strncmp(argv[i], "--port=", 7) == 0) {
+            port = atoi(argv[i] + 7);
+            if (port <= 0 || port > 65535) {
+                fprintf(stderr, "Invalid port. Using %d\n", NM_PORT);
+                port = 0;
+            }
+        } else if (strncmp(argv[i], "--shards=", 9) == 0 && argv[i][9]) {
+            shard_list = argv[i] + 9;
+        } else if (strncmp(argv[i], "--shard-index=", 14) == 0 && argv[i][14]) {
+            shard_self = atoi(argv[i] + 14);
+        } else if (strncmp(argv[i], "--import-json=", 14) == 0 && argv[i][14]) {
+            import_json = argv[i] + 14;
+        } else if (strncmp(argv[i], "--export-json=", 14) == 0 && argv[i][14]) {
+            export_json = argv[i] + 14;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (shard_list) {
+        if (shard_map_parse(&shard_map, shard_list) != 0) {
+            fprintf(stderr, "Invalid shard list '%s' (at most %d HOST:PORT entries)\n", shard_list, SHARD_MAX);
+            return 1;
+        }
+        if (shard_self < 0 || shard_self >= shard_map.count) {
+            fprintf(stderr, "--shards needs --shard-index between 0 and %d\n", shard_map.count - 1);
+            return 1;
+        }
+        if (port == 0) {
+            port = shard_map.shards[shard_self].port;
+        }
+        /* shards started from one directory keep separate metadata */
+        mkdir(BASE_DIR, 0755);
+        size_t base_len = strlen(BASE_DIR);
+        snprintf(BASE_DIR + base_len, sizeof(BASE_DIR) - base_len, "/shard-%d", shard_self);
+    } else if (shard_self >= 0) {
+        fprintf(stderr, "--shard-index needs --shards\n");
+        return 1;
+    }
+    if (port == 0) {
+        port = NM_PORT;
+    }
+
+    init_name_server(cache_capacity, import_json);
+
+    if (export_json) {
+        if (!export_metadata_json(export_json)) {
+            fprintf(stderr, "Failed to export metadata to %s\n", export_json);
+            return 1;
+        }
+        printf("Metadata exported to %s\n", export_json);
+        return 0;
+    }
 
     int server_fd;
     struct sockaddr_in address;
-    int addrlen = sizeof(address);
 
     server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd < 0) {
@@ -70,48 +200,27 @@ int main(void) {
 
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(NM_PORT);
+    address.sin_port = htons(port);
 
     if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
         perror("Bind failed");
         exit(EXIT_FAILURE);
     }
 
-    if (listen(server_fd, 10) < 0) {
+    if (listen(server_fd, SOMAXCONN) < 0) {
         perror("Listen failed");
         exit(EXIT_FAILURE);
     }
 
-    printf("Name Server started on port %d\n", NM_PORT);
-    log_message("INFO", "Name Server started", "127.0.0.1", NM_PORT, "system");
-
-    while (1) {
-        int new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen);
-        if (new_socket < 0) {
-            perror("Accept failed");
-            continue;
-        }
-
-        char client_ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &address.sin_addr, client_ip, INET_ADDRSTRLEN);
-        printf("New connection from %s:%d\n", client_ip, ntohs(address.sin_port));
-
-        pthread_t thread_id;
-        int *pclient = malloc(sizeof(int));
-        if (!pclient) {
-            close(new_socket);
-            continue;
-        }
-        *pclient = new_socket;
-
-        if (pthread_create(&thread_id, NULL, handle_connection, pclient) != 0) {
-            perror("Thread creation failed");
-            free(pclient);
-            close(new_socket);
-            continue;
-        }
-        pthread_detach(thread_id);
+    printf("Name Server started on port %d (%s mode)\n", port,
+           mode == NM_MODE_EPOLL ? "epoll" : "threaded");
+    if (shard_map.count > 0) {
+        printf("Serving shard %d of %d; metadata in %s\n", shard_self, shard_map.count, BASE_DIR);
     }
+    log_message("INFO", "Name Server started", "127.0.0.1", port, "system");
 
-    return 0;
+    if (mode == NM_MODE_EPOLL) {
+        return run_epoll_server(server_fd, worker_count) == 0 ? 0 : EXIT_FAILURE;
+    }
+    return run_threaded_server(server_fd);
 }
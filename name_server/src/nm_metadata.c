@@ -1,14 +1,9 @@
 #include "nm_metadata.h"
 #include "nm_cache.h"
-
-static unsigned int hash_function(const char *str) {
-    unsigned int hash = 5381;
-    int c;
-    while (str && (c = *str++)) {
-        hash = ((hash << 5) + hash) + (unsigned int)c;
-    }
-    return hash % MAX_FILES;
-}
+#include "nm_file_table.h"
+#include "nm_journal.h"
+#include "nm_logging.h"
+#include "nm_snapshot.h"
 
 FileMetadata *lookup_file(const char *filename) {
     if (!filename) {
@@ -20,17 +15,11 @@ FileMetadata *lookup_file(const char *filename) {
         return cached;
     }
 
-    unsigned int index = hash_function(filename);
-    HashNode *node = file_hash_table[index];
-
-    while (node) {
-        if (strcmp(node->key, filename) == 0 && node->file->active) {
-            cache_put(filename, node->file);
-            return node->file;
-        }
-        node = node->next;
+    FileMetadata *file = file_table_find(filename);
+    if (file) {
+        cache_put(filename, file);
     }
-    return NULL;
+    return file;
 }
 
 void insert_file(FileMetadata *file) {
@@ -38,18 +27,9 @@ void insert_file(FileMetadata *file) {
         return;
     }
 
-    unsigned int index = hash_function(file->filename);
-    HashNode *new_node = malloc(sizeof(HashNode));
-    if (!new_node) {
-        return;
+    if (file_table_insert(file)) {
+        cache_put(file->filename, file);
     }
-
-    strncpy(new_node->key, file->filename, sizeof(new_node->key) - 1);
-    new_node->key[sizeof(new_node->key) - 1] = '\0';
-    new_node->file = file;
-    new_node->next = file_hash_table[index];
-    file_hash_table[index] = new_node;
-    cache_put(file->filename, file);
 }
 
 int check_access(FileMetadata *file, const char *username, const char *required_mode) {
@@ -76,184 +56,73 @@ int check_access(FileMetadata *file, const char *username, const char *required_
     return 0;
 }
 
-static const char *skip_ws(const char *p) {
-    while (p && *p && (unsigned char)*p <= ' ') {
-        p++;
-    }
-    return p;
-}
+void metadata_write_entry(FILE *fp, const FileMetadata *file) {
+    char created_str[64];
+    char modified_str[64];
+    char accessed_str[64];
 
-void parse_json_string(const char *json, const char *key, char *value, int max_len) {
-    if (!json || !key || !value || max_len <= 0) {
-        return;
-    }
-
-    char search_key[128];
-    snprintf(search_key, sizeof(search_key), "\"%s\"", key);
-
-    const char *pos = strstr(json, search_key);
-    if (!pos) {
-        return;
-    }
-
-    pos = strchr(pos, ':');
-    if (!pos) {
-        return;
-    }
-    pos++;
+    struct tm tm_info;
+    localtime_r(&file->created_at, &tm_info);
+    strftime(created_str, sizeof(created_str), "%Y-%m-%d %H:%M:%S", &tm_info);
 
-    pos = skip_ws(pos);
-    if (*pos != '"') {
-        return;
-    }
-    pos++;
+    localtime_r(&file->last_modified, &tm_info);
+    strftime(modified_str, sizeof(modified_str), "%Y-%m-%d %H:%M:%S", &tm_info);
 
-    const char *end = pos;
-    while (*end && *end != '"') {
-        if (*end == '\\' && *(end + 1)) {
-            end += 2;
-            continue;
-        }
-        end++;
-    }
-    if (*end != '"') {
-        return;
-    }
+    localtime_r(&file->last_accessed, &tm_info);
+    strftime(accessed_str, sizeof(accessed_str), "%Y-%m-%d %H:%M:%S", &tm_info);
 
-    int len = (int)(end - pos);
-    if (len >= max_len) {
-        len = max_len - 1;
-    }
+    fprintf(fp, "{\"owner\": \"%s\", \"ss_ip\": \"%s\", \"ss_port\": %d, \"backup_ss_ip\": \"%s\", \"backup_ss_port\": %d, \"created_at\": \"%s\", \"last_modified\": \"%s\", \"last_accessed\": \"%s\", \"last_accessed_by\": \"%s\", \"words\": %d, \"chars\": %d, \"bytes\": %d, \"access\": [",
+            file->owner, file->ss_ip, file->ss_port, file->backup_ss_ip, file->backup_ss_port,
+            created_str, modified_str, accessed_str, file->last_accessed_by, file->words, file->chars, file->bytes);
 
-    int idx = 0;
-    while (pos < end && idx < len) {
-        if (*pos == '\\' && (pos + 1) < end) {
-            pos++;
-            switch (*pos) {
-                case 'n': value[idx++] = '\n'; break;
-                case 'r': value[idx++] = '\r'; break;
-                case 't': value[idx++] = '\t'; break;
-                case '\\': value[idx++] = '\\'; break;
-                case '"': value[idx++] = '"'; break;
-                case '/': value[idx++] = '/'; break;
-                default: value[idx++] = *pos; break;
-            }
-            pos++;
-        } else {
-            value[idx++] = *pos++;
+    AccessEntry *entry = file->access_list;
+    int first_access = 1;
+    while (entry) {
+        if (!first_access) {
+            fprintf(fp, ", ");
         }
+        first_access = 0;
+        fprintf(fp, "{\"user\": \"%s\", \"mode\": \"%s\"}", entry->username, entry->mode);
+        entry = entry->next;
     }
-    value[idx] = '\0';
-}
-
-int parse_json_int(const char *json, const char *key) {
-    if (!json || !key) {
-        return 0;
-    }
-
-    char search_key[128];
-    snprintf(search_key, sizeof(search_key), "\"%s\"", key);
-
-    const char *pos = strstr(json, search_key);
-    if (!pos) {
-        return 0;
-    }
-
-    pos = strchr(pos, ':');
-    if (!pos) {
-        return 0;
-    }
-    pos++;
 
-    pos = skip_ws(pos);
-    return atoi(pos);
+    fprintf(fp, "]}");
 }
 
-int request_file_stats(const char *ip, int port, const char *filename,
-                       int *words, int *chars, int *bytes) {
-    if (!ip || !filename) {
-        return 0;
-    }
-
-    int ss_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (ss_fd < 0) {
-        return 0;
-    }
-
-    struct sockaddr_in ss_addr;
-    memset(&ss_addr, 0, sizeof(ss_addr));
-    ss_addr.sin_family = AF_INET;
-    ss_addr.sin_port = htons(port);
-    if (inet_pton(AF_INET, ip, &ss_addr.sin_addr) <= 0) {
-        close(ss_fd);
-        return 0;
-    }
-
-    if (connect(ss_fd, (struct sockaddr *)&ss_addr, sizeof(ss_addr)) < 0) {
-        close(ss_fd);
-        return 0;
-    }
-
-    char stat_req[256];
-    int len = snprintf(stat_req, sizeof(stat_req),
-                       "{\"cmd\":\"STAT\",\"filename\":\"%s\"}\n",
-                       filename);
-    if (len <= 0) {
-        close(ss_fd);
-        return 0;
-    }
+typedef struct {
+    FILE *fp;
+    int first;
+} MetadataWriter;
 
-    if (send(ss_fd, stat_req, len, 0) < 0) {
-        close(ss_fd);
-        return 0;
-    }
+static int write_file_entry(FileMetadata *file, void *arg) {
+    MetadataWriter *writer = arg;
 
-    char stat_resp[512];
-    int total = 0;
-    int done = 0;
-    while (!done && total < (int)sizeof(stat_resp) - 1) {
-        int chunk = recv(ss_fd, stat_resp + total, (int)sizeof(stat_resp) - 1 - total, 0);
-        if (chunk <= 0) {
-            break;
-        }
-        total += chunk;
-        for (int i = total - chunk; i < total; i++) {
-            if (stat_resp[i] == '\n') {
-                done = 1;
-                total = i + 1;
-                break;
-            }
-        }
-    }
-    close(ss_fd);
-
-    if (total <= 0) {
-        return 0;
+    if (!writer->first) {
+        fprintf(writer->fp, ",\n");
     }
+    writer->first = 0;
 
-    stat_resp[total] = '\0';
-    if (total > 0 && stat_resp[total - 1] == '\n') {
-        stat_resp[total - 1] = '\0';
-    }
-
-    if (!strstr(stat_resp, "\"status\":\"OK\"")) {
-        return 0;
-    }
-
-    if (words) *words = parse_json_int(stat_resp, "words");
-    if (chars) *chars = parse_json_int(stat_resp, "chars");
-    if (bytes) *bytes = parse_json_int(stat_resp, "bytes");
+    fprintf(writer->fp, "    \"%s\": ", file->filename);
+    metadata_write_entry(writer->fp, file);
     return 1;
 }
 
-void save_metadata(void) {
-    FILE *fp = fopen(METADATA_FILE, "w");
+/*
+ * Export the metadata as JSON (the pre-snapshot format). Written to a
+ * temporary file that is fsynced and renamed over path. Returns 1 on success.
+ */
+int export_metadata_json(const char *path) {
+    char tmp_path[1100];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *fp = fopen(tmp_path, "w");
     if (!fp) {
-        return;
+        return 0;
     }
 
     fprintf(fp, "{\n  \"users\": [");
 
+    pthread_mutex_lock(&clients_mutex);
     int first = 1;
     for (int i = 0; i < client_count; i++) {
         if (!first) {
@@ -262,79 +131,181 @@ void save_metadata(void) {
         first = 0;
         fprintf(fp, "\"%s\"", clients[i].username);
     }
+    pthread_mutex_unlock(&clients_mutex);
 
     fprintf(fp, "],\n  \"files\": {\n");
 
-    first = 1;
-    for (int i = 0; i < MAX_FILES; i++) {
-        HashNode *node = file_hash_table[i];
-        while (node) {
-            FileMetadata *file = node->file;
-            if (file->active) {
-                if (!first) {
-                    fprintf(fp, ",\n");
-                }
-                first = 0;
+    MetadataWriter writer = {fp, 1};
+    file_table_foreach(write_file_entry, &writer, 0);
 
-                char created_str[64];
-                char modified_str[64];
-                char accessed_str[64];
+    fprintf(fp, "\n  }\n}\n");
 
-                struct tm *tm_info = localtime(&file->created_at);
-                strftime(created_str, sizeof(created_str), "%Y-%m-%d %H:%M:%S", tm_info);
+    int ok = (fflush(fp) == 0 && fsync(fileno(fp)) == 0);
+    if (fclose(fp) != 0) {
+        ok = 0;
+    }
+    if (ok && rename(tmp_path, path) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        unlink(tmp_path);
+    }
+    return ok;
+}
 
-                tm_info = localtime(&file->last_modified);
-                strftime(modified_str, sizeof(modified_str), "%Y-%m-%d %H:%M:%S", tm_info);
+/* Write a full binary snapshot; saves are serialized against each other. */
+static pthread_mutex_t save_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-                tm_info = localtime(&file->last_accessed);
-                strftime(accessed_str, sizeof(accessed_str), "%Y-%m-%d %H:%M:%S", tm_info);
+int save_metadata(void) {
+    pthread_mutex_lock(&save_mutex);
+    int ok = snapshot_save(SNAPSHOT_FILE);
+    pthread_mutex_unlock(&save_mutex);
+    return ok;
+}
 
-                fprintf(fp, "    \"%s\": {\"owner\": \"%s\", \"ss_ip\": \"%s\", \"ss_port\": %d, \"backup_ss_ip\": \"%s\", \"backup_ss_port\": %d, \"created_at\": \"%s\", \"last_modified\": \"%s\", \"last_accessed\": \"%s\", \"last_accessed_by\": \"%s\", \"words\": %d, \"chars\": %d, \"bytes\": %d, \"access\": [",
-                        file->filename, file->owner, file->ss_ip, file->ss_port, file->backup_ss_ip, file->backup_ss_port,
-                        created_str, modified_str, accessed_str, file->last_accessed_by, file->words, file->chars, file->bytes);
+FileMetadata *metadata_parse_entry(const char *filename, const char *entry, size_t len) {
+    JsonMessage msg;
+    json_parse(&msg, entry, len);
 
-                AccessEntry *entry = file->access_list;
-                int first_access = 1;
-                while (entry) {
-                    if (!first_access) {
-                        fprintf(fp, ", ");
-                    }
-                    first_access = 0;
-                    fprintf(fp, "{\"user\": \"%s\", \"mode\": \"%s\"}", entry->username, entry->mode);
-                    entry = entry->next;
-                }
+    FileMetadata *file = malloc(sizeof(FileMetadata));
+    if (!file) {
+        return NULL;
+    }
+    memset(file, 0, sizeof(*file));
+    strncpy(file->filename, filename, sizeof(file->filename) - 1);
+    file->filename[sizeof(file->filename) - 1] = '\0';
+    json_field_string(&msg, "owner", file->owner, sizeof(file->owner));
+    json_field_string(&msg, "ss_ip", file->ss_ip, sizeof(file->ss_ip));
+    json_field_int(&msg, "ss_port", &file->ss_port);
+    json_field_string(&msg, "backup_ss_ip", file->backup_ss_ip, sizeof(file->backup_ss_ip));
+    json_field_int(&msg, "backup_ss_port", &file->backup_ss_port);
+    file->active = 1;
+
+    char created_str[64] = {0};
+    char modified_str[64] = {0};
+    char accessed_str[64] = {0};
+    char accessed_by[MAX_USERNAME] = {0};
+
+    json_field_string(&msg, "created_at", created_str, sizeof(created_str));
+    json_field_string(&msg, "last_modified", modified_str, sizeof(modified_str));
+    json_field_string(&msg, "last_accessed", accessed_str, sizeof(accessed_str));
+    json_field_string(&msg, "last_accessed_by", accessed_by, sizeof(accessed_by));
+
+    if (strlen(created_str) > 0) {
+        struct tm tm = {0};
+        strptime(created_str, "%Y-%m-%d %H:%M:%S", &tm);
+        file->created_at = mktime(&tm);
+    } else {
+        file->created_at = time(NULL);
+    }
+
+    if (strlen(modified_str) > 0) {
+        struct tm tm = {0};
+        strptime(modified_str, "%Y-%m-%d %H:%M:%S", &tm);
+        file->last_modified = mktime(&tm);
+    } else {
+        file->last_modified = file->created_at;
+    }
+
+    if (strlen(accessed_str) > 0) {
+        struct tm tm = {0};
+        strptime(accessed_str, "%Y-%m-%d %H:%M:%S", &tm);
+        file->last_accessed = mktime(&tm);
+    } else {
+        file->last_accessed = file->created_at;
+    }
+
+    if (strlen(accessed_by) > 0) {
+        strncpy(file->last_accessed_by, accessed_by, sizeof(file->last_accessed_by) - 1);
+        file->last_accessed_by[sizeof(file->last_accessed_by) - 1] = '\0';
+    } else {
+        strncpy(file->last_accessed_by, file->owner, sizeof(file->last_accessed_by) - 1);
+        file->last_accessed_by[sizeof(file->last_accessed_by) - 1] = '\0';
+    }
+
+    json_field_int(&msg, "words", &file->words);
+    json_field_int(&msg, "chars", &file->chars);
+    json_field_int(&msg, "bytes", &file->bytes);
+    file->access_list = NULL;
+
+    AccessEntry *head = NULL;
+    AccessEntry **tail = &head;
+
+    const char *cursor = json_field_array(&msg, "access");
+    while (cursor && *cursor) {
+        while (*cursor && (isspace((unsigned char)*cursor) || *cursor == ',')) {
+            cursor++;
+        }
+        if (*cursor == ']' || *cursor == '\0') {
+            break;
+        }
+        if (*cursor != '{') {
+            cursor++;
+            continue;
+        }
 
-                fprintf(fp, "]}");
+        const char *obj_start = cursor++;
+        int obj_depth = 1;
+        while (*cursor && obj_depth > 0) {
+            if (*cursor == '{') {
+                obj_depth++;
+            } else if (*cursor == '}') {
+                obj_depth--;
             }
-            node = node->next;
+            cursor++;
+        }
+        if (obj_depth != 0) {
+            break;
         }
+
+        JsonMessage access_obj;
+        json_parse(&access_obj, obj_start, (size_t)(cursor - obj_start));
+
+        AccessEntry *new_entry = malloc(sizeof(AccessEntry));
+        if (!new_entry) {
+            break;
+        }
+        memset(new_entry, 0, sizeof(*new_entry));
+        json_field_string(&access_obj, "user", new_entry->username, sizeof(new_entry->username));
+        json_field_string(&access_obj, "mode", new_entry->mode, sizeof(new_entry->mode));
+        if (new_entry->username[0] == '\0') {
+            free(new_entry);
+            continue;
+        }
+        if (new_entry->mode[0] == '\0') {
+            strcpy(new_entry->mode, "R");
+        }
+        new_entry->next = NULL;
+        *tail = new_entry;
+        tail = &new_entry->next;
     }
 
-    fprintf(fp, "\n  }\n}\n");
-    fclose(fp);
+    file->access_list = head;
+    return file;
 }
 
-void load_metadata(void) {
-    FILE *fp = fopen(METADATA_FILE, "r");
+/* Returns the number of files imported, or -1 if path cannot be read. */
+long import_metadata_json(const char *path) {
+    FILE *fp = fopen(path, "r");
     if (!fp) {
-        return;
+        return -1;
     }
 
     if (fseek(fp, 0, SEEK_END) != 0) {
         fclose(fp);
-        return;
+        return -1;
     }
     long size = ftell(fp);
     if (size < 0) {
         fclose(fp);
-        return;
+        return -1;
     }
     rewind(fp);
 
     char *json = malloc((size_t)size + 1);
     if (!json) {
         fclose(fp);
-        return;
+        return -1;
     }
 
     size_t read_bytes = fread(json, 1, (size_t)size, fp);
@@ -378,6 +349,7 @@ void load_metadata(void) {
         }
     }
 
+    long imported = 0;
     const char *files_section = strstr(json, "\"files\"");
     if (files_section) {
         const char *cursor = strchr(files_section, '{');
@@ -425,148 +397,59 @@ void load_metadata(void) {
                 if (brace_depth != 0) {
                     break;
                 }
-                size_t entry_len = (size_t)((entry_end - 1) - entry_start);
-                if (entry_len >= 1024) {
-                    entry_len = 1023;
-                }
-                char entry_buf[1024];
-                memcpy(entry_buf, entry_start, entry_len);
-                entry_buf[entry_len] = '\0';
-
-                FileMetadata *file = malloc(sizeof(FileMetadata));
+                FileMetadata *file = metadata_parse_entry(filename, entry_start - 1,
+                                                          (size_t)(entry_end - (entry_start - 1)));
                 if (!file) {
                     break;
                 }
-                memset(file, 0, sizeof(*file));
-                strncpy(file->filename, filename, sizeof(file->filename) - 1);
-                file->filename[sizeof(file->filename) - 1] = '\0';
-                parse_json_string(entry_buf, "owner", file->owner, sizeof(file->owner));
-                parse_json_string(entry_buf, "ss_ip", file->ss_ip, sizeof(file->ss_ip));
-                file->ss_port = parse_json_int(entry_buf, "ss_port");
-                parse_json_string(entry_buf, "backup_ss_ip", file->backup_ss_ip, sizeof(file->backup_ss_ip));
-                file->backup_ss_port = parse_json_int(entry_buf, "backup_ss_port");
-                file->active = 1;
-
-                char created_str[64] = {0};
-                char modified_str[64] = {0};
-                char accessed_str[64] = {0};
-                char accessed_by[MAX_USERNAME] = {0};
-
-                parse_json_string(entry_buf, "created_at", created_str, sizeof(created_str));
-                parse_json_string(entry_buf, "last_modified", modified_str, sizeof(modified_str));
-                parse_json_string(entry_buf, "last_accessed", accessed_str, sizeof(accessed_str));
-                parse_json_string(entry_buf, "last_accessed_by", accessed_by, sizeof(accessed_by));
-
-                if (strlen(created_str) > 0) {
-                    struct tm tm = {0};
-                    strptime(created_str, "%Y-%m-%d %H:%M:%S", &tm);
-                    file->created_at = mktime(&tm);
-                } else {
-                    file->created_at = time(NULL);
-                }
-
-                if (strlen(modified_str) > 0) {
-                    struct tm tm = {0};
-                    strptime(modified_str, "%Y-%m-%d %H:%M:%S", &tm);
-                    file->last_modified = mktime(&tm);
-                } else {
-                    file->last_modified = file->created_at;
-                }
-
-                if (strlen(accessed_str) > 0) {
-                    struct tm tm = {0};
-                    strptime(accessed_str, "%Y-%m-%d %H:%M:%S", &tm);
-                    file->last_accessed = mktime(&tm);
-                } else {
-                    file->last_accessed = file->created_at;
-                }
-
-                if (strlen(accessed_by) > 0) {
-                    strncpy(file->last_accessed_by, accessed_by, sizeof(file->last_accessed_by) - 1);
-                    file->last_accessed_by[sizeof(file->last_accessed_by) - 1] = '\0';
-                } else {
-                    strncpy(file->last_accessed_by, file->owner, sizeof(file->last_accessed_by) - 1);
-                    file->last_accessed_by[sizeof(file->last_accessed_by) - 1] = '\0';
-                }
-
-                file->words = parse_json_int(entry_buf, "words");
-                file->chars = parse_json_int(entry_buf, "chars");
-                file->bytes = parse_json_int(entry_buf, "bytes");
-                file->access_list = NULL;
-
-                AccessEntry *head = NULL;
-                AccessEntry **tail = &head;
-
-                const char *access_pos = strstr(entry_buf, "\"access\"");
-                if (access_pos) {
-                    const char *array_start = strchr(access_pos, '[');
-                    if (array_start) {
-                        array_start++;
-                        while (*array_start) {
-                            while (*array_start && (isspace((unsigned char)*array_start) || *array_start == ',')) {
-                                array_start++;
-                            }
-                            if (*array_start == ']' || *array_start == '\0') {
-                                break;
-                            }
-                            if (*array_start != '{') {
-                                array_start++;
-                                continue;
-                            }
-
-                            array_start++;
-                            int obj_depth = 1;
-                            const char *obj_cursor = array_start;
-                            while (*obj_cursor && obj_depth > 0) {
-                                if (*obj_cursor == '{') {
-                                    obj_depth++;
-                                } else if (*obj_cursor == '}') {
-                                    obj_depth--;
-                                }
-                                obj_cursor++;
-                            }
-                            if (obj_depth != 0) {
-                                break;
-                            }
-
-                            size_t obj_len = (size_t)((obj_cursor - 1) - array_start);
-                            if (obj_len >= 256) {
-                                obj_len = 255;
-                            }
-                            char access_obj[256];
-                            memcpy(access_obj, array_start, obj_len);
-                            access_obj[obj_len] = '\0';
-
-                            AccessEntry *new_entry = malloc(sizeof(AccessEntry));
-                            if (!new_entry) {
-                                break;
-                            }
-                            memset(new_entry, 0, sizeof(*new_entry));
-                            parse_json_string(access_obj, "user", new_entry->username, sizeof(new_entry->username));
-                            parse_json_string(access_obj, "mode", new_entry->mode, sizeof(new_entry->mode));
-                            if (new_entry->username[0] == '\0') {
-                                free(new_entry);
-                                array_start = obj_cursor;
-                                continue;
-                            }
-                            if (new_entry->mode[0] == '\0') {
-                                strcpy(new_entry->mode, "R");
-                            }
-                            new_entry->next = NULL;
-                            *tail = new_entry;
-                            tail = &new_entry->next;
-
-                            array_start = obj_cursor;
-                        }
-                    }
-                }
-
-                file->access_list = head;
-                insert_file(file);
+                file_table_insert(file);
+                imported++;
                 cursor = entry_end;
             }
         }
     }
 
     free(json);
+    return imported;
+}
+
+/*
+ * Startup load: the binary snapshot when present, otherwise (or when
+ * import_json is given) the JSON store, which is then converted to a
+ * snapshot straight away. A snapshot that exists but fails to load is never
+ * replaced by the older JSON store: returns -1 and leaves it on disk.
+ * An explicit import replaces everything, journal included, and returns -1
+ * if it cannot be read or saved.
+ */
+int load_metadata(const char *import_json) {
+    char log_msg[1200];
+    long loaded = -1;
+
+    if (!import_json) {
+        loaded = snapshot_load(SNAPSHOT_FILE);
+        if (loaded >= 0) {
+            snprintf(log_msg, sizeof(log_msg), "Loaded %ld files from snapshot %s", loaded, SNAPSHOT_FILE);
+            log_message("INFO", log_msg, "0.0.0.0", 0, "system");
+            return 0;
+        }
+        if (loaded == SNAPSHOT_INVALID) {
+            return -1;
+        }
+    }
+
+    const char *json_path = import_json ? import_json : METADATA_FILE;
+    loaded = import_metadata_json(json_path);
+    if (loaded < 0) {
+        return import_json ? -1 : 0;
+    }
+
+    snprintf(log_msg, sizeof(log_msg), "Imported %ld files from %s", loaded, json_path);
+    log_message("INFO", log_msg, "0.0.0.0", 0, "system");
+    if (import_json) {
+        /* The journal holds changes on top of the state being replaced */
+        journal_discard();
+        return save_metadata() ? 0 : -1;
+    }
+    save_metadata();
+    return 0;
 }
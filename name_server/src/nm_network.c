@@ -3,39 +3,59 @@
 #include "nm_logging.h"
 #include "nm_metadata.h"
 
-void *handle_connection(void *arg) {
-    int socket_fd = *(int *)arg;
-    free(arg);
+#include <netinet/tcp.h>
 
-    struct sockaddr_in addr;
-    socklen_t addr_len = sizeof(addr);
-    getpeername(socket_fd, (struct sockaddr *)&addr, &addr_len);
-    char client_ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &addr.sin_addr, client_ip, INET_ADDRSTRLEN);
+/*
+ * A sharded server answers file commands only for the names it owns; any
+ * other gets WRONG_SHARD with the owner's index, so a client whose map is
+ * out of date fetches it again instead of seeing FILE_NOT_FOUND.
+ */
+static int reject_foreign_file(int socket_fd, const JsonMessage *request) {
+    if (shard_map.count == 0 || !json_find(request, "filename")) {
+        return 0;
+    }
 
-    char *request = read_request(socket_fd);
-    if (!request) {
-        close(socket_fd);
-        return NULL;
+    char filename[MAX_FILENAME] = {0};
+    json_field_string(request, "filename", filename, sizeof(filename));
+    int owner = shard_map_owner(&shard_map, filename);
+    if (owner == shard_self) {
+        return 0;
     }
 
+    char response[96];
+    snprintf(response, sizeof(response), "{\"status\":\"ERR\",\"reason\":\"WRONG_SHARD\",\"shard\":%d}", owner);
+    send_response(socket_fd, response);
+    return 1;
+}
+
+void dispatch_request(int socket_fd, const JsonMessage *request, const char *client_ip, int client_port) {
     char cmd[64] = {0};
-    parse_json_string(request, "cmd", cmd, sizeof(cmd));
+    json_field_string(request, "cmd", cmd, sizeof(cmd));
 
-    log_message("INFO", "Received command", client_ip, ntohs(addr.sin_port), cmd);
+    log_message("INFO", "Received command", client_ip, client_port, cmd);
 
     if (strcmp(cmd, "register_client") == 0) {
         handle_register_client(socket_fd, request, client_ip);
     } else if (strcmp(cmd, "register_ss") == 0) {
         handle_register_ss(socket_fd, request, client_ip);
+    } else if (strcmp(cmd, "SS_STATS") == 0) {
+        handle_ss_stats(socket_fd, request, client_ip);
+    } else if (strcmp(cmd, "SS_HEARTBEAT") == 0) {
+        handle_ss_heartbeat(socket_fd, request, client_ip);
+    } else if (strcmp(cmd, "SHARD_MAP") == 0) {
+        handle_shard_map(socket_fd);
     } else {
         char username[MAX_USERNAME] = {0};
-        parse_json_string(request, "username", username, sizeof(username));
+        json_field_string(request, "username", username, sizeof(username));
 
         if (strcmp(cmd, "VIEW") == 0) {
             handle_view(socket_fd, request, username);
         } else if (strcmp(cmd, "LIST") == 0) {
             handle_list(socket_fd, username);
+        } else if (strcmp(cmd, "CACHE_STATS") == 0) {
+            handle_cache_stats(socket_fd, request, username);
+        } else if (reject_foreign_file(socket_fd, request)) {
+            return;
         } else if (strcmp(cmd, "CREATE") == 0) {
             handle_create(socket_fd, request, username);
         } else if (strcmp(cmd, "INFO") == 0) {
@@ -47,7 +67,8 @@ void *handle_connection(void *arg) {
         } else if (strcmp(cmd, "DELETE") == 0) {
             handle_delete(socket_fd, request, username);
         } else if (strcmp(cmd, "READ") == 0 || strcmp(cmd, "WRITE") == 0 ||
-                   strcmp(cmd, "STREAM") == 0 || strcmp(cmd, "UNDO") == 0) {
+                   strcmp(cmd, "STREAM") == 0 || strcmp(cmd, "UNDO") == 0 ||
+                   strcmp(cmd, "VERSIONS") == 0) {
             handle_file_operation(socket_fd, request, username);
         } else if (strcmp(cmd, "EXEC") == 0) {
             handle_exec(socket_fd, request, username);
@@ -55,33 +76,248 @@ void *handle_connection(void *arg) {
             send_response(socket_fd, "{\"status\":\"ERR\",\"reason\":\"UNKNOWN_COMMAND\"}");
         }
     }
+}
+
+static __thread NmRequestContext *current_request = NULL;
+
+NmConn *conn_create(int fd) {
+    NmConn *conn = malloc(sizeof(NmConn));
+    if (!conn) {
+        return NULL;
+    }
+    memset(conn, 0, sizeof(*conn));
+    conn->fd = fd;
+    conn->refs = 1;
+    pthread_mutex_init(&conn->mutex, NULL);
+    pthread_mutex_init(&conn->write_mutex, NULL);
+
+    /* a session's replies go out one send() each; without this, Nagle holds
+     * every reply after the first until the peer's delayed ACK */
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    getpeername(fd, (struct sockaddr *)&addr, &addr_len);
+    inet_ntop(AF_INET, &addr.sin_addr, conn->ip, INET_ADDRSTRLEN);
+    conn->port = ntohs(addr.sin_port);
+    return conn;
+}
+
+void conn_retain(NmConn *conn) {
+    pthread_mutex_lock(&conn->mutex);
+    conn->refs++;
+    pthread_mutex_unlock(&conn->mutex);
+}
+
+void conn_release(NmConn *conn) {
+    if (!conn) {
+        return;
+    }
+
+    pthread_mutex_lock(&conn->mutex);
+    int remaining = --conn->refs;
+    pthread_mutex_unlock(&conn->mutex);
+    if (remaining > 0) {
+        return;
+    }
+
+    close(conn->fd);
+    pthread_mutex_destroy(&conn->mutex);
+    pthread_mutex_destroy(&conn->write_mutex);
+    free(conn->rbuf);
+    free(conn);
+}
+
+int conn_fill(NmConn *conn) {
+    if (conn->rcap - conn->rlen < BUFFER_SIZE) {
+        size_t new_cap = conn->rcap ? conn->rcap * 2 : BUFFER_SIZE * 2;
+        if (new_cap > NM_MAX_REQUEST) {
+            return -1;
+        }
+        char *tmp = realloc(conn->rbuf, new_cap);
+        if (!tmp) {
+            return -1;
+        }
+        conn->rbuf = tmp;
+        conn->rcap = new_cap;
+    }
+
+    int bytes_read = recv(conn->fd, conn->rbuf + conn->rlen, conn->rcap - conn->rlen - 1, 0);
+    if (bytes_read > 0) {
+        conn->rlen += (size_t)bytes_read;
+        conn->rbuf[conn->rlen] = '\0';
+    }
+    return bytes_read;
+}
+
+/* Legacy senders write one JSON object per send() without a trailing newline. */
+static int json_object_complete(const char *buf, size_t len) {
+    int depth = 0;
+    int in_string = 0;
+    int seen = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = buf[i];
+        if (in_string) {
+            if (c == '\\' && i + 1 < len) {
+                i++;
+            } else if (c == '"') {
+                in_string = 0;
+            }
+        } else if (c == '"') {
+            in_string = 1;
+        } else if (c == '{') {
+            depth++;
+            seen = 1;
+        } else if (c == '}') {
+            depth--;
+        }
+    }
+    return seen && depth == 0 && !in_string;
+}
+
+char *conn_next_request(NmConn *conn) {
+    while (conn->rlen > 0) {
+        char *nl = memchr(conn->rbuf, '\n', conn->rlen);
+        size_t frame_len;
+        size_t consumed;
+        if (nl) {
+            frame_len = (size_t)(nl - conn->rbuf);
+            consumed = frame_len + 1;
+        } else if (json_object_complete(conn->rbuf, conn->rlen)) {
+            frame_len = conn->rlen;
+            consumed = conn->rlen;
+        } else {
+            return NULL;
+        }
+
+        if (frame_len > 0 && conn->rbuf[frame_len - 1] == '\r') {
+            frame_len--;
+        }
+
+        char *request = NULL;
+        if (frame_len > 0) {
+            request = malloc(frame_len + 1);
+            if (request) {
+                memcpy(request, conn->rbuf, frame_len);
+                request[frame_len] = '\0';
+            }
+        }
+
+        memmove(conn->rbuf, conn->rbuf + consumed, conn->rlen - consumed);
+        conn->rlen -= consumed;
+        conn->rbuf[conn->rlen] = '\0';
+
+        if (request) {
+            return request;
+        }
+    }
+    return NULL;
+}
+
+/* Only a top-level numeric "req_id" counts; the lookup stops at that key */
+int request_is_tagged(const char *request) {
+    int req_id;
+    return request && json_get_int(request, "req_id", &req_id);
+}
+
+int conn_handle_request(NmConn *conn, const char *request) {
+    JsonMessage msg;
+    json_parse(&msg, request, (size_t)-1);
+
+    NmRequestContext ctx;
+    ctx.conn = conn;
+    ctx.req_id = 0;
+    ctx.tagged = json_field_long(&msg, "req_id", &ctx.req_id);
+
+    current_request = &ctx;
+    dispatch_request(conn->fd, &msg, conn->ip, conn->port);
+    current_request = NULL;
+    return ctx.tagged;
+}
+
+void serve_connection(int socket_fd) {
+    NmConn *conn = conn_create(socket_fd);
+    if (!conn) {
+        close(socket_fd);
+        return;
+    }
+
+    int done = 0;
+    while (!done) {
+        int bytes_read = conn_fill(conn);
 
-    free(request);
-    close(socket_fd);
+        char *request;
+        while ((request = conn_next_request(conn)) != NULL) {
+            if (conn_handle_request(conn, request)) {
+                conn->session = 1;
+            }
+            free(request);
+            if (!conn->session) {
+                done = 1;
+                break;
+            }
+        }
+
+        if (bytes_read <= 0) {
+            done = 1;
+        }
+    }
+
+    conn_release(conn);
+}
+
+void *handle_connection(void *arg) {
+    int socket_fd = *(int *)arg;
+    free(arg);
+
+    serve_connection(socket_fd);
     return NULL;
 }
 
+static int send_all(int fd, const char *data, size_t len) {
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = send(fd, data + sent, len - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        sent += (size_t)n;
+    }
+    return 0;
+}
+
 void send_response(int fd, const char *response) {
     if (!response) {
         return;
     }
 
     int len = (int)strlen(response);
-    send(fd, response, len, 0);
-}
-
-char *read_request(int fd) {
-    char *buffer = malloc(BUFFER_SIZE);
-    if (!buffer) {
-        return NULL;
+    NmRequestContext *ctx = current_request;
+    if (!ctx || !ctx->tagged || ctx->conn->fd != fd || response[0] != '{') {
+        send(fd, response, len, MSG_NOSIGNAL);
+        return;
     }
 
-    int bytes_read = recv(fd, buffer, BUFFER_SIZE - 1, 0);
-    if (bytes_read <= 0) {
-        free(buffer);
-        return NULL;
+    char prefix[48];
+    int prefix_len = snprintf(prefix, sizeof(prefix), "{\"req_id\":%ld%s",
+                              ctx->req_id, response[1] == '}' ? "" : ",");
+    size_t total = (size_t)prefix_len + (size_t)len;
+    char *framed = malloc(total + 1);
+    if (!framed) {
+        return;
     }
+    memcpy(framed, prefix, (size_t)prefix_len);
+    memcpy(framed + prefix_len, response + 1, (size_t)len - 1);
+    framed[total - 1] = '\n';
+    framed[total] = '\0';
 
-    buffer[bytes_read] = '\0';
-    return buffer;
+    pthread_mutex_lock(&ctx->conn->write_mutex);
+    send_all(fd, framed, total);
+    pthread_mutex_unlock(&ctx->conn->write_mutex);
+    free(framed);
 }
@@ -0,0 +1,285 @@
+#include "nm_reactor.h"
+#include "nm_logging.h"
+#include "nm_network.h"
+
+#include <sys/epoll.h>
+
+/* request == NULL means "the connection is readable" */
+typedef struct {
+    NmConn *conn;
+    char *request;
+} NmJob;
+
+typedef struct {
+    NmJob *jobs;
+    int capacity;
+    int head;
+    int tail;
+    int count;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} NmWorkQueue;
+
+static NmWorkQueue work_queue;
+static int reactor_epoll_fd = -1;
+
+static void work_queue_init(NmWorkQueue *queue, int capacity) {
+    queue->jobs = malloc(sizeof(NmJob) * (size_t)capacity);
+    queue->capacity = queue->jobs ? capacity : 0;
+    queue->head = 0;
+    queue->tail = 0;
+    queue->count = 0;
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+}
+
+static void work_queue_push(NmWorkQueue *queue, NmConn *conn, char *request) {
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == queue->capacity) {
+        pthread_cond_wait(&queue->not_full, &queue->mutex);
+    }
+    queue->jobs[queue->tail].conn = conn;
+    queue->jobs[queue->tail].request = request;
+    queue->tail = (queue->tail + 1) % queue->capacity;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+/* Workers never block on a full queue; the caller runs the job itself instead. */
+static int work_queue_try_push(NmWorkQueue *queue, NmConn *conn, char *request) {
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count == queue->capacity) {
+        pthread_mutex_unlock(&queue->mutex);
+        return 0;
+    }
+    queue->jobs[queue->tail].conn = conn;
+    queue->jobs[queue->tail].request = request;
+    queue->tail = (queue->tail + 1) % queue->capacity;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+    return 1;
+}
+
+static NmJob work_queue_pop(NmWorkQueue *queue) {
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == 0) {
+        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+    }
+    NmJob job = queue->jobs[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->mutex);
+    return job;
+}
+
+static void rearm_connection(NmConn *conn) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = conn;
+    if (epoll_ctl(reactor_epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) < 0) {
+        conn_release(conn);
+    }
+}
+
+/*
+ * Tagged requests on a session are fanned out to the pool so that slow
+ * commands do not hold up the ones behind them; responses carry the req_id and
+ * may be written out of order. Untagged requests keep the old one-shot
+ * semantics and are served inline.
+ */
+static void service_readable(NmConn *conn) {
+    int bytes_read = conn_fill(conn);
+    int close_after = (bytes_read <= 0);
+
+    char *request;
+    while ((request = conn_next_request(conn)) != NULL) {
+        if (request_is_tagged(request)) {
+            conn->session = 1;
+            conn_retain(conn);
+            if (!work_queue_try_push(&work_queue, conn, request)) {
+                conn_handle_request(conn, request);
+                free(request);
+                conn_release(conn);
+            }
+            continue;
+        }
+
+        conn_handle_request(conn, request);
+        free(request);
+        if (!conn->session) {
+            close_after = 1;
+            break;
+        }
+    }
+
+    if (close_after) {
+        conn_release(conn);
+    } else {
+        rearm_connection(conn);
+    }
+}
+
+static void *reactor_worker(void *arg) {
+    (void)arg;
+    while (1) {
+        NmJob job = work_queue_pop(&work_queue);
+        if (job.request) {
+            conn_handle_request(job.conn, job.request);
+            free(job.request);
+            conn_release(job.conn);
+        } else {
+            service_readable(job.conn);
+        }
+    }
+    return NULL;
+}
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void accept_pending(int server_fd) {
+    while (1) {
+        struct sockaddr_in address;
+        socklen_t addrlen = sizeof(address);
+        int new_socket = accept(server_fd, (struct sockaddr *)&address, &addrlen);
+        if (new_socket < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("Accept failed");
+            }
+            return;
+        }
+
+        char client_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &address.sin_addr, client_ip, INET_ADDRSTRLEN);
+        printf("New connection from %s:%d\n", client_ip, ntohs(address.sin_port));
+
+        NmConn *conn = conn_create(new_socket);
+        if (!conn) {
+            close(new_socket);
+            continue;
+        }
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        ev.data.ptr = conn;
+        if (epoll_ctl(reactor_epoll_fd, EPOLL_CTL_ADD, new_socket, &ev) < 0) {
+            perror("epoll_ctl add failed");
+            conn_release(conn);
+        }
+    }
+}
+
+int run_threaded_server(int server_fd) {
+    struct sockaddr_in address;
+    socklen_t addrlen = sizeof(address);
+
+    while (1) {
+        int new_socket = accept(server_fd, (struct sockaddr *)&address, &addrlen);
+        if (new_socket < 0) {
+            perror("Accept failed");
+            continue;
+        }
+
+        char client_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &address.sin_addr, client_ip, INET_ADDRSTRLEN);
+        printf("New connection from %s:%d\n", client_ip, ntohs(address.sin_port));
+
+        pthread_t thread_id;
+        int *pclient = malloc(sizeof(int));
+        if (!pclient) {
+            close(new_socket);
+            continue;
+        }
+        *pclient = new_socket;
+
+        if (pthread_create(&thread_id, NULL, handle_connection, pclient) != 0) {
+            perror("Thread creation failed");
+            free(pclient);
+            close(new_socket);
+            continue;
+        }
+        pthread_detach(thread_id);
+    }
+
+    return 0;
+}
+
+int run_epoll_server(int server_fd, int worker_count) {
+    if (worker_count <= 0) {
+        worker_count = NM_DEFAULT_WORKERS;
+    }
+
+    reactor_epoll_fd = epoll_create1(0);
+    if (reactor_epoll_fd < 0) {
+        perror("epoll_create1 failed");
+        return -1;
+    }
+
+    if (set_nonblocking(server_fd) < 0) {
+        perror("fcntl failed");
+        return -1;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(reactor_epoll_fd, EPOLL_CTL_ADD, server_fd, &ev) < 0) {
+        perror("epoll_ctl failed");
+        return -1;
+    }
+
+    work_queue_init(&work_queue, NM_WORK_QUEUE_SIZE);
+    if (work_queue.capacity == 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < worker_count; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, reactor_worker, NULL) != 0) {
+            perror("Worker creation failed");
+            return -1;
+        }
+        pthread_detach(tid);
+    }
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "Event loop started with %d workers", worker_count);
+    log_message("INFO", log_msg, "0.0.0.0", 0, "system");
+
+    struct epoll_event events[NM_MAX_EVENTS];
+    while (1) {
+        int n = epoll_wait(reactor_epoll_fd, events, NM_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait failed");
+            return -1;
+        }
+
+        for (int i = 0; i < n; i++) {
+            NmConn *conn = events[i].data.ptr;
+            if (!conn) {
+                accept_pending(server_fd);
+                continue;
+            }
+            /* EPOLLONESHOT keeps the fd disarmed until a worker has read from it */
+            work_queue_push(&work_queue, conn, NULL);
+        }
+    }
+
+    return 0;
+}
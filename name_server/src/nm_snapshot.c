@@ -0,0 +1,293 @@
+#include "nm_snapshot.h"
+#include "nm_file_table.h"
+#include "nm_logging.h"
+
+#include <sys/mman.h>
+
+#define FNV_OFFSET 1469598103934665603ULL
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct {
+    FILE *fp;
+    uint64_t checksum;
+    uint64_t bytes;
+    uint64_t file_count;
+    int failed;
+} SnapshotWriter;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static void writer_put(SnapshotWriter *w, const void *data, size_t len) {
+    if (w->failed || len == 0) {
+        return;
+    }
+    if (fwrite(data, 1, len, w->fp) != len) {
+        w->failed = 1;
+        return;
+    }
+    w->checksum = fnv1a(w->checksum, data, len);
+    w->bytes += len;
+}
+
+static void writer_put_short_string(SnapshotWriter *w, const char *s) {
+    size_t len = strnlen(s, 255);
+    uint8_t len8 = (uint8_t)len;
+    writer_put(w, &len8, sizeof(len8));
+    writer_put(w, s, len);
+}
+
+static int write_file_record(FileMetadata *file, void *arg) {
+    SnapshotWriter *w = arg;
+
+    SnapshotFileRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.created_at = (int64_t)file->created_at;
+    rec.last_modified = (int64_t)file->last_modified;
+    rec.last_accessed = (int64_t)file->last_accessed;
+    rec.ss_port = file->ss_port;
+    rec.backup_ss_port = file->backup_ss_port;
+    rec.words = file->words;
+    rec.chars = file->chars;
+    rec.bytes = file->bytes;
+    rec.filename_len = (uint16_t)strnlen(file->filename, sizeof(file->filename));
+    rec.owner_len = (uint16_t)strnlen(file->owner, sizeof(file->owner));
+    rec.ss_ip_len = (uint16_t)strnlen(file->ss_ip, sizeof(file->ss_ip));
+    rec.backup_ss_ip_len = (uint16_t)strnlen(file->backup_ss_ip, sizeof(file->backup_ss_ip));
+    rec.accessed_by_len = (uint16_t)strnlen(file->last_accessed_by, sizeof(file->last_accessed_by));
+    for (AccessEntry *entry = file->access_list; entry; entry = entry->next) {
+        rec.access_count++;
+    }
+
+    writer_put(w, &rec, sizeof(rec));
+    writer_put(w, file->filename, rec.filename_len);
+    writer_put(w, file->owner, rec.owner_len);
+    writer_put(w, file->ss_ip, rec.ss_ip_len);
+    writer_put(w, file->backup_ss_ip, rec.backup_ss_ip_len);
+    writer_put(w, file->last_accessed_by, rec.accessed_by_len);
+
+    for (AccessEntry *entry = file->access_list; entry; entry = entry->next) {
+        uint8_t lens[2];
+        lens[0] = (uint8_t)strnlen(entry->username, sizeof(entry->username));
+        lens[1] = (uint8_t)strnlen(entry->mode, sizeof(entry->mode));
+        writer_put(w, lens, sizeof(lens));
+        writer_put(w, entry->username, lens[0]);
+        writer_put(w, entry->mode, lens[1]);
+    }
+
+    w->file_count++;
+    return !w->failed;
+}
+
+/* Written to path.tmp, fsynced, then renamed into place. Returns 1 on success. */
+int snapshot_save(const char *path) {
+    char tmp_path[1100];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        return 0;
+    }
+    setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        fclose(fp);
+        unlink(tmp_path);
+        return 0;
+    }
+
+    SnapshotWriter w = {fp, FNV_OFFSET, 0, 0, 0};
+
+    pthread_mutex_lock(&clients_mutex);
+    uint32_t user_count = (uint32_t)client_count;
+    for (int i = 0; i < client_count; i++) {
+        writer_put_short_string(&w, clients[i].username);
+    }
+    pthread_mutex_unlock(&clients_mutex);
+
+    file_table_foreach(write_file_record, &w, 0);
+
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.user_count = user_count;
+    header.file_count = w.file_count;
+    header.payload_bytes = w.bytes;
+    header.checksum = w.checksum;
+
+    int ok = !w.failed;
+    ok = ok && fseek(fp, 0, SEEK_SET) == 0;
+    ok = ok && fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && fflush(fp) == 0;
+    ok = ok && fsync(fileno(fp)) == 0;
+    if (fclose(fp) != 0) {
+        ok = 0;
+    }
+    ok = ok && rename(tmp_path, path) == 0;
+    if (!ok) {
+        unlink(tmp_path);
+    }
+    return ok;
+}
+
+typedef struct {
+    const unsigned char *pos;
+    const unsigned char *end;
+} SnapshotReader;
+
+static int reader_take(SnapshotReader *r, void *out, size_t len) {
+    if ((size_t)(r->end - r->pos) < len) {
+        return 0;
+    }
+    memcpy(out, r->pos, len);
+    r->pos += len;
+    return 1;
+}
+
+/* Copy a length-prefixed string into a fixed field, truncating like strncpy. */
+static int reader_string(SnapshotReader *r, size_t len, char *out, size_t out_size) {
+    if ((size_t)(r->end - r->pos) < len) {
+        return 0;
+    }
+    size_t copy = len < out_size ? len : out_size - 1;
+    memcpy(out, r->pos, copy);
+    out[copy] = '\0';
+    r->pos += len;
+    return 1;
+}
+
+static FileMetadata *read_file_record(SnapshotReader *r) {
+    SnapshotFileRecord rec;
+    if (!reader_take(r, &rec, sizeof(rec))) {
+        return NULL;
+    }
+
+    FileMetadata *file = calloc(1, sizeof(FileMetadata));
+    if (!file) {
+        return NULL;
+    }
+
+    int ok = reader_string(r, rec.filename_len, file->filename, sizeof(file->filename)) &&
+             reader_string(r, rec.owner_len, file->owner, sizeof(file->owner)) &&
+             reader_string(r, rec.ss_ip_len, file->ss_ip, sizeof(file->ss_ip)) &&
+             reader_string(r, rec.backup_ss_ip_len, file->backup_ss_ip, sizeof(file->backup_ss_ip)) &&
+             reader_string(r, rec.accessed_by_len, file->last_accessed_by, sizeof(file->last_accessed_by));
+
+    file->created_at = (time_t)rec.created_at;
+    file->last_modified = (time_t)rec.last_modified;
+    file->last_accessed = (time_t)rec.last_accessed;
+    file->ss_port = rec.ss_port;
+    file->backup_ss_port = rec.backup_ss_port;
+    file->words = rec.words;
+    file->chars = rec.chars;
+    file->bytes = rec.bytes;
+    file->active = 1;
+
+    AccessEntry **tail = &file->access_list;
+    for (uint16_t i = 0; ok && i < rec.access_count; i++) {
+        uint8_t lens[2];
+        AccessEntry *entry = calloc(1, sizeof(AccessEntry));
+        if (!entry || !reader_take(r, lens, sizeof(lens))) {
+            free(entry);
+            ok = 0;
+            break;
+        }
+        ok = reader_string(r, lens[0], entry->username, sizeof(entry->username)) &&
+             reader_string(r, lens[1], entry->mode, sizeof(entry->mode));
+        *tail = entry;
+        tail = &entry->next;
+    }
+
+    if (!ok) {
+        while (file->access_list) {
+            AccessEntry *next = file->access_list->next;
+            free(file->access_list);
+            file->access_list = next;
+        }
+        free(file);
+        return NULL;
+    }
+    return file;
+}
+
+/*
+ * Map the snapshot and rebuild clients[] and the file table in one linear
+ * pass. Startup only: no table locks are taken. Returns the number of files
+ * loaded, SNAPSHOT_MISSING if there is no snapshot, or SNAPSHOT_INVALID if
+ * one exists but cannot be read or fails validation.
+ */
+long snapshot_load(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno == ENOENT ? SNAPSHOT_MISSING : SNAPSHOT_INVALID;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        log_message("ERROR", "Metadata snapshot is truncated", "0.0.0.0", 0, "system");
+        close(fd);
+        return SNAPSHOT_INVALID;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return SNAPSHOT_INVALID;
+    }
+    posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+
+    SnapshotHeader header;
+    memcpy(&header, map, sizeof(header));
+    const unsigned char *payload = (const unsigned char *)map + sizeof(header);
+
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SNAPSHOT_VERSION ||
+        header.payload_bytes != size - sizeof(header) ||
+        fnv1a(FNV_OFFSET, payload, header.payload_bytes) != header.checksum) {
+        log_message("ERROR", "Metadata snapshot failed validation", "0.0.0.0", 0, "system");
+        munmap(map, size);
+        return SNAPSHOT_INVALID;
+    }
+
+    SnapshotReader r = {payload, payload + header.payload_bytes};
+
+    long loaded = 0;
+    int records_ok = 1;
+    client_count = 0;
+    for (uint32_t i = 0; i < header.user_count; i++) {
+        uint8_t len;
+        char username[MAX_USERNAME];
+        if (!reader_take(&r, &len, sizeof(len)) ||
+            !reader_string(&r, len, username, sizeof(username))) {
+            records_ok = 0;
+            break;
+        }
+        if (client_count < MAX_CLIENTS) {
+            memcpy(clients[client_count].username, username, sizeof(username));
+            clients[client_count].active = 0;
+            client_count++;
+        }
+    }
+
+    for (uint64_t i = 0; records_ok && i < header.file_count; i++) {
+        FileMetadata *file = read_file_record(&r);
+        if (!file) {
+            log_message("ERROR", "Truncated record in metadata snapshot", "0.0.0.0", 0, "system");
+            records_ok = 0;
+            break;
+        }
+        file_table_insert(file);
+        loaded++;
+    }
+
+    munmap(map, size);
+    return records_ok ? loaded : SNAPSHOT_INVALID;
+}
@@ -0,0 +1,311 @@
+#include "nm_stats.h"
+#include "nm_file_table.h"
+#include "nm_journal.h"
+#include "nm_logging.h"
+#include "nm_metadata.h"
+
+typedef struct {
+    char filename[MAX_FILENAME];
+    char ss_ip[INET_ADDRSTRLEN];
+    int ss_port;
+} StatTarget;
+
+typedef struct {
+    time_t now;
+    StatTarget *targets;
+    size_t count;
+    size_t capacity;
+} StatScan;
+
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stats_cond = PTHREAD_COND_INITIALIZER;
+static int refresh_requested = 0;
+static int stats_running = 0;
+
+int stats_is_stale(const FileMetadata *file, time_t now) {
+    return file->stats_refreshed == 0 || now - file->stats_refreshed >= NM_STATS_STALE_SECS;
+}
+
+void stats_request_refresh(void) {
+    pthread_mutex_lock(&stats_mutex);
+    refresh_requested = 1;
+    pthread_cond_signal(&stats_cond);
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+static int collect_stale(FileMetadata *file, void *arg) {
+    StatScan *scan = arg;
+    if (file->ss_ip[0] == '\0' || !stats_is_stale(file, scan->now)) {
+        return 1;
+    }
+
+    if (scan->count == scan->capacity) {
+        size_t new_capacity = scan->capacity ? scan->capacity * 2 : 64;
+        StatTarget *tmp = realloc(scan->targets, sizeof(StatTarget) * new_capacity);
+        if (!tmp) {
+            return 0;
+        }
+        scan->targets = tmp;
+        scan->capacity = new_capacity;
+    }
+
+    StatTarget *target = &scan->targets[scan->count++];
+    strncpy(target->filename, file->filename, sizeof(target->filename) - 1);
+    target->filename[sizeof(target->filename) - 1] = '\0';
+    strncpy(target->ss_ip, file->ss_ip, sizeof(target->ss_ip) - 1);
+    target->ss_ip[sizeof(target->ss_ip) - 1] = '\0';
+    target->ss_port = file->ss_port;
+    return 1;
+}
+
+static int compare_targets(const void *a, const void *b) {
+    const StatTarget *ta = a;
+    const StatTarget *tb = b;
+    int cmp = strcmp(ta->ss_ip, tb->ss_ip);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return ta->ss_port - tb->ss_port;
+}
+
+static int same_server(const StatTarget *a, const StatTarget *b) {
+    return a->ss_port == b->ss_port && strcmp(a->ss_ip, b->ss_ip) == 0;
+}
+
+/* Store fresh counts, or only the refresh time when the SS had none to give. */
+static void apply_stats(const StatTarget *target, int have_counts,
+                        int words, int chars, int bytes, time_t stamp) {
+    file_table_wrlock(target->filename);
+    FileMetadata *file = file_table_find(target->filename);
+    if (file && file->ss_port == target->ss_port && strcmp(file->ss_ip, target->ss_ip) == 0) {
+        file->stats_refreshed = stamp;
+        if (have_counts && (file->words != words || file->chars != chars || file->bytes != bytes)) {
+            file->words = words;
+            file->chars = chars;
+            file->bytes = bytes;
+            journal_log_file(file);
+        }
+    }
+    file_table_unlock(target->filename);
+}
+
+static int connect_ss(const char *ip, int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec = NM_STATS_TIMEOUT_SECS;
+    timeout.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) <= 0 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static char *recv_line(int fd) {
+    size_t cap = 4096;
+    size_t len = 0;
+    char *buf = malloc(cap);
+    while (buf) {
+        if (len + 1 >= cap) {
+            if (cap >= NM_MAX_REQUEST) {
+                break;
+            }
+            char *tmp = realloc(buf, cap * 2);
+            if (!tmp) {
+                break;
+            }
+            buf = tmp;
+            cap *= 2;
+        }
+
+        ssize_t n = recv(fd, buf + len, cap - 1 - len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        char *nl = memchr(buf + len, '\n', (size_t)n);
+        len += (size_t)n;
+        if (nl) {
+            *nl = '\0';
+            return buf;
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+/* Walk the {"filename":...} objects of a "stats" array, from just past its '['. */
+static int apply_stats_array(const char *p, const StatTarget *server, time_t stamp) {
+    int seen = 0;
+    JsonMessage entry;
+    while ((p = json_array_next_object(p, &entry)) != NULL) {
+        StatTarget target = *server;
+        json_field_string(&entry, "filename", target.filename, sizeof(target.filename));
+        if (target.filename[0]) {
+            int have_counts = (json_find(&entry, "error") == NULL);
+            int words = 0;
+            int chars = 0;
+            int bytes = 0;
+            if (have_counts) {
+                json_field_int(&entry, "words", &words);
+                json_field_int(&entry, "chars", &chars);
+                json_field_int(&entry, "bytes", &bytes);
+            }
+            apply_stats(&target, have_counts, words, chars, bytes, stamp);
+            seen++;
+        }
+    }
+    return seen;
+}
+
+int stats_apply_push(const char *ss_ip, int ss_port, const char *stats) {
+    StatTarget server;
+    memset(&server, 0, sizeof(server));
+    strncpy(server.ss_ip, ss_ip, sizeof(server.ss_ip) - 1);
+    server.ss_port = ss_port;
+    return apply_stats_array(stats, &server, time(NULL));
+}
+
+/*
+ * One connection per storage server; batches are sent one at a time and each
+ * reply is read before the next request so neither side can fill its socket
+ * buffer while the other is still writing. Requests stay under the SS line
+ * limit.
+ */
+static void refresh_server(const StatTarget *targets, size_t count, time_t stamp) {
+    int fd = connect_ss(targets[0].ss_ip, targets[0].ss_port);
+    if (fd < 0) {
+        char log_msg[128];
+        snprintf(log_msg, sizeof(log_msg), "STAT refresh: SS %s:%d unreachable",
+                 targets[0].ss_ip, targets[0].ss_port);
+        log_message("WARN", log_msg, targets[0].ss_ip, targets[0].ss_port, "stats");
+    }
+
+    char request[NM_STATS_BATCH_BYTES + MAX_FILENAME + 64];
+    size_t i = 0;
+    while (i < count) {
+        int len = snprintf(request, sizeof(request), "{\"cmd\":\"STAT_BATCH\",\"files\":[");
+        size_t j = i;
+        while (j < count) {
+            size_t name_len = strlen(targets[j].filename);
+            if (j > i && (size_t)len + name_len + 4 > NM_STATS_BATCH_BYTES) {
+                break;
+            }
+            len += snprintf(request + len, sizeof(request) - (size_t)len, "%s\"%s\"",
+                            j > i ? "," : "", targets[j].filename);
+            j++;
+        }
+        len += snprintf(request + len, sizeof(request) - (size_t)len, "]}\n");
+
+        char *reply = NULL;
+        if (fd >= 0 && send_all(fd, request, (size_t)len) == 0) {
+            reply = recv_line(fd);
+        }
+
+        if (reply && strstr(reply, "\"status\":\"OK\"")) {
+            apply_stats_array(json_find_array(reply, "stats"), &targets[i], stamp);
+        } else {
+            /* back off to the staleness bound rather than retrying every tick */
+            for (size_t k = i; k < j; k++) {
+                apply_stats(&targets[k], 0, 0, 0, 0, stamp);
+            }
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        free(reply);
+        i = j;
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+static void refresh_stale_stats(void) {
+    StatScan scan = {time(NULL), NULL, 0, 0};
+    file_table_foreach(collect_stale, &scan, 0);
+    if (scan.count == 0) {
+        free(scan.targets);
+        return;
+    }
+
+    qsort(scan.targets, scan.count, sizeof(StatTarget), compare_targets);
+    size_t start = 0;
+    while (start < scan.count) {
+        size_t end = start + 1;
+        while (end < scan.count && same_server(&scan.targets[start], &scan.targets[end])) {
+            end++;
+        }
+        refresh_server(&scan.targets[start], end - start, scan.now);
+        start = end;
+    }
+    free(scan.targets);
+}
+
+static void *stats_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&stats_mutex);
+        if (!refresh_requested) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += NM_STATS_REFRESH_MS / 1000;
+            deadline.tv_nsec += (long)(NM_STATS_REFRESH_MS % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&stats_cond, &stats_mutex, &deadline);
+        }
+        refresh_requested = 0;
+        pthread_mutex_unlock(&stats_mutex);
+
+        refresh_stale_stats();
+    }
+    return NULL;
+}
+
+int stats_start(void) {
+    if (stats_running) {
+        return 0;
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, stats_thread, NULL) != 0) {
+        return -1;
+    }
+    pthread_detach(tid);
+    stats_running = 1;
+    return 0;
+}
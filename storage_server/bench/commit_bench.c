@@ -0,0 +1,161 @@
+/*
+ * Commit latency under each durability mode.
+ *
+ * Every thread edits its own file the way ETIRW does: splice one sentence
+ * and commit it under the document lock, which returns once the durability
+ * mode is satisfied. Latency is measured from taking the lock to the point
+ * WRITE DONE would be sent.
+ * Files live in a scratch directory under the current one, so run it from
+ * a disk-backed directory; on tmpfs fsync costs nothing.
+ *
+ *   ./storage_server/bench/commit_bench [threads] [commits_per_thread]
+ *                                      (default 8 threads, 200 commits)
+ */
+#include "ss_document.h"
+#include "ss_durability.h"
+#include "ss_file_ops.h"
+
+#include <sys/time.h>
+
+#define BENCH_SENTENCES 64
+
+typedef struct {
+    int id;
+    int commits;
+    double *latencies;
+} Worker;
+
+static double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int count, double p) {
+    int index = (int)(p * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+static void bench_filename(char *dest, size_t size, int id) {
+    snprintf(dest, size, "bench%d.txt", id);
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = arg;
+    char filename[64];
+    bench_filename(filename, sizeof(filename), w->id);
+    Document *doc = document_open(filename);
+
+    for (int i = 0; i < w->commits; i++) {
+        char *sentence = malloc(64);
+        if (!sentence) break;
+        snprintf(sentence, 64, "Edit %d from writer %d.", i, w->id);
+        int index = i % BENCH_SENTENCES;
+
+        double start = now_seconds();
+        int rc = -1;
+        if (document_lock(doc)) {
+            rc = document_commit(doc, index, index + 1, &sentence, 1);
+            document_unlock(doc);
+        } else {
+            free(sentence);
+        }
+        if (rc != 0) {
+            fprintf(stderr, "commit failed for %s\n", filename);
+            exit(1);
+        }
+        w->latencies[i] = (now_seconds() - start) * 1e3;
+    }
+    document_release(doc);
+    return NULL;
+}
+
+static void run(DurabilityMode mode, int window_ms, int threads, int commits) {
+    durability_init(mode, window_ms);
+
+    Worker *workers = calloc((size_t)threads, sizeof(Worker));
+    pthread_t *tids = calloc((size_t)threads, sizeof(pthread_t));
+    double *all = malloc(sizeof(double) * (size_t)threads * (size_t)commits);
+    if (!workers || !tids || !all) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    double start = now_seconds();
+    for (int t = 0; t < threads; t++) {
+        workers[t].id = t;
+        workers[t].commits = commits;
+        workers[t].latencies = all + (size_t)t * (size_t)commits;
+        pthread_create(&tids[t], NULL, worker_main, &workers[t]);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    double elapsed = now_seconds() - start;
+
+    int total = threads * commits;
+    qsort(all, (size_t)total, sizeof(double), compare_double);
+    char window_text[16] = "-";
+    if (mode == DURABILITY_GROUP) {
+        snprintf(window_text, sizeof(window_text), "%d", window_ms);
+    }
+    printf("%6s %9s %10.0f %9.3f %9.3f %9.3f %9.3f\n", durability_mode_name(mode), window_text,
+           total / elapsed, percentile(all, total, 0.50), percentile(all, total, 0.90),
+           percentile(all, total, 0.99), all[total - 1]);
+
+    free(all);
+    free(tids);
+    free(workers);
+}
+
+int main(int argc, char *argv[]) {
+    int threads = argc > 1 ? atoi(argv[1]) : 8;
+    int commits = argc > 2 ? atoi(argv[2]) : 200;
+    if (threads <= 0 || commits <= 0) {
+        fprintf(stderr, "Usage: %s [threads] [commits_per_thread]\n", argv[0]);
+        return 1;
+    }
+
+    char scratch[] = "commit_bench.XXXXXX";
+    if (!mkdtemp(scratch)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(BASE_DIR, sizeof(BASE_DIR), "%s", scratch);
+    ensure_directories();
+
+    char sentences[BENCH_SENTENCES * 48] = "";
+    size_t len = 0;
+    for (int i = 0; i < BENCH_SENTENCES; i++) {
+        len += (size_t)snprintf(sentences + len, sizeof(sentences) - len, "%sSentence %d of the file.",
+                                i ? " " : "", i);
+    }
+    for (int t = 0; t < threads; t++) {
+        char filename[64];
+        bench_filename(filename, sizeof(filename), t);
+        save_file_atomic(filename, sentences);
+    }
+
+    printf("%d threads x %d commits, one file each\n", threads, commits);
+    printf("%6s %9s %10s %9s %9s %9s %9s\n", "mode", "window ms", "commits/s", "p50 ms",
+           "p90 ms", "p99 ms", "max ms");
+    run(DURABILITY_NONE, 0, threads, commits);
+    run(DURABILITY_SYNC, 0, threads, commits);
+    static const int windows[] = {0, DURABILITY_DEFAULT_WINDOW_MS, 10};
+    for (size_t i = 0; i < sizeof(windows) / sizeof(windows[0]); i++) {
+        run(DURABILITY_GROUP, windows[i], threads, commits);
+    }
+
+    char command[1100];
+    snprintf(command, sizeof(command), "rm -rf '%s'", scratch);
+    if (system(command) != 0) {
+        fprintf(stderr, "could not remove %s\n", scratch);
+    }
+    return 0;
+}
@@ -0,0 +1,297 @@
+/*
+ * Request framing: fuzz check and replay throughput.
+ *
+ * Builds a pipelined stream of client requests (mostly small commands with
+ * some large UPDATE payloads, a share of them "\r\n" terminated) and
+ * replays it through the framer. The fuzz pass cuts the stream at random
+ * points, down to single bytes, mixes in requests over the size limit, and
+ * checks that every request comes out whole and in order and that each
+ * oversized one is reported exactly once. The replay pass feeds the stream
+ * in socket-sized reads and compares against the line splitter the server
+ * used before, which copied every read twice and could not keep a request
+ * longer than its buffer.
+ *
+ *   ./storage_server/bench/framer_bench [requests] [fuzz_rounds]
+ *                                      (default 200000 requests, 20 rounds)
+ */
+#include "ss_framer.h"
+
+#include <sys/time.h>
+
+#define BENCH_READ_BYTES (64 * 1024)
+#define FUZZ_MAX_REQUEST (256 * 1024)
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t *ends;       // offset just past each request's newline
+    int count;
+} Stream;
+
+static unsigned int g_seed = 12345;
+
+static unsigned int next_random(void) {
+    g_seed = g_seed * 1103515245u + 12345u;
+    return (g_seed >> 8) & 0xffffff;
+}
+
+static double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static void stream_append(Stream *stream, size_t *cap, const char *text, size_t len) {
+    while (stream->len + len > *cap) {
+        *cap *= 2;
+        stream->data = realloc(stream->data, *cap);
+        if (!stream->data) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    memcpy(stream->data + stream->len, text, len);
+    stream->len += len;
+}
+
+// One request in every large_every carries a payload of large_bytes; every
+// oversize_every-th (if set) is longer than FUZZ_MAX_REQUEST
+static Stream build_stream(int count, int large_every, size_t large_bytes, int oversize_every) {
+    Stream stream = {NULL, 0, NULL, count};
+    size_t cap = 1 << 20;
+    stream.data = malloc(cap);
+    stream.ends = malloc(sizeof(size_t) * (size_t)count);
+    size_t payload_cap = (large_bytes > FUZZ_MAX_REQUEST ? large_bytes : FUZZ_MAX_REQUEST) * 2;
+    char *payload = malloc(payload_cap);
+    if (!stream.data || !stream.ends || !payload) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < count; i++) {
+        size_t words = 1 + next_random() % 12;
+        if (oversize_every && i % oversize_every == oversize_every - 1) {
+            words = FUZZ_MAX_REQUEST / 6 + next_random() % 1000;
+        } else if (large_every && i % large_every == large_every - 1) {
+            words = large_bytes / 6;
+        }
+        size_t plen = 0;
+        for (size_t w = 0; w < words && plen + 8 < payload_cap; w++) {
+            plen += (size_t)snprintf(payload + plen, payload_cap - plen, "%sw%04u", w ? " " : "",
+                                     next_random() % 10000);
+        }
+        char head[128];
+        int hlen = snprintf(head, sizeof(head),
+                            "{\"cmd\":\"UPDATE\",\"seq\":%d,\"word_index\":0,\"content\":\"", i);
+        stream_append(&stream, &cap, head, (size_t)hlen);
+        stream_append(&stream, &cap, payload, plen);
+        const char *end = (next_random() % 4 == 0) ? "\"}\r\n" : "\"}\n";
+        stream_append(&stream, &cap, end, strlen(end));
+        stream.ends[i] = stream.len;
+    }
+    free(payload);
+    return stream;
+}
+
+static size_t request_length(const Stream *stream, int i, size_t *start) {
+    *start = i ? stream->ends[i - 1] : 0;
+    size_t len = stream->ends[i] - *start - 1;
+    if (len > 0 && stream->data[*start + len - 1] == '\r') {
+        len--;
+    }
+    return len;
+}
+
+static int fuzz_round(const Stream *stream, int max_chunk) {
+    Framer framer;
+    if (!framer_init(&framer, FUZZ_MAX_REQUEST)) return -1;
+
+    int expect = 0;
+    size_t fed = 0;
+    while (fed < stream->len || expect < stream->count) {
+        size_t avail = 0;
+        char *space = framer_space(&framer, &avail);
+        if (!space) {
+            fprintf(stderr, "fuzz: no buffer space at byte %zu\n", fed);
+            return -1;
+        }
+        size_t chunk = 1 + next_random() % (unsigned int)max_chunk;
+        if (chunk > avail) chunk = avail;
+        if (chunk > stream->len - fed) chunk = stream->len - fed;
+        memcpy(space, stream->data + fed, chunk);
+        framer_commit(&framer, chunk);
+        fed += chunk;
+
+        char *line;
+        size_t len;
+        FrameResult result;
+        while ((result = framer_next(&framer, &line, &len)) != FRAME_NONE) {
+            if (expect >= stream->count) {
+                fprintf(stderr, "fuzz: extra request after the last one\n");
+                return -1;
+            }
+            size_t start;
+            size_t want = request_length(stream, expect, &start);
+            if (want >= FUZZ_MAX_REQUEST) {
+                if (result != FRAME_OVERSIZE) {
+                    fprintf(stderr, "fuzz: request %d (%zu bytes) not reported oversize\n", expect, want);
+                    return -1;
+                }
+            } else if (result != FRAME_LINE || len != want ||
+                       memcmp(line, stream->data + start, len) != 0 || line[len] != '\0') {
+                fprintf(stderr, "fuzz: request %d damaged (%zu bytes, expected %zu)\n", expect, len, want);
+                return -1;
+            }
+            expect++;
+        }
+        if (fed == stream->len && expect < stream->count) {
+            fprintf(stderr, "fuzz: %d requests never came out\n", stream->count - expect);
+            return -1;
+        }
+    }
+    framer_free(&framer);
+    return 0;
+}
+
+static double replay_framer(const Stream *stream, int *requests) {
+    Framer framer;
+    if (!framer_init(&framer, MAX_REQUEST)) return -1;
+    double start = now_seconds();
+    size_t fed = 0;
+    int count = 0;
+    while (fed < stream->len) {
+        size_t avail = 0;
+        char *space = framer_space(&framer, &avail);
+        if (!space) break;
+        size_t chunk = BENCH_READ_BYTES < avail ? BENCH_READ_BYTES : avail;
+        if (chunk > stream->len - fed) chunk = stream->len - fed;
+        memcpy(space, stream->data + fed, chunk);
+        framer_commit(&framer, chunk);
+        fed += chunk;
+
+        char *line;
+        size_t len;
+        while (framer_next(&framer, &line, &len) == FRAME_LINE) {
+            count += line[0] == '{';
+        }
+    }
+    double elapsed = now_seconds() - start;
+    framer_free(&framer);
+    *requests = count;
+    return elapsed;
+}
+
+// The splitter handle_client used before: a MAX_MSG read buffer copied into
+// a line buffer that resets (dropping the partial request) once it cannot
+// grow, strlen on every line and a memmove of the tail after every read
+static double replay_legacy(const Stream *stream, size_t workcap_limit, int *requests) {
+    double start = now_seconds();
+    char buffer[MAX_MSG];
+    size_t workcap = MAX_MSG;
+    char *workbuf = malloc(workcap);
+    size_t worklen = 0;
+    size_t fed = 0;
+    int count = 0;
+    while (workbuf && fed < stream->len) {
+        size_t bytes_read = sizeof(buffer) - 1;
+        if (bytes_read > stream->len - fed) bytes_read = stream->len - fed;
+        memset(buffer, 0, sizeof(buffer));
+        memcpy(buffer, stream->data + fed, bytes_read);
+        fed += bytes_read;
+
+        if (worklen + bytes_read >= workcap - 1) {
+            size_t new_cap = workcap;
+            while (new_cap <= worklen + bytes_read + 1 && new_cap < workcap_limit) {
+                new_cap *= 2;
+            }
+            char *tmp = (new_cap > workcap) ? realloc(workbuf, new_cap) : NULL;
+            if (tmp) {
+                workbuf = tmp;
+                workcap = new_cap;
+            }
+            if (worklen + bytes_read >= workcap - 1) {
+                worklen = 0;
+            }
+        }
+
+        size_t scan_from = worklen;
+        memcpy(workbuf + worklen, buffer, bytes_read);
+        worklen += bytes_read;
+        workbuf[worklen] = '\0';
+
+        char *line_start = workbuf;
+        char *scan = workbuf + scan_from;
+        char *nl;
+        while ((nl = memchr(scan, '\n', (size_t)(workbuf + worklen - scan))) != NULL) {
+            *nl = '\0';
+            size_t len = strlen(line_start);
+            if (len > 0 && line_start[len - 1] == '\r') {
+                line_start[len - 1] = '\0';
+            }
+            if (strlen(line_start) > 0) {
+                count += line_start[0] == '{';
+            }
+            line_start = nl + 1;
+            scan = line_start;
+        }
+        size_t remaining = (size_t)(workbuf + worklen - line_start);
+        memmove(workbuf, line_start, remaining + 1);
+        worklen = remaining;
+    }
+    free(workbuf);
+    *requests = count;
+    return now_seconds() - start;
+}
+
+static void replay(const char *label, const Stream *stream) {
+    int framed = 0;
+    int legacy = 0;
+    int legacy_small = 0;
+    double framer_time = replay_framer(stream, &framed);
+    double legacy_time = replay_legacy(stream, MAX_REQUEST, &legacy);
+    replay_legacy(stream, MAX_MSG, &legacy_small);
+    double mb = (double)stream->len / (1024.0 * 1024.0);
+    printf("%-22s %8.1f %12.0f %12.0f %9.2fx %8d/%d\n", label, mb, framed / framer_time,
+           legacy / legacy_time, legacy_time / framer_time, legacy_small, stream->count);
+}
+
+int main(int argc, char *argv[]) {
+    int requests = argc > 1 ? atoi(argv[1]) : 200000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+    if (requests <= 0 || rounds < 0) {
+        fprintf(stderr, "Usage: %s [requests] [fuzz_rounds]\n", argv[0]);
+        return 1;
+    }
+
+    static const int chunk_limits[] = {1, 7, 100, 4096, 70000};
+    int fuzz_requests = requests < 5000 ? requests : 5000;
+    for (int r = 0; r < rounds; r++) {
+        Stream stream = build_stream(fuzz_requests, 50, 64 * 1024, 400);
+        int max_chunk = chunk_limits[r % (int)(sizeof(chunk_limits) / sizeof(chunk_limits[0]))];
+        if (fuzz_round(&stream, max_chunk) != 0) {
+            fprintf(stderr, "fuzz round %d (chunks up to %d bytes) failed\n", r, max_chunk);
+            return 1;
+        }
+        free(stream.data);
+        free(stream.ends);
+    }
+    printf("fuzz: %d rounds x %d requests intact\n\n", rounds, fuzz_requests);
+
+    printf("%-22s %8s %12s %12s %10s %8s\n", "stream", "MB", "framer req/s", "legacy req/s",
+           "speedup", "4KB-buf kept");
+    Stream small = build_stream(requests, 0, 0, 0);
+    replay("small requests", &small);
+    free(small.data);
+    free(small.ends);
+
+    Stream mixed = build_stream(requests / 10, 100, 256 * 1024, 0);
+    replay("1% 256 KB UPDATEs", &mixed);
+    free(mixed.data);
+    free(mixed.ends);
+
+    Stream large = build_stream(50, 1, 4 * 1024 * 1024, 0);
+    replay("4 MB payloads", &large);
+    free(large.data);
+    free(large.ends);
+    return 0;
+}
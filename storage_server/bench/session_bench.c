@@ -0,0 +1,212 @@
+/*
+ * Cost of write-session tokenization and joining for growing documents.
+ *
+ * "join" rebuilds a whole document from its sentences; "tokenize" splits
+ * every sentence into words and joins them back, as WRITE and commit do.
+ * The legacy columns reproduce the previous code: repeated strcat and a
+ * strdup per word. The current columns are ss_session.c on an arena. The
+ * legacy join is quadratic, so it is only run up to LEGACY_JOIN_MAX.
+ *
+ *   ./storage_server/bench/session_bench [bytes ...]   (default 1K to 10M)
+ */
+#include "ss_arena.h"
+#include "ss_session.h"
+
+#include <sys/time.h>
+
+#define LEGACY_JOIN_MAX (1024 * 1024)
+#define BENCH_BYTES_PER_ROUND (16 * 1024 * 1024)
+
+static const char *vocabulary[] = {
+    "the", "storage", "server", "keeps", "every", "sentence", "of", "a",
+    "document", "in", "memory", "while", "clients", "edit", "words", "concurrently",
+};
+
+static double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static char *make_document(size_t bytes) {
+    char *doc = malloc(bytes + 64);
+    if (!doc) {
+        return NULL;
+    }
+    size_t len = 0;
+    unsigned int seed = 12345;
+    int words_in_sentence = 0;
+    int sentence_length = 8;
+    while (len < bytes) {
+        seed = seed * 1103515245 + 12345;
+        const char *word = vocabulary[(seed >> 16) % (sizeof(vocabulary) / sizeof(vocabulary[0]))];
+        if (len > 0) {
+            doc[len++] = ' ';
+        }
+        size_t wlen = strlen(word);
+        memcpy(doc + len, word, wlen);
+        len += wlen;
+        if (++words_in_sentence == sentence_length) {
+            doc[len++] = '.';
+            words_in_sentence = 0;
+            sentence_length = 4 + (int)((seed >> 8) % 12);
+        }
+    }
+    doc[len++] = '.';
+    doc[len] = '\0';
+    return doc;
+}
+
+static char *legacy_join(char **parts, int count, char punctuation) {
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += strlen(parts[i]) + 1;
+    }
+    char *out = malloc(total + 2);
+    if (!out) {
+        return NULL;
+    }
+    out[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        strcat(out, parts[i]);
+        if (i != count - 1) strcat(out, " ");
+    }
+    if (punctuation) {
+        size_t len = strlen(out);
+        out[len] = punctuation;
+        out[len + 1] = '\0';
+    }
+    return out;
+}
+
+static int legacy_split_words(const char *sentence, char ***out_words, char *punctuation) {
+    size_t len = strlen(sentence);
+    char punct = (len > 0 && strchr(".!?", sentence[len - 1])) ? sentence[len - 1] : 0;
+    char *copy = strdup(sentence);
+    int capacity = 8;
+    int count = 0;
+    char **words = malloc(sizeof(char *) * capacity);
+    for (char *token = strtok(copy, " \t\n"); token; token = strtok(NULL, " \t\n")) {
+        if (count == capacity) {
+            capacity *= 2;
+            words = realloc(words, sizeof(char *) * capacity);
+        }
+        words[count++] = strdup(token);
+    }
+    if (count > 0 && punct) {
+        words[count - 1][strlen(words[count - 1]) - 1] = '\0';
+    }
+    free(copy);
+    *out_words = words;
+    *punctuation = punct;
+    return count;
+}
+
+static double bench_join(char **sentences, int count, int legacy, int rounds) {
+    double start = now_seconds();
+    for (int r = 0; r < rounds; r++) {
+        char *joined = legacy ? legacy_join(sentences, count, 0) : join_sentences(sentences, count);
+        free(joined);
+    }
+    return (now_seconds() - start) / rounds;
+}
+
+static double bench_tokenize_legacy(char **sentences, int count, int rounds, long *allocations) {
+    double start = now_seconds();
+    *allocations = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < count; i++) {
+            char **words = NULL;
+            char punct = 0;
+            int word_count = legacy_split_words(sentences[i], &words, &punct);
+            char *joined = legacy_join(words, word_count, punct);
+            free(joined);
+            free_string_array(words, word_count);
+            *allocations += word_count + 3;
+        }
+    }
+    *allocations /= rounds;
+    return (now_seconds() - start) / rounds;
+}
+
+// One arena for the whole pass, the way a session keeps one across updates
+static double bench_tokenize_arena(char **sentences, int count, int rounds, long *allocations) {
+    double start = now_seconds();
+    *allocations = 0;
+    for (int r = 0; r < rounds; r++) {
+        Arena arena;
+        arena_init(&arena);
+        int blocks = 0;
+        ArenaBlock *seen = NULL;
+        for (int i = 0; i < count; i++) {
+            char **words = NULL;
+            int word_count = 0;
+            int capacity = 0;
+            char punct = 0;
+            split_sentence_into_words(&arena, sentences[i], &words, &word_count, &capacity, &punct);
+            if (arena.head != seen) {
+                seen = arena.head;
+                blocks++;
+            }
+            char *joined = join_words(words, word_count, punct);
+            free(joined);
+            free(words);
+        }
+        arena_reset(&arena);
+        *allocations += 2L * count + blocks;
+    }
+    *allocations /= rounds;
+    return (now_seconds() - start) / rounds;
+}
+
+static void run(size_t bytes) {
+    char *doc = make_document(bytes);
+    char **sentences = NULL;
+    int count = 0;
+    if (!doc || !split_into_sentences(doc, &sentences, &count)) {
+        fprintf(stderr, "out of memory at %zu bytes\n", bytes);
+        exit(1);
+    }
+    int rounds = (int)(BENCH_BYTES_PER_ROUND / bytes);
+    if (rounds < 1) {
+        rounds = 1;
+    }
+
+    double join_new = bench_join(sentences, count, 0, rounds);
+    double join_old = bytes <= LEGACY_JOIN_MAX ? bench_join(sentences, count, 1, rounds) : -1;
+    long allocs_old = 0;
+    long allocs_new = 0;
+    double tok_old = bench_tokenize_legacy(sentences, count, rounds, &allocs_old);
+    double tok_new = bench_tokenize_arena(sentences, count, rounds, &allocs_new);
+
+    char join_old_text[32] = "-";
+    if (join_old >= 0) {
+        snprintf(join_old_text, sizeof(join_old_text), "%.3f", join_old * 1e3);
+    }
+    printf("%10zu %9d %12s %12.3f %12.3f %12.3f %10ld %10ld\n", bytes, count, join_old_text,
+           join_new * 1e3, tok_old * 1e3, tok_new * 1e3, allocs_old, allocs_new);
+
+    free_string_array(sentences, count);
+    free(doc);
+}
+
+int main(int argc, char *argv[]) {
+    printf("%10s %9s %12s %12s %12s %12s %10s %10s\n", "bytes", "sentences", "join old ms",
+           "join new ms", "tok old ms", "tok new ms", "old allocs", "new allocs");
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            long bytes = atol(argv[i]);
+            if (bytes <= 0) {
+                fprintf(stderr, "Usage: %s [bytes ...]\n", argv[0]);
+                return 1;
+            }
+            run((size_t)bytes);
+        }
+        return 0;
+    }
+    static const size_t sizes[] = {1024, 10 * 1024, 100 * 1024, 1024 * 1024, 10 * 1024 * 1024};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        run(sizes[i]);
+    }
+    return 0;
+}
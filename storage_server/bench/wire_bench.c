@@ -0,0 +1,382 @@
+/*
+ * Request throughput over JSON lines and over binary frames.
+ *
+ * Runs the storage server's own connection code (ss_conn_service and the
+ * real handlers) on one end of a socketpair and a client on the other, the
+ * way bulk tooling drives a server: requests pipelined DEPTH at a time, each
+ * reply decoded before the next batch. The JSON client builds requests with
+ * snprintf and unescapes READ content out of the reply; the binary client
+ * writes fixed-width frames and takes content straight from the frame. A
+ * check pass first makes sure both encodings return the same file bytes.
+ * The server does not log here, so the columns compare encoding work only.
+ *
+ *   ./storage_server/bench/wire_bench [iterations]     (default 100000)
+ */
+#include "ss_network.h"
+#include "ss_durability.h"
+#include "ss_file_ops.h"
+#include "ss_locking.h"
+#include "ss_readcache.h"
+#include "proto_json.h"
+#include "proto_wire.h"
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#define DEPTH 32
+#define REQUEST_BYTES 256
+
+typedef enum {
+    LOAD_STAT,
+    LOAD_READ,
+    LOAD_EDIT           // WRITE, UPDATE, ETIRW of one word
+} LoadKind;
+
+typedef struct {
+    const char *label;
+    LoadKind kind;
+    const char *filename;
+    size_t bytes;
+} Workload;
+
+// Replies arrive in a growing buffer; consumed bytes are dropped on refill
+typedef struct {
+    int fd;
+    char *buf;
+    size_t cap;
+    size_t head;
+    size_t tail;
+} ReplyStream;
+
+static double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static void *serve(void *arg) {
+    SsConn *conn = arg;
+    while (ss_conn_service(conn) > 0) {
+    }
+    ss_conn_close(conn);
+    return NULL;
+}
+
+static int start_server(pthread_t *thread) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        perror("socketpair");
+        return -1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    SsConn *conn = ss_conn_create(fds[1], &addr);
+    if (!conn || pthread_create(thread, NULL, serve, conn) != 0) {
+        fprintf(stderr, "could not start the server side\n");
+        return -1;
+    }
+    return fds[0];
+}
+
+static int send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0) return -1;
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Makes at least want bytes available after head; false on EOF
+static bool fill(ReplyStream *in, size_t want) {
+    if (in->tail - in->head >= want) return true;
+    if (in->head > 0) {
+        memmove(in->buf, in->buf + in->head, in->tail - in->head);
+        in->tail -= in->head;
+        in->head = 0;
+    }
+    while (in->tail < want) {
+        if (in->cap - in->tail < 64 * 1024 || in->cap < want + 1) {
+            size_t cap = in->cap * 2 > want + 64 * 1024 ? in->cap * 2 : want + 64 * 1024;
+            char *grown = realloc(in->buf, cap);
+            if (!grown) return false;
+            in->buf = grown;
+            in->cap = cap;
+        }
+        ssize_t n = read(in->fd, in->buf + in->tail, in->cap - in->tail - 1);
+        if (n <= 0) return false;
+        in->tail += (size_t)n;
+    }
+    return true;
+}
+
+// The next reply line, NUL-terminated in place
+static char *next_line(ReplyStream *in, size_t *len) {
+    size_t scanned = 0;
+    while (1) {
+        char *nl = memchr(in->buf + in->head + scanned, '\n', in->tail - in->head - scanned);
+        if (nl) {
+            char *line = in->buf + in->head;
+            *nl = '\0';
+            *len = (size_t)(nl - line);
+            in->head += *len + 1;
+            return line;
+        }
+        scanned = in->tail - in->head;
+        if (!fill(in, scanned + 1)) return NULL;
+    }
+}
+
+// The next reply frame's body
+static const char *next_frame(ReplyStream *in, size_t *len) {
+    if (!fill(in, WIRE_PREFIX_BYTES)) return NULL;
+    *len = wire_frame_length(in->buf + in->head);
+    if (!fill(in, WIRE_PREFIX_BYTES + *len)) return NULL;
+    const char *body = in->buf + in->head + WIRE_PREFIX_BYTES;
+    in->head += WIRE_PREFIX_BYTES + *len;
+    return body;
+}
+
+static size_t json_request(char *out, LoadKind kind, int step, const char *filename) {
+    int n = 0;
+    if (kind == LOAD_STAT) {
+        n = snprintf(out, REQUEST_BYTES, "{\"cmd\":\"STAT\",\"username\":\"bench\",\"filename\":\"%s\"}\n",
+                     filename);
+    } else if (kind == LOAD_READ) {
+        n = snprintf(out, REQUEST_BYTES, "{\"cmd\":\"READ\",\"username\":\"bench\",\"filename\":\"%s\"}\n",
+                     filename);
+    } else if (step == 0) {
+        n = snprintf(out, REQUEST_BYTES, "{\"cmd\":\"WRITE\",\"username\":\"bench\",\"filename\":\"%s\","
+                     "\"sentence_index\":0}\n", filename);
+    } else if (step == 1) {
+        n = snprintf(out, REQUEST_BYTES, "{\"cmd\":\"UPDATE\",\"word_index\":1,\"content\":\"edited\","
+                     "\"mode\":\"replace\"}\n");
+    } else {
+        n = snprintf(out, REQUEST_BYTES, "{\"cmd\":\"ETIRW\"}\n");
+    }
+    return (size_t)n;
+}
+
+static size_t wire_request(char *out, LoadKind kind, int step, const char *filename) {
+    WireWriter w;
+    wire_writer_init(&w, out, REQUEST_BYTES);
+    unsigned int op = kind == LOAD_STAT ? WIRE_OP_STAT : kind == LOAD_READ ? WIRE_OP_READ :
+                      step == 0 ? WIRE_OP_WRITE : step == 1 ? WIRE_OP_UPDATE : WIRE_OP_ETIRW;
+    wire_put_u8(&w, (uint8_t)op);
+    wire_put_str16(&w, "bench", 5);
+    if (op == WIRE_OP_STAT || op == WIRE_OP_READ || op == WIRE_OP_WRITE) {
+        wire_put_str16(&w, filename, strlen(filename));
+    }
+    if (op == WIRE_OP_WRITE) {
+        wire_put_u32(&w, 0);
+        wire_put_u32(&w, 0);
+    } else if (op == WIRE_OP_UPDATE) {
+        wire_put_u32(&w, 1);
+        wire_put_u8(&w, 1);
+        wire_put_str32(&w, "edited", 6);
+    }
+    size_t len = 0;
+    wire_writer_finish(&w, 0, &len);
+    return len;
+}
+
+// Decodes one reply the way a client would use it; returns the bytes of
+// content it carried, or -1 on an error reply
+static long json_reply(ReplyStream *in, char *content, size_t content_cap) {
+    size_t len = 0;
+    char *line = next_line(in, &len);
+    if (!line) return -1;
+    JsonMessage msg;
+    json_parse(&msg, line, len);
+    char status[8] = "";
+    json_field_string(&msg, "status", status, sizeof(status));
+    if (strcmp(status, "OK") != 0) return -1;
+    const JsonField *field = json_find(&msg, "content");
+    if (field) {
+        return (long)json_unescape(field->value, field->value_len, content, content_cap);
+    }
+    int words = 0;
+    json_field_int(&msg, "words", &words);
+    return words;
+}
+
+static long wire_reply(ReplyStream *in, LoadKind kind, int step, char *content, size_t content_cap) {
+    size_t len = 0;
+    const char *body = next_frame(in, &len);
+    if (!body) return -1;
+    WireReader r;
+    wire_reader_init(&r, body, len);
+    if (wire_get_u8(&r) != WIRE_OK) return -1;
+    if (kind == LOAD_READ) {
+        size_t bytes = 0;
+        const char *data = wire_get_str32(&r, &bytes);
+        if (!data) return -1;
+        // a client that keeps the text copies it once; nothing to decode
+        size_t copy = bytes < content_cap ? bytes : content_cap - 1;
+        memcpy(content, data, copy);
+        content[copy] = '\0';
+        return (long)bytes;
+    }
+    if (kind == LOAD_STAT) {
+        return (long)wire_get_u32(&r);
+    }
+    (void)step;
+    return 0;
+}
+
+static int handshake(int fd) {
+    const unsigned char hello[2] = {WIRE_HANDSHAKE, WIRE_VERSION};
+    unsigned char ack[2];
+    if (send_all(fd, (const char *)hello, sizeof(hello)) != 0 ||
+        read(fd, ack, sizeof(ack)) != (ssize_t)sizeof(ack) || ack[1] != WIRE_VERSION) {
+        fprintf(stderr, "handshake failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Sends n requests DEPTH at a time; returns seconds, or -1
+static double run(const Workload *load, bool binary, long n, char *content, size_t content_cap) {
+    pthread_t server;
+    int fd = start_server(&server);
+    if (fd < 0) return -1;
+    if (binary && handshake(fd) != 0) return -1;
+
+    ReplyStream in = {fd, malloc(64 * 1024), 64 * 1024, 0, 0};
+    char *batch = malloc((size_t)DEPTH * REQUEST_BYTES);
+    if (!in.buf || !batch) return -1;
+    int steps = load->kind == LOAD_EDIT ? 3 : 1;
+    double start = now_seconds();
+    bool ok = true;
+    for (long done = 0; ok && done < n; ) {
+        int count = n - done < DEPTH ? (int)(n - done) : DEPTH;
+        size_t used = 0;
+        for (int i = 0; i < count; i++) {
+            int step = (int)((done + i) % steps);
+            used += binary ? wire_request(batch + used, load->kind, step, load->filename)
+                           : json_request(batch + used, load->kind, step, load->filename);
+        }
+        ok = send_all(fd, batch, used) == 0;
+        for (int i = 0; ok && i < count; i++) {
+            int step = (int)((done + i) % steps);
+            ok = (binary ? wire_reply(&in, load->kind, step, content, content_cap)
+                         : json_reply(&in, content, content_cap)) >= 0;
+        }
+        done += count;
+    }
+    double elapsed = now_seconds() - start;
+    close(fd);
+    pthread_join(server, NULL);
+    free(in.buf);
+    free(batch);
+    return ok ? elapsed : -1;
+}
+
+// Prose with quotes, tabs and line breaks, so JSON has something to escape
+static char *make_text(size_t bytes) {
+    static const char *pieces[] = {
+        "The server keeps every sentence in memory.", " \"Quoted\" words need escapes.",
+        "\tIndented lines too.", "\nA new paragraph starts here.", " Plain words cost nothing.",
+    };
+    char *text = malloc(bytes + 64);
+    if (!text) return NULL;
+    size_t len = 0;
+    for (unsigned int i = 0; len < bytes; i++) {
+        const char *piece = pieces[(i * 7) % (sizeof(pieces) / sizeof(pieces[0]))];
+        size_t plen = strlen(piece);
+        memcpy(text + len, piece, plen);
+        len += plen;
+    }
+    text[bytes] = '\0';
+    return text;
+}
+
+static int check(const Workload *load, const char *expect, char *content, size_t content_cap) {
+    for (int binary = 0; binary <= 1; binary++) {
+        content[0] = '\0';
+        if (run(load, binary, 1, content, content_cap) < 0 || strcmp(content, expect) != 0) {
+            fprintf(stderr, "%s: %s READ returned different bytes\n", load->label,
+                    binary ? "binary" : "JSON");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = argc > 1 ? atol(argv[1]) : 100000;
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    char scratch[] = "wire_bench.XXXXXX";
+    if (!mkdtemp(scratch)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(BASE_DIR, sizeof(BASE_DIR), "%s", scratch);
+    ensure_directories();
+    locking_init();
+    durability_init(DURABILITY_NONE, 0);
+    readcache_init((size_t)READ_CACHE_DEFAULT_MB * 1024 * 1024);
+
+    Workload loads[] = {
+        {"STAT", LOAD_STAT, "read_256.txt", 256},
+        {"READ 256 B", LOAD_READ, "read_256.txt", 256},
+        {"READ 4 KB", LOAD_READ, "read_4k.txt", 4 * 1024},
+        {"READ 64 KB", LOAD_READ, "read_64k.txt", 64 * 1024},
+        {"READ 1 MB", LOAD_READ, "read_1m.txt", 1024 * 1024},
+        {"WRITE/UPDATE/ETIRW", LOAD_EDIT, "edit.txt", 256},
+    };
+    int count = (int)(sizeof(loads) / sizeof(loads[0]));
+    size_t content_cap = 2 * 1024 * 1024;
+    char *content = malloc(content_cap);
+    if (!content) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        char *text = make_text(loads[i].bytes);
+        if (!text || save_file_atomic(loads[i].filename, text) != 0) {
+            fprintf(stderr, "could not create %s\n", loads[i].filename);
+            return 1;
+        }
+        if (loads[i].kind == LOAD_READ && check(&loads[i], text, content, content_cap) != 0) {
+            return 1;
+        }
+        free(text);
+    }
+
+    printf("%d requests in flight per connection\n", DEPTH);
+    printf("%-20s %12s %12s %9s\n", "workload", "JSON req/s", "binary req/s", "speedup");
+    for (int i = 0; i < count; i++) {
+        long n = iterations;
+        if (loads[i].bytes > 4096) {
+            n = iterations * 4096 / (long)loads[i].bytes;
+            if (n < 200) n = 200;
+        }
+        if (loads[i].kind == LOAD_EDIT) {
+            n = (iterations / 10) / 3 * 3;
+        }
+        double json_time = run(&loads[i], false, n, content, content_cap);
+        double wire_time = run(&loads[i], true, n, content, content_cap);
+        if (json_time < 0 || wire_time < 0) {
+            fprintf(stderr, "%s: a request failed\n", loads[i].label);
+            return 1;
+        }
+        printf("%-20s %12.0f %12.0f %8.2fx\n", loads[i].label, n / json_time, n / wire_time,
+               json_time / wire_time);
+    }
+    free(content);
+
+    char command[1100];
+    snprintf(command, sizeof(command), "rm -rf '%s'", scratch);
+    if (system(command) != 0) {
+        fprintf(stderr, "could not remove %s\n", scratch);
+    }
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef SS_ARENA_H
+#define SS_ARENA_H
+
+#include "ss_common.h"
+
+#define ARENA_MIN_BLOCK 4096
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    char data[];
+} ArenaBlock;
+
+// Bump allocator for short-lived strings such as the words of a write
+// session. Strings are packed back to back at a cursor in the newest block;
+// a new block, at least twice the previous one, is chained only when the
+// cursor runs out, so a session holds a handful of blocks however many words
+// it tokenizes. Nothing is freed individually: arena_reset drops everything.
+typedef struct {
+    ArenaBlock *head;
+    char *cursor;
+    char *limit;
+    size_t allocated;
+} Arena;
+
+void arena_init(Arena *arena);
+void arena_reset(Arena *arena);
+
+// Make room for at least bytes more without chaining another block
+int arena_reserve(Arena *arena, size_t bytes);
+char *arena_strndup(Arena *arena, const char *src, size_t len);
+
+#endif // SS_ARENA_H
@@ -17,12 +17,17 @@
 #include <stdbool.h>
 #include <time.h>
 
+#include "proto_shard.h"
+
 // Constants
 #define NM_PORT 9000
 #define MAX_FILENAME 256
 #define MAX_MSG 4096
-#define MAX_LOCKS 128
+#define MAX_REQUEST (16 * 1024 * 1024)
+#define READ_CHUNK_BYTES (256 * 1024)
+#define READ_ESCAPE_BYTES (16 * 1024)  // plain READ escapes the file through this buffer
 #define MAX_USERNAME 64
+#define LOG_PREVIEW_BYTES 256      // longer requests are logged as their start and length
 
 // Global path variables
 extern char BASE_DIR[1024];
@@ -31,6 +36,8 @@ extern char SNAP_DIR[1024];
 extern char LOG_DIR[1024];
 extern char NM_IP[INET_ADDRSTRLEN];
 extern char ADVERTISE_IP[INET_ADDRSTRLEN];
+extern char REGISTERED_IP[INET_ADDRSTRLEN];
+extern ShardMap NM_SHARDS;               // empty unless the NM is sharded
 extern int CLIENT_PORT;
 
 // Logging context (thread-local)
@@ -0,0 +1,20 @@
+#ifndef SS_CONTROL_H
+#define SS_CONTROL_H
+
+#include "ss_common.h"
+#include "ss_stats.h"
+
+#define CONTROL_BATCH_MAX 128
+#define CONTROL_RETRY_SECS 1
+#define CONTROL_HEARTBEAT_MS 1000
+
+// Persistent, tagged session to each name server shard used for pushes that
+// the NM would otherwise have to poll for; a file's counts go to its owner.
+// Updates are coalesced per file while the channel is busy or down and
+// resent after a reconnect. When there is nothing to push for
+// CONTROL_HEARTBEAT_MS a heartbeat is sent instead, and an NM that no longer
+// knows this server makes it register again.
+void control_start(void);
+void control_push_stats(const char *filename, const FileStats *stats);
+
+#endif // SS_CONTROL_H
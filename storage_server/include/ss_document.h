@@ -0,0 +1,73 @@
+#ifndef SS_DOCUMENT_H
+#define SS_DOCUMENT_H
+
+#include "ss_common.h"
+#include "ss_stats.h"
+
+#define DOC_BUCKETS 64
+#define DOC_IDLE_MAX 32         // unreferenced documents kept loaded
+#define DOC_WRITEV_BATCH 512    // sentences per writev call
+
+// One sentence of a document. Spans point into the text loaded from disk
+// until a commit replaces them with owned strings, so an edit only
+// allocates the sentences it touches.
+typedef struct {
+    const char *text;
+    size_t len;
+    char *owned;
+    int words;
+    int chars;
+} DocSentence;
+
+// Shared in-memory model of a file: its sentences as they would be split
+// by split_into_sentences, joined on disk by single spaces. Documents are
+// reference counted and cached by filename; the on-disk identity (inode,
+// size, mtime) is checked under the document lock, so UNDO, CREATE or
+// REPLICATE writes made elsewhere cause a reload rather than stale data.
+typedef struct Document {
+    char filename[MAX_FILENAME];
+    char *base;
+    DocSentence *sentences;
+    int count;
+    int capacity;
+    FileStats stats;
+    bool loaded;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    pthread_mutex_t mutex;
+    int refcount;
+    unsigned long last_used;
+    struct Document *next;
+} Document;
+
+// Reference management
+Document *document_open(const char *filename);
+void document_release(Document *doc);
+
+// Hold the lock around any read-modify-write. document_lock re-validates the
+// cached sentences against the file; it returns 0, without the lock held,
+// if the file no longer exists.
+int document_lock(Document *doc);
+void document_unlock(Document *doc);
+
+// Accessors (lock held). Stats cover the content as written by a commit.
+void document_stats(const Document *doc, FileStats *out);
+const DocSentence *document_sentence(const Document *doc, int index);
+bool document_sentence_equals(const Document *doc, int index, const char *text);
+int document_find_sentence(const Document *doc, const char *target, int hint_index);
+
+// Replace sentences [keep_prefix, resume) with the given ones and write the
+// file. The strings (not the array) become the document's, even on failure,
+// and stay valid until the lock is released. The overwritten sentences
+// are logged to the version history first. Returns 0 on success; on
+// failure the document is reloaded from disk on the next lock. It returns
+// once the new version is as durable as the durability mode asks.
+int document_commit(Document *doc, int keep_prefix, int resume, char **sentences, int count);
+
+// Overwrite the file with content and reload the sentences from it, as
+// UNDO does. Returns 0 on success.
+int document_replace(Document *doc, const char *content);
+
+#endif // SS_DOCUMENT_H
@@ -0,0 +1,40 @@
+#ifndef SS_DURABILITY_H
+#define SS_DURABILITY_H
+
+#include "ss_common.h"
+
+#define DURABILITY_DEFAULT_WINDOW_MS 2  // group commit: how long a batch collects
+#define DURABILITY_MAX_WINDOW_MS 1000
+#define DURABILITY_MAX_BATCH 256        // files per group flush; a full batch flushes at once
+
+// How a file write is made durable before it is acknowledged.
+//   none:  rename only; the page cache decides (the old behaviour)
+//   sync:  fsync the temp file, rename it into place, then fsync DATA_DIR,
+//          inline
+//   group: the temp file is queued; a flusher thread fsyncs every temp file
+//          queued within the window, renames them into place, fsyncs
+//          DATA_DIR once and releases their writers together.
+// The live file is only replaced once its new data is on disk, so a crash
+// leaves either the previous version or the new one under the name.
+// After an fsync error nothing is reported durable again until restart,
+// since the kernel may already have dropped the failed pages.
+typedef enum {
+    DURABILITY_NONE,
+    DURABILITY_SYNC,
+    DURABILITY_GROUP
+} DurabilityMode;
+
+void durability_init(DurabilityMode mode, int window_ms);
+DurabilityMode durability_mode(void);
+const char *durability_mode_name(DurabilityMode mode);
+bool durability_parse_mode(const char *name, DurabilityMode *out);
+
+// Make the temp file just written through fd durable and rename it over
+// path as the mode requires. The fd stays the caller's. Returns once the
+// new version is in place (in group mode, when its batch is flushed), so
+// call it with the file's lock held: no other write to it can start in
+// between. Returns 0 on success; on failure path still names the previous
+// version, and the caller removes tmp_path.
+int durability_commit(int fd, const char *tmp_path, const char *path);
+
+#endif // SS_DURABILITY_H
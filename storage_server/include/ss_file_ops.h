@@ -6,12 +6,13 @@
 // File operations
 void ensure_directories(void);
 void build_filepath(char *dest, const char *filename);
-void build_snapshot_path(char *dest, const char *filename);
 int file_exists(const char *path);
 char *load_file(const char *filename);
 void save_file(const char *filename, const char *content);
-void save_snapshot(const char *filename, const char *content);
+// Replace the file with content, durable per the durability mode before it
+// returns. Returns 0 on success.
 int save_file_atomic(const char *filename, const char *content);
-char *build_files_manifest(void);
+// JSON array of the stored files; with shards, only those owned by shard
+char *build_files_manifest(const ShardMap *shards, int shard);
 
 #endif // SS_FILE_OPS_H
@@ -0,0 +1,38 @@
+#ifndef SS_FILEVIEW_H
+#define SS_FILEVIEW_H
+
+#include "ss_common.h"
+
+#define VIEW_BUCKETS 64
+#define VIEW_IDLE_MAX 32        // unreferenced mappings kept for the next reader
+
+// Read-only mapping of a data file, shared by every reader of it. Files are
+// only ever replaced by rename, never rewritten in place, so a view stays a
+// consistent copy of the content it was opened on for as long as it is held,
+// even after a commit. A file truncated in place by something other than
+// this server would make reads of its view fault.
+typedef struct FileView {
+    char filename[MAX_FILENAME];
+    const char *data;           // not NUL-terminated
+    size_t size;
+    unsigned long version;      // distinct for every mapping, for caches derived from it
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    int refcount;
+    bool cached;                // still the current view of the file
+    unsigned long last_used;
+    struct FileView *next;
+} FileView;
+
+// The current view of filename, mapping it again if the file has changed
+// since; NULL if it does not exist. Pair with fileview_release.
+FileView *fileview_open(const char *filename);
+void fileview_release(FileView *view);
+
+// Drop the cached view, and the read cache entry built from it, after the
+// file was replaced or deleted; readers still holding the view keep their
+// mapping until they release it
+void fileview_invalidate(const char *filename);
+
+#endif // SS_FILEVIEW_H
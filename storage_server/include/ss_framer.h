@@ -0,0 +1,56 @@
+#ifndef SS_FRAMER_H
+#define SS_FRAMER_H
+
+#include "ss_common.h"
+
+#define FRAMER_INITIAL_BYTES (16 * 1024)
+#define FRAMER_MIN_READ 4096        // slide the window back once less than this is free
+
+typedef enum {
+    FRAME_NONE = 0,     // no complete request buffered
+    FRAME_LINE,         // a whole request: a line, or a frame on a binary connection
+    FRAME_OVERSIZE      // a request longer than the limit was dropped
+} FrameResult;
+
+// Splits a connection's byte stream into newline-terminated requests and
+// hands each one out in place, NUL-terminated, without copying it. Reads
+// append after the buffered data; the unconsumed bytes are only moved back
+// to the front when the free space behind them runs short, so a pipelined
+// stream costs one move of a partial request per buffer length, and the
+// buffer only grows for a request that does not fit. A request is never
+// cut or dropped unless it exceeds max_request, and then the client is told
+// (FRAME_OVERSIZE) and the rest of it up to the newline is skipped.
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t head;            // first unconsumed byte
+    size_t tail;            // end of the buffered bytes
+    size_t scanned;         // [head, scanned) is known to hold no newline
+    size_t max_request;
+    bool discarding;        // skipping the rest of an oversized request
+    size_t skip;            // bytes left of an oversized binary frame
+} Framer;
+
+bool framer_init(Framer *framer, size_t max_request);
+void framer_free(Framer *framer);
+
+// Where the next read should go and how much fits there; NULL if the
+// buffer could not be grown. Pair with framer_commit(bytes actually read).
+char *framer_space(Framer *framer, size_t *avail);
+void framer_commit(Framer *framer, size_t bytes);
+
+// The next complete request, without its "\n" or "\r\n". It stays valid
+// until the next framer_space call.
+FrameResult framer_next(Framer *framer, char **line, size_t *len);
+
+// The same for a connection that negotiated binary framing (proto_wire.h):
+// the body of the next length-prefixed frame, not terminated. A frame over
+// max_request is reported once and skipped by its length.
+FrameResult framer_next_frame(Framer *framer, char **frame, size_t *len);
+
+// The buffered bytes not yet handed out, and dropping the first of them;
+// for reading the handshake before either kind of request
+const char *framer_pending(const Framer *framer, size_t *len);
+void framer_consume(Framer *framer, size_t bytes);
+
+#endif // SS_FRAMER_H
@@ -3,23 +3,30 @@
 
 #include "ss_common.h"
 #include "ss_session.h"
+#include "proto_wire.h"
 
 // Command handlers
 void handle_create_file(int client, const char *filename, const char *initial_content);
 void handle_read(int client, const char *filename);
-void handle_write_begin(int client, const char *filename, int sentence_index, 
+void handle_read_chunked(int client, const char *filename);
+void handle_write_begin(int client, const char *filename, int sentence_index, int wait_ms,
                         WriteSession *session, const char *username);
 void handle_update(int client, int word_index, const char *content, 
                    WriteSession *session, int replace_word);
 void handle_commit(int client, WriteSession *session);
-void handle_undo(int client, const char *filename);
-void handle_stream(int client, const char *filename);
+void handle_undo(int client, const char *filename, int steps, long version);
+void handle_versions(int client, const char *filename);
 void handle_stat(int client, const char *filename);
+void handle_stat_batch(int client, const char *files_array);
+void handle_lock_stats(int client);
+void handle_read_cache_stats(int client, int capacity_mb);
 
-// Message sending utilities
+// Message sending utilities. On a connection that negotiated binary framing
+// (g_binary_replies, set per request like g_log_ctx) they send wire frames.
+extern __thread bool g_binary_replies;
+void send_frame(int client, WireWriter *w, const char *log_msg);
 void send_json(int client, const char* json);
 void send_error(int client, const char *reason);
 void send_ok_message(int client, const char *msg);
-void send_plain_line(int client, const char *line, size_t len);
 
 #endif // SS_HANDLERS_H
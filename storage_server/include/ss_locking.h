@@ -3,19 +3,58 @@
 
 #include "ss_common.h"
 
-// Sentence lock structure
-typedef struct {
-    bool active;
+#define LOCK_SHARDS 16
+#define LOCK_BUCKETS 64         // per shard, for each of the three indexes
+#define LOCK_WAIT_MAX_MS 60000  // longest wait a WRITE may ask for
+
+struct LockWaiter;
+
+// Sentence lock. A lock lives in the shard of its file, chained by
+// (file, sentence), and on its owner's list so a disconnect releases only
+// what that connection held. Writers waiting for it queue FIFO; on release
+// the lock is handed to the first of them rather than freed, so a newcomer
+// can never overtake the queue.
+typedef struct SentenceLock {
     char filename[MAX_FILENAME];
     int sentence_index;
     int owner_fd;
+    struct timespec acquired_at;
+    struct SentenceLock *next;
+    struct SentenceLock *owner_prev;
+    struct SentenceLock *owner_next;
+    struct LockWaiter *waiters;
+    struct LockWaiter *waiters_tail;
+    int waiting;
 } SentenceLock;
 
-// Lock management functions
+// Totals since startup, summed over the shards
+typedef struct {
+    unsigned long acquired;
+    unsigned long contended;    // found another owner holding the sentence
+    unsigned long waited;       // of those, queued rather than refused
+    unsigned long timed_out;
+    unsigned long released;
+    unsigned long active;
+    double hold_total_ms;
+    double hold_max_ms;
+    double wait_total_ms;
+} LockStats;
+
+// Lock management functions. acquire_sentence_lock returns NULL if another
+// owner holds the sentence; an owner re-acquiring its own lock gets it back.
 void locking_init(void);
-int acquire_sentence_lock(const char *filename, int sentence_index, int owner_fd);
-void release_sentence_lock_slot(int slot);
+SentenceLock *acquire_sentence_lock(const char *filename, int sentence_index, int owner_fd);
+
+// As above, but a held sentence is waited for, in FIFO order, for up to
+// timeout_ms. If it has to wait, queued (when set) is called once with the
+// 1-based queue position before blocking; no lock mutex is held then, so it
+// may write to the client. Returns NULL on timeout.
+SentenceLock *acquire_sentence_lock_wait(const char *filename, int sentence_index, int owner_fd,
+                                         int timeout_ms, void (*queued)(int position, void *arg),
+                                         void *arg);
+void release_sentence_lock(SentenceLock *lock);
 void release_sentence_locks_for_owner(int owner_fd);
 bool file_has_active_lock(const char *filename);
+void locking_get_stats(LockStats *out);
 
 #endif // SS_LOCKING_H
@@ -2,16 +2,46 @@
 #define SS_NETWORK_H
 
 #include "ss_common.h"
+#include "ss_framer.h"
+#include "ss_session.h"
+
+// How a connection's requests are encoded, fixed by its first byte
+typedef enum {
+    CONN_UNDECIDED = 0,
+    CONN_JSON,
+    CONN_BINARY         // negotiated with WIRE_HANDSHAKE (proto_wire.h)
+} ConnEncoding;
+
+// A client connection: its buffered requests, write session and the
+// logging context its requests run under. Only one thread services a
+// connection at a time.
+typedef struct SsConn {
+    int fd;
+    ConnEncoding encoding;
+    Framer framer;
+    WriteSession session;
+    ClientLogContext log;
+} SsConn;
+
+// Name server shards: with an unsharded NM there is one, at NM_IP:NM_PORT
+void load_shard_map(void);
+int nm_shard_count(void);
+const char *nm_shard_host(int shard);
+int nm_shard_port(int shard);
+int connect_nm_shard(int shard);
 
 // Network operations
-void register_with_nm(void);
-void handle_client(int client_sock);
-void *client_thread(void *arg);
+void register_with_nm(void);            // with every shard
+void register_with_shard(int shard);
+
+// Reads once from the connection and handles every complete request; the
+// return value is that of read, so <= 0 means the connection is done (0 also
+// once a paced STREAM has taken the connection over).
+SsConn *ss_conn_create(int fd, const struct sockaddr_in *addr);
+int ss_conn_service(SsConn *conn);
+void ss_conn_close(SsConn *conn);   // releases its locks and session, closes fd
 
-// Client thread argument
-typedef struct {
-    int socket_fd;
-    struct sockaddr_in addr;
-} ClientThreadArg;
+// Thread-per-connection mode: services one connection until it closes
+void *client_thread(void *arg);
 
 #endif // SS_NETWORK_H
@@ -0,0 +1,36 @@
+#ifndef SS_REACTOR_H
+#define SS_REACTOR_H
+
+#include "ss_common.h"
+
+#define SS_DEFAULT_WORKERS 8
+#define SS_DEFAULT_MAX_CONNS 1024   // connections served at once before BUSY
+#define SS_MAX_EVENTS 64
+#define SS_LISTEN_BACKLOG 128
+
+typedef enum {
+    SS_MODE_THREADED = 0,
+    SS_MODE_EPOLL
+} SsServeMode;
+
+// Both modes admit at most max_conns clients at a time; one beyond that is
+// answered with a BUSY error and closed straight away, so an overload is
+// refused up front instead of slowing down every client already connected.
+int run_threaded_server(int server_sock, int max_conns);
+
+// An epoll loop hands readable connections to a fixed pool of workers. The
+// work queue holds one entry per admitted connection at most, so it never
+// fills.
+int run_epoll_server(int server_sock, int worker_count, int max_conns);
+
+// Bracket a wait that can last long (a WRITE queued behind a held
+// sentence). While a pool worker is parked in one, a spare worker is started
+// so the pool keeps its full size for everyone else; spares exit once the
+// waits are over. No-ops in threaded mode.
+void reactor_block_begin(void);
+void reactor_block_end(void);
+
+// For client_thread: one admitted connection has gone
+void reactor_connection_closed(void);
+
+#endif // SS_REACTOR_H
@@ -0,0 +1,51 @@
+#ifndef SS_READCACHE_H
+#define SS_READCACHE_H
+
+#include "ss_common.h"
+#include "ss_fileview.h"
+
+#define READ_CACHE_BUCKETS 64
+#define READ_CACHE_DEFAULT_MB 64
+#define READ_CACHE_MAX_SHARE 4      // one payload may take at most 1/4 of the budget
+
+// LRU cache of complete plain-READ replies (the file content already JSON
+// escaped), bounded by total bytes. The text itself comes from the shared
+// FileView mapping; what a hit saves is the escaping pass. Entries are keyed
+// by filename and the version of the view they were built from, so a reply
+// built from content a commit has since replaced can never be served.
+// Replacing or deleting a file drops its entry straight away.
+typedef struct ReadCachePayload {
+    char *data;
+    size_t len;
+    int refcount;
+} ReadCachePayload;
+
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    unsigned long invalidations;
+    size_t resident_bytes;
+    size_t capacity_bytes;
+    int entries;
+} ReadCacheStats;
+
+void readcache_init(size_t capacity_bytes);     // 0 disables the cache
+void readcache_set_capacity(size_t capacity_bytes);
+
+// The cached reply for this view, or NULL (a miss) if there is none.
+// Release what it returns with readcache_release.
+ReadCachePayload *readcache_get(const FileView *view);
+
+// Cache a reply built from view; the cache takes data over. Returns a
+// reference to release, or NULL if it could not be kept (data is freed).
+ReadCachePayload *readcache_put(const FileView *view, char *data, size_t len);
+void readcache_release(ReadCachePayload *payload);
+
+// Whether a reply of len bytes fits in the cache at all
+bool readcache_accepts(size_t len);
+
+void readcache_invalidate(const char *filename);
+void readcache_get_stats(ReadCacheStats *out);
+
+#endif // SS_READCACHE_H
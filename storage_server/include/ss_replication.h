@@ -0,0 +1,53 @@
+#ifndef SS_REPLICATION_H
+#define SS_REPLICATION_H
+
+#include "ss_common.h"
+#include "proto_json.h"
+
+#define REPL_MAX_PENDING 256
+#define REPL_MAX_PENDING_BYTES (64 * 1024 * 1024)
+#define REPL_ACK_TIMEOUT_SECS 5
+#define REPL_RETRY_SECS 2
+#define REPL_MAX_TARGETS 16
+#define REPL_MAP_BUCKETS 256
+
+// Primary -> backup replication. Committed changes are queued and shipped
+// by a background thread, so the commit path does not wait on the backup
+// unless wait_for_ack is set. Once more than max_pending changes are
+// unshipped, publishers hold their reply until the backlog drains, which
+// bounds the backup's lag.
+//
+// Each change carries (epoch, seq). A backup that missed a change, or that
+// restarted, answers NEED_FULL and receives the whole post-change content
+// instead of the sentence delta.
+void replication_init(bool wait_for_ack, int max_pending);
+
+// Replica assignment from the NM, persisted under BASE_DIR
+void replication_set_replica(const char *filename, const char *backup_ip, int backup_port);
+void replication_forget(const char *filename);
+
+// A published change, for replication_wait
+typedef struct {
+    bool queued;
+    struct ReplChange *change;  // set when the publisher waits for the ack
+} ReplTicket;
+
+// Primary side. A commit replaced sentences [keep_prefix, resume) of a file
+// that had base_count sentences with the given new ones. Files without a
+// replica are ignored. Publishing only queues the change, so it is done
+// under the document lock to keep commit order.
+ReplTicket replication_publish_delta(const char *filename, int base_count, int keep_prefix, int resume,
+                                     char **sentences, int sentence_count);
+ReplTicket replication_publish_full(const char *filename, const char *content);
+
+// After the document lock is released: blocks while more than max_pending
+// changes are unshipped, then, with wait_for_ack, until the backup
+// acknowledges this change or REPL_ACK_TIMEOUT_SECS pass. A call that
+// waits is bracketed by reactor_block_begin/end.
+void replication_wait(ReplTicket ticket);
+
+// Command handlers
+void handle_replicate(int client, const JsonMessage *request);
+void handle_set_replica(int client, const JsonMessage *request);
+
+#endif // SS_REPLICATION_H
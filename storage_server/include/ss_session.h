@@ -2,24 +2,27 @@
 #define SS_SESSION_H
 
 #include "ss_common.h"
+#include "ss_arena.h"
+#include "ss_document.h"
+#include "ss_locking.h"
 
 // Write session structure
 typedef struct {
     bool active;
     int owner_fd;
-    int lock_slot;
+    SentenceLock *lock;
     char filename[MAX_FILENAME];
     int sentence_index;
     int original_sentence_index;
     bool append_mode;
     char username[MAX_USERNAME];
-    char **sentences;
-    int sentence_count;
+    Document *doc;              // shared document, referenced while the write is open
+    char *baseline;             // the sentence as it was at WRITE begin
+    Arena arena;                // backs the words; freed as a whole on reset
     char **words;
     int word_count;
     int word_capacity;
     char trailing_punct;
-    char *original_content;
     bool dirty;
 } WriteSession;
 
@@ -30,11 +33,10 @@ void session_reset(WriteSession *session);
 // String array utilities
 void free_string_array(char **arr, int count);
 int split_into_sentences(const char *content, char ***out_sentences, int *out_count);
-int split_sentence_into_words(const char *sentence, char ***out_words, int *out_count, 
-                               int *out_capacity, char *punctuation);
+int split_sentence_into_words(Arena *arena, const char *sentence, char ***out_words, int *out_count,
+                              int *out_capacity, char *punctuation);
 char *join_words(char **words, int word_count, char punctuation);
 char *join_sentences(char **sentences, int count);
 void refresh_trailing_punctuation(WriteSession *session);
-int find_sentence_index_with_hint(char **sentences, int count, const char *target, int hint_index);
 
 #endif // SS_SESSION_H
@@ -0,0 +1,30 @@
+#ifndef SS_STATS_H
+#define SS_STATS_H
+
+#include "ss_common.h"
+
+#define STATS_CACHE_BUCKETS 256
+
+// Word/char/byte counts for one file
+typedef struct {
+    int words;
+    int chars;
+    size_t bytes;
+} FileStats;
+
+// Counting: stats_add_text accumulates one piece of text; pieces joined by a
+// single space can be summed with stats_add_separator between them.
+void stats_add_text(FileStats *stats, const char *text);
+void stats_add_span(FileStats *stats, const char *text, size_t len);
+void stats_add_separator(FileStats *stats);
+
+// Cache of counts keyed by filename, validated against the file's mtime/size
+// so edits made outside the commit path are never served stale.
+int stats_lookup(const char *filename, FileStats *out);
+void stats_store(const char *filename, const FileStats *stats);
+void stats_forget(const char *filename);
+
+// Load and count a file, using the cache when it is still valid
+int stats_for_file(const char *filename, FileStats *out);
+
+#endif // SS_STATS_H
@@ -0,0 +1,25 @@
+#ifndef SS_STREAM_H
+#define SS_STREAM_H
+
+#include "ss_common.h"
+
+#define STREAM_DEFAULT_RATE 10      // words per second when the client gives none
+#define STREAM_MAX_RATE 1000000
+#define STREAM_BATCH_WORDS 256      // words per sendmsg; two iovecs each
+#define STREAM_MIN_TICK_MS 5        // words due within one tick go out together
+#define STREAM_RETRY_MS 20          // backoff while a slow client's socket is full
+
+// STREAM sends each word followed by a NUL byte and ends with "STOP\0".
+// rate is words per second; 0 sends everything at once from the calling
+// thread. Paced streams are handed to a single timer thread that serves all
+// of them, so a slow stream holds no thread of its own.
+//
+// A paced stream takes the connection over: handle_stream sets
+// g_stream_handoff, the connection loop then stops serving and drops its fd,
+// and the timer thread closes the socket after STOP. Nothing else is ever
+// written between the words.
+extern __thread bool g_stream_handoff;
+void stream_init(void);
+void handle_stream(int client, const char *filename, int rate);
+
+#endif // SS_STREAM_H
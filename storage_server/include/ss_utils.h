@@ -2,11 +2,7 @@
 #define SS_UTILS_H
 
 #include "ss_common.h"
-
-// JSON utilities
-int json_get_string(const char *json, const char *key, char *out, size_t out_size);
-int json_get_int(const char *json, const char *key, int *out);
-char *json_escape(const char *src);
+#include "proto_json.h"
 
 // Network utilities
 int is_loopback_address(const char *ip);
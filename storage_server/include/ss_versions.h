@@ -0,0 +1,44 @@
+#ifndef SS_VERSIONS_H
+#define SS_VERSIONS_H
+
+#include "ss_common.h"
+#include "ss_document.h"
+
+#define VERSION_FULL_INTERVAL 32    // a full record at least every this many versions
+#define VERSION_MAX_RECORDS 256     // the oldest half is dropped beyond this
+#define VERSION_LIST_MAX 64         // versions listed per VERSIONS reply
+
+// Per-file version history under SNAP_DIR, replacing the single .bak copy.
+// Every commit appends one record holding what it overwrote: the sentences
+// it removed and where, so undoing it means splicing them back. A record
+// costs the size of the edit; only every VERSION_FULL_INTERVAL-th one (and
+// the first) stores the whole previous text. A commit that finds the file
+// changed behind the log's back is also stored whole, so versions from
+// then on stay restorable; older ones report HISTORY_STALE once the walk
+// back reaches that change. Versions count up from 0, the content before
+// the first logged commit.
+//
+// All calls that take a Document expect its lock to be held.
+
+// Log the commit about to replace sentences [keep_prefix, resume) of doc
+// with the given ones. *rollback receives the log offset to pass to
+// versions_rollback if the commit then fails. Returns 0 on success.
+int versions_record(const Document *doc, int keep_prefix, int resume, char **sentences, int count,
+                    off_t *rollback);
+void versions_rollback(const char *filename, off_t rollback);
+
+// Drop the history, e.g. when the file is recreated or replaced wholesale
+void versions_forget(const char *filename);
+
+// Restore doc to version target, or steps versions back when target is
+// negative. Later versions are discarded. On success returns NULL and sets
+// *restored and *content (the new text, caller frees); otherwise returns
+// the error reason.
+const char *versions_restore(Document *doc, int steps, long target, unsigned long *restored,
+                             char **content);
+
+// JSON array of {"version","time","full"} for the VERSIONS command, the
+// newest VERSION_LIST_MAX first; caller frees
+char *versions_list_json(const char *filename);
+
+#endif // SS_VERSIONS_H
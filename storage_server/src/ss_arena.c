@@ -0,0 +1,44 @@
+#include "ss_arena.h"
+
+void arena_init(Arena *arena) {
+    memset(arena, 0, sizeof(*arena));
+}
+
+void arena_reset(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    memset(arena, 0, sizeof(*arena));
+}
+
+int arena_reserve(Arena *arena, size_t bytes) {
+    if (arena->cursor && (size_t)(arena->limit - arena->cursor) >= bytes) {
+        return 1;
+    }
+
+    size_t size = arena->head ? arena->head->size * 2 : ARENA_MIN_BLOCK;
+    while (size < bytes) {
+        size *= 2;
+    }
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+    if (!block) return 0;
+    block->next = arena->head;
+    block->size = size;
+    arena->head = block;
+    arena->cursor = block->data;
+    arena->limit = block->data + size;
+    arena->allocated += size;
+    return 1;
+}
+
+char *arena_strndup(Arena *arena, const char *src, size_t len) {
+    if (!arena_reserve(arena, len + 1)) return NULL;
+    char *copy = arena->cursor;
+    memcpy(copy, src, len);
+    copy[len] = '\0';
+    arena->cursor += len + 1;
+    return copy;
+}
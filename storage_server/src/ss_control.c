@@ -0,0 +1,245 @@
+#include "ss_control.h"
+#include "ss_network.h"
+#include "ss_utils.h"
+
+typedef struct PendingStats {
+    char filename[MAX_FILENAME];
+    FileStats stats;
+    struct PendingStats *next;
+} PendingStats;
+
+// One channel per name server shard, each pushing the counts of the files
+// that shard owns and sending its own heartbeats
+typedef struct {
+    int shard;
+    PendingStats *pending;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} ControlChannel;
+
+static ControlChannel g_channels[SHARD_MAX];
+static int g_channel_count = 0;
+static bool g_control_running = false;
+
+static PendingStats *find_pending(PendingStats *list, const char *filename) {
+    for (PendingStats *p = list; p; p = p->next) {
+        if (strcmp(p->filename, filename) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+void control_push_stats(const char *filename, const FileStats *stats) {
+    if (!g_control_running || !filename || !stats) return;
+
+    int owner = shard_map_owner(&NM_SHARDS, filename);
+    ControlChannel *ch = &g_channels[owner < 0 ? 0 : owner];
+    pthread_mutex_lock(&ch->mutex);
+    PendingStats *entry = find_pending(ch->pending, filename);
+    if (!entry) {
+        entry = malloc(sizeof(PendingStats));
+        if (!entry) {
+            pthread_mutex_unlock(&ch->mutex);
+            return;
+        }
+        strncpy(entry->filename, filename, sizeof(entry->filename) - 1);
+        entry->filename[sizeof(entry->filename) - 1] = '\0';
+        entry->next = ch->pending;
+        ch->pending = entry;
+    }
+    entry->stats = *stats;
+    pthread_cond_signal(&ch->cond);
+    pthread_mutex_unlock(&ch->mutex);
+}
+
+// Put an unsent batch back, unless a newer update for the same file arrived
+static void requeue(ControlChannel *ch, PendingStats *batch) {
+    pthread_mutex_lock(&ch->mutex);
+    while (batch) {
+        PendingStats *next = batch->next;
+        if (find_pending(ch->pending, batch->filename)) {
+            free(batch);
+        } else {
+            batch->next = ch->pending;
+            ch->pending = batch;
+        }
+        batch = next;
+    }
+    pthread_mutex_unlock(&ch->mutex);
+}
+
+static void free_batch(PendingStats *batch) {
+    while (batch) {
+        PendingStats *next = batch->next;
+        free(batch);
+        batch = next;
+    }
+}
+
+// Returns NULL when the heartbeat interval passed with nothing to push
+static PendingStats *take_batch(ControlChannel *ch) {
+    pthread_mutex_lock(&ch->mutex);
+    if (!ch->pending) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += CONTROL_HEARTBEAT_MS / 1000;
+        deadline.tv_nsec += (long)(CONTROL_HEARTBEAT_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (!ch->pending) {
+            if (pthread_cond_timedwait(&ch->cond, &ch->mutex, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+    }
+    if (!ch->pending) {
+        pthread_mutex_unlock(&ch->mutex);
+        return NULL;
+    }
+
+    PendingStats *batch = ch->pending;
+    PendingStats *tail = batch;
+    int count = 1;
+    while (tail->next && count < CONTROL_BATCH_MAX) {
+        tail = tail->next;
+        count++;
+    }
+    ch->pending = tail->next;
+    tail->next = NULL;
+    pthread_mutex_unlock(&ch->mutex);
+    return batch;
+}
+
+static int send_all(int sock, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(sock, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// The NM answers each tagged request with one line
+static int read_reply(int sock, char *buf, size_t size) {
+    size_t len = 0;
+    while (len < size - 1) {
+        ssize_t n = recv(sock, buf + len, size - 1 - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        len += (size_t)n;
+        buf[len] = '\0';
+        if (strchr(buf, '\n')) return 1;
+    }
+    return 0;
+}
+
+static char *build_stats_request(PendingStats *batch, long req_id) {
+    char *msg = NULL;
+    size_t msg_len = 0;
+    FILE *out = open_memstream(&msg, &msg_len);
+    if (!out) return NULL;
+
+    fprintf(out, "{\"cmd\":\"SS_STATS\",\"req_id\":%ld,\"ip\":\"%s\",\"client_port\":%d,\"stats\":[",
+            req_id, REGISTERED_IP, CLIENT_PORT);
+    for (PendingStats *p = batch; p; p = p->next) {
+        char *escaped = json_escape(p->filename);
+        if (!escaped) continue;
+        fprintf(out, "%s{\"filename\":\"%s\",\"words\":%d,\"chars\":%d,\"bytes\":%zu}",
+                p == batch ? "" : ",", escaped, p->stats.words, p->stats.chars, p->stats.bytes);
+        free(escaped);
+    }
+    fputs("]}\n", out);
+    fclose(out);
+    return msg;
+}
+
+static char *build_heartbeat(long req_id) {
+    char *msg = malloc(MAX_MSG);
+    if (!msg) return NULL;
+    snprintf(msg, MAX_MSG, "{\"cmd\":\"SS_HEARTBEAT\",\"req_id\":%ld,\"ip\":\"%s\",\"client_port\":%d}\n",
+             req_id, REGISTERED_IP, CLIENT_PORT);
+    return msg;
+}
+
+static void *control_thread(void *arg) {
+    ControlChannel *ch = arg;
+    const char *nm_host = nm_shard_host(ch->shard);
+    int nm_port = nm_shard_port(ch->shard);
+    int sock = -1;
+    long req_id = 0;
+    bool nm_reachable = true;
+
+    while (1) {
+        PendingStats *batch = take_batch(ch);
+
+        if (sock < 0) {
+            sock = connect_nm_shard(ch->shard);
+        }
+        char *msg = NULL;
+        if (sock >= 0) {
+            msg = batch ? build_stats_request(batch, ++req_id) : build_heartbeat(++req_id);
+        }
+
+        char reply[256];
+        int delivered = msg && send_all(sock, msg, strlen(msg)) == 0 &&
+                        read_reply(sock, reply, sizeof(reply));
+        free(msg);
+
+        // A rejected batch is dropped; the NM falls back to polling for those
+        // files. UNKNOWN_SS means the NM restarted or expired us: register again.
+        if (delivered) {
+            if (!nm_reachable) {
+                log_event("INFO", nm_host, nm_port, "-", "CONTROL", "Control channel to NM restored");
+                nm_reachable = true;
+            }
+            if (strstr(reply, "UNKNOWN_SS")) {
+                log_event("INFO", nm_host, nm_port, "-", "CONTROL", "NM does not know this server; re-registering");
+                register_with_shard(ch->shard);
+            } else if (!strstr(reply, "\"status\":\"OK\"")) {
+                log_event("ERROR", nm_host, nm_port, "-", "CONTROL", reply);
+            }
+            free_batch(batch);
+            continue;
+        }
+
+        if (nm_reachable) {
+            log_event("ERROR", nm_host, nm_port, "-", "CONTROL", "Control channel to NM failed; will retry");
+            nm_reachable = false;
+        }
+        if (sock >= 0) {
+            close(sock);
+            sock = -1;
+        }
+        requeue(ch, batch);
+        sleep(CONTROL_RETRY_SECS);
+    }
+    return NULL;
+}
+
+void control_start(void) {
+    if (g_control_running) return;
+
+    g_channel_count = nm_shard_count();
+    for (int i = 0; i < g_channel_count; i++) {
+        ControlChannel *ch = &g_channels[i];
+        ch->shard = i;
+        ch->pending = NULL;
+        pthread_mutex_init(&ch->mutex, NULL);
+        pthread_cond_init(&ch->cond, NULL);
+    }
+
+    for (int i = 0; i < g_channel_count; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, control_thread, &g_channels[i]) != 0) {
+            perror("[SS] control thread");
+            continue;
+        }
+        pthread_detach(tid);
+    }
+    g_control_running = true;
+}
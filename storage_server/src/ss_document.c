@@ -0,0 +1,385 @@
+#include "ss_document.h"
+#include "ss_durability.h"
+#include "ss_file_ops.h"
+#include "ss_fileview.h"
+#include "ss_versions.h"
+
+#include <fcntl.h>
+#include <sys/uio.h>
+
+static Document *g_docs[DOC_BUCKETS];
+static pthread_mutex_t g_docs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int g_idle_count = 0;
+static unsigned long g_use_clock = 0;
+
+static unsigned int document_hash(const char *filename) {
+    unsigned int hash = 5381;
+    for (const char *p = filename; *p; p++) {
+        hash = hash * 33 + (unsigned char)*p;
+    }
+    return hash % DOC_BUCKETS;
+}
+
+static void clear_sentences(Document *doc) {
+    for (int i = 0; i < doc->count; i++) {
+        free(doc->sentences[i].owned);
+    }
+    free(doc->sentences);
+    free(doc->base);
+    doc->sentences = NULL;
+    doc->base = NULL;
+    doc->count = 0;
+    doc->capacity = 0;
+    memset(&doc->stats, 0, sizeof(doc->stats));
+    doc->loaded = false;
+}
+
+static int reserve_sentences(Document *doc, int needed) {
+    if (needed <= doc->capacity) return 1;
+    int capacity = doc->capacity ? doc->capacity : 16;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    DocSentence *tmp = realloc(doc->sentences, sizeof(DocSentence) * (size_t)capacity);
+    if (!tmp) return 0;
+    doc->sentences = tmp;
+    doc->capacity = capacity;
+    return 1;
+}
+
+static void set_sentence(Document *doc, DocSentence *s, const char *text, size_t len, char *owned) {
+    FileStats counts = {0, 0, 0};
+    stats_add_span(&counts, text, len);
+    s->text = text;
+    s->len = len;
+    s->owned = owned;
+    s->words = counts.words;
+    s->chars = counts.chars;
+    doc->stats.words += counts.words;
+    doc->stats.chars += counts.chars;
+    doc->stats.bytes += len;
+}
+
+static int push_sentence(Document *doc, const char *text, size_t len) {
+    if (!reserve_sentences(doc, doc->count + 1)) return 0;
+    set_sentence(doc, &doc->sentences[doc->count], text, len, NULL);
+    doc->count++;
+    return 1;
+}
+
+// Same boundaries as split_into_sentences, but as spans over one buffer
+static int load_document(Document *doc) {
+    char path[1024];
+    build_filepath(path, doc->filename);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return 0;
+    }
+    char *base = malloc((size_t)st.st_size + 1);
+    if (!base) {
+        close(fd);
+        return 0;
+    }
+    size_t got = 0;
+    while (got < (size_t)st.st_size) {
+        ssize_t n = read(fd, base + got, (size_t)st.st_size - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    close(fd);
+    base[got] = '\0';
+
+    clear_sentences(doc);
+    doc->base = base;
+
+    const char *p = base;
+    const char *start = base;
+    while (*p) {
+        if (*p == '.' || *p == '!' || *p == '?') {
+            if (!push_sentence(doc, start, (size_t)(p - start + 1))) {
+                clear_sentences(doc);
+                return 0;
+            }
+            p++;
+            while (*p && isspace((unsigned char)*p)) {
+                p++;
+            }
+            start = p;
+            continue;
+        }
+        p++;
+    }
+    if (*start && !push_sentence(doc, start, (size_t)(p - start))) {
+        clear_sentences(doc);
+        return 0;
+    }
+
+    doc->dev = st.st_dev;
+    doc->ino = st.st_ino;
+    doc->size = st.st_size;
+    doc->mtime = st.st_mtim;
+    doc->loaded = true;
+    return 1;
+}
+
+static bool identity_matches(const Document *doc, const struct stat *st) {
+    return doc->dev == st->st_dev && doc->ino == st->st_ino && doc->size == st->st_size &&
+           doc->mtime.tv_sec == st->st_mtim.tv_sec && doc->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void free_document(Document *doc) {
+    clear_sentences(doc);
+    pthread_mutex_destroy(&doc->mutex);
+    free(doc);
+}
+
+// Call with g_docs_mutex held
+static void evict_idle(void) {
+    while (g_idle_count > DOC_IDLE_MAX) {
+        Document **oldest = NULL;
+        for (int i = 0; i < DOC_BUCKETS; i++) {
+            for (Document **link = &g_docs[i]; *link; link = &(*link)->next) {
+                if ((*link)->refcount == 0 && (!oldest || (*link)->last_used < (*oldest)->last_used)) {
+                    oldest = link;
+                }
+            }
+        }
+        if (!oldest) break;
+        Document *dead = *oldest;
+        *oldest = dead->next;
+        free_document(dead);
+        g_idle_count--;
+    }
+}
+
+Document *document_open(const char *filename) {
+    if (!filename || !*filename) return NULL;
+
+    unsigned int index = document_hash(filename);
+    pthread_mutex_lock(&g_docs_mutex);
+    Document *doc = g_docs[index];
+    while (doc && strcmp(doc->filename, filename) != 0) {
+        doc = doc->next;
+    }
+    if (doc) {
+        if (doc->refcount++ == 0) {
+            g_idle_count--;
+        }
+    } else {
+        doc = calloc(1, sizeof(Document));
+        if (doc) {
+            strncpy(doc->filename, filename, sizeof(doc->filename) - 1);
+            pthread_mutex_init(&doc->mutex, NULL);
+            doc->refcount = 1;
+            doc->next = g_docs[index];
+            g_docs[index] = doc;
+        }
+    }
+    if (doc) {
+        doc->last_used = ++g_use_clock;
+    }
+    pthread_mutex_unlock(&g_docs_mutex);
+    return doc;
+}
+
+void document_release(Document *doc) {
+    if (!doc) return;
+    pthread_mutex_lock(&g_docs_mutex);
+    if (--doc->refcount == 0) {
+        g_idle_count++;
+        evict_idle();
+    }
+    pthread_mutex_unlock(&g_docs_mutex);
+}
+
+int document_lock(Document *doc) {
+    pthread_mutex_lock(&doc->mutex);
+
+    char path[1024];
+    build_filepath(path, doc->filename);
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        clear_sentences(doc);
+        pthread_mutex_unlock(&doc->mutex);
+        return 0;
+    }
+    if ((!doc->loaded || !identity_matches(doc, &st)) && !load_document(doc)) {
+        pthread_mutex_unlock(&doc->mutex);
+        return 0;
+    }
+    return 1;
+}
+
+void document_unlock(Document *doc) {
+    pthread_mutex_unlock(&doc->mutex);
+}
+
+void document_stats(const Document *doc, FileStats *out) {
+    *out = doc->stats;
+    if (doc->count > 1) {
+        out->bytes += (size_t)(doc->count - 1);
+    }
+}
+
+const DocSentence *document_sentence(const Document *doc, int index) {
+    if (index < 0 || index >= doc->count) return NULL;
+    return &doc->sentences[index];
+}
+
+bool document_sentence_equals(const Document *doc, int index, const char *text) {
+    const DocSentence *s = document_sentence(doc, index);
+    return s && strlen(text) == s->len && memcmp(s->text, text, s->len) == 0;
+}
+
+int document_find_sentence(const Document *doc, const char *target, int hint_index) {
+    if (!target || *target == '\0') {
+        return -1;
+    }
+
+    int count = doc->count;
+    if (hint_index >= 0 && hint_index < count && document_sentence_equals(doc, hint_index, target)) {
+        return hint_index;
+    }
+
+    if (hint_index < 0 || hint_index >= count) {
+        for (int i = 0; i < count; i++) {
+            if (document_sentence_equals(doc, i, target)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    for (int offset = 1; offset < count; offset++) {
+        if (document_sentence_equals(doc, hint_index + offset, target)) {
+            return hint_index + offset;
+        }
+        if (document_sentence_equals(doc, hint_index - offset, target)) {
+            return hint_index - offset;
+        }
+    }
+    return -1;
+}
+
+static int writev_all(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+
+        size_t left = (size_t)n;
+        while (count > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+    return 0;
+}
+
+static int write_sentences(const Document *doc, int fd) {
+    static const char space = ' ';
+    struct iovec iov[DOC_WRITEV_BATCH * 2];
+    int i = 0;
+    while (i < doc->count) {
+        int n = 0;
+        for (; i < doc->count && n + 2 <= DOC_WRITEV_BATCH * 2; i++) {
+            if (i > 0) {
+                iov[n].iov_base = (void *)&space;
+                iov[n].iov_len = 1;
+                n++;
+            }
+            iov[n].iov_base = (void *)doc->sentences[i].text;
+            iov[n].iov_len = doc->sentences[i].len;
+            n++;
+        }
+        if (writev_all(fd, iov, n) != 0) return -1;
+    }
+    return 0;
+}
+
+static int save_document(Document *doc) {
+    char path[1024];
+    char tmp_path[1024];
+    build_filepath(path, doc->filename);
+    // a cut-off temp name could be renamed over some other file
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s%s.tmp", DATA_DIR, doc->filename) >= (int)sizeof(tmp_path)) {
+        return -1;
+    }
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    if (write_sentences(doc, fd) != 0 || durability_commit(fd, tmp_path, path) != 0) {
+        close(fd);
+        remove(tmp_path);
+        return -1;
+    }
+
+    fileview_invalidate(doc->filename);
+
+    // Still under the document lock, so this is the file now at path
+    struct stat st;
+    int rc = fstat(fd, &st);
+    close(fd);
+    if (rc != 0) return -1;
+    doc->dev = st.st_dev;
+    doc->ino = st.st_ino;
+    doc->size = st.st_size;
+    doc->mtime = st.st_mtim;
+    return 0;
+}
+
+int document_commit(Document *doc, int keep_prefix, int resume, char **sentences, int count) {
+    int new_count = doc->count - (resume - keep_prefix) + count;
+    if (keep_prefix < 0 || resume < keep_prefix || resume > doc->count ||
+        !reserve_sentences(doc, new_count)) {
+        for (int i = 0; i < count; i++) {
+            free(sentences[i]);
+        }
+        return -1;
+    }
+
+    // History is best effort: a commit is not refused because it failed
+    off_t rollback = -1;
+    if (versions_record(doc, keep_prefix, resume, sentences, count, &rollback) != 0) {
+        rollback = -1;
+    }
+
+    for (int i = keep_prefix; i < resume; i++) {
+        DocSentence *s = &doc->sentences[i];
+        doc->stats.words -= s->words;
+        doc->stats.chars -= s->chars;
+        doc->stats.bytes -= s->len;
+        free(s->owned);
+    }
+    memmove(&doc->sentences[keep_prefix + count], &doc->sentences[resume],
+            sizeof(DocSentence) * (size_t)(doc->count - resume));
+    for (int i = 0; i < count; i++) {
+        set_sentence(doc, &doc->sentences[keep_prefix + i], sentences[i], strlen(sentences[i]), sentences[i]);
+    }
+    doc->count = new_count;
+
+    if (save_document(doc) != 0) {
+        versions_rollback(doc->filename, rollback);
+        doc->loaded = false;
+        return -1;
+    }
+    return 0;
+}
+
+int document_replace(Document *doc, const char *content) {
+    if (save_file_atomic(doc->filename, content) != 0 || !load_document(doc)) {
+        doc->loaded = false;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include "ss_durability.h"
+
+#include <fcntl.h>
+
+// One writer's temp file, on its stack until the flusher marks it done
+typedef struct PendingSync {
+    int fd;
+    const char *tmp_path;
+    const char *path;
+    int rc;
+    bool done;
+    struct PendingSync *next;
+} PendingSync;
+
+static DurabilityMode g_mode = DURABILITY_NONE;
+static int g_window_ms = DURABILITY_DEFAULT_WINDOW_MS;
+static bool g_flusher_running = false;
+
+static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_done = PTHREAD_COND_INITIALIZER;
+static PendingSync *g_queue = NULL;
+static PendingSync *g_queue_tail = NULL;
+static int g_queued = 0;
+static bool g_failed = false;               // an fsync has failed since startup
+
+static int fsync_data_dir(void) {
+    int fd = open(DATA_DIR, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return -1;
+    int rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+static void *flusher_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_mutex);
+    while (1) {
+        while (!g_queue) {
+            pthread_cond_wait(&g_work, &g_mutex);
+        }
+
+        // Let the batch fill for one window, unless it fills up first
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)g_window_ms * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (g_queued < DURABILITY_MAX_BATCH &&
+               pthread_cond_timedwait(&g_work, &g_mutex, &deadline) != ETIMEDOUT) {
+        }
+
+        PendingSync *batch = g_queue;
+        bool failed = g_failed;
+        g_queue = NULL;
+        g_queue_tail = NULL;
+        g_queued = 0;
+        pthread_mutex_unlock(&g_mutex);
+
+        // Data first, then the renames, then one directory sync for all of
+        // them: no name is switched to data that is not on disk yet
+        for (PendingSync *e = batch; e; e = e->next) {
+            e->rc = -1;
+            if (failed || fsync(e->fd) != 0) {
+                failed = true;
+                continue;
+            }
+            if (rename(e->tmp_path, e->path) == 0) {
+                e->rc = 0;
+            }
+        }
+        if (fsync_data_dir() != 0) {
+            failed = true;
+        }
+
+        pthread_mutex_lock(&g_mutex);
+        if (failed) {
+            g_failed = true;
+        }
+        for (PendingSync *e = batch; e; e = e->next) {
+            if (failed) {
+                e->rc = -1;
+            }
+            e->done = true;
+        }
+        pthread_cond_broadcast(&g_done);
+    }
+    return NULL;
+}
+
+void durability_init(DurabilityMode mode, int window_ms) {
+    if (window_ms < 0) {
+        window_ms = 0;
+    }
+    if (window_ms > DURABILITY_MAX_WINDOW_MS) {
+        window_ms = DURABILITY_MAX_WINDOW_MS;
+    }
+
+    pthread_mutex_lock(&g_mutex);
+    g_mode = mode;
+    g_window_ms = window_ms;
+    if (mode == DURABILITY_GROUP && !g_flusher_running) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, flusher_thread, NULL) == 0) {
+            pthread_detach(tid);
+            g_flusher_running = true;
+        } else {
+            perror("[SS] durability flusher");
+            g_mode = DURABILITY_SYNC;
+        }
+    }
+    pthread_mutex_unlock(&g_mutex);
+}
+
+DurabilityMode durability_mode(void) {
+    return g_mode;
+}
+
+const char *durability_mode_name(DurabilityMode mode) {
+    switch (mode) {
+        case DURABILITY_SYNC:
+            return "sync";
+        case DURABILITY_GROUP:
+            return "group";
+        default:
+            return "none";
+    }
+}
+
+bool durability_parse_mode(const char *name, DurabilityMode *out) {
+    static const DurabilityMode modes[] = {DURABILITY_NONE, DURABILITY_SYNC, DURABILITY_GROUP};
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        if (strcmp(name, durability_mode_name(modes[i])) == 0) {
+            *out = modes[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+static int commit_sync(int fd, const char *tmp_path, const char *path) {
+    pthread_mutex_lock(&g_mutex);
+    bool failed = g_failed;
+    pthread_mutex_unlock(&g_mutex);
+    if (failed) return -1;
+
+    if (fsync(fd) != 0) {
+        pthread_mutex_lock(&g_mutex);
+        g_failed = true;
+        pthread_mutex_unlock(&g_mutex);
+        return -1;
+    }
+    if (rename(tmp_path, path) != 0) return -1;
+    if (fsync_data_dir() != 0) {
+        pthread_mutex_lock(&g_mutex);
+        g_failed = true;
+        pthread_mutex_unlock(&g_mutex);
+        return -1;
+    }
+    return 0;
+}
+
+int durability_commit(int fd, const char *tmp_path, const char *path) {
+    if (g_mode == DURABILITY_NONE) {
+        return rename(tmp_path, path);
+    }
+    if (g_mode == DURABILITY_SYNC) {
+        return commit_sync(fd, tmp_path, path);
+    }
+
+    PendingSync entry = {fd, tmp_path, path, -1, false, NULL};
+    pthread_mutex_lock(&g_mutex);
+    if (g_failed) {
+        pthread_mutex_unlock(&g_mutex);
+        return -1;
+    }
+    if (g_queue_tail) {
+        g_queue_tail->next = &entry;
+    } else {
+        g_queue = &entry;
+    }
+    g_queue_tail = &entry;
+    g_queued++;
+    if (g_queued == 1 || g_queued >= DURABILITY_MAX_BATCH) {
+        pthread_cond_signal(&g_work);
+    }
+    while (!entry.done) {
+        pthread_cond_wait(&g_done, &g_mutex);
+    }
+    pthread_mutex_unlock(&g_mutex);
+    return entry.rc;
+}
@@ -1,6 +1,9 @@
 #include "ss_file_ops.h"
+#include "ss_durability.h"
+#include "ss_fileview.h"
 #include <sys/stat.h>
 #include <dirent.h>
+#include <fcntl.h>
 
 // Global path variables (defined here)
 char BASE_DIR[1024] = "./storage_server";
@@ -24,10 +27,6 @@ void build_filepath(char *dest, const char *filename) {
     snprintf(dest, 512, "%s%s", DATA_DIR, filename);
 }
 
-void build_snapshot_path(char *dest, const char *filename) {
-    snprintf(dest, 1024, "%s%s.bak", SNAP_DIR, filename);
-}
-
 int file_exists(const char *path) {
     return access(path, F_OK) == 0;
 }
@@ -59,15 +58,6 @@ void save_file(const char *filename, const char *content) {
     fclose(f);
 }
 
-void save_snapshot(const char *filename, const char *content) {
-    char path[1024];
-    build_snapshot_path(path, filename);
-
-    FILE *f = fopen(path, "w");
-    fprintf(f, "%s", content);
-    fclose(f);
-}
-
 int save_file_atomic(const char *filename, const char *content) {
     if (!filename || !content) return -1;
 
@@ -76,30 +66,30 @@ int save_file_atomic(const char *filename, const char *content) {
     build_filepath(path, filename);
     snprintf(tmp_path, sizeof(tmp_path), "%s%s.tmp", DATA_DIR, filename);
 
-    FILE *tmp = fopen(tmp_path, "w");
-    if (!tmp) return -1;
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
 
     size_t len = strlen(content);
-    size_t written = fwrite(content, 1, len, tmp);
-    fflush(tmp);
-    if (fclose(tmp) != 0 || written != len) {
-        remove(tmp_path);
-        return -1;
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = write(fd, content + written, len - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        written += (size_t)n;
     }
-
-    if (remove(path) != 0 && errno != ENOENT) {
+    // rename replaces the target atomically, so readers see old or new
+    if (written != len || durability_commit(fd, tmp_path, path) != 0) {
+        close(fd);
         remove(tmp_path);
         return -1;
     }
+    close(fd);
 
-    if (rename(tmp_path, path) != 0) {
-        remove(tmp_path);
-        return -1;
-    }
+    fileview_invalidate(filename);
     return 0;
 }
 
-char *build_files_manifest(void) {
+char *build_files_manifest(const ShardMap *shards, int shard) {
     DIR *dir = opendir(DATA_DIR);
     if (!dir) {
         return strdup("[]");
@@ -127,6 +117,9 @@ char *build_files_manifest(void) {
         if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
             continue;
         }
+        if (shards && shard_map_owner(shards, entry->d_name) != shard) {
+            continue;
+        }
 
         size_t needed = strlen(buffer) + strlen(entry->d_name) + 5;
         if (needed >= capacity) {
@@ -0,0 +1,169 @@
+#include "ss_fileview.h"
+#include "ss_file_ops.h"
+#include "ss_readcache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+static FileView *g_views[VIEW_BUCKETS];
+static pthread_mutex_t g_views_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int g_idle_count = 0;
+static unsigned long g_use_clock = 0;
+static unsigned long g_version_clock = 0;
+
+static unsigned int view_hash(const char *filename) {
+    unsigned int hash = 5381;
+    for (const char *p = filename; *p; p++) {
+        hash = hash * 33 + (unsigned char)*p;
+    }
+    return hash % VIEW_BUCKETS;
+}
+
+static bool view_matches(const FileView *view, const struct stat *st) {
+    return view->dev == st->st_dev && view->ino == st->st_ino && (off_t)view->size == st->st_size &&
+           view->mtime.tv_sec == st->st_mtim.tv_sec && view->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void free_view(FileView *view) {
+    if (view->size > 0) {
+        munmap((void *)view->data, view->size);
+    }
+    free(view);
+}
+
+static FileView *map_view(const char *filename) {
+    char path[1024];
+    build_filepath(path, filename);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    FileView *view = fstat(fd, &st) == 0 ? calloc(1, sizeof(FileView)) : NULL;
+    if (!view) {
+        close(fd);
+        return NULL;
+    }
+    strncpy(view->filename, filename, sizeof(view->filename) - 1);
+    view->size = (size_t)st.st_size;
+    view->dev = st.st_dev;
+    view->ino = st.st_ino;
+    view->mtime = st.st_mtim;
+    view->data = "";
+    if (view->size > 0) {
+        void *data = mmap(NULL, view->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            free(view);
+            return NULL;
+        }
+        madvise(data, view->size, MADV_SEQUENTIAL);
+        view->data = data;
+    }
+    close(fd);
+    return view;
+}
+
+// Unlink the view from its bucket (g_views_mutex held); it is freed here
+// if nobody holds it, otherwise by the last release
+static void uncache_view(FileView **link) {
+    FileView *view = *link;
+    *link = view->next;
+    view->cached = false;
+    if (view->refcount == 0) {
+        g_idle_count--;
+        free_view(view);
+    }
+}
+
+// Call with g_views_mutex held
+static void evict_idle(void) {
+    while (g_idle_count > VIEW_IDLE_MAX) {
+        FileView **oldest = NULL;
+        for (int i = 0; i < VIEW_BUCKETS; i++) {
+            for (FileView **link = &g_views[i]; *link; link = &(*link)->next) {
+                if ((*link)->refcount == 0 && (!oldest || (*link)->last_used < (*oldest)->last_used)) {
+                    oldest = link;
+                }
+            }
+        }
+        if (!oldest) break;
+        uncache_view(oldest);
+    }
+}
+
+FileView *fileview_open(const char *filename) {
+    if (!filename || !*filename) return NULL;
+
+    char path[1024];
+    build_filepath(path, filename);
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fileview_invalidate(filename);
+        return NULL;
+    }
+
+    unsigned int index = view_hash(filename);
+    pthread_mutex_lock(&g_views_mutex);
+    FileView **link = &g_views[index];
+    while (*link && strcmp((*link)->filename, filename) != 0) {
+        link = &(*link)->next;
+    }
+    if (*link && view_matches(*link, &st)) {
+        FileView *view = *link;
+        if (view->refcount++ == 0) {
+            g_idle_count--;
+        }
+        view->last_used = ++g_use_clock;
+        pthread_mutex_unlock(&g_views_mutex);
+        return view;
+    }
+    pthread_mutex_unlock(&g_views_mutex);
+
+    // Map outside the lock; a racing reader may map the same file too, and
+    // whichever installs last becomes the cached view
+    FileView *view = map_view(filename);
+    if (!view) return NULL;
+
+    pthread_mutex_lock(&g_views_mutex);
+    link = &g_views[index];
+    while (*link && strcmp((*link)->filename, filename) != 0) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        uncache_view(link);
+    }
+    view->refcount = 1;
+    view->version = ++g_version_clock;
+    view->cached = true;
+    view->last_used = ++g_use_clock;
+    view->next = g_views[index];
+    g_views[index] = view;
+    pthread_mutex_unlock(&g_views_mutex);
+    return view;
+}
+
+void fileview_release(FileView *view) {
+    if (!view) return;
+    pthread_mutex_lock(&g_views_mutex);
+    if (--view->refcount == 0) {
+        if (view->cached) {
+            g_idle_count++;
+            evict_idle();
+        } else {
+            free_view(view);
+        }
+    }
+    pthread_mutex_unlock(&g_views_mutex);
+}
+
+void fileview_invalidate(const char *filename) {
+    readcache_invalidate(filename);
+    pthread_mutex_lock(&g_views_mutex);
+    for (FileView **link = &g_views[view_hash(filename)]; *link; link = &(*link)->next) {
+        if (strcmp((*link)->filename, filename) == 0) {
+            uncache_view(link);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_views_mutex);
+}
@@ -0,0 +1,137 @@
+#include "ss_framer.h"
+#include "proto_wire.h"
+
+bool framer_init(Framer *framer, size_t max_request) {
+    memset(framer, 0, sizeof(*framer));
+    framer->buf = malloc(FRAMER_INITIAL_BYTES);
+    if (!framer->buf) return false;
+    framer->cap = FRAMER_INITIAL_BYTES;
+    framer->max_request = max_request;
+    return true;
+}
+
+void framer_free(Framer *framer) {
+    free(framer->buf);
+    framer->buf = NULL;
+    framer->cap = 0;
+}
+
+char *framer_space(Framer *framer, size_t *avail) {
+    // One byte is always kept back for the NUL that ends a request in place
+    if (framer->cap - framer->tail <= FRAMER_MIN_READ && framer->head > 0) {
+        size_t pending = framer->tail - framer->head;
+        memmove(framer->buf, framer->buf + framer->head, pending);
+        framer->scanned -= framer->head;
+        framer->head = 0;
+        framer->tail = pending;
+    }
+    if (framer->cap - framer->tail <= FRAMER_MIN_READ && framer->cap <= framer->max_request) {
+        size_t new_cap = framer->cap * 2;
+        if (new_cap > framer->max_request + 1) {
+            new_cap = framer->max_request + 1;
+        }
+        char *grown = realloc(framer->buf, new_cap);
+        if (grown) {
+            framer->buf = grown;
+            framer->cap = new_cap;
+        }
+    }
+    if (framer->cap - framer->tail <= 1) {
+        return NULL;
+    }
+    *avail = framer->cap - framer->tail - 1;
+    return framer->buf + framer->tail;
+}
+
+void framer_commit(Framer *framer, size_t bytes) {
+    framer->tail += bytes;
+}
+
+FrameResult framer_next(Framer *framer, char **line, size_t *len) {
+    while (1) {
+        char *start = framer->buf + framer->head;
+        char *scan = framer->buf + framer->scanned;
+        char *nl = memchr(scan, '\n', framer->tail - framer->scanned);
+
+        if (!nl) {
+            framer->scanned = framer->tail;
+            if (framer->discarding) {
+                framer->head = framer->tail = framer->scanned = 0;
+                return FRAME_NONE;
+            }
+            if (framer->tail - framer->head < framer->max_request) {
+                if (framer->head == framer->tail) {
+                    framer->head = framer->tail = framer->scanned = 0;
+                }
+                return FRAME_NONE;
+            }
+            framer->head = framer->tail = framer->scanned = 0;
+            framer->discarding = true;
+            return FRAME_OVERSIZE;
+        }
+
+        framer->head = framer->scanned = (size_t)(nl - framer->buf) + 1;
+        if (framer->discarding) {
+            framer->discarding = false;
+            continue;
+        }
+
+        size_t length = (size_t)(nl - start);
+        if (length > 0 && start[length - 1] == '\r') {
+            length--;
+        }
+        start[length] = '\0';
+        *line = start;
+        *len = length;
+        return FRAME_LINE;
+    }
+}
+
+FrameResult framer_next_frame(Framer *framer, char **frame, size_t *len) {
+    if (framer->skip > 0) {
+        size_t pending = framer->tail - framer->head;
+        size_t dropped = pending < framer->skip ? pending : framer->skip;
+        framer->head += dropped;
+        framer->skip -= dropped;
+        if (framer->skip > 0) {
+            framer->head = framer->tail = framer->scanned = 0;
+            return FRAME_NONE;
+        }
+    }
+
+    size_t pending = framer->tail - framer->head;
+    if (pending < WIRE_PREFIX_BYTES) {
+        if (pending == 0) {
+            framer->head = framer->tail = framer->scanned = 0;
+        }
+        return FRAME_NONE;
+    }
+    size_t length = wire_frame_length(framer->buf + framer->head);
+    if (length > framer->max_request - WIRE_PREFIX_BYTES) {
+        framer->head += WIRE_PREFIX_BYTES;
+        framer->scanned = framer->head;
+        framer->skip = length;
+        return FRAME_OVERSIZE;
+    }
+    if (pending - WIRE_PREFIX_BYTES < length) {
+        return FRAME_NONE;
+    }
+
+    *frame = framer->buf + framer->head + WIRE_PREFIX_BYTES;
+    *len = length;
+    framer->head += WIRE_PREFIX_BYTES + length;
+    framer->scanned = framer->head;
+    return FRAME_LINE;
+}
+
+const char *framer_pending(const Framer *framer, size_t *len) {
+    *len = framer->tail - framer->head;
+    return framer->buf + framer->head;
+}
+
+void framer_consume(Framer *framer, size_t bytes) {
+    framer->head += bytes;
+    if (framer->scanned < framer->head) {
+        framer->scanned = framer->head;
+    }
+}
@@ -1,12 +1,56 @@
 #include "ss_handlers.h"
+#include "ss_control.h"
 #include "ss_file_ops.h"
+#include "ss_fileview.h"
+#include "ss_readcache.h"
 #include "ss_locking.h"
+#include "ss_replication.h"
 #include "ss_session.h"
+#include "ss_stats.h"
 #include "ss_utils.h"
+#include "ss_versions.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
 
 extern __thread ClientLogContext g_log_ctx;
+__thread bool g_binary_replies;
+
+static int write_all(int client, const char *data, size_t len);
+
+void send_frame(int client, WireWriter *w, const char *log_msg) {
+    size_t len = 0;
+    const char *frame = wire_writer_finish(w, 0, &len);
+    if (frame) {
+        write_all(client, frame, len);
+    }
+    log_event("RESPONSE", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, g_log_ctx.cmd, log_msg);
+}
+
+// Status frame with one str16: the reason of an error or the msg of an OK
+static void send_status_frame(int client, WireStatus status, const char *text, const char *log_msg) {
+    char buf[MAX_MSG];
+    WireWriter w;
+    wire_writer_init(&w, buf, sizeof(buf));
+    wire_put_u8(&w, status);
+    wire_put_str16(&w, text, strlen(text));
+    send_frame(client, &w, log_msg);
+}
 
 void send_json(int client, const char* json) {
+    if (g_binary_replies) {
+        // replies without a binary layout of their own travel as JSON text
+        size_t len = strlen(json);
+        char buf[MAX_MSG + 16];
+        WireWriter w;
+        wire_writer_init(&w, buf, sizeof(buf));
+        wire_put_u8(&w, WIRE_JSON);
+        wire_put_str32(&w, json, len);
+        send_frame(client, &w, json);
+        return;
+    }
     char msg[MAX_MSG];
     int n = snprintf(msg, sizeof(msg), "%s\n", json);
     if (n > 0) {
@@ -18,11 +62,20 @@ void send_json(int client, const char* json) {
 
 void send_error(int client, const char *reason) {
     char buf[MAX_MSG];
+    if (g_binary_replies) {
+        snprintf(buf, sizeof(buf), "ERR %s", reason);
+        send_status_frame(client, WIRE_ERR, reason, buf);
+        return;
+    }
     snprintf(buf, sizeof(buf), "{ \"status\":\"ERR\", \"reason\":\"%s\" }", reason);
     send_json(client, buf);
 }
 
 void send_ok_message(int client, const char *msg) {
+    if (g_binary_replies) {
+        send_status_frame(client, WIRE_OK, msg ? msg : "", msg && *msg ? msg : "OK");
+        return;
+    }
     if (msg && *msg) {
         char buf[MAX_MSG];
         snprintf(buf, sizeof(buf), "{ \"status\":\"OK\", \"msg\":\"%s\" }", msg);
@@ -32,24 +85,6 @@ void send_ok_message(int client, const char *msg) {
     }
 }
 
-void send_plain_line(int client, const char *line, size_t len) {
-    if (!line) return;
-    if (len == (size_t)-1) {
-        len = strlen(line);
-    }
-    if (len > 0) {
-        write(client, line, len);
-        char preview[128];
-        size_t copy_len = len < (sizeof(preview) - 1) ? len : (sizeof(preview) - 1);
-        memcpy(preview, line, copy_len);
-        preview[copy_len] = '\0';
-        log_event("RESPONSE", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, g_log_ctx.cmd, preview);
-    } else {
-        log_event("RESPONSE", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, g_log_ctx.cmd, "");
-    }
-    write(client, "", 1);
-}
-
 void handle_create_file(int client, const char *filename, const char *initial_content) {
     if (!filename || !*filename) {
         send_error(client, "BAD_REQUEST");
@@ -69,143 +104,372 @@ void handle_create_file(int client, const char *filename, const char *initial_co
         send_error(client, "UNKNOWN");
         return;
     }
+    // a leftover history belongs to a deleted file of the same name
+    versions_forget(filename);
+
+    FileStats stats = {0, 0, 0};
+    stats_add_text(&stats, content);
+    stats_store(filename, &stats);
+    control_push_stats(filename, &stats);
+    replication_wait(replication_publish_full(filename, content));
 
     send_ok_message(client, "CREATED");
 }
 
+static int write_all(int client, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(client, data, len);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w <= 0) {
+            return -1;
+        }
+        data += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+static const char g_read_head[] = "{ \"status\":\"OK\", \"content\":\"";
+static const char g_read_tail[] = "\" }\n";
+
+// Escape text into JSON string content straight onto the socket, one
+// READ_ESCAPE_BYTES buffer at a time
+static int send_escaped(int client, const char *text, size_t len) {
+    char buf[READ_ESCAPE_BYTES];
+    size_t used = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (used + 6 > sizeof(buf)) {
+            if (write_all(client, buf, used) != 0) return -1;
+            used = 0;
+        }
+        used += json_escape_byte(buf + used, (unsigned char)text[i]);
+    }
+    return write_all(client, buf, used);
+}
+
+// The whole READ reply for view in one buffer, for the read cache
+static char *build_read_reply(const FileView *view, size_t *out_len) {
+    char scratch[8];
+    size_t escaped = 0;
+    for (size_t i = 0; i < view->size; i++) {
+        escaped += json_escape_byte(scratch, (unsigned char)view->data[i]);
+    }
+    size_t len = sizeof(g_read_head) - 1 + escaped + sizeof(g_read_tail) - 1;
+    char *reply = malloc(len);
+    if (!reply) return NULL;
+
+    char *w = reply;
+    memcpy(w, g_read_head, sizeof(g_read_head) - 1);
+    w += sizeof(g_read_head) - 1;
+    for (size_t i = 0; i < view->size; i++) {
+        w += json_escape_byte(w, (unsigned char)view->data[i]);
+    }
+    memcpy(w, g_read_tail, sizeof(g_read_tail) - 1);
+    *out_len = len;
+    return reply;
+}
+
+// Binary READ: the file goes out raw from the mapping behind a short header
+static void send_read_frame(int client, const FileView *view) {
+    char head[16];
+    WireWriter w;
+    wire_writer_init(&w, head, sizeof(head));
+    wire_put_u8(&w, WIRE_OK);
+    wire_put_u32(&w, (uint32_t)view->size);
+    size_t len = 0;
+    const char *frame = wire_writer_finish(&w, view->size, &len);
+    if (!frame) {
+        send_error(client, "FILE_TOO_LARGE");
+        return;
+    }
+    // header and file in one call; a short write is finished piecewise
+    struct iovec iov[2] = {{(void *)frame, len}, {(void *)view->data, view->size}};
+    ssize_t sent = writev(client, iov, 2);
+    if (sent < 0 && errno == EINTR) {
+        sent = 0;
+    }
+    if (sent >= 0 && (size_t)sent < len) {
+        if (write_all(client, frame + sent, len - (size_t)sent) == 0) {
+            write_all(client, view->data, view->size);
+        }
+    } else if (sent >= 0 && (size_t)sent < len + view->size) {
+        write_all(client, view->data + (sent - (ssize_t)len), view->size - ((size_t)sent - len));
+    }
+    log_event("RESPONSE", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, g_log_ctx.cmd, "READ content");
+}
+
 void handle_read(int client, const char *filename) {
-    char *content = load_file(filename);
-    if (!content) {
+    FileView *view = fileview_open(filename);
+    if (!view) {
         send_error(client, "FILE_NOT_FOUND");
         return;
     }
-
-    char *escaped = json_escape(content);
-    if (!escaped) {
-        free(content);
-        send_error(client, "UNKNOWN");
+    if (g_binary_replies) {
+        send_read_frame(client, view);
+        fileview_release(view);
         return;
     }
 
-    char response[MAX_MSG];
-    snprintf(response, sizeof(response),
-             "{ \"status\":\"OK\", \"content\":\"%s\" }",
-             escaped);
-
-    send_json(client, response);
-    free(escaped);
-    free(content);
+    // A hot file's reply is cached whole; anything else is escaped from the
+    // shared mapping as it is sent, so a READ never copies a large file
+    ReadCachePayload *reply = readcache_get(view);
+    if (!reply && readcache_accepts(view->size)) {
+        size_t len = 0;
+        char *data = build_read_reply(view, &len);
+        reply = data ? readcache_put(view, data, len) : NULL;
+    }
+    if (reply) {
+        write_all(client, reply->data, reply->len);
+        readcache_release(reply);
+    } else if (write_all(client, g_read_head, sizeof(g_read_head) - 1) == 0 &&
+               send_escaped(client, view->data, view->size) == 0) {
+        write_all(client, g_read_tail, sizeof(g_read_tail) - 1);
+    }
+    fileview_release(view);
+    log_event("RESPONSE", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, g_log_ctx.cmd, "READ content");
 }
 
-void handle_stream(int client, const char *filename) {
-    char *content = load_file(filename);
-    if (!content) {
+/*
+ * READ with "mode":"chunked". After a one-line JSON header the raw file bytes
+ * follow as chunks of a 4-byte big-endian length and at most READ_CHUNK_BYTES
+ * of data, ended by a zero-length chunk. Data goes from the file straight to
+ * the socket with sendfile; saves replace the file by rename, so the open fd
+ * stays a consistent snapshot for the whole transfer.
+ */
+void handle_read_chunked(int client, const char *filename) {
+    char path[1024];
+    build_filepath(path, filename);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
         send_error(client, "FILE_NOT_FOUND");
         return;
     }
 
-    const char *p = content;
-    while (*p) {
-        while (*p && isspace((unsigned char)*p)) {
-            p++;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        send_error(client, "UNKNOWN");
+        return;
+    }
+
+    char header[128];
+    int header_len = snprintf(header, sizeof(header),
+                              "{\"status\":\"OK\",\"mode\":\"chunked\",\"bytes\":%lld}\n",
+                              (long long)st.st_size);
+    if (write_all(client, header, (size_t)header_len) != 0) {
+        close(fd);
+        return;
+    }
+
+    off_t offset = 0;
+    off_t remaining = st.st_size;
+    while (remaining > 0) {
+        size_t chunk = remaining > READ_CHUNK_BYTES ? READ_CHUNK_BYTES : (size_t)remaining;
+        uint32_t prefix = htonl((uint32_t)chunk);
+        if (send(client, &prefix, sizeof(prefix), MSG_MORE | MSG_NOSIGNAL) != (ssize_t)sizeof(prefix)) {
+            break;
         }
-        if (!*p) break;
-        const char *start = p;
-        while (*p && !isspace((unsigned char)*p)) {
-            p++;
+
+        size_t sent = 0;
+        while (sent < chunk) {
+            ssize_t n = sendfile(client, fd, &offset, chunk - sent);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            sent += (size_t)n;
         }
-        size_t len = (size_t)(p - start);
-        if (len > 0) {
-            send_plain_line(client, start, len);
-            usleep(100000);
+        if (sent < chunk) {
+            break;
         }
+        remaining -= (off_t)chunk;
     }
+    close(fd);
 
-    send_plain_line(client, "STOP", 4);
-    free(content);
+    // A short transfer leaves out the terminator so the client sees an error
+    if (remaining == 0) {
+        uint32_t end = 0;
+        write_all(client, (const char *)&end, sizeof(end));
+    }
+
+    char log_msg[64];
+    snprintf(log_msg, sizeof(log_msg), "READ chunked %lld bytes", (long long)(st.st_size - remaining));
+    log_event("RESPONSE", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, g_log_ctx.cmd, log_msg);
 }
 
 void handle_stat(int client, const char *filename) {
-    char *content = load_file(filename);
-    if (!content) {
+    FileStats stats;
+    if (!stats_for_file(filename, &stats)) {
         send_error(client, "FILE_NOT_FOUND");
         return;
     }
 
-    int word_count = 0;
-    int char_count = 0;
-    const char *p = content;
-    int in_word = 0;
+    char response[256];
+    snprintf(response, sizeof(response),
+             "{\"status\":\"OK\",\"words\":%d,\"chars\":%d,\"bytes\":%zu}",
+             stats.words, stats.chars, stats.bytes);
+    if (g_binary_replies) {
+        WireWriter w;
+        char frame[32];
+        wire_writer_init(&w, frame, sizeof(frame));
+        wire_put_u8(&w, WIRE_OK);
+        wire_put_u32(&w, (uint32_t)stats.words);
+        wire_put_u32(&w, (uint32_t)stats.chars);
+        wire_put_u64(&w, stats.bytes);
+        send_frame(client, &w, response);
+        return;
+    }
+    send_json(client, response);
+}
+
+/*
+ * STAT for many files in one round trip. The reply can outgrow MAX_MSG, so it
+ * is built in a memstream and written directly rather than through send_json.
+ * Files that cannot be read are reported per entry instead of failing the batch.
+ */
+void handle_stat_batch(int client, const char *files_array) {
+    char *response = NULL;
+    size_t response_len = 0;
+    FILE *out = open_memstream(&response, &response_len);
+    if (!out) {
+        send_error(client, "NO_MEMORY");
+        return;
+    }
 
-    while (*p) {
-        if (isspace((unsigned char)*p)) {
-            if (in_word) {
-                word_count++;
-                in_word = 0;
-            }
+    fputs("{\"status\":\"OK\",\"stats\":[", out);
+    char filename[MAX_FILENAME];
+    const char *cursor = files_array;
+    int count = 0;
+    while ((cursor = json_array_next_string(cursor, filename, sizeof(filename))) != NULL) {
+        char *escaped = json_escape(filename);
+        if (!escaped) {
+            continue;
+        }
+        FileStats stats;
+        if (count++ > 0) {
+            fputc(',', out);
+        }
+        if (stats_for_file(filename, &stats)) {
+            fprintf(out, "{\"filename\":\"%s\",\"words\":%d,\"chars\":%d,\"bytes\":%zu}",
+                    escaped, stats.words, stats.chars, stats.bytes);
         } else {
-            char_count++;
-            in_word = 1;
+            fprintf(out, "{\"filename\":\"%s\",\"error\":\"FILE_NOT_FOUND\"}", escaped);
         }
-        p++;
-    }
-    if (in_word) {
-        word_count++;
+        free(escaped);
     }
+    fputs("]}\n", out);
+    fclose(out);
 
-    size_t byte_count = strlen(content);
-    free(content);
+    write_all(client, response, response_len);
 
-    char response[256];
+    char log_msg[64];
+    snprintf(log_msg, sizeof(log_msg), "STAT_BATCH %d files", count);
+    log_event("RESPONSE", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, g_log_ctx.cmd, log_msg);
+    free(response);
+}
+
+void handle_lock_stats(int client) {
+    LockStats stats;
+    locking_get_stats(&stats);
+
+    char response[512];
     snprintf(response, sizeof(response),
-             "{\"status\":\"OK\",\"words\":%d,\"chars\":%d,\"bytes\":%zu}",
-             word_count, char_count, byte_count);
+             "{\"status\":\"OK\",\"acquired\":%lu,\"contended\":%lu,\"waited\":%lu,"
+             "\"timed_out\":%lu,\"released\":%lu,\"active\":%lu,\"hold_avg_ms\":%.3f,"
+             "\"hold_max_ms\":%.3f,\"wait_avg_ms\":%.3f}",
+             stats.acquired, stats.contended, stats.waited, stats.timed_out, stats.released,
+             stats.active, stats.released ? stats.hold_total_ms / (double)stats.released : 0.0,
+             stats.hold_max_ms, stats.waited ? stats.wait_total_ms / (double)stats.waited : 0.0);
+    send_json(client, response);
+}
+
+void handle_read_cache_stats(int client, int capacity_mb) {
+    if (capacity_mb >= 0) {
+        readcache_set_capacity((size_t)capacity_mb * 1024 * 1024);
+    }
+
+    ReadCacheStats stats;
+    readcache_get_stats(&stats);
+    unsigned long lookups = stats.hits + stats.misses;
+    char response[512];
+    snprintf(response, sizeof(response),
+             "{\"status\":\"OK\",\"hits\":%lu,\"misses\":%lu,\"hit_ratio\":%.4f,"
+             "\"entries\":%d,\"resident_bytes\":%zu,\"capacity_bytes\":%zu,\"evictions\":%lu,"
+             "\"invalidations\":%lu}",
+             stats.hits, stats.misses, lookups ? (double)stats.hits / (double)lookups : 0.0,
+             stats.entries, stats.resident_bytes, stats.capacity_bytes, stats.evictions,
+             stats.invalidations);
     send_json(client, response);
 }
 
-void handle_undo(int client, const char *filename) {
+void handle_undo(int client, const char *filename, int steps, long version) {
     if (file_has_active_lock(filename)) {
         send_error(client, "LOCKED");
         return;
     }
 
-    char path[1024];
-    build_snapshot_path(path, filename);
-    FILE *f = fopen(path, "r");
-    if (!f) {
-        send_error(client, "NO_SNAPSHOT");
+    Document *doc = document_open(filename);
+    if (!doc || !document_lock(doc)) {
+        document_release(doc);
+        send_error(client, "FILE_NOT_FOUND");
         return;
     }
 
-    if (fseek(f, 0, SEEK_END) != 0) {
-        fclose(f);
-        send_error(client, "UNKNOWN");
+    unsigned long restored = 0;
+    char *content = NULL;
+    const char *error = versions_restore(doc, steps, version, &restored, &content);
+    if (error) {
+        document_unlock(doc);
+        document_release(doc);
+        send_error(client, error);
         return;
     }
-    long size = ftell(f);
-    if (size < 0) {
-        fclose(f);
-        send_error(client, "UNKNOWN");
+
+    FileStats stats;
+    document_stats(doc, &stats);
+    stats_store(filename, &stats);
+    control_push_stats(filename, &stats);
+    // the backup gets the restored text, not the history
+    ReplTicket repl_ticket = replication_publish_full(filename, content);
+    document_unlock(doc);
+    document_release(doc);
+    free(content);
+    replication_wait(repl_ticket);
+
+    char response[128];
+    snprintf(response, sizeof(response), "{\"status\":\"OK\",\"version\":%lu}", restored);
+    if (g_binary_replies) {
+        WireWriter w;
+        char frame[32];
+        wire_writer_init(&w, frame, sizeof(frame));
+        wire_put_u8(&w, WIRE_OK);
+        wire_put_u64(&w, restored);
+        send_frame(client, &w, response);
         return;
     }
-    rewind(f);
+    send_json(client, response);
+}
 
-    char *content = malloc((size_t)size + 1);
-    if (!content) {
-        fclose(f);
-        send_error(client, "UNKNOWN");
+void handle_versions(int client, const char *filename) {
+    char path[1024];
+    build_filepath(path, filename);
+    if (!file_exists(path)) {
+        send_error(client, "FILE_NOT_FOUND");
         return;
     }
-    size_t read = fread(content, 1, (size_t)size, f);
-    fclose(f);
-    content[read] = '\0';
 
-    if (save_file_atomic(filename, content) != 0) {
-        free(content);
+    char *list = versions_list_json(filename);
+    if (!list) {
         send_error(client, "UNKNOWN");
         return;
     }
-
-    free(content);
-    send_ok_message(client, NULL);
+    char response[MAX_MSG];
+    snprintf(response, sizeof(response), "{\"status\":\"OK\",\"versions\":%s}", list);
+    free(list);
+    send_json(client, response);
 }
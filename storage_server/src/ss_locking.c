@@ -1,87 +1,399 @@
 #include "ss_locking.h"
 
-static SentenceLock g_sentence_locks[MAX_LOCKS];
-static pthread_mutex_t g_lock_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Number of locks held on one file, so UNDO can check without a scan
+typedef struct LockedFile {
+    char filename[MAX_FILENAME];
+    int count;
+    struct LockedFile *next;
+} LockedFile;
+
+// One blocked WRITE, on its own stack
+typedef struct LockWaiter {
+    pthread_cond_t cond;
+    int owner_fd;
+    bool granted;
+    struct LockWaiter *next;
+} LockWaiter;
+
+typedef struct LockOwner {
+    int fd;
+    SentenceLock *locks;
+    struct LockOwner *next;
+} LockOwner;
+
+// A file's locks and counts live in the shard chosen by its name. Owners are
+// indexed separately by fd under g_owner_mutex, which may be taken while a
+// shard mutex is held but never the other way round.
+typedef struct {
+    pthread_mutex_t mutex;
+    SentenceLock *locks[LOCK_BUCKETS];
+    LockedFile *files[LOCK_BUCKETS];
+    LockStats stats;
+} LockShard;
+
+static LockShard g_shards[LOCK_SHARDS];
+static LockOwner *g_owners[LOCK_SHARDS][LOCK_BUCKETS];
+static pthread_mutex_t g_owner_mutex[LOCK_SHARDS];
+
+static unsigned int hash_filename(const char *filename) {
+    unsigned int hash = 5381;
+    for (const char *p = filename; *p; p++) {
+        hash = hash * 33 + (unsigned char)*p;
+    }
+    return hash;
+}
+
+static LockShard *shard_for(unsigned int file_hash) {
+    return &g_shards[file_hash % LOCK_SHARDS];
+}
+
+static unsigned int lock_bucket(unsigned int file_hash, int sentence_index) {
+    return ((file_hash / LOCK_SHARDS) ^ ((unsigned int)sentence_index * 2654435761u)) % LOCK_BUCKETS;
+}
+
+static unsigned int file_bucket(unsigned int file_hash) {
+    return (file_hash / LOCK_SHARDS) % LOCK_BUCKETS;
+}
+
+static double elapsed_ms(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - since->tv_sec) * 1000.0 +
+           (double)(now.tv_nsec - since->tv_nsec) / 1e6;
+}
+
+static LockOwner **owner_bucket(int owner_fd, pthread_mutex_t **mutex) {
+    unsigned int key = (unsigned int)owner_fd;
+    *mutex = &g_owner_mutex[key % LOCK_SHARDS];
+    return &g_owners[key % LOCK_SHARDS][(key / LOCK_SHARDS) % LOCK_BUCKETS];
+}
 
 void locking_init(void) {
-    pthread_mutex_lock(&g_lock_mutex);
-    for (int i = 0; i < MAX_LOCKS; i++) {
-        g_sentence_locks[i].active = false;
-        g_sentence_locks[i].filename[0] = '\0';
-        g_sentence_locks[i].sentence_index = 0;
-        g_sentence_locks[i].owner_fd = -1;
+    for (int i = 0; i < LOCK_SHARDS; i++) {
+        memset(&g_shards[i], 0, sizeof(g_shards[i]));
+        pthread_mutex_init(&g_shards[i].mutex, NULL);
+        pthread_mutex_init(&g_owner_mutex[i], NULL);
+        memset(g_owners[i], 0, sizeof(g_owners[i]));
     }
-    pthread_mutex_unlock(&g_lock_mutex);
 }
 
-int acquire_sentence_lock(const char *filename, int sentence_index, int owner_fd) {
-    int result = -1;
+// Call with the shard mutex held
+static void adjust_file_count(LockShard *shard, unsigned int file_hash, const char *filename, int delta) {
+    LockedFile **link = &shard->files[file_bucket(file_hash)];
+    while (*link && strcmp((*link)->filename, filename) != 0) {
+        link = &(*link)->next;
+    }
 
-    pthread_mutex_lock(&g_lock_mutex);
+    LockedFile *file = *link;
+    if (!file) {
+        if (delta < 0) return;
+        file = calloc(1, sizeof(LockedFile));
+        if (!file) return;
+        strncpy(file->filename, filename, sizeof(file->filename) - 1);
+        *link = file;
+    }
+    file->count += delta;
+    if (file->count <= 0) {
+        *link = file->next;
+        free(file);
+    }
+}
 
-    for (int i = 0; i < MAX_LOCKS; i++) {
-        SentenceLock *lock = &g_sentence_locks[i];
-        if (lock->active && lock->sentence_index == sentence_index && 
-            strcmp(lock->filename, filename) == 0) {
-            if (lock->owner_fd == owner_fd) {
-                result = i;
-            }
-            pthread_mutex_unlock(&g_lock_mutex);
-            return result;
+static void owner_link(SentenceLock *lock) {
+    pthread_mutex_t *mutex;
+    LockOwner **bucket = owner_bucket(lock->owner_fd, &mutex);
+
+    pthread_mutex_lock(mutex);
+    LockOwner *owner = *bucket;
+    while (owner && owner->fd != lock->owner_fd) {
+        owner = owner->next;
+    }
+    if (!owner) {
+        owner = calloc(1, sizeof(LockOwner));
+        if (owner) {
+            owner->fd = lock->owner_fd;
+            owner->next = *bucket;
+            *bucket = owner;
+        }
+    }
+    if (owner) {
+        lock->owner_prev = NULL;
+        lock->owner_next = owner->locks;
+        if (owner->locks) {
+            owner->locks->owner_prev = lock;
+        }
+        owner->locks = lock;
+    }
+    pthread_mutex_unlock(mutex);
+}
+
+static void owner_unlink(SentenceLock *lock) {
+    pthread_mutex_t *mutex;
+    LockOwner **link = owner_bucket(lock->owner_fd, &mutex);
+
+    pthread_mutex_lock(mutex);
+    while (*link && (*link)->fd != lock->owner_fd) {
+        link = &(*link)->next;
+    }
+    LockOwner *owner = *link;
+    if (owner) {
+        if (lock->owner_prev) {
+            lock->owner_prev->owner_next = lock->owner_next;
+        } else if (owner->locks == lock) {
+            owner->locks = lock->owner_next;
+        }
+        if (lock->owner_next) {
+            lock->owner_next->owner_prev = lock->owner_prev;
+        }
+        if (!owner->locks) {
+            *link = owner->next;
+            free(owner);
         }
     }
+    pthread_mutex_unlock(mutex);
+    lock->owner_prev = NULL;
+    lock->owner_next = NULL;
+}
+
+// Call with the shard mutex held
+static void account_release(LockShard *shard, SentenceLock *lock) {
+    double held = elapsed_ms(&lock->acquired_at);
+    shard->stats.released++;
+    shard->stats.hold_total_ms += held;
+    if (held > shard->stats.hold_max_ms) {
+        shard->stats.hold_max_ms = held;
+    }
+}
+
+// Give a released lock to the first waiter; call with the shard mutex held.
+// Returns false if nobody is waiting.
+static bool hand_off(LockShard *shard, SentenceLock *lock) {
+    LockWaiter *waiter = lock->waiters;
+    if (!waiter) return false;
+
+    lock->waiters = waiter->next;
+    if (!lock->waiters) {
+        lock->waiters_tail = NULL;
+    }
+    lock->waiting--;
 
-    for (int i = 0; i < MAX_LOCKS; i++) {
-        SentenceLock *lock = &g_sentence_locks[i];
-        if (!lock->active) {
-            lock->active = true;
-            lock->sentence_index = sentence_index;
-            lock->owner_fd = owner_fd;
-            strncpy(lock->filename, filename, sizeof(lock->filename) - 1);
-            lock->filename[sizeof(lock->filename) - 1] = '\0';
-            result = i;
+    account_release(shard, lock);
+    shard->stats.acquired++;
+    lock->owner_fd = waiter->owner_fd;
+    clock_gettime(CLOCK_MONOTONIC, &lock->acquired_at);
+    owner_link(lock);
+
+    waiter->granted = true;
+    pthread_cond_signal(&waiter->cond);
+    return true;
+}
+
+// Call with the shard mutex held; the waiter has not been granted the lock
+static void dequeue_waiter(SentenceLock *lock, LockWaiter *waiter) {
+    LockWaiter *prev = NULL;
+    for (LockWaiter *w = lock->waiters; w; prev = w, w = w->next) {
+        if (w != waiter) continue;
+        if (prev) {
+            prev->next = w->next;
+        } else {
+            lock->waiters = w->next;
+        }
+        if (lock->waiters_tail == w) {
+            lock->waiters_tail = prev;
+        }
+        lock->waiting--;
+        return;
+    }
+}
+
+// Queue behind the holder of lock until it is handed over or the deadline
+// passes; call with the shard mutex held, which is dropped while waiting
+static SentenceLock *wait_for_lock(LockShard *shard, SentenceLock *lock, int owner_fd, int timeout_ms,
+                                   void (*queued)(int position, void *arg), void *arg) {
+    LockWaiter waiter;
+    memset(&waiter, 0, sizeof(waiter));
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&waiter.cond, &attr);
+    pthread_condattr_destroy(&attr);
+    waiter.owner_fd = owner_fd;
+
+    if (lock->waiters_tail) {
+        lock->waiters_tail->next = &waiter;
+    } else {
+        lock->waiters = &waiter;
+    }
+    lock->waiters_tail = &waiter;
+    int position = ++lock->waiting;
+    shard->stats.waited++;
+
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    struct timespec deadline = started;
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    if (queued) {
+        pthread_mutex_unlock(&shard->mutex);
+        queued(position, arg);
+        pthread_mutex_lock(&shard->mutex);
+    }
+
+    while (!waiter.granted) {
+        if (pthread_cond_timedwait(&waiter.cond, &shard->mutex, &deadline) == ETIMEDOUT) {
             break;
         }
     }
+    if (!waiter.granted) {
+        dequeue_waiter(lock, &waiter);
+        shard->stats.timed_out++;
+    }
+    shard->stats.wait_total_ms += elapsed_ms(&started);
+    pthread_cond_destroy(&waiter.cond);
+    return waiter.granted ? lock : NULL;
+}
+
+SentenceLock *acquire_sentence_lock(const char *filename, int sentence_index, int owner_fd) {
+    return acquire_sentence_lock_wait(filename, sentence_index, owner_fd, 0, NULL, NULL);
+}
+
+SentenceLock *acquire_sentence_lock_wait(const char *filename, int sentence_index, int owner_fd,
+                                         int timeout_ms, void (*queued)(int position, void *arg),
+                                         void *arg) {
+    unsigned int file_hash = hash_filename(filename);
+    LockShard *shard = shard_for(file_hash);
+    SentenceLock **bucket = &shard->locks[lock_bucket(file_hash, sentence_index)];
+
+    pthread_mutex_lock(&shard->mutex);
+    for (SentenceLock *lock = *bucket; lock; lock = lock->next) {
+        if (lock->sentence_index == sentence_index && strcmp(lock->filename, filename) == 0) {
+            if (lock->owner_fd != owner_fd) {
+                shard->stats.contended++;
+                lock = timeout_ms > 0 ? wait_for_lock(shard, lock, owner_fd, timeout_ms, queued, arg) : NULL;
+            }
+            pthread_mutex_unlock(&shard->mutex);
+            return lock;
+        }
+    }
+
+    SentenceLock *lock = calloc(1, sizeof(SentenceLock));
+    if (lock) {
+        strncpy(lock->filename, filename, sizeof(lock->filename) - 1);
+        lock->sentence_index = sentence_index;
+        lock->owner_fd = owner_fd;
+        clock_gettime(CLOCK_MONOTONIC, &lock->acquired_at);
+        lock->next = *bucket;
+        *bucket = lock;
+        adjust_file_count(shard, file_hash, filename, 1);
+        owner_link(lock);
+        shard->stats.acquired++;
+        shard->stats.active++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    return lock;
+}
 
-    pthread_mutex_unlock(&g_lock_mutex);
-    return result;
+// Remove from the shard's indexes and account the hold time; call with the
+// shard mutex held
+static void shard_remove(LockShard *shard, unsigned int file_hash, SentenceLock *lock) {
+    SentenceLock **link = &shard->locks[lock_bucket(file_hash, lock->sentence_index)];
+    while (*link && *link != lock) {
+        link = &(*link)->next;
+    }
+    if (!*link) return;
+    *link = lock->next;
+    adjust_file_count(shard, file_hash, lock->filename, -1);
+    account_release(shard, lock);
+    shard->stats.active--;
 }
 
-void release_sentence_lock_slot(int slot) {
-    if (slot < 0 || slot >= MAX_LOCKS) return;
+// Release a lock already off its owner's list: hand it on, or drop it
+static void release_unlinked(SentenceLock *lock) {
+    unsigned int file_hash = hash_filename(lock->filename);
+    LockShard *shard = shard_for(file_hash);
+    pthread_mutex_lock(&shard->mutex);
+    bool handed = hand_off(shard, lock);
+    if (!handed) {
+        shard_remove(shard, file_hash, lock);
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    if (!handed) {
+        free(lock);
+    }
+}
 
-    pthread_mutex_lock(&g_lock_mutex);
-    g_sentence_locks[slot].active = false;
-    g_sentence_locks[slot].filename[0] = '\0';
-    g_sentence_locks[slot].sentence_index = 0;
-    g_sentence_locks[slot].owner_fd = -1;
-    pthread_mutex_unlock(&g_lock_mutex);
+// An owner's locks are taken and released by its own connection thread, so
+// a lock is never released twice concurrently.
+void release_sentence_lock(SentenceLock *lock) {
+    if (!lock) return;
+    owner_unlink(lock);
+    release_unlinked(lock);
 }
 
 void release_sentence_locks_for_owner(int owner_fd) {
-    pthread_mutex_lock(&g_lock_mutex);
-    for (int i = 0; i < MAX_LOCKS; i++) {
-        if (g_sentence_locks[i].active && g_sentence_locks[i].owner_fd == owner_fd) {
-            g_sentence_locks[i].active = false;
-            g_sentence_locks[i].filename[0] = '\0';
-            g_sentence_locks[i].sentence_index = 0;
-            g_sentence_locks[i].owner_fd = -1;
-        }
+    pthread_mutex_t *mutex;
+    LockOwner **link = owner_bucket(owner_fd, &mutex);
+
+    // Detach the owner's whole list, then drop each lock from its file shard
+    pthread_mutex_lock(mutex);
+    while (*link && (*link)->fd != owner_fd) {
+        link = &(*link)->next;
+    }
+    LockOwner *owner = *link;
+    if (owner) {
+        *link = owner->next;
+    }
+    pthread_mutex_unlock(mutex);
+    if (!owner) return;
+
+    SentenceLock *lock = owner->locks;
+    while (lock) {
+        SentenceLock *next = lock->owner_next;
+        lock->owner_prev = NULL;
+        lock->owner_next = NULL;
+        release_unlinked(lock);
+        lock = next;
     }
-    pthread_mutex_unlock(&g_lock_mutex);
+    free(owner);
 }
 
 bool file_has_active_lock(const char *filename) {
+    unsigned int file_hash = hash_filename(filename);
+    LockShard *shard = shard_for(file_hash);
     bool locked = false;
 
-    pthread_mutex_lock(&g_lock_mutex);
-    for (int i = 0; i < MAX_LOCKS; i++) {
-        if (g_sentence_locks[i].active && strcmp(g_sentence_locks[i].filename, filename) == 0) {
-            locked = true;
+    pthread_mutex_lock(&shard->mutex);
+    for (LockedFile *file = shard->files[file_bucket(file_hash)]; file; file = file->next) {
+        if (strcmp(file->filename, filename) == 0) {
+            locked = file->count > 0;
             break;
         }
     }
-    pthread_mutex_unlock(&g_lock_mutex);
+    pthread_mutex_unlock(&shard->mutex);
     return locked;
 }
+
+void locking_get_stats(LockStats *out) {
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < LOCK_SHARDS; i++) {
+        LockShard *shard = &g_shards[i];
+        pthread_mutex_lock(&shard->mutex);
+        out->acquired += shard->stats.acquired;
+        out->contended += shard->stats.contended;
+        out->waited += shard->stats.waited;
+        out->timed_out += shard->stats.timed_out;
+        out->released += shard->stats.released;
+        out->active += shard->stats.active;
+        out->hold_total_ms += shard->stats.hold_total_ms;
+        out->wait_total_ms += shard->stats.wait_total_ms;
+        if (shard->stats.hold_max_ms > out->hold_max_ms) {
+            out->hold_max_ms = shard->stats.hold_max_ms;
+        }
+        pthread_mutex_unlock(&shard->mutex);
+    }
+}
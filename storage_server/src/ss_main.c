@@ -6,13 +6,80 @@
 #include "ss_locking.h"
 #include "ss_utils.h"
 #include "ss_network.h"
+#include "ss_reactor.h"
+#include "ss_control.h"
+#include "ss_durability.h"
+#include "ss_readcache.h"
+#include "ss_replication.h"
+#include "ss_stream.h"
 #include <pthread.h>
+#include <signal.h>
 
 int main(int argc, char *argv[]) {
     // Parse command line arguments
-    // Usage: ./ss [port] [nm_ip] [advertise_ip]
-    if (argc > 1) {
-        int port = atoi(argv[1]);
+    // Usage: ./ss [port] [nm_ip] [advertise_ip] [--repl-sync] [--repl-max-lag=N]
+    //             [--durability=none|sync|group] [--group-commit-ms=N] [--read-cache-mb=N]
+    //             [--mode=epoll|threaded] [--workers=N] [--max-conns=N]
+    bool repl_sync = false;
+    int repl_max_lag = REPL_MAX_PENDING;
+    DurabilityMode durability = DURABILITY_NONE;
+    int group_commit_ms = DURABILITY_DEFAULT_WINDOW_MS;
+    int read_cache_mb = READ_CACHE_DEFAULT_MB;
+    SsServeMode mode = SS_MODE_EPOLL;
+    int workers = SS_DEFAULT_WORKERS;
+    int max_conns = SS_DEFAULT_MAX_CONNS;
+    char *args[4] = {argv[0], NULL, NULL, NULL};
+    int arg_count = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--repl-sync") == 0) {
+            repl_sync = true;
+        } else if (strncmp(argv[i], "--repl-max-lag=", 15) == 0) {
+            repl_max_lag = atoi(argv[i] + 15);
+            if (repl_max_lag <= 0) {
+                fprintf(stderr, "Invalid replication lag bound. Using default %d\n", REPL_MAX_PENDING);
+                repl_max_lag = REPL_MAX_PENDING;
+            }
+        } else if (strncmp(argv[i], "--durability=", 13) == 0) {
+            if (!durability_parse_mode(argv[i] + 13, &durability)) {
+                fprintf(stderr, "Unknown durability mode '%s'. Using none\n", argv[i] + 13);
+                durability = DURABILITY_NONE;
+            }
+        } else if (strncmp(argv[i], "--group-commit-ms=", 18) == 0) {
+            group_commit_ms = atoi(argv[i] + 18);
+            if (group_commit_ms < 0 || group_commit_ms > DURABILITY_MAX_WINDOW_MS) {
+                fprintf(stderr, "Invalid group commit window. Using default %d ms\n",
+                        DURABILITY_DEFAULT_WINDOW_MS);
+                group_commit_ms = DURABILITY_DEFAULT_WINDOW_MS;
+            }
+        } else if (strncmp(argv[i], "--read-cache-mb=", 16) == 0) {
+            read_cache_mb = atoi(argv[i] + 16);
+            if (read_cache_mb < 0) {
+                fprintf(stderr, "Invalid read cache size. Using default %d MB\n", READ_CACHE_DEFAULT_MB);
+                read_cache_mb = READ_CACHE_DEFAULT_MB;
+            }
+        } else if (strcmp(argv[i], "--mode=epoll") == 0) {
+            mode = SS_MODE_EPOLL;
+        } else if (strcmp(argv[i], "--mode=threaded") == 0) {
+            mode = SS_MODE_THREADED;
+        } else if (strncmp(argv[i], "--workers=", 10) == 0) {
+            workers = atoi(argv[i] + 10);
+            if (workers <= 0) {
+                fprintf(stderr, "Invalid worker count. Using default %d\n", SS_DEFAULT_WORKERS);
+                workers = SS_DEFAULT_WORKERS;
+            }
+        } else if (strncmp(argv[i], "--max-conns=", 12) == 0) {
+            max_conns = atoi(argv[i] + 12);
+            if (max_conns <= 0) {
+                fprintf(stderr, "Invalid connection limit. Using default %d\n", SS_DEFAULT_MAX_CONNS);
+                max_conns = SS_DEFAULT_MAX_CONNS;
+            }
+        } else if (arg_count < 4) {
+            args[arg_count++] = argv[i];
+        }
+    }
+
+    if (arg_count > 1) {
+        int port = atoi(args[1]);
         if (port > 0 && port < 65536) {
             CLIENT_PORT = port;
         } else {
@@ -20,32 +87,48 @@ int main(int argc, char *argv[]) {
         }
     }
     
-    if (argc > 2) {
-        strncpy(NM_IP, argv[2], INET_ADDRSTRLEN - 1);
+    if (arg_count > 2) {
+        strncpy(NM_IP, args[2], INET_ADDRSTRLEN - 1);
         NM_IP[INET_ADDRSTRLEN - 1] = '\0';
         printf("[SS] Connecting to Name Server at %s:%d\n", NM_IP, NM_PORT);
     } else {
-        printf("[SS] Usage: %s [port] [nm_ip] [advertise_ip]\n", argv[0]);
+        printf("[SS] Usage: %s [port] [nm_ip] [advertise_ip] [--repl-sync] [--repl-max-lag=N] "
+               "[--durability=none|sync|group] [--group-commit-ms=N] [--read-cache-mb=N] "
+               "[--mode=epoll|threaded] [--workers=N] [--max-conns=N]\n", argv[0]);
         printf("[SS] Using default Name Server IP: %s\n", NM_IP);
     }
     
-    if (argc > 3) {
-        strncpy(ADVERTISE_IP, argv[3], INET_ADDRSTRLEN - 1);
+    if (arg_count > 3) {
+        strncpy(ADVERTISE_IP, args[3], INET_ADDRSTRLEN - 1);
         ADVERTISE_IP[INET_ADDRSTRLEN - 1] = '\0';
         printf("[SS] Will advertise IP: %s\n", ADVERTISE_IP);
     }
 
+    // A client hanging up mid-reply must only fail that send: sendfile()
+    // and plain write() cannot take MSG_NOSIGNAL
+    signal(SIGPIPE, SIG_IGN);
+
     // Initialize subsystems
     ensure_directories();
     init_logging();
     locking_init();
+    durability_init(durability, group_commit_ms);
+    if (durability != DURABILITY_NONE) {
+        printf("[SS] Durability: %s", durability_mode_name(durability));
+        if (durability == DURABILITY_GROUP) {
+            printf(", %d ms window", group_commit_ms);
+        }
+        printf("\n");
+    }
+    readcache_init((size_t)read_cache_mb * 1024 * 1024);
+    replication_init(repl_sync, repl_max_lag);
+    stream_init();
     
     log_event("INFO", "0.0.0.0", CLIENT_PORT, "-", "START", "Storage server starting");
 
     // Create server socket
-    int server_sock, client_sock;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t addr_size;
+    int server_sock;
+    struct sockaddr_in server_addr;
 
     server_sock = socket(AF_INET, SOCK_STREAM, 0);
     if (server_sock < 0) {
@@ -71,43 +154,22 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
-    if (listen(server_sock, 5) < 0) {
+    if (listen(server_sock, SS_LISTEN_BACKLOG) < 0) {
         perror("[SS] Listen failed");
         close(server_sock);
         return 1;
     }
 
-    printf("[SS] Storage Server ready on port %d\n", CLIENT_PORT);
+    printf("[SS] Storage Server ready on port %d (%s mode, at most %d clients)\n", CLIENT_PORT,
+           mode == SS_MODE_EPOLL ? "epoll" : "threaded", max_conns);
     
     // Register with name server
+    load_shard_map();
     register_with_nm();
+    control_start();
 
-    // Main server loop - accept and handle client connections
-    while (1) {
-        addr_size = sizeof(client_addr);
-        client_sock = accept(server_sock, (struct sockaddr*)&client_addr, &addr_size);
-        if (client_sock < 0) {
-            continue;
-        }
-
-        // Create thread argument
-        ClientThreadArg *arg = (ClientThreadArg *)malloc(sizeof(ClientThreadArg));
-        if (!arg) {
-            close(client_sock);
-            continue;
-        }
-        arg->socket_fd = client_sock;
-        memcpy(&arg->addr, &client_addr, sizeof(client_addr));
-
-        // Spawn thread to handle client
-        pthread_t tid;
-        if (pthread_create(&tid, NULL, client_thread, arg) != 0) {
-            free(arg);
-            close(client_sock);
-            continue;
-        }
-        pthread_detach(tid);
+    if (mode == SS_MODE_EPOLL) {
+        return run_epoll_server(server_sock, workers, max_conns) == 0 ? 0 : 1;
     }
-
-    return 0;
+    return run_threaded_server(server_sock, max_conns) == 0 ? 0 : 1;
 }
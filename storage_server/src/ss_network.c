@@ -1,27 +1,45 @@
 #include "ss_network.h"
+#include "ss_reactor.h"
 #include "ss_utils.h"
 #include "ss_file_ops.h"
+#include "ss_fileview.h"
 #include "ss_handlers.h"
 #include "ss_session.h"
 #include "ss_locking.h"
+#include "ss_replication.h"
+#include "ss_stats.h"
+#include "ss_stream.h"
+#include "ss_versions.h"
 
 extern __thread ClientLogContext g_log_ctx;
 
-void register_with_nm(void) {
+int nm_shard_count(void) {
+    return NM_SHARDS.count > 0 ? NM_SHARDS.count : 1;
+}
+
+const char *nm_shard_host(int shard) {
+    return NM_SHARDS.count > 0 ? NM_SHARDS.shards[shard].host : NM_IP;
+}
+
+int nm_shard_port(int shard) {
+    return NM_SHARDS.count > 0 ? NM_SHARDS.shards[shard].port : NM_PORT;
+}
+
+static int connect_nm_at(const char *host, int port) {
     int sock = socket(AF_INET, SOCK_STREAM, 0);
     if (sock < 0) {
         perror("[SS] socket");
-        return;
+        return -1;
     }
 
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
-    addr.sin_port = htons(NM_PORT);
-    if (inet_pton(AF_INET, NM_IP, &addr.sin_addr) <= 0) {
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) <= 0) {
         perror("[SS] inet_pton");
         close(sock);
-        return;
+        return -1;
     }
 
     struct timeval timeout;
@@ -31,8 +49,60 @@ void register_with_nm(void) {
     setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
 
     if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-        perror("[SS] connect NM");
         close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int connect_nm_shard(int shard) {
+    return connect_nm_at(nm_shard_host(shard), nm_shard_port(shard));
+}
+
+// The map comes from the NM given on the command line; one that does not
+// know SHARD_MAP, or does not answer, is taken to hold the whole namespace
+void load_shard_map(void) {
+    shard_map_init(&NM_SHARDS);
+    int sock = connect_nm_at(NM_IP, NM_PORT);
+    if (sock < 0) {
+        return;
+    }
+
+    const char *request = "{\"cmd\":\"SHARD_MAP\"}\n";
+    char reply[MAX_MSG];
+    size_t len = 0;
+    if (write(sock, request, strlen(request)) > 0) {
+        ssize_t n;
+        while (len < sizeof(reply) - 1 && (n = read(sock, reply + len, sizeof(reply) - 1 - len)) > 0) {
+            len += (size_t)n;
+        }
+    }
+    reply[len] = '\0';
+    close(sock);
+
+    JsonMessage msg;
+    json_parse(&msg, reply, len);
+    if (shard_map_from_json(&NM_SHARDS, &msg) != 0) {
+        log_event("ERROR", NM_IP, NM_PORT, "-", "SHARD_MAP", reply);
+    } else if (NM_SHARDS.count > 0) {
+        printf("[SS] Name Server namespace has %d shards\n", NM_SHARDS.count);
+    }
+}
+
+// Every shard may place new files here, so each one gets a registration,
+// listing only the files it owns
+void register_with_nm(void) {
+    for (int shard = 0; shard < nm_shard_count(); shard++) {
+        register_with_shard(shard);
+    }
+}
+
+void register_with_shard(int shard) {
+    const char *nm_host = nm_shard_host(shard);
+    int nm_port = nm_shard_port(shard);
+    int sock = connect_nm_shard(shard);
+    if (sock < 0) {
+        perror("[SS] connect NM");
         return;
     }
     
@@ -67,8 +137,10 @@ void register_with_nm(void) {
     }
     
     printf("[SS] Registering with NM using IP: %s (port: %d)\n", local_ip, CLIENT_PORT);
+    strncpy(REGISTERED_IP, local_ip, sizeof(REGISTERED_IP) - 1);
+    REGISTERED_IP[sizeof(REGISTERED_IP) - 1] = '\0';
 
-    char *files_json = build_files_manifest();
+    char *files_json = build_files_manifest(NM_SHARDS.count > 0 ? &NM_SHARDS : NULL, shard);
     if (!files_json) {
         files_json = strdup("[]");
     }
@@ -83,7 +155,7 @@ void register_with_nm(void) {
 
     int n = snprintf(msg, payload_len,
                      "{ \"cmd\":\"register_ss\", \"ip\":\"%s\", \"nm_port\":%d, \"client_port\":%d, \"files\":%s }\n",
-                     local_ip, NM_PORT, CLIENT_PORT, files_json);
+                     local_ip, nm_port, CLIENT_PORT, files_json);
     free(files_json);
 
     if (n > 0) {
@@ -93,7 +165,7 @@ void register_with_nm(void) {
         preview[copy_len] = '\0';
         char *newline = strchr(preview, '\n');
         if (newline) *newline = '\0';
-        log_event("REQUEST", "127.0.0.1", NM_PORT, "-", "REGISTER_SS", preview);
+        log_event("REQUEST", nm_host, nm_port, "-", "REGISTER_SS", preview);
         if (write(sock, msg, (size_t)n) < 0) {
             perror("[SS] register send");
             free(msg);
@@ -109,30 +181,32 @@ void register_with_nm(void) {
     if (r > 0) {
         buf[r] = '\0';
         printf("[SS] NM reply: %s\n", buf);
-        log_event("RESPONSE", "127.0.0.1", NM_PORT, "-", "REGISTER_SS", buf);
+        log_event("RESPONSE", nm_host, nm_port, "-", "REGISTER_SS", buf);
     } else if (r == 0) {
         printf("[SS] WARNING: Name Server closed connection without response\n");
-        log_event("ERROR", "127.0.0.1", NM_PORT, "-", "REGISTER_SS", "Connection closed");
+        log_event("ERROR", nm_host, nm_port, "-", "REGISTER_SS", "Connection closed");
     } else {
         perror("[SS] read NM response");
-        log_event("ERROR", "127.0.0.1", NM_PORT, "-", "REGISTER_SS", "Read timeout or error");
+        log_event("ERROR", nm_host, nm_port, "-", "REGISTER_SS", "Read timeout or error");
     }
 
     close(sock);
 }
 
-static void parse_and_handle(int client, char *buf, WriteSession *session) {
-    char cmd[32];
-    if (!json_get_string(buf, "cmd", cmd, sizeof(cmd))) {
-        g_log_ctx.cmd[0] = '\0';
-        g_log_ctx.username[0] = '\0';
-        log_event("REQUEST", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, "UNKNOWN", buf);
-        send_error(client, "UNKNOWN_CMD");
+// Requests are logged whole up to LOG_PREVIEW_BYTES; a longer one (a large
+// UPDATE or REPLICATE) is logged as its start and its length
+static void log_request(const char *cmd, const char *buf, size_t len) {
+    if (len <= LOG_PREVIEW_BYTES) {
+        log_event("REQUEST", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, cmd, buf);
         return;
     }
+    char preview[LOG_PREVIEW_BYTES + 48];   // "... (" + 20 digits + " bytes)"
+    snprintf(preview, sizeof(preview), "%.*s... (%zu bytes)", LOG_PREVIEW_BYTES, buf, len);
+    log_event("REQUEST", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, cmd, preview);
+}
 
-    char username[MAX_USERNAME] = {0};
-    json_get_string(buf, "username", username, sizeof(username));
+// Requests without a username are logged under the write session's owner
+static void set_request_context(const char *cmd, const char *username, const WriteSession *session) {
     if (username[0] != '\0') {
         strncpy(g_log_ctx.username, username, sizeof(g_log_ctx.username) - 1);
         g_log_ctx.username[sizeof(g_log_ctx.username) - 1] = '\0';
@@ -145,66 +219,118 @@ static void parse_and_handle(int client, char *buf, WriteSession *session) {
 
     strncpy(g_log_ctx.cmd, cmd, sizeof(g_log_ctx.cmd) - 1);
     g_log_ctx.cmd[sizeof(g_log_ctx.cmd) - 1] = '\0';
-    log_event("REQUEST", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, g_log_ctx.cmd, buf);
+}
+
+static void handle_delete(int client, const char *filename) {
+    char filepath[1024];
+    snprintf(filepath, sizeof(filepath), "%s/%s", DATA_DIR, filename);
+    if (remove(filepath) == 0) {
+        stats_forget(filename);
+        replication_forget(filename);
+        versions_forget(filename);
+        fileview_invalidate(filename);
+        send_ok_message(client, NULL);
+    } else {
+        send_error(client, "FILE_NOT_FOUND");
+    }
+}
+
+static void parse_and_handle(int client, const char *buf, size_t len, WriteSession *session) {
+    // One pass over the request finds every field the handlers below ask for
+    JsonMessage msg;
+    json_parse(&msg, buf, len);
+
+    char cmd[32];
+    if (!json_field_string(&msg, "cmd", cmd, sizeof(cmd))) {
+        g_log_ctx.cmd[0] = '\0';
+        g_log_ctx.username[0] = '\0';
+        log_request("UNKNOWN", buf, len);
+        send_error(client, "UNKNOWN_CMD");
+        return;
+    }
+
+    char username[MAX_USERNAME] = {0};
+    json_field_string(&msg, "username", username, sizeof(username));
+    set_request_context(cmd, username, session);
+    log_request(g_log_ctx.cmd, buf, len);
 
     if (strcmp(cmd, "READ") == 0) {
         char filename[MAX_FILENAME];
-        if (!json_get_string(buf, "filename", filename, sizeof(filename))) {
+        if (!json_field_string(&msg, "filename", filename, sizeof(filename))) {
             send_error(client, "BAD_REQUEST");
             return;
         }
-        handle_read(client, filename);
+        char mode[16];
+        if (json_field_string(&msg, "mode", mode, sizeof(mode)) && strcmp(mode, "chunked") == 0) {
+            handle_read_chunked(client, filename);
+        } else {
+            handle_read(client, filename);
+        }
         return;
     }
 
     if (strcmp(cmd, "CREATE") == 0) {
         char filename[MAX_FILENAME];
-        if (!json_get_string(buf, "filename", filename, sizeof(filename))) {
+        if (!json_field_string(&msg, "filename", filename, sizeof(filename))) {
             send_error(client, "BAD_REQUEST");
             return;
         }
-        char content[MAX_MSG];
-        if (!json_get_string(buf, "content", content, sizeof(content))) {
+        // Unescaping never lengthens a string, so the request bounds it
+        char *content = malloc(len + 1);
+        if (!content) {
+            send_error(client, "UNKNOWN");
+            return;
+        }
+        if (!json_field_string(&msg, "content", content, len + 1)) {
             content[0] = '\0';
         }
         handle_create_file(client, filename, content);
+        free(content);
         return;
     }
 
     if (strcmp(cmd, "WRITE") == 0) {
         char filename[MAX_FILENAME];
-        if (!json_get_string(buf, "filename", filename, sizeof(filename))) {
+        if (!json_field_string(&msg, "filename", filename, sizeof(filename))) {
             send_error(client, "BAD_REQUEST");
             return;
         }
         int sentence_index = 0;
-        if (!json_get_int(buf, "sentence_index", &sentence_index)) {
+        if (!json_field_int(&msg, "sentence_index", &sentence_index)) {
             send_error(client, "BAD_REQUEST");
             return;
         }
-        handle_write_begin(client, filename, sentence_index, session, g_log_ctx.username);
+        int wait_ms = 0;
+        json_field_int(&msg, "wait_ms", &wait_ms);
+        handle_write_begin(client, filename, sentence_index, wait_ms, session, g_log_ctx.username);
         return;
     }
 
     if (strcmp(cmd, "UPDATE") == 0) {
         int word_index = 0;
-        if (!json_get_int(buf, "word_index", &word_index)) {
+        if (!json_field_int(&msg, "word_index", &word_index)) {
             send_error(client, "BAD_REQUEST");
             return;
         }
-        char content[MAX_MSG];
-        if (!json_get_string(buf, "content", content, sizeof(content))) {
+        char *content = malloc(len + 1);
+        if (!content) {
+            send_error(client, "UNKNOWN");
+            return;
+        }
+        if (!json_field_string(&msg, "content", content, len + 1)) {
+            free(content);
             send_error(client, "BAD_REQUEST");
             return;
         }
         char mode[16] = {0};
         int replace_word = 0;
-        if (json_get_string(buf, "mode", mode, sizeof(mode))) {
+        if (json_field_string(&msg, "mode", mode, sizeof(mode))) {
             if (strcmp(mode, "replace") == 0) {
                 replace_word = 1;
             }
         }
         handle_update(client, word_index, content, session, replace_word);
+        free(content);
         return;
     }
 
@@ -215,27 +341,43 @@ static void parse_and_handle(int client, char *buf, WriteSession *session) {
 
     if (strcmp(cmd, "UNDO") == 0) {
         char filename[MAX_FILENAME];
-        if (!json_get_string(buf, "filename", filename, sizeof(filename))) {
+        if (!json_field_string(&msg, "filename", filename, sizeof(filename))) {
+            send_error(client, "BAD_REQUEST");
+            return;
+        }
+        int steps = 1;
+        int version = -1;
+        json_field_int(&msg, "steps", &steps);
+        json_field_int(&msg, "version", &version);
+        handle_undo(client, filename, steps, version);
+        return;
+    }
+
+    if (strcmp(cmd, "VERSIONS") == 0) {
+        char filename[MAX_FILENAME];
+        if (!json_field_string(&msg, "filename", filename, sizeof(filename))) {
             send_error(client, "BAD_REQUEST");
             return;
         }
-        handle_undo(client, filename);
+        handle_versions(client, filename);
         return;
     }
 
     if (strcmp(cmd, "STREAM") == 0) {
         char filename[MAX_FILENAME];
-        if (!json_get_string(buf, "filename", filename, sizeof(filename))) {
+        if (!json_field_string(&msg, "filename", filename, sizeof(filename))) {
             send_error(client, "BAD_REQUEST");
             return;
         }
-        handle_stream(client, filename);
+        int rate = STREAM_DEFAULT_RATE;
+        json_field_int(&msg, "rate", &rate);
+        handle_stream(client, filename, rate);
         return;
     }
 
     if (strcmp(cmd, "STAT") == 0) {
         char filename[MAX_FILENAME];
-        if (!json_get_string(buf, "filename", filename, sizeof(filename))) {
+        if (!json_field_string(&msg, "filename", filename, sizeof(filename))) {
             send_error(client, "BAD_REQUEST");
             return;
         }
@@ -243,109 +385,292 @@ static void parse_and_handle(int client, char *buf, WriteSession *session) {
         return;
     }
 
+    if (strcmp(cmd, "STAT_BATCH") == 0) {
+        const char *files = json_field_array(&msg, "files");
+        if (!files) {
+            send_error(client, "BAD_REQUEST");
+            return;
+        }
+        handle_stat_batch(client, files);
+        return;
+    }
+
+    if (strcmp(cmd, "LOCK_STATS") == 0) {
+        handle_lock_stats(client);
+        return;
+    }
+
+    if (strcmp(cmd, "READ_CACHE_STATS") == 0) {
+        int capacity_mb = -1;
+        json_field_int(&msg, "capacity_mb", &capacity_mb);
+        handle_read_cache_stats(client, capacity_mb);
+        return;
+    }
+
+    if (strcmp(cmd, "REPLICATE") == 0) {
+        handle_replicate(client, &msg);
+        return;
+    }
+
+    if (strcmp(cmd, "SET_REPLICA") == 0) {
+        handle_set_replica(client, &msg);
+        return;
+    }
+
     if (strcmp(cmd, "DELETE") == 0) {
         char filename[MAX_FILENAME];
-        if (!json_get_string(buf, "filename", filename, sizeof(filename))) {
+        if (!json_field_string(&msg, "filename", filename, sizeof(filename))) {
             send_error(client, "BAD_REQUEST");
             return;
         }
-        char filepath[1024];
-        snprintf(filepath, sizeof(filepath), "%s/%s", DATA_DIR, filename);
-        if (remove(filepath) == 0) {
-            char snappath[1024];
-            snprintf(snappath, sizeof(snappath), "%s/%s.bak", SNAP_DIR, filename);
-            remove(snappath);
-            send_ok_message(client, NULL);
-        } else {
-            send_error(client, "FILE_NOT_FOUND");
-        }
+        handle_delete(client, filename);
         return;
     }
 
     send_error(client, "UNKNOWN_CMD");
 }
 
-void handle_client(int client_sock) {
-    char buffer[MAX_MSG];
-    ssize_t bytes_read;
+// A str16 field as a NUL-terminated name; false if it does not fit
+static bool copy_name(const char *data, size_t len, char *out, size_t out_size) {
+    if (!data || len >= out_size) return false;
+    memcpy(out, data, len);
+    out[len] = '\0';
+    return true;
+}
 
-    char workbuf[MAX_MSG];
-    size_t worklen = 0;
-    workbuf[0] = '\0';
+// Binary counterpart of parse_and_handle for one frame body (proto_wire.h):
+// the same handlers, with fixed-width fields in place of JSON lookups
+static void decode_and_handle(int client, const char *frame, size_t len, WriteSession *session) {
+    WireReader r;
+    wire_reader_init(&r, frame, len);
+    unsigned int op = wire_get_u8(&r);
+    size_t name_len = 0;
+    const char *name = wire_get_str16(&r, &name_len);
+    const char *cmd = wire_op_name(op);
 
-    WriteSession session;
-    session_init(&session, client_sock);
+    char username[MAX_USERNAME] = {0};
+    if (!cmd || !copy_name(name, name_len, username, sizeof(username))) {
+        g_log_ctx.cmd[0] = '\0';
+        g_log_ctx.username[0] = '\0';
+        char preview[64];
+        snprintf(preview, sizeof(preview), "binary opcode %u (%zu bytes)", op, len);
+        log_event("REQUEST", g_log_ctx.ip, g_log_ctx.port, "", "UNKNOWN", preview);
+        send_error(client, cmd ? "BAD_REQUEST" : "UNKNOWN_CMD");
+        return;
+    }
+    set_request_context(cmd, username, session);
+
+    // Every opcode but the three below names a file right after the user
+    char filename[MAX_FILENAME] = {0};
+    if (op != WIRE_OP_UPDATE && op != WIRE_OP_ETIRW && op != WIRE_OP_LOCK_STATS &&
+        op != WIRE_OP_READ_CACHE_STATS) {
+        name = wire_get_str16(&r, &name_len);
+        if (!copy_name(name, name_len, filename, sizeof(filename)) || filename[0] == '\0') {
+            log_event("REQUEST", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, cmd, "binary");
+            send_error(client, "BAD_REQUEST");
+            return;
+        }
+    }
+    char preview[MAX_FILENAME + 64];
+    snprintf(preview, sizeof(preview), "binary %s (%zu bytes)", filename[0] ? filename : "-", len);
+    log_event("REQUEST", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, cmd, preview);
+
+    int sentence_index = 0;
+    int word_index = 0;
+    int steps = 0;
+    int capacity_mb = -1;
+    uint32_t wait_ms = 0;
+    uint64_t version = 0;
+    bool replace_word = false;
+    const char *content = NULL;
+    size_t content_len = 0;
+    switch (op) {
+        case WIRE_OP_CREATE:
+            content = wire_get_str32(&r, &content_len);
+            break;
+        case WIRE_OP_WRITE:
+            sentence_index = (int32_t)wire_get_u32(&r);
+            wait_ms = wire_get_u32(&r);
+            break;
+        case WIRE_OP_UPDATE:
+            word_index = (int32_t)wire_get_u32(&r);
+            replace_word = wire_get_u8(&r) != 0;
+            content = wire_get_str32(&r, &content_len);
+            break;
+        case WIRE_OP_UNDO:
+            steps = (int32_t)wire_get_u32(&r);
+            version = wire_get_u64(&r);
+            break;
+        case WIRE_OP_READ_CACHE_STATS:
+            capacity_mb = (int32_t)wire_get_u32(&r);
+            break;
+    }
+    if (!wire_reader_done(&r)) {
+        send_error(client, "BAD_REQUEST");
+        return;
+    }
 
-    while (1) {
-        memset(buffer, 0, sizeof(buffer));
-        bytes_read = read(client_sock, buffer, sizeof(buffer) - 1);
+    // The handlers take content as a C string; the frame is not terminated
+    char *text = NULL;
+    if (content) {
+        text = malloc(content_len + 1);
+        if (!text) {
+            send_error(client, "UNKNOWN");
+            return;
+        }
+        memcpy(text, content, content_len);
+        text[content_len] = '\0';
+    }
 
-        if (bytes_read <= 0) {
+    switch (op) {
+        case WIRE_OP_READ:
+            handle_read(client, filename);
             break;
-        }
+        case WIRE_OP_CREATE:
+            handle_create_file(client, filename, text);
+            break;
+        case WIRE_OP_WRITE:
+            handle_write_begin(client, filename, sentence_index, wait_ms > INT32_MAX ? INT32_MAX : (int)wait_ms,
+                               session, g_log_ctx.username);
+            break;
+        case WIRE_OP_UPDATE:
+            handle_update(client, word_index, text, session, replace_word);
+            break;
+        case WIRE_OP_ETIRW:
+            handle_commit(client, session);
+            break;
+        case WIRE_OP_UNDO:
+            // version all ones restores by steps, like a missing "version"
+            handle_undo(client, filename, steps, version == UINT64_MAX ? -1 : (long)version);
+            break;
+        case WIRE_OP_VERSIONS:
+            handle_versions(client, filename);
+            break;
+        case WIRE_OP_STAT:
+            handle_stat(client, filename);
+            break;
+        case WIRE_OP_DELETE:
+            handle_delete(client, filename);
+            break;
+        case WIRE_OP_LOCK_STATS:
+            handle_lock_stats(client);
+            break;
+        case WIRE_OP_READ_CACHE_STATS:
+            handle_read_cache_stats(client, capacity_mb);
+            break;
+    }
+    free(text);
+}
 
-        if (worklen + (size_t)bytes_read >= sizeof(workbuf) - 1) {
-            worklen = 0;
-        }
+// The first byte decides the encoding: WIRE_HANDSHAKE and a version switch
+// the connection to frames and are answered with the server's version,
+// anything else is the start of a JSON request. Returns false to close.
+static bool negotiate(SsConn *conn) {
+    size_t pending = 0;
+    const char *bytes = framer_pending(&conn->framer, &pending);
+    if ((unsigned char)bytes[0] != WIRE_HANDSHAKE) {
+        conn->encoding = CONN_JSON;
+        return true;
+    }
+    if (pending < 2) {
+        return true;
+    }
+    unsigned char version = (unsigned char)bytes[1];
+    framer_consume(&conn->framer, 2);
+    const unsigned char ack[2] = {WIRE_HANDSHAKE, WIRE_VERSION};
+    ssize_t w = write(conn->fd, ack, sizeof(ack));
+    (void)w;
+
+    char msg[64];
+    snprintf(msg, sizeof(msg), "Binary framing, version %u requested", version);
+    log_event("INFO", conn->log.ip, conn->log.port, "", "HANDSHAKE", msg);
+    if (version != WIRE_VERSION) {
+        return false;
+    }
+    conn->encoding = CONN_BINARY;
+    return true;
+}
+
+SsConn *ss_conn_create(int fd, const struct sockaddr_in *addr) {
+    SsConn *conn = calloc(1, sizeof(SsConn));
+    if (!conn) return NULL;
+    // REPLICATE ships whole files on one line, so a request may be up to
+    // MAX_REQUEST long
+    if (!framer_init(&conn->framer, MAX_REQUEST)) {
+        free(conn);
+        return NULL;
+    }
+    conn->fd = fd;
+    session_init(&conn->session, fd);
 
-        memcpy(workbuf + worklen, buffer, bytes_read);
-        worklen += bytes_read;
-        workbuf[worklen] = '\0';
+    if (!inet_ntop(AF_INET, &addr->sin_addr, conn->log.ip, sizeof(conn->log.ip))) {
+        strncpy(conn->log.ip, "unknown", sizeof(conn->log.ip) - 1);
+    }
+    conn->log.port = ntohs(addr->sin_port);
+    log_event("INFO", conn->log.ip, conn->log.port, "", "CONNECT", "Client connected");
+    return conn;
+}
 
-        char *line_start = workbuf;
-        while (1) {
-            char *nl = strchr(line_start, '\n');
-            if (!nl) break;
+int ss_conn_service(SsConn *conn) {
+    size_t avail = 0;
+    char *space = framer_space(&conn->framer, &avail);
+    if (!space) return -1;
+    ssize_t bytes_read = read(conn->fd, space, avail);
+    if (bytes_read <= 0) {
+        return (int)bytes_read;
+    }
+    framer_commit(&conn->framer, (size_t)bytes_read);
 
-            *nl = '\0';
+    if (conn->encoding == CONN_UNDECIDED) {
+        if (!negotiate(conn)) return 0;
+        if (conn->encoding == CONN_UNDECIDED) return (int)bytes_read;
+    }
 
-            size_t len = strlen(line_start);
-            if (len > 0 && line_start[len - 1] == '\r') {
-                line_start[len - 1] = '\0';
+    g_log_ctx = conn->log;
+    g_binary_replies = conn->encoding == CONN_BINARY;
+    g_stream_handoff = false;
+    char *line;
+    size_t len;
+    FrameResult result;
+    if (g_binary_replies) {
+        while (!g_stream_handoff &&
+               (result = framer_next_frame(&conn->framer, &line, &len)) != FRAME_NONE) {
+            if (result == FRAME_OVERSIZE) {
+                send_error(conn->fd, "REQUEST_TOO_LARGE");
+            } else {
+                decode_and_handle(conn->fd, line, len, &conn->session);
             }
-
-            if (strlen(line_start) > 0) {
-                printf("[SS] Received: %s\n", line_start);
-                log_event("INFO", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, 
-                         g_log_ctx.cmd, line_start);
-                parse_and_handle(client_sock, line_start, &session);
+        }
+    } else {
+        while (!g_stream_handoff &&
+               (result = framer_next(&conn->framer, &line, &len)) != FRAME_NONE) {
+            if (result == FRAME_OVERSIZE) {
+                send_error(conn->fd, "REQUEST_TOO_LARGE");
+            } else if (len > 0) {
+                parse_and_handle(conn->fd, line, len, &conn->session);
             }
-
-            line_start = nl + 1;
         }
-
-        size_t remaining = strlen(line_start);
-        memmove(workbuf, line_start, remaining + 1);
-        worklen = remaining;
     }
+    conn->log = g_log_ctx;
+    // a paced STREAM owns the socket from here on
+    return g_stream_handoff ? 0 : (int)bytes_read;
+}
 
-    session_reset(&session);
-    release_sentence_locks_for_owner(client_sock);
+void ss_conn_close(SsConn *conn) {
+    session_reset(&conn->session);
+    release_sentence_locks_for_owner(conn->fd);
+    close(conn->fd);
+    log_event("INFO", conn->log.ip, conn->log.port, conn->log.username, 
+             "DISCONNECT", "Client disconnected");
+    framer_free(&conn->framer);
+    free(conn);
 }
 
 void *client_thread(void *arg) {
-    ClientThreadArg *ctx = (ClientThreadArg *)arg;
-    if (!ctx) return NULL;
-
-    int client_sock = ctx->socket_fd;
-    struct sockaddr_in addr = ctx->addr;
-    free(ctx);
-
-    if (!inet_ntop(AF_INET, &addr.sin_addr, g_log_ctx.ip, sizeof(g_log_ctx.ip))) {
-        strncpy(g_log_ctx.ip, "unknown", sizeof(g_log_ctx.ip) - 1);
-        g_log_ctx.ip[sizeof(g_log_ctx.ip) - 1] = '\0';
+    SsConn *conn = arg;
+    while (ss_conn_service(conn) > 0) {
     }
-    g_log_ctx.port = ntohs(addr.sin_port);
-    g_log_ctx.username[0] = '\0';
-    g_log_ctx.cmd[0] = '\0';
-
-    log_event("INFO", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, 
-             "CONNECT", "Client connected");
-
-    handle_client(client_sock);
-    close(client_sock);
-
-    log_event("INFO", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, 
-             "DISCONNECT", "Client disconnected");
+    ss_conn_close(conn);
+    reactor_connection_closed();
     return NULL;
 }
@@ -0,0 +1,348 @@
+#include "ss_reactor.h"
+#include "ss_network.h"
+#include "ss_utils.h"
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+
+// Ready connections waiting for a worker. EPOLLONESHOT keeps a connection
+// disarmed from the moment it is queued until a worker rearms it, so it is
+// never queued twice and never serviced by two workers at once.
+typedef struct {
+    SsConn **conns;
+    int capacity;
+    int head;
+    int tail;
+    int count;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} SsWorkQueue;
+
+static SsWorkQueue g_work_queue;
+static int g_epoll_fd = -1;
+
+static pthread_mutex_t g_admit_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int g_active_conns = 0;
+static int g_max_conns = SS_DEFAULT_MAX_CONNS;
+
+// Worker accounting; blocked workers are parked in reactor_block_begin/end
+static pthread_mutex_t g_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool g_pool_enabled = false;
+static int g_pool_target = 0;
+static int g_pool_threads = 0;
+static int g_pool_blocked = 0;
+
+static bool work_queue_init(SsWorkQueue *queue, int capacity) {
+    queue->conns = malloc(sizeof(SsConn *) * (size_t)capacity);
+    queue->capacity = queue->conns ? capacity : 0;
+    queue->head = 0;
+    queue->tail = 0;
+    queue->count = 0;
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    return queue->conns != NULL;
+}
+
+static void work_queue_push(SsWorkQueue *queue, SsConn *conn) {
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == queue->capacity) {
+        pthread_cond_wait(&queue->not_full, &queue->mutex);
+    }
+    queue->conns[queue->tail] = conn;
+    queue->tail = (queue->tail + 1) % queue->capacity;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// Call with g_pool_mutex free; true if this worker is a spare no longer needed
+static bool retire_spare_worker(void) {
+    pthread_mutex_lock(&g_pool_mutex);
+    bool retire = g_pool_threads - g_pool_blocked > g_pool_target;
+    if (retire) {
+        g_pool_threads--;
+    }
+    pthread_mutex_unlock(&g_pool_mutex);
+    return retire;
+}
+
+// The next ready connection, or NULL when the calling worker should exit
+static SsConn *work_queue_pop(SsWorkQueue *queue) {
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == 0) {
+        if (retire_spare_worker()) {
+            pthread_mutex_unlock(&queue->mutex);
+            return NULL;
+        }
+        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+    }
+    SsConn *conn = queue->conns[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->mutex);
+    return conn;
+}
+
+static bool admit_connection(void) {
+    pthread_mutex_lock(&g_admit_mutex);
+    bool admitted = g_active_conns < g_max_conns;
+    if (admitted) {
+        g_active_conns++;
+    }
+    pthread_mutex_unlock(&g_admit_mutex);
+    return admitted;
+}
+
+void reactor_connection_closed(void) {
+    pthread_mutex_lock(&g_admit_mutex);
+    g_active_conns--;
+    pthread_mutex_unlock(&g_admit_mutex);
+}
+
+// Answer a client over the admission limit without reading its request.
+// Whatever it has sent already is drained first, so the close does not turn
+// into a reset that could discard the reply before the client reads it.
+static void refuse_busy(int fd, const struct sockaddr_in *addr) {
+    static const char reply[] = "{ \"status\":\"ERR\", \"reason\":\"BUSY\" }\n";
+    ssize_t w = send(fd, reply, sizeof(reply) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+    (void)w;
+    shutdown(fd, SHUT_WR);
+    char scratch[MAX_MSG];
+    while (recv(fd, scratch, sizeof(scratch), MSG_DONTWAIT) > 0) {
+    }
+    close(fd);
+
+    char ip[INET_ADDRSTRLEN] = "unknown";
+    inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+    log_event("ERROR", ip, ntohs(addr->sin_port), "", "BUSY", "Connection limit reached, client refused");
+}
+
+static void close_connection(SsConn *conn) {
+    // A paced STREAM may still hold a dup of the fd, which would keep the
+    // registration alive past close
+    epoll_ctl(g_epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    ss_conn_close(conn);
+    reactor_connection_closed();
+}
+
+static void rearm_connection(SsConn *conn) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = conn;
+    if (epoll_ctl(g_epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) < 0) {
+        close_connection(conn);
+    }
+}
+
+// The socket stays blocking: readiness means one read returns at once, and
+// replies are written in full from the worker as in threaded mode
+static void *reactor_worker(void *arg) {
+    (void)arg;
+    SsConn *conn;
+    while ((conn = work_queue_pop(&g_work_queue)) != NULL) {
+        if (ss_conn_service(conn) > 0) {
+            rearm_connection(conn);
+        } else {
+            close_connection(conn);
+        }
+    }
+    return NULL;
+}
+
+static bool start_worker(void) {
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, reactor_worker, NULL) != 0) {
+        return false;
+    }
+    pthread_detach(tid);
+    return true;
+}
+
+void reactor_block_begin(void) {
+    pthread_mutex_lock(&g_pool_mutex);
+    if (!g_pool_enabled) {
+        pthread_mutex_unlock(&g_pool_mutex);
+        return;
+    }
+    g_pool_blocked++;
+    bool spawn = g_pool_threads - g_pool_blocked < g_pool_target;
+    if (spawn) {
+        g_pool_threads++;
+    }
+    pthread_mutex_unlock(&g_pool_mutex);
+
+    if (spawn && !start_worker()) {
+        pthread_mutex_lock(&g_pool_mutex);
+        g_pool_threads--;
+        pthread_mutex_unlock(&g_pool_mutex);
+    }
+}
+
+void reactor_block_end(void) {
+    pthread_mutex_lock(&g_pool_mutex);
+    if (!g_pool_enabled) {
+        pthread_mutex_unlock(&g_pool_mutex);
+        return;
+    }
+    g_pool_blocked--;
+    pthread_mutex_unlock(&g_pool_mutex);
+
+    // Wake idle workers so a spare that is now surplus can exit
+    pthread_mutex_lock(&g_work_queue.mutex);
+    pthread_cond_broadcast(&g_work_queue.not_empty);
+    pthread_mutex_unlock(&g_work_queue.mutex);
+}
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void accept_pending(int server_sock) {
+    while (1) {
+        struct sockaddr_in addr;
+        socklen_t addr_size = sizeof(addr);
+        int client_sock = accept(server_sock, (struct sockaddr *)&addr, &addr_size);
+        if (client_sock < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("[SS] accept");
+            }
+            return;
+        }
+
+        if (!admit_connection()) {
+            refuse_busy(client_sock, &addr);
+            continue;
+        }
+
+        SsConn *conn = ss_conn_create(client_sock, &addr);
+        if (!conn) {
+            close(client_sock);
+            reactor_connection_closed();
+            continue;
+        }
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        ev.data.ptr = conn;
+        if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, client_sock, &ev) < 0) {
+            perror("[SS] epoll_ctl add");
+            ss_conn_close(conn);
+            reactor_connection_closed();
+        }
+    }
+}
+
+int run_threaded_server(int server_sock, int max_conns) {
+    g_max_conns = max_conns > 0 ? max_conns : SS_DEFAULT_MAX_CONNS;
+
+    while (1) {
+        struct sockaddr_in addr;
+        socklen_t addr_size = sizeof(addr);
+        int client_sock = accept(server_sock, (struct sockaddr *)&addr, &addr_size);
+        if (client_sock < 0) {
+            continue;
+        }
+
+        if (!admit_connection()) {
+            refuse_busy(client_sock, &addr);
+            continue;
+        }
+
+        SsConn *conn = ss_conn_create(client_sock, &addr);
+        if (!conn) {
+            close(client_sock);
+            reactor_connection_closed();
+            continue;
+        }
+
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, client_thread, conn) != 0) {
+            ss_conn_close(conn);
+            reactor_connection_closed();
+            continue;
+        }
+        pthread_detach(tid);
+    }
+
+    return 0;
+}
+
+int run_epoll_server(int server_sock, int worker_count, int max_conns) {
+    if (worker_count <= 0) {
+        worker_count = SS_DEFAULT_WORKERS;
+    }
+    g_max_conns = max_conns > 0 ? max_conns : SS_DEFAULT_MAX_CONNS;
+
+    g_epoll_fd = epoll_create1(0);
+    if (g_epoll_fd < 0) {
+        perror("[SS] epoll_create1");
+        return -1;
+    }
+
+    if (set_nonblocking(server_sock) < 0) {
+        perror("[SS] fcntl");
+        return -1;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, server_sock, &ev) < 0) {
+        perror("[SS] epoll_ctl");
+        return -1;
+    }
+
+    if (!work_queue_init(&g_work_queue, g_max_conns)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_pool_mutex);
+    g_pool_enabled = true;
+    g_pool_target = worker_count;
+    g_pool_threads = worker_count;
+    pthread_mutex_unlock(&g_pool_mutex);
+    for (int i = 0; i < worker_count; i++) {
+        if (!start_worker()) {
+            perror("[SS] worker creation");
+            return -1;
+        }
+    }
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "Event loop started with %d workers, at most %d clients",
+             worker_count, g_max_conns);
+    log_event("INFO", "0.0.0.0", CLIENT_PORT, "-", "START", log_msg);
+
+    struct epoll_event events[SS_MAX_EVENTS];
+    while (1) {
+        int n = epoll_wait(g_epoll_fd, events, SS_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("[SS] epoll_wait");
+            return -1;
+        }
+
+        for (int i = 0; i < n; i++) {
+            SsConn *conn = events[i].data.ptr;
+            if (!conn) {
+                accept_pending(server_sock);
+                continue;
+            }
+            work_queue_push(&g_work_queue, conn);
+        }
+    }
+
+    return 0;
+}
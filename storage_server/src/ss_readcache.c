@@ -0,0 +1,188 @@
+#include "ss_readcache.h"
+
+typedef struct ReadCacheEntry {
+    char filename[MAX_FILENAME];
+    unsigned long version;
+    ReadCachePayload *payload;
+    struct ReadCacheEntry *hash_next;
+    struct ReadCacheEntry *lru_prev;    // towards the most recently used
+    struct ReadCacheEntry *lru_next;
+} ReadCacheEntry;
+
+static ReadCacheEntry *g_buckets[READ_CACHE_BUCKETS];
+static ReadCacheEntry *g_lru_head = NULL;
+static ReadCacheEntry *g_lru_tail = NULL;
+static pthread_mutex_t g_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ReadCacheStats g_stats = {0, 0, 0, 0, 0, 0, 0};
+
+static unsigned int cache_hash(const char *filename) {
+    unsigned int hash = 5381;
+    for (const char *p = filename; *p; p++) {
+        hash = hash * 33 + (unsigned char)*p;
+    }
+    return hash % READ_CACHE_BUCKETS;
+}
+
+// Call with g_cache_mutex held; the payload itself lives until its last release
+static void drop_payload(ReadCachePayload *payload) {
+    if (--payload->refcount == 0) {
+        free(payload->data);
+        free(payload);
+    }
+}
+
+static void lru_unlink(ReadCacheEntry *entry) {
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        g_lru_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        g_lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+static void lru_push_front(ReadCacheEntry *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = g_lru_head;
+    if (g_lru_head) {
+        g_lru_head->lru_prev = entry;
+    } else {
+        g_lru_tail = entry;
+    }
+    g_lru_head = entry;
+}
+
+static ReadCacheEntry **find_link(const char *filename) {
+    ReadCacheEntry **link = &g_buckets[cache_hash(filename)];
+    while (*link && strcmp((*link)->filename, filename) != 0) {
+        link = &(*link)->hash_next;
+    }
+    return link;
+}
+
+static void remove_entry(ReadCacheEntry **link) {
+    ReadCacheEntry *entry = *link;
+    *link = entry->hash_next;
+    lru_unlink(entry);
+    g_stats.resident_bytes -= entry->payload->len;
+    g_stats.entries--;
+    drop_payload(entry->payload);
+    free(entry);
+}
+
+// Evict from the cold end until the cache fits its budget (mutex held)
+static void evict_to_capacity(void) {
+    while (g_lru_tail && g_stats.resident_bytes > g_stats.capacity_bytes) {
+        remove_entry(find_link(g_lru_tail->filename));
+        g_stats.evictions++;
+    }
+}
+
+void readcache_init(size_t capacity_bytes) {
+    readcache_set_capacity(capacity_bytes);
+}
+
+void readcache_set_capacity(size_t capacity_bytes) {
+    pthread_mutex_lock(&g_cache_mutex);
+    g_stats.capacity_bytes = capacity_bytes;
+    evict_to_capacity();
+    pthread_mutex_unlock(&g_cache_mutex);
+}
+
+bool readcache_accepts(size_t len) {
+    pthread_mutex_lock(&g_cache_mutex);
+    bool fits = len > 0 && len <= g_stats.capacity_bytes / READ_CACHE_MAX_SHARE;
+    pthread_mutex_unlock(&g_cache_mutex);
+    return fits;
+}
+
+ReadCachePayload *readcache_get(const FileView *view) {
+    ReadCachePayload *payload = NULL;
+    pthread_mutex_lock(&g_cache_mutex);
+    ReadCacheEntry **link = find_link(view->filename);
+    if (*link && (*link)->version == view->version) {
+        ReadCacheEntry *entry = *link;
+        lru_unlink(entry);
+        lru_push_front(entry);
+        payload = entry->payload;
+        payload->refcount++;
+        g_stats.hits++;
+    } else {
+        g_stats.misses++;
+    }
+    pthread_mutex_unlock(&g_cache_mutex);
+    return payload;
+}
+
+ReadCachePayload *readcache_put(const FileView *view, char *data, size_t len) {
+    ReadCachePayload *payload = malloc(sizeof(ReadCachePayload));
+    ReadCacheEntry *entry = calloc(1, sizeof(ReadCacheEntry));
+    if (!payload || !entry) {
+        free(payload);
+        free(entry);
+        free(data);
+        return NULL;
+    }
+    payload->data = data;
+    payload->len = len;
+    payload->refcount = 2;      // the cache's and the caller's
+    strncpy(entry->filename, view->filename, sizeof(entry->filename) - 1);
+    entry->version = view->version;
+    entry->payload = payload;
+
+    pthread_mutex_lock(&g_cache_mutex);
+    ReadCacheEntry **link = find_link(view->filename);
+    if (*link) {
+        // Keep whichever was built from the newer view
+        if ((*link)->version > view->version) {
+            pthread_mutex_unlock(&g_cache_mutex);
+            payload->refcount = 1;
+            free(entry);
+            return payload;
+        }
+        remove_entry(link);
+    }
+    if (len > g_stats.capacity_bytes / READ_CACHE_MAX_SHARE) {
+        pthread_mutex_unlock(&g_cache_mutex);
+        payload->refcount = 1;
+        free(entry);
+        return payload;
+    }
+    unsigned int index = cache_hash(view->filename);
+    entry->hash_next = g_buckets[index];
+    g_buckets[index] = entry;
+    lru_push_front(entry);
+    g_stats.resident_bytes += len;
+    g_stats.entries++;
+    evict_to_capacity();
+    pthread_mutex_unlock(&g_cache_mutex);
+    return payload;
+}
+
+void readcache_release(ReadCachePayload *payload) {
+    if (!payload) return;
+    pthread_mutex_lock(&g_cache_mutex);
+    drop_payload(payload);
+    pthread_mutex_unlock(&g_cache_mutex);
+}
+
+void readcache_invalidate(const char *filename) {
+    pthread_mutex_lock(&g_cache_mutex);
+    ReadCacheEntry **link = find_link(filename);
+    if (*link) {
+        remove_entry(link);
+        g_stats.invalidations++;
+    }
+    pthread_mutex_unlock(&g_cache_mutex);
+}
+
+void readcache_get_stats(ReadCacheStats *out) {
+    pthread_mutex_lock(&g_cache_mutex);
+    *out = g_stats;
+    pthread_mutex_unlock(&g_cache_mutex);
+}
@@ -0,0 +1,655 @@
+#include "ss_replication.h"
+#include "ss_document.h"
+#include "ss_durability.h"
+#include "ss_file_ops.h"
+#include "ss_handlers.h"
+#include "ss_reactor.h"
+#include "ss_session.h"
+#include "ss_stats.h"
+#include "ss_utils.h"
+#include "ss_versions.h"
+
+// One entry per file this server is primary or backup for
+typedef struct ReplicaEntry {
+    char filename[MAX_FILENAME];
+    char backup_ip[INET_ADDRSTRLEN];    // primary side; empty when none
+    int backup_port;
+    int last_seq;                       // primary side: last seq published
+    int applied_epoch;                  // backup side: state of our copy
+    int applied_seq;
+    struct ReplicaEntry *next;
+} ReplicaEntry;
+
+typedef struct ReplChange {
+    char filename[MAX_FILENAME];
+    char backup_ip[INET_ADDRSTRLEN];
+    int backup_port;
+    int seq;
+    char *delta;        // JSON members of a sentence delta; NULL ships content
+    char *content;      // file content after the change; NULL for deltas,
+                        // whose full form is read from disk if needed
+    size_t bytes;
+    bool waited;
+    bool done;
+    bool acked;
+    struct ReplChange *next;
+} ReplChange;
+
+typedef struct {
+    char ip[INET_ADDRSTRLEN];
+    int port;
+    int fd;
+    time_t retry_at;
+} ReplTarget;
+
+static ReplicaEntry *g_replicas[REPL_MAP_BUCKETS];
+static pthread_mutex_t g_map_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static ReplChange *g_queue_head = NULL;
+static ReplChange *g_queue_tail = NULL;
+static int g_pending_count = 0;
+static size_t g_pending_bytes = 0;
+static pthread_mutex_t g_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_space_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_done_cond = PTHREAD_COND_INITIALIZER;
+
+// Only touched by the sender thread
+static ReplTarget g_targets[REPL_MAX_TARGETS];
+static int g_target_count = 0;
+
+static int g_epoch = 0;
+static bool g_wait_for_ack = false;
+static int g_max_pending = REPL_MAX_PENDING;
+static bool g_running = false;
+
+static unsigned int replica_hash(const char *filename) {
+    unsigned int hash = 5381;
+    for (const char *p = filename; *p; p++) {
+        hash = hash * 33 + (unsigned char)*p;
+    }
+    return hash % REPL_MAP_BUCKETS;
+}
+
+// Call with g_map_mutex held
+static ReplicaEntry *find_entry(const char *filename, bool create) {
+    unsigned int index = replica_hash(filename);
+    for (ReplicaEntry *e = g_replicas[index]; e; e = e->next) {
+        if (strcmp(e->filename, filename) == 0) {
+            return e;
+        }
+    }
+    if (!create) return NULL;
+
+    ReplicaEntry *entry = calloc(1, sizeof(ReplicaEntry));
+    if (!entry) return NULL;
+    strncpy(entry->filename, filename, sizeof(entry->filename) - 1);
+    entry->next = g_replicas[index];
+    g_replicas[index] = entry;
+    return entry;
+}
+
+static void replica_map_path(char *path, size_t size) {
+    snprintf(path, size, "%s/replicas.tsv", BASE_DIR);
+}
+
+// Call with g_map_mutex held
+static void save_replica_map(void) {
+    char path[1100];
+    char tmp_path[sizeof(path) + sizeof(".tmp")];
+    replica_map_path(path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *f = fopen(tmp_path, "w");
+    if (!f) return;
+    for (int i = 0; i < REPL_MAP_BUCKETS; i++) {
+        for (ReplicaEntry *e = g_replicas[i]; e; e = e->next) {
+            if (e->backup_ip[0]) {
+                fprintf(f, "%s\t%s\t%d\n", e->filename, e->backup_ip, e->backup_port);
+            }
+        }
+    }
+    if (fclose(f) == 0) {
+        rename(tmp_path, path);
+    } else {
+        remove(tmp_path);
+    }
+}
+
+static void load_replica_map(void) {
+    char path[1100];
+    replica_map_path(path, sizeof(path));
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+
+    char line[MAX_FILENAME + INET_ADDRSTRLEN + 32];
+    while (fgets(line, sizeof(line), f)) {
+        char *ip = strchr(line, '\t');
+        char *port = ip ? strchr(ip + 1, '\t') : NULL;
+        if (!port) continue;
+        *ip++ = '\0';
+        *port++ = '\0';
+
+        ReplicaEntry *entry = find_entry(line, true);
+        if (entry) {
+            strncpy(entry->backup_ip, ip, sizeof(entry->backup_ip) - 1);
+            entry->backup_port = atoi(port);
+        }
+    }
+    fclose(f);
+}
+
+void replication_set_replica(const char *filename, const char *backup_ip, int backup_port) {
+    pthread_mutex_lock(&g_map_mutex);
+    ReplicaEntry *entry = find_entry(filename, true);
+    if (entry) {
+        strncpy(entry->backup_ip, backup_ip, sizeof(entry->backup_ip) - 1);
+        entry->backup_ip[sizeof(entry->backup_ip) - 1] = '\0';
+        entry->backup_port = backup_port;
+        save_replica_map();
+    }
+    pthread_mutex_unlock(&g_map_mutex);
+}
+
+void replication_forget(const char *filename) {
+    pthread_mutex_lock(&g_map_mutex);
+    ReplicaEntry **link = &g_replicas[replica_hash(filename)];
+    while (*link) {
+        if (strcmp((*link)->filename, filename) == 0) {
+            ReplicaEntry *dead = *link;
+            *link = dead->next;
+            bool had_backup = dead->backup_ip[0] != '\0';
+            free(dead);
+            if (had_backup) {
+                save_replica_map();
+            }
+            break;
+        }
+        link = &(*link)->next;
+    }
+    pthread_mutex_unlock(&g_map_mutex);
+}
+
+static bool has_replica(const char *filename) {
+    pthread_mutex_lock(&g_map_mutex);
+    ReplicaEntry *entry = find_entry(filename, false);
+    bool found = entry && entry->backup_ip[0];
+    pthread_mutex_unlock(&g_map_mutex);
+    return found;
+}
+
+static void free_change(ReplChange *change) {
+    free(change->delta);
+    free(change->content);
+    free(change);
+}
+
+// Stamp the change with its target and next seq. Called with g_queue_mutex
+// held so queue order always matches seq order.
+static bool assign_target(ReplChange *change) {
+    pthread_mutex_lock(&g_map_mutex);
+    ReplicaEntry *entry = find_entry(change->filename, false);
+    bool found = entry && entry->backup_ip[0];
+    if (found) {
+        strncpy(change->backup_ip, entry->backup_ip, sizeof(change->backup_ip) - 1);
+        change->backup_port = entry->backup_port;
+        change->seq = ++entry->last_seq;
+    }
+    pthread_mutex_unlock(&g_map_mutex);
+    return found;
+}
+
+// Queue the change and stamp its seq. Cheap enough to call under the
+// document lock, which keeps queue order equal to commit order; waiting for
+// queue space or for the backup happens in replication_wait.
+static ReplTicket publish(const char *filename, char *delta, const char *content) {
+    ReplTicket ticket = {false, NULL};
+    ReplChange *change = calloc(1, sizeof(ReplChange));
+    if (!change) {
+        free(delta);
+        return ticket;
+    }
+    strncpy(change->filename, filename, sizeof(change->filename) - 1);
+    change->delta = delta;
+    if (content) {
+        change->content = strdup(content);
+        if (!change->content) {
+            free_change(change);
+            return ticket;
+        }
+    }
+    change->bytes = (content ? strlen(content) : 0) + (delta ? strlen(delta) : 0);
+
+    pthread_mutex_lock(&g_queue_mutex);
+    if (!assign_target(change)) {
+        pthread_mutex_unlock(&g_queue_mutex);
+        free_change(change);
+        return ticket;
+    }
+
+    change->waited = g_wait_for_ack;
+    if (g_queue_tail) {
+        g_queue_tail->next = change;
+    } else {
+        g_queue_head = change;
+    }
+    g_queue_tail = change;
+    g_pending_count++;
+    g_pending_bytes += change->bytes;
+    pthread_cond_signal(&g_queue_cond);
+    pthread_mutex_unlock(&g_queue_mutex);
+
+    ticket.queued = true;
+    // the sender thread leaves a waited change for replication_wait to free
+    ticket.change = change->waited ? change : NULL;
+    return ticket;
+}
+
+ReplTicket replication_publish_delta(const char *filename, int base_count, int keep_prefix, int resume,
+                                     char **sentences, int sentence_count) {
+    ReplTicket none = {false, NULL};
+    if (!g_running || !filename || !has_replica(filename)) return none;
+
+    char *delta = NULL;
+    size_t delta_len = 0;
+    FILE *out = open_memstream(&delta, &delta_len);
+    if (!out) return none;
+    fprintf(out, "\"base_count\":%d,\"keep_prefix\":%d,\"resume\":%d,\"sentences\":[",
+            base_count, keep_prefix, resume);
+    for (int i = 0; i < sentence_count; i++) {
+        char *escaped = json_escape(sentences[i]);
+        fprintf(out, "%s\"%s\"", i > 0 ? "," : "", escaped ? escaped : "");
+        free(escaped);
+    }
+    fputc(']', out);
+    fclose(out);
+
+    return publish(filename, delta, NULL);
+}
+
+ReplTicket replication_publish_full(const char *filename, const char *content) {
+    ReplTicket none = {false, NULL};
+    if (!g_running || !filename || !content || !has_replica(filename)) return none;
+    return publish(filename, NULL, content);
+}
+
+// Called with g_queue_mutex held
+static bool backlog_over_limit(void) {
+    return g_pending_count > g_max_pending ||
+           (g_pending_count > 1 && g_pending_bytes > REPL_MAX_PENDING_BYTES);
+}
+
+void replication_wait(ReplTicket ticket) {
+    if (!ticket.queued) return;
+
+    pthread_mutex_lock(&g_queue_mutex);
+    // a wait parks this reactor worker, so let the pool cover for it
+    bool blocking = ticket.change != NULL || backlog_over_limit();
+    if (blocking) {
+        pthread_mutex_unlock(&g_queue_mutex);
+        reactor_block_begin();
+        pthread_mutex_lock(&g_queue_mutex);
+    }
+
+    // backpressure: hold the reply until the backlog is back within bounds
+    while (backlog_over_limit()) {
+        pthread_cond_wait(&g_space_cond, &g_queue_mutex);
+    }
+
+    ReplChange *change = ticket.change;
+    if (change) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += REPL_ACK_TIMEOUT_SECS;
+        while (!change->done) {
+            if (pthread_cond_timedwait(&g_done_cond, &g_queue_mutex, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+        if (change->done) {
+            if (!change->acked) {
+                log_event("ERROR", change->backup_ip, change->backup_port, "-", "REPLICATE",
+                          "Backup did not acknowledge change");
+            }
+            free_change(change);
+        } else {
+            // the sender thread frees it once shipped
+            change->waited = false;
+            log_event("ERROR", change->backup_ip, change->backup_port, "-", "REPLICATE",
+                      "Timed out waiting for backup ack");
+        }
+    }
+    pthread_mutex_unlock(&g_queue_mutex);
+
+    if (blocking) {
+        reactor_block_end();
+    }
+}
+
+static ReplTarget *get_target(const char *ip, int port) {
+    for (int i = 0; i < g_target_count; i++) {
+        if (g_targets[i].port == port && strcmp(g_targets[i].ip, ip) == 0) {
+            return &g_targets[i];
+        }
+    }
+
+    int slot = g_target_count;
+    if (slot == REPL_MAX_TARGETS) {
+        slot = 0;
+        if (g_targets[slot].fd >= 0) {
+            close(g_targets[slot].fd);
+        }
+    } else {
+        g_target_count++;
+    }
+    ReplTarget *target = &g_targets[slot];
+    strncpy(target->ip, ip, sizeof(target->ip) - 1);
+    target->ip[sizeof(target->ip) - 1] = '\0';
+    target->port = port;
+    target->fd = -1;
+    target->retry_at = 0;
+    return target;
+}
+
+static int connect_backup(const char *ip, int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+
+    struct timeval timeout;
+    timeout.tv_sec = REPL_ACK_TIMEOUT_SECS;
+    timeout.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) <= 0 ||
+        connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static int send_replicate(int sock, const ReplChange *change, bool as_delta, char *reply, size_t reply_size) {
+    char *msg = NULL;
+    size_t msg_len = 0;
+    FILE *out = open_memstream(&msg, &msg_len);
+    if (!out) return 0;
+
+    char *escaped_name = json_escape(change->filename);
+    fprintf(out, "{\"cmd\":\"REPLICATE\",\"filename\":\"%s\",\"epoch\":%d,\"seq\":%d,",
+            escaped_name ? escaped_name : "", g_epoch, change->seq);
+    free(escaped_name);
+    if (as_delta) {
+        fprintf(out, "\"mode\":\"delta\",%s}\n", change->delta);
+    } else {
+        // A delta's full form is whatever is on disk now; if that is already
+        // past this seq the backup catches up again on the next change.
+        char *loaded = change->content ? NULL : load_file(change->filename);
+        char *escaped = json_escape(change->content ? change->content : (loaded ? loaded : ""));
+        fprintf(out, "\"mode\":\"full\",\"content\":\"%s\"}\n", escaped ? escaped : "");
+        free(escaped);
+        free(loaded);
+    }
+    fclose(out);
+
+    size_t off = 0;
+    while (off < msg_len) {
+        ssize_t n = send(sock, msg + off, msg_len - off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        off += (size_t)n;
+    }
+    free(msg);
+    if (off < msg_len) return 0;
+
+    size_t len = 0;
+    while (len < reply_size - 1) {
+        ssize_t n = recv(sock, reply + len, reply_size - 1 - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        len += (size_t)n;
+        reply[len] = '\0';
+        if (strchr(reply, '\n')) return 1;
+    }
+    return 0;
+}
+
+static bool ship_change(const ReplChange *change) {
+    ReplTarget *target = get_target(change->backup_ip, change->backup_port);
+    if (target->fd < 0) {
+        if (time(NULL) < target->retry_at) return false;
+        target->fd = connect_backup(target->ip, target->port);
+        if (target->fd < 0) {
+            target->retry_at = time(NULL) + REPL_RETRY_SECS;
+            log_event("ERROR", target->ip, target->port, "-", "REPLICATE", "Backup unreachable");
+            return false;
+        }
+    }
+
+    char reply[256];
+    int sent = send_replicate(target->fd, change, change->delta != NULL, reply, sizeof(reply));
+    if (sent && change->delta && strstr(reply, "NEED_FULL")) {
+        sent = send_replicate(target->fd, change, false, reply, sizeof(reply));
+    }
+    if (!sent) {
+        close(target->fd);
+        target->fd = -1;
+        target->retry_at = time(NULL) + REPL_RETRY_SECS;
+        return false;
+    }
+    return strstr(reply, "\"status\":\"OK\"") != NULL;
+}
+
+static void *replication_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&g_queue_mutex);
+        while (!g_queue_head) {
+            pthread_cond_wait(&g_queue_cond, &g_queue_mutex);
+        }
+        ReplChange *change = g_queue_head;
+        g_queue_head = change->next;
+        if (!g_queue_head) {
+            g_queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&g_queue_mutex);
+
+        // A dropped change leaves a seq gap, so the backup asks for the full
+        // content on the next one and catches up.
+        bool acked = ship_change(change);
+
+        pthread_mutex_lock(&g_queue_mutex);
+        g_pending_count--;
+        g_pending_bytes -= change->bytes;
+        pthread_cond_broadcast(&g_space_cond);
+        if (change->waited) {
+            change->done = true;
+            change->acked = acked;
+            pthread_cond_broadcast(&g_done_cond);
+            pthread_mutex_unlock(&g_queue_mutex);
+        } else {
+            pthread_mutex_unlock(&g_queue_mutex);
+            free_change(change);
+        }
+    }
+    return NULL;
+}
+
+void replication_init(bool wait_for_ack, int max_pending) {
+    if (g_running) return;
+
+    g_wait_for_ack = wait_for_ack;
+    g_max_pending = max_pending > 0 ? max_pending : REPL_MAX_PENDING;
+    g_epoch = (int)(((unsigned int)time(NULL) ^ ((unsigned int)getpid() << 16)) & 0x7fffffff);
+    if (g_epoch == 0) {
+        g_epoch = 1;
+    }
+
+    pthread_mutex_lock(&g_map_mutex);
+    load_replica_map();
+    pthread_mutex_unlock(&g_map_mutex);
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, replication_thread, NULL) != 0) {
+        perror("[SS] replication thread");
+        return;
+    }
+    pthread_detach(tid);
+    g_running = true;
+}
+
+// Apply the primary's sentence splice to our copy of the document. Returns
+// 0 when our copy does not match the primary's base.
+static int apply_delta(const char *filename, const JsonMessage *request) {
+    int base_count = -1;
+    int keep_prefix = -1;
+    int resume = -1;
+    const JsonField *sentences = json_find(request, "sentences");
+    if (!json_field_int(request, "base_count", &base_count) ||
+        !json_field_int(request, "keep_prefix", &keep_prefix) ||
+        !json_field_int(request, "resume", &resume) || !sentences || sentences->type != JSON_ARRAY) {
+        return -1;
+    }
+
+    // No sentence can be longer than the array holding it
+    const char *cursor = sentences->value + 1;
+    size_t scratch_size = sentences->value_len + 1;
+    char *scratch = malloc(scratch_size);
+    char **added = NULL;
+    int added_count = 0;
+    int added_capacity = 0;
+    while (scratch && (cursor = json_array_next_string(cursor, scratch, scratch_size)) != NULL) {
+        if (added_count == added_capacity) {
+            added_capacity = added_capacity ? added_capacity * 2 : 8;
+            char **tmp = realloc(added, sizeof(char *) * (size_t)added_capacity);
+            if (!tmp) break;
+            added = tmp;
+        }
+        added[added_count] = strdup(scratch);
+        if (!added[added_count]) break;
+        added_count++;
+    }
+    free(scratch);
+
+    Document *doc = document_open(filename);
+    if (!doc || !document_lock(doc)) {
+        document_release(doc);
+        free_string_array(added, added_count);
+        return 0;
+    }
+
+    int result = 0;
+    if (doc->count == base_count && keep_prefix >= 0 && resume >= keep_prefix && resume <= doc->count) {
+        result = document_commit(doc, keep_prefix, resume, added, added_count) == 0 ? 1 : -1;
+        if (result > 0) {
+            FileStats stats;
+            document_stats(doc, &stats);
+            stats_store(filename, &stats);
+        }
+        free(added);
+    } else {
+        free_string_array(added, added_count);
+    }
+    document_unlock(doc);
+    document_release(doc);
+    return result;
+}
+
+static int apply_full(const char *filename, const JsonMessage *request) {
+    const JsonField *field = json_find(request, "content");
+    if (!field) return -1;
+    size_t size = field->value_len + 1;
+    char *content = malloc(size);
+    if (!content) return -1;
+    if (!json_field_string(request, "content", content, size)) {
+        free(content);
+        return -1;
+    }
+
+    int result = -1;
+    if (save_file_atomic(filename, content) == 0) {
+        // Deltas since the last full copy built our history; it no longer
+        // matches the primary's, so start again from this content
+        versions_forget(filename);
+        FileStats stats = {0, 0, 0};
+        stats_add_text(&stats, content);
+        stats_store(filename, &stats);
+        result = 1;
+    }
+    free(content);
+    return result;
+}
+
+void handle_replicate(int client, const JsonMessage *request) {
+    char filename[MAX_FILENAME];
+    char mode[16];
+    int epoch = 0;
+    int seq = 0;
+    if (!json_field_string(request, "filename", filename, sizeof(filename)) ||
+        !json_field_string(request, "mode", mode, sizeof(mode)) ||
+        !json_field_int(request, "epoch", &epoch) || !json_field_int(request, "seq", &seq)) {
+        send_error(client, "BAD_REQUEST");
+        return;
+    }
+
+    int applied_epoch = 0;
+    int applied_seq = 0;
+    pthread_mutex_lock(&g_map_mutex);
+    ReplicaEntry *entry = find_entry(filename, false);
+    if (entry) {
+        applied_epoch = entry->applied_epoch;
+        applied_seq = entry->applied_seq;
+    }
+    pthread_mutex_unlock(&g_map_mutex);
+
+    if (applied_epoch == epoch && seq <= applied_seq) {
+        send_ok_message(client, "STALE");
+        return;
+    }
+
+    int result;
+    if (strcmp(mode, "full") == 0) {
+        result = apply_full(filename, request);
+    } else if (applied_epoch != epoch || applied_seq != seq - 1) {
+        result = 0;
+    } else {
+        result = apply_delta(filename, request);
+    }
+
+    if (result == 0) {
+        send_error(client, "NEED_FULL");
+        return;
+    }
+    if (result < 0) {
+        send_error(client, "UNKNOWN");
+        return;
+    }
+
+    pthread_mutex_lock(&g_map_mutex);
+    entry = find_entry(filename, true);
+    if (entry) {
+        entry->applied_epoch = epoch;
+        entry->applied_seq = seq;
+    }
+    pthread_mutex_unlock(&g_map_mutex);
+    send_ok_message(client, NULL);
+}
+
+void handle_set_replica(int client, const JsonMessage *request) {
+    char filename[MAX_FILENAME];
+    char backup_ip[INET_ADDRSTRLEN];
+    int backup_port = 0;
+    if (!json_field_string(request, "filename", filename, sizeof(filename)) ||
+        !json_field_string(request, "backup_ip", backup_ip, sizeof(backup_ip)) ||
+        !json_field_int(request, "backup_port", &backup_port) || backup_port <= 0) {
+        send_error(client, "BAD_REQUEST");
+        return;
+    }
+
+    replication_set_replica(filename, backup_ip, backup_port);
+    send_ok_message(client, NULL);
+}
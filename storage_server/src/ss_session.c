@@ -1,24 +1,20 @@
 #include "ss_session.h"
-#include "ss_locking.h"
 
 void session_init(WriteSession *session, int owner_fd) {
     if (!session) return;
     memset(session, 0, sizeof(*session));
-    session->lock_slot = -1;
     session->owner_fd = owner_fd;
     session->original_sentence_index = -1;
 }
 
 void session_reset(WriteSession *session) {
     if (!session) return;
-    if (session->lock_slot >= 0) {
-        release_sentence_lock_slot(session->lock_slot);
-    }
-    free_string_array(session->words, session->word_count);
-    free_string_array(session->sentences, session->sentence_count);
-    free(session->original_content);
+    release_sentence_lock(session->lock);
+    free(session->words);
+    arena_reset(&session->arena);
+    free(session->baseline);
+    document_release(session->doc);
     memset(session, 0, sizeof(*session));
-    session->lock_slot = -1;
     session->owner_fd = -1;
     session->original_sentence_index = -1;
 }
@@ -31,26 +27,6 @@ void free_string_array(char **arr, int count) {
     free(arr);
 }
 
-static int append_sentence(char ***arr, int *count, int *capacity, const char *src) {
-    if (!arr || !count || !capacity) return 0;
-    if (*count >= *capacity) {
-        int new_capacity = (*capacity == 0) ? 4 : (*capacity * 2);
-        char **tmp = (char **)realloc(*arr, sizeof(char *) * new_capacity);
-        if (!tmp) {
-            return 0;
-        }
-        *arr = tmp;
-        *capacity = new_capacity;
-    }
-
-    (*arr)[*count] = strdup(src ? src : "");
-    if (!(*arr)[*count]) {
-        return 0;
-    }
-    (*count)++;
-    return 1;
-}
-
 int split_into_sentences(const char *content, char ***out_sentences, int *out_count) {
     if (!content || !out_sentences || !out_count) return 0;
 
@@ -127,9 +103,9 @@ static const char *skip_spaces(const char *p) {
     return p;
 }
 
-int split_sentence_into_words(const char *sentence, char ***out_words, int *out_count, 
-                               int *out_capacity, char *punctuation) {
-    if (!sentence || !out_words || !out_count || !out_capacity || !punctuation) return 0;
+int split_sentence_into_words(Arena *arena, const char *sentence, char ***out_words, int *out_count,
+                              int *out_capacity, char *punctuation) {
+    if (!arena || !sentence || !out_words || !out_count || !out_capacity || !punctuation) return 0;
 
     size_t len = strlen(sentence);
     char punct = 0;
@@ -140,50 +116,41 @@ int split_sentence_into_words(const char *sentence, char ***out_words, int *out_
         }
     }
 
-    char *copy = strdup(sentence);
-    if (!copy) return 0;
+    // The words and their terminators never exceed the sentence itself, so
+    // one reservation covers every copy below
+    if (!arena_reserve(arena, len + 1)) return 0;
 
     int capacity = 8;
     int count = 0;
     char **words = malloc(sizeof(char *) * capacity);
-    if (!words) {
-        free(copy);
-        return 0;
-    }
+    if (!words) return 0;
 
-    char *token = copy;
+    const char *token = sentence;
     while (*token) {
-        token = (char *)skip_spaces(token);
+        token = skip_spaces(token);
         if (!*token) break;
 
-        char *end = token;
+        const char *end = token;
         while (*end && !isspace((unsigned char)*end)) {
             end++;
         }
 
-        size_t wlen = (size_t)(end - token);
-        char *word = malloc(wlen + 1);
-        if (!word) {
-            free_string_array(words, count);
-            free(copy);
-            return 0;
-        }
-        memcpy(word, token, wlen);
-        word[wlen] = '\0';
-
         if (count == capacity) {
             capacity *= 2;
             char **tmp = realloc(words, sizeof(char *) * capacity);
             if (!tmp) {
-                free(word);
-                free_string_array(words, count);
-                free(copy);
+                free(words);
                 return 0;
             }
             words = tmp;
         }
 
-        words[count++] = word;
+        words[count] = arena_strndup(arena, token, (size_t)(end - token));
+        if (!words[count]) {
+            free(words);
+            return 0;
+        }
+        count++;
         token = end;
     }
 
@@ -196,7 +163,6 @@ int split_sentence_into_words(const char *sentence, char ***out_words, int *out_
         }
     }
 
-    free(copy);
     *out_words = words;
     *out_count = count;
     *out_capacity = capacity;
@@ -204,6 +170,7 @@ int split_sentence_into_words(const char *sentence, char ***out_words, int *out_
     return 1;
 }
 
+// Both joins write through a cursor, so each byte is copied once
 char *join_words(char **words, int word_count, char punctuation) {
     size_t total = 0;
     for (int i = 0; i < word_count; i++) {
@@ -231,17 +198,18 @@ char *join_words(char **words, int word_count, char punctuation) {
     char *sentence = malloc(total + 1);
     if (!sentence) return NULL;
 
-    sentence[0] = '\0';
+    char *cursor = sentence;
     for (int i = 0; i < word_count; i++) {
-        strcat(sentence, words[i]);
-        if (i != word_count - 1) strcat(sentence, " ");
+        size_t len = strlen(words[i]);
+        memcpy(cursor, words[i], len);
+        cursor += len;
+        if (i != word_count - 1) *cursor++ = ' ';
     }
 
     if (append_punct) {
-        size_t len = strlen(sentence);
-        sentence[len] = punctuation;
-        sentence[len + 1] = '\0';
+        *cursor++ = punctuation;
     }
+    *cursor = '\0';
 
     return sentence;
 }
@@ -254,11 +222,14 @@ char *join_sentences(char **sentences, int count) {
     }
     char *result = malloc(total + 1);
     if (!result) return NULL;
-    result[0] = '\0';
+    char *cursor = result;
     for (int i = 0; i < count; i++) {
-        strcat(result, sentences[i]);
-        if (i != count - 1) strcat(result, " ");
+        size_t len = strlen(sentences[i]);
+        memcpy(cursor, sentences[i], len);
+        cursor += len;
+        if (i != count - 1) *cursor++ = ' ';
     }
+    *cursor = '\0';
     return result;
 }
 
@@ -275,7 +246,6 @@ void refresh_trailing_punctuation(WriteSession *session) {
 
         size_t len = strlen(last);
         if (len == 0) {
-            free(last);
             session->words[session->word_count - 1] = NULL;
             session->word_count--;
             continue;
@@ -288,34 +258,3 @@ void refresh_trailing_punctuation(WriteSession *session) {
         break;
     }
 }
-
-int find_sentence_index_with_hint(char **sentences, int count, const char *target, int hint_index) {
-    if (!sentences || !target || *target == '\0') {
-        return -1;
-    }
-
-    if (hint_index >= 0 && hint_index < count && strcmp(sentences[hint_index], target) == 0) {
-        return hint_index;
-    }
-
-    if (hint_index < 0 || hint_index >= count) {
-        for (int i = 0; i < count; i++) {
-            if (strcmp(sentences[i], target) == 0) {
-                return i;
-            }
-        }
-        return -1;
-    }
-
-    for (int offset = 1; offset < count; offset++) {
-        int forward = hint_index + offset;
-        if (forward < count && strcmp(sentences[forward], target) == 0) {
-            return forward;
-        }
-        int backward = hint_index - offset;
-        if (backward >= 0 && strcmp(sentences[backward], target) == 0) {
-            return backward;
-        }
-    }
-    return -1;
-}
@@ -0,0 +1,145 @@
+#include "ss_stats.h"
+#include "ss_file_ops.h"
+#include "ss_fileview.h"
+
+typedef struct StatsEntry {
+    char filename[MAX_FILENAME];
+    FileStats stats;
+    struct timespec mtime;
+    off_t size;
+    struct StatsEntry *next;
+} StatsEntry;
+
+static StatsEntry *g_stats_buckets[STATS_CACHE_BUCKETS];
+static pthread_mutex_t g_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int stats_hash(const char *filename) {
+    unsigned int hash = 5381;
+    for (const char *p = filename; *p; p++) {
+        hash = hash * 33 + (unsigned char)*p;
+    }
+    return hash % STATS_CACHE_BUCKETS;
+}
+
+void stats_add_span(FileStats *stats, const char *text, size_t len) {
+    const char *end = text + len;
+    int in_word = 0;
+
+    for (const char *p = text; p < end; p++) {
+        if (isspace((unsigned char)*p)) {
+            if (in_word) {
+                stats->words++;
+                in_word = 0;
+            }
+        } else {
+            stats->chars++;
+            in_word = 1;
+        }
+    }
+    if (in_word) {
+        stats->words++;
+    }
+    stats->bytes += len;
+}
+
+void stats_add_text(FileStats *stats, const char *text) {
+    stats_add_span(stats, text, strlen(text));
+}
+
+void stats_add_separator(FileStats *stats) {
+    stats->bytes++;
+}
+
+static int stat_data_file(const char *filename, struct stat *st) {
+    char path[1024];
+    build_filepath(path, filename);
+    return stat(path, st) == 0;
+}
+
+int stats_lookup(const char *filename, FileStats *out) {
+    struct stat st;
+    if (!stat_data_file(filename, &st)) {
+        return 0;
+    }
+
+    int found = 0;
+    pthread_mutex_lock(&g_stats_mutex);
+    for (StatsEntry *e = g_stats_buckets[stats_hash(filename)]; e; e = e->next) {
+        if (strcmp(e->filename, filename) == 0) {
+            if (e->size == st.st_size && e->mtime.tv_sec == st.st_mtim.tv_sec &&
+                e->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+                *out = e->stats;
+                found = 1;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_stats_mutex);
+    return found;
+}
+
+void stats_store(const char *filename, const FileStats *stats) {
+    // A size mismatch means the file changed again after these counts were
+    // taken (e.g. a concurrent commit); leave it to the next lookup to rescan.
+    struct stat st;
+    if (!stat_data_file(filename, &st) || (size_t)st.st_size != stats->bytes) {
+        stats_forget(filename);
+        return;
+    }
+
+    unsigned int index = stats_hash(filename);
+    pthread_mutex_lock(&g_stats_mutex);
+    StatsEntry *entry = g_stats_buckets[index];
+    while (entry && strcmp(entry->filename, filename) != 0) {
+        entry = entry->next;
+    }
+    if (!entry) {
+        entry = malloc(sizeof(StatsEntry));
+        if (!entry) {
+            pthread_mutex_unlock(&g_stats_mutex);
+            return;
+        }
+        strncpy(entry->filename, filename, sizeof(entry->filename) - 1);
+        entry->filename[sizeof(entry->filename) - 1] = '\0';
+        entry->next = g_stats_buckets[index];
+        g_stats_buckets[index] = entry;
+    }
+    entry->stats = *stats;
+    entry->mtime = st.st_mtim;
+    entry->size = st.st_size;
+    pthread_mutex_unlock(&g_stats_mutex);
+}
+
+void stats_forget(const char *filename) {
+    pthread_mutex_lock(&g_stats_mutex);
+    StatsEntry **link = &g_stats_buckets[stats_hash(filename)];
+    while (*link) {
+        if (strcmp((*link)->filename, filename) == 0) {
+            StatsEntry *dead = *link;
+            *link = dead->next;
+            free(dead);
+            break;
+        }
+        link = &(*link)->next;
+    }
+    pthread_mutex_unlock(&g_stats_mutex);
+}
+
+int stats_for_file(const char *filename, FileStats *out) {
+    if (stats_lookup(filename, out)) {
+        return 1;
+    }
+
+    FileView *view = fileview_open(filename);
+    if (!view) {
+        return 0;
+    }
+
+    FileStats stats = {0, 0, 0};
+    stats_add_span(&stats, view->data, view->size);
+    fileview_release(view);
+
+    stats_store(filename, &stats);
+    *out = stats;
+    return 1;
+}
@@ -0,0 +1,326 @@
+#include "ss_stream.h"
+#include "ss_fileview.h"
+#include "ss_handlers.h"
+#include "ss_utils.h"
+
+#include <sys/uio.h>
+
+typedef struct {
+    const char *start;
+    size_t len;
+} StreamWord;
+
+typedef struct StreamJob {
+    int fd;                 // dup of the client socket, owned by the job
+    FileView *view;         // the words point into this shared mapping
+    StreamWord *words;      // the file's words followed by "STOP"
+    int word_count;
+    int next_word;
+    size_t partial;         // bytes of words[next_word] (and its NUL) already sent
+    int rate;
+    struct timespec started;
+    struct timespec due;
+    struct StreamJob *next;
+} StreamJob;
+
+static const char g_nul = '\0';
+static const char g_stop[] = "STOP";
+
+__thread bool g_stream_handoff;
+
+static StreamJob *g_jobs = NULL;
+static pthread_mutex_t g_stream_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_stream_cond = PTHREAD_COND_INITIALIZER;
+static bool g_stream_running = false;
+
+static void free_job(StreamJob *job) {
+    if (job->fd >= 0) {
+        // Requests the client sent after STREAM were never read; drain them
+        // so the close does not reset the connection before STOP arrives
+        shutdown(job->fd, SHUT_WR);
+        char scratch[MAX_MSG];
+        while (recv(job->fd, scratch, sizeof(scratch), MSG_DONTWAIT) > 0) {
+        }
+        close(job->fd);
+    }
+    free(job->words);
+    fileview_release(job->view);
+    free(job);
+}
+
+static int split_words(const char *content, size_t len, StreamWord **out) {
+    int capacity = 64;
+    int count = 0;
+    StreamWord *words = malloc(sizeof(StreamWord) * (size_t)capacity);
+    if (!words) return -1;
+
+    const char *p = content;
+    const char *end = content + len;
+    while (true) {
+        while (p < end && isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            StreamWord *tmp = realloc(words, sizeof(StreamWord) * (size_t)capacity);
+            if (!tmp) {
+                free(words);
+                return -1;
+            }
+            words = tmp;
+        }
+        if (p == end) break;
+
+        const char *start = p;
+        while (p < end && !isspace((unsigned char)*p)) {
+            p++;
+        }
+        words[count].start = start;
+        words[count].len = (size_t)(p - start);
+        count++;
+    }
+
+    // room was left above for the terminator
+    words[count].start = g_stop;
+    words[count].len = sizeof(g_stop) - 1;
+    *out = words;
+    return count + 1;
+}
+
+// Send words [next_word, upto) as word/NUL iovec pairs, STREAM_BATCH_WORDS per
+// call, resuming inside a word after a short write. Returns -1 when the client
+// is gone, otherwise 0 (possibly short if the socket filled up).
+static int send_words(StreamJob *job, int upto, int flags) {
+    struct iovec iov[STREAM_BATCH_WORDS * 2];
+    while (job->next_word < upto) {
+        int n_iov = 0;
+        size_t skip = job->partial;
+        for (int w = job->next_word; w < upto && n_iov + 2 <= STREAM_BATCH_WORDS * 2; w++) {
+            const StreamWord *word = &job->words[w];
+            if (skip < word->len) {
+                iov[n_iov].iov_base = (void *)(word->start + skip);
+                iov[n_iov].iov_len = word->len - skip;
+                n_iov++;
+                skip = 0;
+            } else {
+                skip -= word->len;
+            }
+            iov[n_iov].iov_base = (void *)&g_nul;
+            iov[n_iov].iov_len = 1;
+            n_iov++;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t)n_iov;
+        ssize_t sent = sendmsg(job->fd, &msg, flags | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+
+        // advance past whatever went out
+        size_t left = (size_t)sent + job->partial;
+        job->partial = 0;
+        while (job->next_word < upto && left >= job->words[job->next_word].len + 1) {
+            left -= job->words[job->next_word].len + 1;
+            job->next_word++;
+        }
+        job->partial = left;
+        if (sent == 0) return 0;
+    }
+    return 0;
+}
+
+static long elapsed_ms(const struct timespec *from, const struct timespec *to) {
+    return (long)(to->tv_sec - from->tv_sec) * 1000L + (to->tv_nsec - from->tv_nsec) / 1000000L;
+}
+
+static void add_ms(struct timespec *ts, long ms) {
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static bool before(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+// Send every word whose time has come and schedule the next one. Returns
+// false once the job is finished or its client went away.
+static bool pace_job(StreamJob *job, const struct timespec *now) {
+    long ms = elapsed_ms(&job->started, now);
+    long due_words = (long)((double)ms * job->rate / 1000.0) + 1;
+    int upto = due_words < job->word_count ? (int)due_words : job->word_count;
+
+    // the last word and STOP go out together
+    if (upto == job->word_count - 1) {
+        upto = job->word_count;
+    }
+
+    if (send_words(job, upto, MSG_DONTWAIT) < 0) return false;
+    if (job->next_word == job->word_count) return false;
+
+    job->due = *now;
+    if (job->next_word < upto) {
+        // socket full; the client is reading slower than the rate
+        add_ms(&job->due, STREAM_RETRY_MS);
+    } else {
+        long next_ms = (long)((double)job->next_word * 1000.0 / job->rate);
+        job->due = job->started;
+        add_ms(&job->due, next_ms);
+        struct timespec min_due = *now;
+        add_ms(&min_due, STREAM_MIN_TICK_MS);
+        if (before(&job->due, &min_due)) {
+            job->due = min_due;
+        }
+    }
+    return true;
+}
+
+static void *stream_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_stream_mutex);
+    while (1) {
+        if (!g_jobs) {
+            pthread_cond_wait(&g_stream_cond, &g_stream_mutex);
+            continue;
+        }
+
+        struct timespec wake = g_jobs->due;
+        for (StreamJob *job = g_jobs->next; job; job = job->next) {
+            if (before(&job->due, &wake)) {
+                wake = job->due;
+            }
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (before(&now, &wake)) {
+            // the condvar uses CLOCK_MONOTONIC, see stream_init
+            pthread_cond_timedwait(&g_stream_cond, &g_stream_mutex, &wake);
+            continue;
+        }
+
+        // Jobs are only added under the mutex, so the list can be walked
+        // with it released while sending.
+        StreamJob *due = NULL;
+        StreamJob **link = &g_jobs;
+        while (*link) {
+            StreamJob *job = *link;
+            if (!before(&now, &job->due)) {
+                *link = job->next;
+                job->next = due;
+                due = job;
+            } else {
+                link = &job->next;
+            }
+        }
+        pthread_mutex_unlock(&g_stream_mutex);
+
+        StreamJob *keep = NULL;
+        while (due) {
+            StreamJob *job = due;
+            due = job->next;
+            if (pace_job(job, &now)) {
+                job->next = keep;
+                keep = job;
+            } else {
+                free_job(job);
+            }
+        }
+
+        pthread_mutex_lock(&g_stream_mutex);
+        while (keep) {
+            StreamJob *job = keep;
+            keep = job->next;
+            job->next = g_jobs;
+            g_jobs = job;
+        }
+    }
+    return NULL;
+}
+
+void stream_init(void) {
+    if (g_stream_running) return;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_destroy(&g_stream_cond);
+    pthread_cond_init(&g_stream_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, stream_thread, NULL) != 0) {
+        perror("[SS] stream thread");
+        return;
+    }
+    pthread_detach(tid);
+    g_stream_running = true;
+}
+
+void handle_stream(int client, const char *filename, int rate) {
+    if (rate < 0 || rate > STREAM_MAX_RATE) {
+        send_error(client, "BAD_REQUEST");
+        return;
+    }
+
+    FileView *view = fileview_open(filename);
+    if (!view) {
+        send_error(client, "FILE_NOT_FOUND");
+        return;
+    }
+
+    StreamJob *job = calloc(1, sizeof(StreamJob));
+    if (!job) {
+        fileview_release(view);
+        send_error(client, "NO_MEMORY");
+        return;
+    }
+    job->fd = -1;
+    job->view = view;
+    job->rate = rate;
+    job->word_count = split_words(view->data, view->size, &job->words);
+    if (job->word_count < 0) {
+        free_job(job);
+        send_error(client, "NO_MEMORY");
+        return;
+    }
+
+    char log_msg[64];
+    snprintf(log_msg, sizeof(log_msg), "STREAM %d words at %d/s", job->word_count - 1, rate);
+    log_event("RESPONSE", g_log_ctx.ip, g_log_ctx.port, g_log_ctx.username, g_log_ctx.cmd, log_msg);
+
+    if (rate == 0 || !g_stream_running) {
+        job->fd = client;
+        send_words(job, job->word_count, 0);
+        job->fd = -1;
+        free_job(job);
+        return;
+    }
+
+    // The job writes through its own dup, and the connection loop closes
+    // the original once it sees g_stream_handoff, so the job is the only
+    // writer left on the socket.
+    job->fd = dup(client);
+    if (job->fd < 0) {
+        free_job(job);
+        send_error(client, "UNKNOWN");
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+    job->due = job->started;
+
+    pthread_mutex_lock(&g_stream_mutex);
+    job->next = g_jobs;
+    g_jobs = job;
+    pthread_cond_signal(&g_stream_cond);
+    pthread_mutex_unlock(&g_stream_mutex);
+    g_stream_handoff = true;
+}
@@ -3,6 +3,8 @@
 // Global variables
 char NM_IP[INET_ADDRSTRLEN] = "127.0.0.1";
 char ADVERTISE_IP[INET_ADDRSTRLEN] = "";
+char REGISTERED_IP[INET_ADDRSTRLEN] = "";
+ShardMap NM_SHARDS;
 int CLIENT_PORT = 9100;
 
 // Thread-local logging context
@@ -11,137 +13,6 @@ __thread ClientLogContext g_log_ctx;
 static FILE *g_log_file = NULL;
 static pthread_mutex_t g_log_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-static const char *skip_spaces(const char *p) {
-    while (p && *p && isspace((unsigned char)*p)) {
-        p++;
-    }
-    return p;
-}
-
-int json_get_string(const char *json, const char *key, char *out, size_t out_size) {
-    if (!json || !key || !out || out_size == 0) return 0;
-
-    char pattern[128];
-    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
-    const char *p = strstr(json, pattern);
-    if (!p) return 0;
-
-    p += strlen(pattern);
-    p = skip_spaces(p);
-    if (!p || *p != ':') return 0;
-    p++;
-    p = skip_spaces(p);
-    if (!p || *p != '"') return 0;
-    p++;
-
-    const char *start = p;
-    while (*p && *p != '"') {
-        if (*p == '\\' && *(p + 1)) {
-            p += 2;
-            continue;
-        }
-        p++;
-    }
-    if (*p != '"') return 0;
-
-    // Unescape the string properly
-    size_t idx = 0;
-    p = start;
-    while (*p && *p != '"' && idx < out_size - 1) {
-        if (*p == '\\' && *(p + 1)) {
-            p++;
-            switch (*p) {
-                case 'n':  out[idx++] = '\n'; break;
-                case 'r':  out[idx++] = '\r'; break;
-                case 't':  out[idx++] = '\t'; break;
-                case '\\': out[idx++] = '\\'; break;
-                case '"':  out[idx++] = '"'; break;
-                case '/':  out[idx++] = '/'; break;
-                default:   out[idx++] = *p; break;
-            }
-            p++;
-        } else {
-            out[idx++] = *p++;
-        }
-    }
-    out[idx] = '\0';
-    return 1;
-}
-
-int json_get_int(const char *json, const char *key, int *out) {
-    if (!json || !key || !out) return 0;
-
-    char pattern[128];
-    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
-    const char *p = strstr(json, pattern);
-    if (!p) return 0;
-
-    p += strlen(pattern);
-    p = skip_spaces(p);
-    if (!p || *p != ':') return 0;
-    p++;
-    p = skip_spaces(p);
-    if (!p) return 0;
-
-    char *endptr = NULL;
-    long val = strtol(p, &endptr, 10);
-    if (p == endptr) return 0;
-    *out = (int)val;
-    return 1;
-}
-
-char *json_escape(const char *src) {
-    if (!src) {
-        char *empty = malloc(1);
-        if (empty) empty[0] = '\0';
-        return empty;
-    }
-
-    size_t extra = 0;
-    for (const char *p = src; *p; p++) {
-        switch (*p) {
-            case '\\':
-            case '"':
-            case '\n':
-            case '\r':
-            case '\t':
-                extra++;
-                break;
-            default:
-                if ((unsigned char)*p < 0x20) {
-                    extra += 5;
-                }
-                break;
-        }
-    }
-
-    size_t len = strlen(src);
-    char *out = malloc(len + extra + 1);
-    if (!out) return NULL;
-
-    char *w = out;
-    for (const char *p = src; *p; p++) {
-        unsigned char ch = (unsigned char)*p;
-        switch (ch) {
-            case '\\': *w++ = '\\'; *w++ = '\\'; break;
-            case '"': *w++ = '\\'; *w++ = '"'; break;
-            case '\n': *w++ = '\\'; *w++ = 'n'; break;
-            case '\r': *w++ = '\\'; *w++ = 'r'; break;
-            case '\t': *w++ = '\\'; *w++ = 't'; break;
-            default:
-                if (ch < 0x20) {
-                    sprintf(w, "\\u%04x", ch);
-                    w += 6;
-                } else {
-                    *w++ = (char)ch;
-                }
-                break;
-        }
-    }
-    *w = '\0';
-    return out;
-}
-
 int is_loopback_address(const char *ip) {
     if (!ip || !*ip) return 1;
     return (strcmp(ip, "127.0.0.1") == 0 || strcmp(ip, "0.0.0.0") == 0);
@@ -0,0 +1,440 @@
+#include "ss_versions.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+
+#define VERSION_MAGIC 0x31565353u   // "SSV1"
+
+// On-disk record: this header, the payload, then the record's own start
+// offset so the newest header can be found from the end of the file. The
+// payload is the removed sentences, each a 32-bit length and its bytes. Host
+// byte order: the log never leaves this server.
+typedef struct {
+    uint32_t magic;
+    uint32_t full;          // removed covers the whole previous document
+    uint64_t version;       // version this commit produced
+    int64_t committed_at;
+    int32_t keep_prefix;
+    int32_t inserted;
+    int32_t removed;
+    int32_t after_count;
+    uint64_t after_bytes;   // sentence bytes after the commit, to spot outside edits
+    uint32_t records;       // records in the log up to and including this one
+    uint32_t since_full;
+    uint64_t payload_bytes;
+} VersionHeader;
+
+typedef struct {
+    VersionHeader header;
+    const char *payload;
+    off_t start;
+} VersionEntry;
+
+// Sentences being rebuilt by a restore; they point into the document or
+// the loaded log
+typedef struct {
+    const char **text;
+    size_t *len;
+    int count;
+    int capacity;
+} SpanList;
+
+static void build_version_path(char *dest, size_t size, const char *filename) {
+    snprintf(dest, size, "%s%s.vlog", SNAP_DIR, filename);
+}
+
+static int write_all_fd(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Returns 1 with the newest header, 0 for an empty log, -1 if the tail is damaged
+static int read_last_header(int fd, VersionHeader *out) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return -1;
+    if (st.st_size == 0) return 0;
+
+    uint64_t start = 0;
+    if ((size_t)st.st_size < sizeof(VersionHeader) + sizeof(start) ||
+        pread(fd, &start, sizeof(start), st.st_size - (off_t)sizeof(start)) != (ssize_t)sizeof(start) ||
+        start > (uint64_t)st.st_size ||
+        pread(fd, out, sizeof(*out), (off_t)start) != (ssize_t)sizeof(*out)) {
+        return -1;
+    }
+    if (out->magic != VERSION_MAGIC ||
+        start + sizeof(*out) + out->payload_bytes + sizeof(start) != (uint64_t)st.st_size) {
+        return -1;
+    }
+    return 1;
+}
+
+// Read the whole log and index its records; a damaged tail is ignored.
+// Returns the buffer the entries point into, or NULL if there is no log.
+static char *load_entries(const char *path, VersionEntry **out, int *out_count) {
+    *out = NULL;
+    *out_count = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    char *data = NULL;
+    size_t size = 0;
+    if (fstat(fd, &st) == 0 && (data = malloc((size_t)st.st_size + 1)) != NULL) {
+        while (size < (size_t)st.st_size) {
+            ssize_t n = read(fd, data + size, (size_t)st.st_size - size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            size += (size_t)n;
+        }
+    }
+    close(fd);
+    if (!data) return NULL;
+
+    int capacity = 0;
+    size_t off = 0;
+    while (off + sizeof(VersionHeader) + sizeof(uint64_t) <= size) {
+        VersionHeader header;
+        memcpy(&header, data + off, sizeof(header));
+        uint64_t start = 0;
+        size_t end = off + sizeof(header) + header.payload_bytes;
+        if (header.magic != VERSION_MAGIC || header.payload_bytes > size ||
+            end + sizeof(start) > size) {
+            break;
+        }
+        memcpy(&start, data + end, sizeof(start));
+        if (start != off) break;
+
+        if (*out_count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            VersionEntry *tmp = realloc(*out, sizeof(VersionEntry) * (size_t)capacity);
+            if (!tmp) break;
+            *out = tmp;
+        }
+        VersionEntry *entry = &(*out)[(*out_count)++];
+        entry->header = header;
+        entry->payload = data + off + sizeof(header);
+        entry->start = (off_t)off;
+        off = end + sizeof(start);
+    }
+    return data;
+}
+
+// Keep the newest half of the records; O(log), once per VERSION_MAX_RECORDS / 2 commits
+static void compact_log(const char *path) {
+    VersionEntry *entries = NULL;
+    int count = 0;
+    char *data = load_entries(path, &entries, &count);
+    if (!data) return;
+
+    char tmp_path[1100];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *out = fopen(tmp_path, "wb");
+    int first = count > VERSION_MAX_RECORDS / 2 ? count - VERSION_MAX_RECORDS / 2 : 0;
+    bool ok = out != NULL;
+    for (int i = first; ok && i < count; i++) {
+        VersionHeader header = entries[i].header;
+        header.records = (uint32_t)(i - first + 1);
+        uint64_t start = (uint64_t)ftell(out);
+        ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+             fwrite(entries[i].payload, 1, header.payload_bytes, out) == header.payload_bytes &&
+             fwrite(&start, sizeof(start), 1, out) == 1;
+    }
+    if (out && fclose(out) != 0) {
+        ok = false;
+    }
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+    }
+    free(entries);
+    free(data);
+}
+
+int versions_record(const Document *doc, int keep_prefix, int resume, char **sentences, int count,
+                    off_t *rollback) {
+    char path[1024];
+    build_version_path(path, sizeof(path), doc->filename);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+
+    VersionHeader last;
+    int found = read_last_header(fd, &last);
+    if (found > 0 && last.records >= VERSION_MAX_RECORDS) {
+        close(fd);
+        compact_log(path);
+        fd = open(path, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) return -1;
+        found = read_last_header(fd, &last);
+    }
+    if (found < 0) {
+        // Unreadable tail: start the history again rather than append to it
+        if (ftruncate(fd, 0) != 0) {
+            close(fd);
+            return -1;
+        }
+        found = 0;
+    }
+
+    size_t removed_bytes = 0;
+    for (int i = keep_prefix; i < resume; i++) {
+        removed_bytes += doc->sentences[i].len;
+    }
+    size_t inserted_bytes = 0;
+    for (int i = 0; i < count; i++) {
+        inserted_bytes += strlen(sentences[i]);
+    }
+
+    VersionHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = VERSION_MAGIC;
+    header.version = found ? last.version + 1 : 1;
+    header.committed_at = (int64_t)time(NULL);
+    header.after_count = doc->count - (resume - keep_prefix) + count;
+    header.after_bytes = doc->stats.bytes - removed_bytes + inserted_bytes;
+    header.records = found ? last.records + 1 : 1;
+    // A full record also resynchronizes the log after an edit it did not see
+    header.full = !found || last.since_full + 1 >= VERSION_FULL_INTERVAL ||
+                  last.after_count != doc->count || last.after_bytes != doc->stats.bytes;
+    if (header.full) {
+        keep_prefix = 0;
+        resume = doc->count;
+        count = header.after_count;
+    }
+    header.keep_prefix = keep_prefix;
+    header.inserted = count;
+    header.removed = resume - keep_prefix;
+    header.since_full = header.full ? 0 : last.since_full + 1;
+
+    for (int i = keep_prefix; i < resume; i++) {
+        header.payload_bytes += sizeof(uint32_t) + doc->sentences[i].len;
+    }
+
+    size_t total = sizeof(header) + header.payload_bytes + sizeof(uint64_t);
+    char *record = malloc(total);
+    if (!record) {
+        close(fd);
+        return -1;
+    }
+    off_t start = lseek(fd, 0, SEEK_END);
+    uint64_t trailer = (uint64_t)start;
+    char *cursor = record;
+    memcpy(cursor, &header, sizeof(header));
+    cursor += sizeof(header);
+    for (int i = keep_prefix; i < resume; i++) {
+        uint32_t len = (uint32_t)doc->sentences[i].len;
+        memcpy(cursor, &len, sizeof(len));
+        cursor += sizeof(len);
+        memcpy(cursor, doc->sentences[i].text, len);
+        cursor += len;
+    }
+    memcpy(cursor, &trailer, sizeof(trailer));
+
+    int rc = start < 0 ? -1 : write_all_fd(fd, record, total);
+    if (rc != 0 && start >= 0 && ftruncate(fd, start) != 0) {
+        rc = -1;
+    }
+    free(record);
+    close(fd);
+    *rollback = start;
+    return rc;
+}
+
+void versions_rollback(const char *filename, off_t rollback) {
+    char path[1024];
+    build_version_path(path, sizeof(path), filename);
+    if (rollback >= 0 && truncate(path, rollback) != 0) {
+        remove(path);
+    }
+}
+
+void versions_forget(const char *filename) {
+    char path[1024];
+    build_version_path(path, sizeof(path), filename);
+    remove(path);
+}
+
+static bool spans_reserve(SpanList *list, int needed) {
+    if (needed <= list->capacity) return true;
+    int capacity = list->capacity ? list->capacity : 64;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    const char **text = realloc(list->text, sizeof(char *) * (size_t)capacity);
+    if (!text) return false;
+    list->text = text;
+    size_t *len = realloc(list->len, sizeof(size_t) * (size_t)capacity);
+    if (!len) return false;
+    list->len = len;
+    list->capacity = capacity;
+    return true;
+}
+
+// Turn the text after a record's commit back into the text before it
+static bool undo_record(SpanList *work, const VersionEntry *entry) {
+    const VersionHeader *h = &entry->header;
+    if (work->count != h->after_count || h->keep_prefix < 0 || h->inserted < 0 || h->removed < 0 ||
+        h->keep_prefix + h->inserted > work->count) {
+        return false;
+    }
+
+    int new_count = work->count - h->inserted + h->removed;
+    if (!spans_reserve(work, new_count)) return false;
+    int tail = work->count - (h->keep_prefix + h->inserted);
+    memmove(&work->text[h->keep_prefix + h->removed], &work->text[h->keep_prefix + h->inserted],
+            sizeof(char *) * (size_t)tail);
+    memmove(&work->len[h->keep_prefix + h->removed], &work->len[h->keep_prefix + h->inserted],
+            sizeof(size_t) * (size_t)tail);
+
+    const char *p = entry->payload;
+    const char *end = entry->payload + h->payload_bytes;
+    for (int i = 0; i < h->removed; i++) {
+        uint32_t len = 0;
+        if ((size_t)(end - p) < sizeof(len)) return false;
+        memcpy(&len, p, sizeof(len));
+        p += sizeof(len);
+        if ((size_t)(end - p) < len) return false;
+        work->text[h->keep_prefix + i] = p;
+        work->len[h->keep_prefix + i] = len;
+        p += len;
+    }
+    work->count = new_count;
+    return true;
+}
+
+static char *join_spans(const SpanList *work) {
+    size_t total = 1;
+    for (int i = 0; i < work->count; i++) {
+        total += work->len[i] + 1;
+    }
+    char *content = malloc(total);
+    if (!content) return NULL;
+    char *cursor = content;
+    for (int i = 0; i < work->count; i++) {
+        if (i > 0) *cursor++ = ' ';
+        memcpy(cursor, work->text[i], work->len[i]);
+        cursor += work->len[i];
+    }
+    *cursor = '\0';
+    return content;
+}
+
+// Rebuild the text of version target, walking back from the current text
+// when it is what the newest record produced, or else from the nearest full
+// record above the target
+static const char *rebuild_version(const Document *doc, const VersionEntry *entries, int count,
+                                   long target, SpanList *work, int *first_dropped) {
+    const VersionHeader *head = &entries[count - 1].header;
+    int next = -1;
+    if (doc->count == head->after_count && doc->stats.bytes == head->after_bytes) {
+        if (!spans_reserve(work, doc->count)) return "UNKNOWN";
+        for (int i = 0; i < doc->count; i++) {
+            work->text[i] = doc->sentences[i].text;
+            work->len[i] = doc->sentences[i].len;
+        }
+        work->count = doc->count;
+        next = count - 1;
+    } else {
+        int k = 0;
+        while (k < count && !(entries[k].header.full && (long)entries[k].header.version > target)) {
+            k++;
+        }
+        if (k == count) return "HISTORY_STALE";
+        // A full record's removed span is the whole previous document
+        work->count = entries[k].header.after_count;
+        if (!spans_reserve(work, work->count)) return "UNKNOWN";
+        if (!undo_record(work, &entries[k])) return "HISTORY_STALE";
+        next = k - 1;
+    }
+
+    while (next >= 0 && (long)entries[next].header.version > target) {
+        if (!undo_record(work, &entries[next])) return "HISTORY_STALE";
+        next--;
+    }
+    *first_dropped = next + 1;
+    return NULL;
+}
+
+const char *versions_restore(Document *doc, int steps, long target, unsigned long *restored,
+                             char **content) {
+    char path[1024];
+    build_version_path(path, sizeof(path), doc->filename);
+    VersionEntry *entries = NULL;
+    int count = 0;
+    char *data = load_entries(path, &entries, &count);
+    if (!data || count == 0) {
+        free(entries);
+        free(data);
+        return "NO_SNAPSHOT";
+    }
+
+    long newest = (long)entries[count - 1].header.version;
+    long oldest = (long)entries[0].header.version - 1;
+    if (target < 0) {
+        target = newest - steps;
+    }
+    const char *error = NULL;
+    if (steps < 1 || target < oldest || target >= newest) {
+        error = "INVALID_VERSION";
+    }
+
+    SpanList work = {NULL, NULL, 0, 0};
+    int first_dropped = count;
+    if (!error) {
+        error = rebuild_version(doc, entries, count, target, &work, &first_dropped);
+    }
+    char *text = error ? NULL : join_spans(&work);
+    if (!error && !text) {
+        error = "UNKNOWN";
+    }
+    // The spans may point into the document, so they are joined before it reloads
+    if (!error && document_replace(doc, text) != 0) {
+        error = "UNKNOWN";
+    }
+    if (!error && truncate(path, entries[first_dropped].start) != 0) {
+        remove(path);
+    }
+
+    if (error) {
+        free(text);
+    } else {
+        *restored = (unsigned long)target;
+        *content = text;
+    }
+    free(work.text);
+    free(work.len);
+    free(entries);
+    free(data);
+    return error;
+}
+
+char *versions_list_json(const char *filename) {
+    char path[1024];
+    build_version_path(path, sizeof(path), filename);
+    VersionEntry *entries = NULL;
+    int count = 0;
+    char *data = load_entries(path, &entries, &count);
+
+    char *json = NULL;
+    size_t json_len = 0;
+    FILE *out = open_memstream(&json, &json_len);
+    if (out) {
+        fputc('[', out);
+        int oldest = count > VERSION_LIST_MAX ? count - VERSION_LIST_MAX : 0;
+        for (int i = count - 1; i >= oldest; i--) {
+            fprintf(out, "%s{\"version\":%llu,\"time\":%lld,\"full\":%s}", i < count - 1 ? "," : "",
+                    (unsigned long long)entries[i].header.version,
+                    (long long)entries[i].header.committed_at,
+                    entries[i].header.full ? "true" : "false");
+        }
+        fputc(']', out);
+        fclose(out);
+    }
+    free(entries);
+    free(data);
+    return json;
+}
@@ -1,7 +1,12 @@
 #include "ss_handlers.h"
+#include "ss_control.h"
+#include "ss_durability.h"
 #include "ss_file_ops.h"
 #include "ss_locking.h"
+#include "ss_reactor.h"
+#include "ss_replication.h"
 #include "ss_session.h"
+#include "ss_stats.h"
 #include "ss_utils.h"
 
 extern __thread ClientLogContext g_log_ctx;
@@ -26,7 +31,59 @@ static int append_sentence(char ***arr, int *count, int *capacity, const char *s
     return 1;
 }
 
-void handle_write_begin(int client, const char *filename, int sentence_index, 
+// Validate the WRITE target and copy out only that sentence (doc locked).
+// Returns the error reason, or NULL with *baseline set.
+static const char *copy_target_sentence(Document *doc, int sentence_index, bool *append_mode,
+                                        char **baseline) {
+    int sentence_count = doc->count;
+    *append_mode = false;
+
+    if (sentence_index == sentence_count) {
+        if (sentence_count > 0) {
+            const DocSentence *prev = document_sentence(doc, sentence_count - 1);
+            if (prev->len == 0 || (prev->text[prev->len - 1] != '.' && prev->text[prev->len - 1] != '!' &&
+                prev->text[prev->len - 1] != '?')) {
+                return "INVALID_INDEX";
+            }
+        }
+        *append_mode = true;
+    } else if (sentence_index > sentence_count) {
+        return "INVALID_INDEX";
+    }
+
+    if (*append_mode) {
+        *baseline = strdup("");
+    } else {
+        const DocSentence *target = document_sentence(doc, sentence_index);
+        *baseline = strndup(target->text, target->len);
+    }
+    return *baseline ? NULL : "UNKNOWN";
+}
+
+typedef struct {
+    int client;
+    bool waited;
+} LockWaitContext;
+
+static void report_queue_position(int position, void *arg) {
+    LockWaitContext *ctx = arg;
+    ctx->waited = true;
+    reactor_block_begin();
+    char response[64];
+    snprintf(response, sizeof(response), "{\"status\":\"WAIT\",\"position\":%d}", position);
+    if (g_binary_replies) {
+        char frame[16];
+        WireWriter w;
+        wire_writer_init(&w, frame, sizeof(frame));
+        wire_put_u8(&w, WIRE_WAIT);
+        wire_put_u32(&w, (uint32_t)position);
+        send_frame(ctx->client, &w, response);
+        return;
+    }
+    send_json(ctx->client, response);
+}
+
+void handle_write_begin(int client, const char *filename, int sentence_index, int wait_ms,
                         WriteSession *session, const char *username) {
     if (!session) {
         send_error(client, "UNKNOWN");
@@ -43,95 +100,70 @@ void handle_write_begin(int client, const char *filename, int sentence_index,
         return;
     }
 
-    char *content = load_file(filename);
-    if (!content) {
+    Document *doc = document_open(filename);
+    if (!doc || !document_lock(doc)) {
+        document_release(doc);
         send_error(client, "FILE_NOT_FOUND");
         return;
     }
 
-    char **sentences = NULL;
-    int sentence_count = 0;
-    if (!split_into_sentences(content, &sentences, &sentence_count)) {
-        free(content);
-        send_error(client, "INVALID_INDEX");
+    int requested_index = sentence_index;
+    bool append_mode = false;
+    char *baseline = NULL;
+    const char *error = copy_target_sentence(doc, sentence_index, &append_mode, &baseline);
+    document_unlock(doc);
+    if (error) {
+        document_release(doc);
+        send_error(client, error);
         return;
     }
 
-    int requested_index = sentence_index;
-    bool append_mode = false;
+    if (wait_ms > LOCK_WAIT_MAX_MS) {
+        wait_ms = LOCK_WAIT_MAX_MS;
+    }
+    LockWaitContext wait_ctx = {client, false};
+    SentenceLock *lock = acquire_sentence_lock_wait(filename, sentence_index, client, wait_ms,
+                                                    report_queue_position, &wait_ctx);
+    if (wait_ctx.waited) {
+        reactor_block_end();
+    }
+    if (!lock) {
+        free(baseline);
+        document_release(doc);
+        send_error(client, wait_ctx.waited ? "LOCK_TIMEOUT" : "SENTENCE LOCKED");
+        return;
+    }
 
-    if (sentence_count == 0 && sentence_index == 0) {
-        append_mode = true;
-        char **tmp = (char **)realloc(sentences, sizeof(char *) * 1);
-        if (!tmp) {
-            free_string_array(sentences, sentence_count);
-            free(content);
-            send_error(client, "UNKNOWN");
-            return;
-        }
-        sentences = tmp;
-        sentences[0] = strdup("");
-        if (!sentences[0]) {
-            free_string_array(sentences, sentence_count);
-            free(content);
-            send_error(client, "UNKNOWN");
-            return;
-        }
-        sentence_count = 1;
-    } else if (sentence_index == sentence_count) {
-        if (sentence_count > 0) {
-            const char *prev_sentence = sentences[sentence_count - 1];
-            size_t len = strlen(prev_sentence);
-            if (len == 0 || (prev_sentence[len - 1] != '.' && prev_sentence[len - 1] != '!' && 
-                prev_sentence[len - 1] != '?')) {
-                free_string_array(sentences, sentence_count);
-                free(content);
-                send_error(client, "INVALID_INDEX");
-                return;
-            }
-        }
-        
-        append_mode = true;
-        char **tmp = (char **)realloc(sentences, sizeof(char *) * (sentence_count + 1));
-        if (!tmp) {
-            free_string_array(sentences, sentence_count);
-            free(content);
-            send_error(client, "UNKNOWN");
-            return;
+    // The previous holder may have committed while we queued
+    if (wait_ctx.waited) {
+        free(baseline);
+        baseline = NULL;
+        if (document_lock(doc)) {
+            error = copy_target_sentence(doc, sentence_index, &append_mode, &baseline);
+            document_unlock(doc);
+        } else {
+            error = "FILE_NOT_FOUND";
         }
-        sentences = tmp;
-        sentences[sentence_count] = strdup("");
-        if (!sentences[sentence_count]) {
-            free_string_array(sentences, sentence_count);
-            free(content);
-            send_error(client, "UNKNOWN");
+        if (error) {
+            release_sentence_lock(lock);
+            document_release(doc);
+            send_error(client, error);
             return;
         }
-        sentence_count++;
-    } else if (sentence_index > sentence_count || sentence_index >= sentence_count) {
-        free_string_array(sentences, sentence_count);
-        free(content);
-        send_error(client, "INVALID_INDEX");
-        return;
-    }
-
-    int slot = acquire_sentence_lock(filename, sentence_index, client);
-    if (slot < 0) {
-        free_string_array(sentences, sentence_count);
-        free(content);
-        send_error(client, "SENTENCE LOCKED");
-        return;
     }
 
     char **words = NULL;
     int word_count = 0;
     int word_capacity = 0;
     char punctuation = 0;
-    if (!split_sentence_into_words(sentences[sentence_index], &words, &word_count, 
-                                    &word_capacity, &punctuation)) {
-        release_sentence_lock_slot(slot);
-        free_string_array(sentences, sentence_count);
-        free(content);
+    Arena arena;
+    arena_init(&arena);
+    if (!split_sentence_into_words(&arena, baseline, &words, &word_count,
+                                   &word_capacity, &punctuation)) {
+        arena_reset(&arena);
+        release_sentence_lock(lock);
+        free(baseline);
+        document_release(doc);
         send_error(client, "UNKNOWN");
         return;
     }
@@ -139,19 +171,19 @@ void handle_write_begin(int client, const char *filename, int sentence_index,
     session_reset(session);
     session->active = true;
     session->owner_fd = client;
-    session->lock_slot = slot;
+    session->lock = lock;
     strncpy(session->filename, filename, sizeof(session->filename) - 1);
     session->filename[sizeof(session->filename) - 1] = '\0';
     session->sentence_index = sentence_index;
     session->original_sentence_index = requested_index;
     session->append_mode = append_mode;
-    session->sentences = sentences;
-    session->sentence_count = sentence_count;
+    session->doc = doc;
+    session->baseline = baseline;
+    session->arena = arena;
     session->words = words;
     session->word_count = word_count;
     session->word_capacity = word_capacity;
     session->trailing_punct = punctuation;
-    session->original_content = content;
     session->dirty = false;
     if (username) {
         strncpy(session->username, username, sizeof(session->username) - 1);
@@ -182,8 +214,8 @@ void handle_update(int client, int word_index, const char *content,
     int new_word_capacity = 0;
     char content_punct = 0;
     
-    if (!split_sentence_into_words(content, &new_words, &new_word_count, 
-                                    &new_word_capacity, &content_punct)) {
+    if (!split_sentence_into_words(&session->arena, content, &new_words, &new_word_count,
+                                   &new_word_capacity, &content_punct)) {
         send_error(client, "UNKNOWN");
         return;
     }
@@ -193,27 +225,20 @@ void handle_update(int client, int word_index, const char *content,
     if (content_punct != 0 && new_word_count > 0) {
         // Put punctuation back on the last new word
         // It will be stripped later by refresh_trailing_punctuation if it becomes the last word
+        // The word was copied with its punctuation, so it fits in place
         char *last_word = new_words[new_word_count - 1];
-        size_t len = strlen(last_word);
-        char *with_punct = malloc(len + 2);
-        if (with_punct) {
-            strcpy(with_punct, last_word);
-            with_punct[len] = content_punct;
-            with_punct[len + 1] = '\0';
-            free(new_words[new_word_count - 1]);
-            new_words[new_word_count - 1] = with_punct;
-        }
+        last_word[strlen(last_word)] = content_punct;
     }
     
     if (new_word_count == 0 && !replace_word) {
-        free_string_array(new_words, new_word_count);
+        free(new_words);
         send_error(client, "BAD_REQUEST");
         return;
     }
 
     if (replace_word) {
         if (word_index >= session->word_count) {
-            free_string_array(new_words, new_word_count);
+            free(new_words);
             send_error(client, "INVALID_INDEX");
             return;
         }
@@ -228,7 +253,7 @@ void handle_update(int client, int word_index, const char *content,
             }
             char **tmp = realloc(session->words, sizeof(char *) * new_capacity);
             if (!tmp) {
-                free_string_array(new_words, new_word_count);
+                free(new_words);
                 send_error(client, "UNKNOWN");
                 return;
             }
@@ -236,8 +261,6 @@ void handle_update(int client, int word_index, const char *content,
             session->word_capacity = new_capacity;
         }
         
-        free(session->words[word_index]);
-        
         if (new_word_count == 1) {
             session->words[word_index] = new_words[0];
             free(new_words);
@@ -260,7 +283,7 @@ void handle_update(int client, int word_index, const char *content,
         }
     } else {
         if (word_index > session->word_count) {
-            free_string_array(new_words, new_word_count);
+            free(new_words);
             send_error(client, "INVALID_INDEX");
             return;
         }
@@ -275,7 +298,7 @@ void handle_update(int client, int word_index, const char *content,
             }
             char **tmp = realloc(session->words, sizeof(char *) * new_capacity);
             if (!tmp) {
-                free_string_array(new_words, new_word_count);
+                free(new_words);
                 send_error(client, "UNKNOWN");
                 return;
             }
@@ -335,38 +358,21 @@ void handle_commit(int client, WriteSession *session) {
     }
     free(updated_text);
 
-    char *latest_content = load_file(session->filename);
-    if (!latest_content) {
+    Document *doc = session->doc;
+    if (!document_lock(doc)) {
         free_string_array(replacement, replacement_count);
         send_error(client, "FILE_NOT_FOUND");
         session_reset(session);
         return;
     }
-
-    char **current_sentences = NULL;
-    int current_count = 0;
-    if (!split_into_sentences(latest_content, &current_sentences, &current_count)) {
-        free(latest_content);
-        free_string_array(replacement, replacement_count);
-        send_error(client, "UNKNOWN");
-        session_reset(session);
-        return;
-    }
-    free(latest_content);
+    int current_count = doc->count;
 
     int target_index = -1;
     if (session->append_mode) {
         target_index = current_count;
     } else {
-        const char *baseline = NULL;
-        if (session->sentences && session->original_sentence_index >= 0 &&
-            session->original_sentence_index < session->sentence_count) {
-            baseline = session->sentences[session->original_sentence_index];
-        }
-
-        if (baseline && *baseline) {
-            target_index = find_sentence_index_with_hint(current_sentences, current_count, 
-                                                         baseline, session->original_sentence_index);
+        if (session->baseline && *session->baseline) {
+            target_index = document_find_sentence(doc, session->baseline, session->original_sentence_index);
         }
 
         if (target_index < 0) {
@@ -380,85 +386,35 @@ void handle_commit(int client, WriteSession *session) {
         }
     }
 
-    int merged_capacity = current_count + replacement_count + 4;
-    char **merged = (char **)malloc(sizeof(char *) * merged_capacity);
-    if (!merged) {
-        free_string_array(current_sentences, current_count);
-        free_string_array(replacement, replacement_count);
-        send_error(client, "UNKNOWN");
-        session_reset(session);
-        return;
-    }
-    int merged_count = 0;
-
     int copy_limit = (target_index < current_count) ? target_index : current_count;
-    for (int i = 0; i < copy_limit; i++) {
-        if (!append_sentence(&merged, &merged_count, &merged_capacity, current_sentences[i])) {
-            free_string_array(current_sentences, current_count);
-            free_string_array(replacement, replacement_count);
-            free_string_array(merged, merged_count);
-            send_error(client, "UNKNOWN");
-            session_reset(session);
-            return;
-        }
-    }
-
-    for (int i = 0; i < replacement_count; i++) {
-        if (!append_sentence(&merged, &merged_count, &merged_capacity, replacement[i])) {
-            free_string_array(current_sentences, current_count);
-            free_string_array(replacement, replacement_count);
-            free_string_array(merged, merged_count);
-            send_error(client, "UNKNOWN");
-            session_reset(session);
-            return;
-        }
-    }
-
     int start_index = current_count;
     if (!session->append_mode) {
         if (target_index < current_count) {
             start_index = target_index + 1;
         }
     }
-    for (int i = start_index; i < current_count; i++) {
-        if (!append_sentence(&merged, &merged_count, &merged_capacity, current_sentences[i])) {
-            free_string_array(current_sentences, current_count);
-            free_string_array(replacement, replacement_count);
-            free_string_array(merged, merged_count);
-            send_error(client, "UNKNOWN");
-            session_reset(session);
-            return;
-        }
-    }
 
-    char *new_content = join_sentences(merged, merged_count);
-    if (!new_content) {
-        free_string_array(current_sentences, current_count);
-        free_string_array(replacement, replacement_count);
-        free_string_array(merged, merged_count);
-        send_error(client, "UNKNOWN");
-        session_reset(session);
-        return;
-    }
-
-    if (session->original_content) {
-        save_snapshot(session->filename, session->original_content);
-    }
-
-    if (save_file_atomic(session->filename, new_content) != 0) {
-        free(new_content);
-        free_string_array(current_sentences, current_count);
-        free_string_array(replacement, replacement_count);
-        free_string_array(merged, merged_count);
+    // Only the replaced span of the sentence table changes; the file is
+    // rewritten from the sentence spans without joining them in memory, and
+    // the history records just the sentences it overwrites.
+    if (document_commit(doc, copy_limit, start_index, replacement, replacement_count) != 0) {
+        document_unlock(doc);
+        free(replacement);
         send_error(client, "UNKNOWN");
         session_reset(session);
         return;
     }
 
-    free(new_content);
-    free_string_array(current_sentences, current_count);
-    free_string_array(replacement, replacement_count);
-    free_string_array(merged, merged_count);
+    FileStats stats;
+    document_stats(doc, &stats);
+    stats_store(session->filename, &stats);
+    control_push_stats(session->filename, &stats);
+    // queued under the document lock so backups see commits in save order
+    ReplTicket repl_ticket = replication_publish_delta(session->filename, current_count, copy_limit,
+                                                       start_index, replacement, replacement_count);
+    document_unlock(doc);
+    free(replacement);
+    replication_wait(repl_ticket);
 
     send_ok_message(client, "WRITE DONE");
     session_reset(session);